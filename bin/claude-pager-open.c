@@ -6,6 +6,7 @@
  *
  * Build: cd bin && make
  */
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,8 +25,14 @@
 
 #include "pager.h"
 
+#include <poll.h>
+
 #ifdef __APPLE__
 #include <mach-o/dyld.h>
+#include <sys/event.h>
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
 #endif
 
 static const int kTurboDraftProtocolVersion = 1;
@@ -160,8 +167,34 @@ static const char *find_matching_brace(const char *open_brace) {
     return NULL;
 }
 
-static int read_settings_env_value(const char *home, const char *key,
-                                   char *out, size_t outlen) {
+/* The env values the shim reads from settings.json, all from one read and
+ * one walk over the env object; an empty string when a key is absent. */
+typedef struct {
+    char editor[512];           /* CLAUDE_PAGER_EDITOR */
+    char editor_type[32];       /* CLAUDE_PAGER_EDITOR_TYPE */
+    char bench[32];             /* CLAUDE_PAGER_BENCH */
+} SettingsEnv;
+
+static void settings_env_take(SettingsEnv *se, const char *key, size_t klen,
+                              const char *val, size_t vlen) {
+    static const struct { const char *key; size_t off, cap; } keys[] = {
+        { "CLAUDE_PAGER_EDITOR", offsetof(SettingsEnv, editor), sizeof(((SettingsEnv *)0)->editor) },
+        { "CLAUDE_PAGER_EDITOR_TYPE", offsetof(SettingsEnv, editor_type), sizeof(((SettingsEnv *)0)->editor_type) },
+        { "CLAUDE_PAGER_BENCH", offsetof(SettingsEnv, bench), sizeof(((SettingsEnv *)0)->bench) },
+    };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (strlen(keys[i].key) != klen || memcmp(keys[i].key, key, klen) != 0) continue;
+        char *out = (char *)se + keys[i].off;
+        /* The first occurrence wins, as a key search would find it. */
+        if (out[0] || vlen >= keys[i].cap) return;
+        memcpy(out, val, vlen);
+        out[vlen] = '\0';
+        return;
+    }
+}
+
+static int read_settings_env(const char *home, SettingsEnv *se) {
+    memset(se, 0, sizeof(*se));
     char path[512];
     snprintf(path, sizeof(path), "%s/.claude/settings.json", home);
     FILE *f = fopen(path, "r");
@@ -181,45 +214,35 @@ static int read_settings_env_value(const char *home, const char *key,
     const char *env_end = find_matching_brace(brace);
     if (!env_end) return -1;
 
-    char needle[256];
-    snprintf(needle, sizeof(needle), "\"%s\"", key);
-    size_t needle_len = strlen(needle);
-    const char *k = brace;
-    while ((k = strstr(k, needle)) != NULL) {
-        if (k + (int)needle_len <= env_end) break;
-        k += needle_len;
-    }
-    if (!k || k >= env_end) return -1;
-
-    /* Extract value */
-    const char *colon = strchr(k + needle_len, ':');
-    if (!colon || colon >= env_end) return -1;
-    const char *quote1 = strchr(colon, '"');
-    if (!quote1 || quote1 >= env_end) return -1;
-    quote1++;
-    const char *quote2 = quote1;
-    while (quote2 < env_end) {
-        if (*quote2 == '"' && (quote2 == quote1 || quote2[-1] != '\\')) break;
-        quote2++;
-    }
-    if (quote2 >= env_end || (size_t)(quote2 - quote1) >= outlen) return -1;
-    memcpy(out, quote1, (size_t)(quote2 - quote1));
-    out[quote2 - quote1] = '\0';
+    /* Walk its members; string values of top-level keys are taken raw,
+     * anything nested is stepped over. */
+    int depth = 0, want_key = 1;
+    const char *p = brace;
+    while (p < env_end) {
+        if (*p == '"') {
+            const char *s = p + 1, *e = skip_json_str(p);
+            p = e;
+            if (depth != 1 || !want_key || e > env_end || e[-1] != '"') continue;
+            want_key = 0;
+            while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+            if (*p != ':') continue;
+            p++;
+            while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+            if (*p != '"') continue;
+            const char *v = p + 1, *ve = skip_json_str(p);
+            if (ve > env_end || ve[-1] != '"') break;
+            settings_env_take(se, s, (size_t)(e - 1 - s), v, (size_t)(ve - 1 - v));
+            p = ve;
+            continue;
+        }
+        if (*p == '{' || *p == '[') depth++;
+        else if (*p == '}' || *p == ']') depth--;
+        else if (*p == ',' && depth == 1) want_key = 1;
+        p++;
+    }
     return 0;
 }
 
-static int read_settings_editor(const char *home, char *out, size_t outlen) {
-    return read_settings_env_value(home, "CLAUDE_PAGER_EDITOR", out, outlen);
-}
-
-static int read_settings_editor_type(const char *home, char *out, size_t outlen) {
-    return read_settings_env_value(home, "CLAUDE_PAGER_EDITOR_TYPE", out, outlen);
-}
-
-static int read_settings_bench_mode(const char *home, char *out, size_t outlen) {
-    return read_settings_env_value(home, "CLAUDE_PAGER_BENCH", out, outlen);
-}
-
 static int strieq(const char *a, const char *b) {
     if (!a || !b) return 0;
     while (*a && *b) {
@@ -257,10 +280,102 @@ static int newest_jsonl(const char *dir, char *out, size_t outlen) {
     return out[0] ? 0 : -1;
 }
 
+/* ~/.claude/pager-transcripts.index: one "kind\tkey\tmtime\tpath" line per
+ * session tty ("tty"), project key ("project") and for the newest session
+ * overall ("last").  Only the SessionStart hook writes it, on every start
+ * and resume, with the transcript's own mtime then (or the time, before the
+ * file exists).  An entry is trusted after a stat or two, see
+ * index_entry_current(); otherwise the directories are walked. */
+
+static void transcript_index_path(const char *home, char *out, size_t outlen) {
+    snprintf(out, outlen, "%s/.claude/pager-transcripts.index", home);
+}
+
+/* Later lines win, so an update only has to append. */
+static int index_lookup(const char *home, const char *kind, const char *key,
+                        char *out, size_t outlen, time_t *mtime) {
+    char path[1024];
+    transcript_index_path(home, path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char line[4096];
+    size_t klen = strlen(kind), keylen = strlen(key);
+    out[0] = '\0';
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, kind, klen) != 0 || line[klen] != '\t') continue;
+        char *k = line + klen + 1;
+        if (strncmp(k, key, keylen) != 0 || k[keylen] != '\t') continue;
+        char *tp = strchr(k + keylen + 1, '\t');
+        if (!tp) continue;
+        tp++;
+        tp[strcspn(tp, "\n")] = '\0';
+        snprintf(out, outlen, "%s", tp);
+        if (mtime) *mtime = (time_t)strtoll(k + keylen + 1, NULL, 10);
+    }
+    fclose(f);
+    if (!out[0]) return -1;
+    if (access(out, R_OK) != 0) {
+        DBG("transcript index stale %s %s: %s\n", kind, key, out);
+        out[0] = '\0';
+        return -1;
+    }
+    return 0;
+}
+
+/* When process pid started, or 0 if unknown. */
+static time_t proc_start_time(pid_t pid) {
+#if defined(__APPLE__)
+    int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, (int)pid };
+    struct kinfo_proc kp;
+    size_t len = sizeof(kp);
+    if (sysctl(mib, 4, &kp, &len, NULL, 0) != 0 || len == 0) return 0;
+    return kp.kp_proc.p_starttime.tv_sec;
+#elif defined(__linux__)
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    /* Field 22, counted after the parenthesised command name. */
+    char *p = strrchr(buf, ')');
+    for (int field = 2; p && field < 22; field++) p = strchr(p + 1, ' ');
+    if (!p) return 0;
+    unsigned long long ticks = strtoull(p + 1, NULL, 10);
+    long long btime = 0;
+    f = fopen("/proc/stat", "r");
+    if (!f) return 0;
+    while (fgets(buf, sizeof(buf), f))
+        if (sscanf(buf, "btime %lld", &btime) == 1) break;
+    fclose(f);
+    long hz = sysconf(_SC_CLK_TCK);
+    if (btime <= 0 || hz <= 0) return 0;
+    return (time_t)(btime + (long long)(ticks / (unsigned long long)hz));
+#else
+    (void)pid;
+    return 0;
+#endif
+}
+
+/* The transcript an entry names was not written before the hook recorded
+ * it, and none of `dirs` gained an entry after its latest write: a session
+ * started or resumed since then would have been recorded in its place, and
+ * one started without the hook shows up as a newer directory.  Appends to
+ * an older session without a resume are not seen, as in any index. */
+static int index_entry_current(const char *path, time_t recorded, const char *const *dirs, int ndirs) {
+    struct stat st, dst;
+    if (stat(path, &st) != 0 || st.st_mtime < recorded) return 0;
+    for (int i = 0; i < ndirs; i++)
+        if (stat(dirs[i], &dst) != 0 || dst.st_mtime > st.st_mtime) return 0;
+    return 1;
+}
+
 static void find_transcript(const char *home, char *out, size_t outlen) {
     out[0] = '\0';
+    time_t mtime = 0;
 
-    /* Strategy 1: tty-keyed file from SessionStart hook */
+    /* Strategy 1: tty-keyed file from SessionStart hook, or its index entry */
     char *tty = ttyname(STDIN_FILENO);
     if (tty) {
         const char *key = tty;
@@ -277,6 +392,12 @@ static void find_transcript(const char *home, char *out, size_t outlen) {
             if (out[0] && access(out, R_OK) == 0) return;
             out[0] = '\0';
         }
+        /* Ptys are reused, so an entry counts only if it was recorded
+         * after this terminal's session began. */
+        time_t since = proc_start_time(getsid(0));
+        if (since > 0 && index_lookup(home, "tty", key, out, outlen, &mtime) == 0 && mtime >= since) return;
+        if (out[0]) DBG("transcript index tty entry predates the session: %s\n", out);
+        out[0] = '\0';
     }
 
     /* Strategy 2: PWD-derived project directory */
@@ -290,12 +411,24 @@ static void find_transcript(const char *home, char *out, size_t outlen) {
         char project_dir[2048];
         snprintf(project_dir, sizeof(project_dir),
                  "%s/.claude/projects/%s", home, project_key);
+        const char *dirs[1] = { project_dir };
+        if (index_lookup(home, "project", project_key, out, outlen, &mtime) == 0 &&
+            index_entry_current(out, mtime, dirs, 1)) return;
         if (newest_jsonl(project_dir, out, outlen) == 0) return;
     }
 
-    /* Strategy 3: globally most recent */
+    /* Strategy 3: globally most recent, walking every project as a last resort */
     char projects_dir[1024];
     snprintf(projects_dir, sizeof(projects_dir), "%s/.claude/projects", home);
+    if (index_lookup(home, "last", "-", out, outlen, &mtime) == 0) {
+        char own_dir[2048];
+        snprintf(own_dir, sizeof(own_dir), "%s", out);
+        char *slash = strrchr(own_dir, '/');
+        if (slash) *slash = '\0';
+        const char *dirs[2] = { own_dir, projects_dir };
+        if (slash && index_entry_current(out, mtime, dirs, 2)) return;
+    }
+    out[0] = '\0';
     DIR *pd = opendir(projects_dir);
     if (!pd) return;
     struct dirent *pe;
@@ -368,6 +501,118 @@ static pid_t fork_pager(int watch_pid, int control_fd) {
 
 /* ── TurboDraft fast path ──────────────────────────────────────────────────── */
 
+/* TurboDraft may be restarting after Cmd-Q: its LaunchAgent can take 3-4
+ * seconds to bring the server back, and until then connect() is refused.
+ * Rather than retrying on a fixed timer, wait for the socket's directory to
+ * change (the server binds the path again on start) and retry then.  A
+ * short backoff timer covers the gap between bind() and listen(), and
+ * platforms or directories without events. */
+#define TD_RESTART_WAIT_MS 5000
+#define TD_BACKOFF_MIN_MS  2
+#define TD_BACKOFF_MAX_MS  250
+
+static int sock_connect(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+}
+
+/* Directory change notifications: -1 where there are none. */
+static int dir_watch_open(const char *path, int *dfd) {
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) return -1;
+    *slash = '\0';
+    *dfd = -1;
+#if defined(__APPLE__)
+    int kq = kqueue();
+    if (kq < 0) return -1;
+    *dfd = open(dir, O_EVTONLY | O_CLOEXEC);
+    struct kevent kev;
+    if (*dfd >= 0) EV_SET(&kev, *dfd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE, 0, NULL);
+    if (*dfd < 0 || kevent(kq, &kev, 1, NULL, 0, NULL) != 0) {
+        if (*dfd >= 0) close(*dfd);
+        *dfd = -1;
+        close(kq);
+        return -1;
+    }
+    return kq;
+#elif defined(__linux__)
+    int in = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (in >= 0 && inotify_add_watch(in, dir, IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0) {
+        close(in);
+        in = -1;
+    }
+    return in;
+#else
+    return -1;
+#endif
+}
+
+/* Sleep up to ms, returning early (1) when the directory changed. */
+static int dir_watch_wait(int wfd, int ms) {
+    if (wfd < 0) {
+        usleep((useconds_t)ms * 1000);
+        return 0;
+    }
+    struct pollfd pfd = { wfd, POLLIN, 0 };
+    if (poll(&pfd, 1, ms) <= 0) return 0;
+#if defined(__APPLE__)
+    struct kevent ev[4];
+    struct timespec zero = { 0, 0 };
+    (void)kevent(wfd, NULL, 0, ev, 4, &zero);
+#else
+    char buf[1024];
+    while (read(wfd, buf, sizeof(buf)) > 0) {}
+#endif
+    return 1;
+}
+
+static void dir_watch_close(int wfd, int dfd) {
+    if (wfd >= 0) close(wfd);
+    if (dfd >= 0) close(dfd);
+}
+
+/* Connect to the socket at path once its server is back; -1 after ms. */
+static int sock_connect_wait(const char *path, int ms) {
+    int dfd = -1;
+    int wfd = dir_watch_open(path, &dfd);
+    int backoff = TD_BACKOFF_MIN_MS, events = 0;
+    double start = elapsed_ms();
+    /* The watch is in place before this attempt, so a bind that races it
+     * still wakes the wait below. */
+    int fd = sock_connect(path);
+    while (fd < 0) {
+        int left = (int)(start + ms - elapsed_ms());
+        if (left <= 0) break;
+        if (dir_watch_wait(wfd, backoff < left ? backoff : left)) {
+            events++;
+            backoff = TD_BACKOFF_MIN_MS;
+        } else {
+            backoff = backoff * 2 < TD_BACKOFF_MAX_MS ? backoff * 2 : TD_BACKOFF_MAX_MS;
+        }
+        fd = sock_connect(path);
+        /* A restart unlinks the path before binding it again, and the watch
+         * sees it come back; without one a missing socket ends the wait,
+         * as the old polling loop did. */
+        if (fd < 0 && errno == ENOENT && wfd < 0) break;
+    }
+    dir_watch_close(wfd, dfd);
+    DBG("turbodraft socket wait %s after %.1fms (%d dir events, %s)\n",
+        fd >= 0 ? "connected" : "gave up", elapsed_ms() - start, events,
+        wfd >= 0 ? "watched" : "timer only");
+    return fd;
+}
+
 static int turbodraft_path(const char *home, const char *file) {
     char sock_path[512];
     snprintf(sock_path, sizeof(sock_path),
@@ -379,52 +624,26 @@ static int turbodraft_path(const char *home, const char *file) {
         return -1;
     }
 
-    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (fd < 0) return -1;
-
-    struct sockaddr_un addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
-
-    /* Retry connection — TurboDraft may be restarting after Cmd-Q.
-     * LaunchAgent restart can take 3-4 seconds in practice.
-     * Only retry on transient errors (ECONNREFUSED); bail immediately
-     * on permanent errors (ENOENT = socket disappeared). */
-    int connected = 0;
-    for (int attempt = 0; attempt < 100; attempt++) {
-        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
-            connected = 1;
-            break;
-        }
-        if (errno == ENOENT) {
-            DBG("turbodraft socket disappeared\n");
-            close(fd);
-            return -1;
-        }
-        if (attempt == 0) {
-            DBG("turbodraft socket connect failed: %s (retrying)\n", strerror(errno));
-            /* Show pager frame immediately so user sees something
-             * while waiting for TurboDraft to restart. */
-            int tty = open("/dev/tty", O_RDWR);
-            if (tty >= 0) {
-                DBG("pager placeholder pre-render start\n");
-                pre_render(tty);
-                DBG("pager placeholder pre-render done\n");
-                close(tty);
-            }
+    int fd = sock_connect(sock_path);
+    if (fd < 0 && errno == ENOENT) {
+        DBG("turbodraft socket disappeared\n");
+        return -1;
+    }
+    if (fd < 0) {
+        DBG("turbodraft socket connect failed: %s (waiting)\n", strerror(errno));
+        /* Show pager frame immediately so user sees something
+         * while waiting for TurboDraft to restart. */
+        int tty = open("/dev/tty", O_RDWR);
+        if (tty >= 0) {
+            DBG("pager placeholder pre-render start\n");
+            pre_render(tty);
+            DBG("pager placeholder pre-render done\n");
+            close(tty);
         }
-        usleep(50000); /* 50ms */
-        close(fd);
-        fd = socket(AF_UNIX, SOCK_STREAM, 0);
-        if (fd < 0) return -1;
-        memset(&addr, 0, sizeof(addr));
-        addr.sun_family = AF_UNIX;
-        strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
-    }
-    if (!connected) {
-        DBG("turbodraft socket connect failed after retries\n");
-        close(fd);
+        fd = sock_connect_wait(sock_path, TD_RESTART_WAIT_MS);
+    }
+    if (fd < 0) {
+        DBG("turbodraft socket connect failed after waiting\n");
         return -1;
     }
     DBG("turbodraft socket connected\n");
@@ -544,17 +763,11 @@ static int turbodraft_path(const char *home, const char *file) {
                          "\"method\":\"turbodraft.session.close\","
                          "\"params\":{\"sessionId\":\"%s\"}}",
                          session_id);
-                int close_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+                int close_fd = sock_connect(sock_path);
                 if (close_fd < 0) {
-                    DBG("session.close socket create failed: %s\n", strerror(errno));
+                    DBG("session.close connect failed: %s\n", strerror(errno));
                 } else {
-                    struct sockaddr_un close_addr;
-                    memset(&close_addr, 0, sizeof(close_addr));
-                    close_addr.sun_family = AF_UNIX;
-                    strncpy(close_addr.sun_path, sock_path, sizeof(close_addr.sun_path) - 1);
-                    if (connect(close_fd, (struct sockaddr *)&close_addr, sizeof(close_addr)) != 0) {
-                        DBG("session.close connect failed: %s\n", strerror(errno));
-                    } else if (send_msg(close_fd, close_msg) != 0) {
+                    if (send_msg(close_fd, close_msg) != 0) {
                         DBG("session.close send failed: %s\n", strerror(errno));
                     } else {
                         DBG("session.close sent on dedicated close socket\n");
@@ -630,6 +843,58 @@ static int editor_exists(const char *cmd) {
     return 0;
 }
 
+/* ── Editor classification cache ───────────────────────────────────────────── */
+
+/* ~/.claude/pager-editors: one "tui\t<command>" or "gui\t<command>" line per
+ * editor the optimistic probe below classified, so later launches take the
+ * right path directly.  CLAUDE_PAGER_EDITOR_TYPE and the built-in lists come
+ * first; deleting the file makes every editor probe again. */
+
+#define EDITOR_CACHE_MAX (16 * 1024)
+
+static int editor_cache_path(char *out, size_t outlen) {
+    const char *home = getenv("HOME");
+    if (!home || !home[0]) return -1;
+    snprintf(out, outlen, "%s/.claude/pager-editors", home);
+    return 0;
+}
+
+/* 't' or 'g' as recorded for editor, 0 if it was never probed.  Later
+ * lines win, so a change of mind only has to append. */
+static char editor_cache_lookup(const char *editor) {
+    char path[1024];
+    if (editor_cache_path(path, sizeof(path)) != 0) return 0;
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char line[4200];
+    size_t elen = strlen(editor);
+    char type = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (strlen(line) != 5 + elen || line[3] != '\t' || strncmp(line + 4, editor, elen) != 0 ||
+            line[4 + elen] != '\n') continue;
+        if (strncmp(line, "tui", 3) == 0) type = 't';
+        else if (strncmp(line, "gui", 3) == 0) type = 'g';
+    }
+    fclose(f);
+    return type;
+}
+
+static void editor_cache_record(const char *editor, char type) {
+    char path[1024];
+    if (editor_cache_path(path, sizeof(path)) != 0 || strpbrk(editor, "\t\n")) return;
+    if (editor_cache_lookup(editor) == type) return;
+    /* Past its cap the file starts over; anything dropped is probed again. */
+    struct stat st;
+    int trunc = stat(path, &st) == 0 && st.st_size > EDITOR_CACHE_MAX;
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (trunc ? O_TRUNC : 0), 0600);
+    if (fd < 0) return;
+    char line[4200];
+    int n = snprintf(line, sizeof(line), "%s\t%s\n", type == 't' ? "tui" : "gui", editor);
+    if (n > 0 && n < (int)sizeof(line)) (void)write_all(fd, line, (size_t)n);
+    close(fd);
+    DBG("editor cache: recorded %s as %s\n", editor, type == 't' ? "tui" : "gui");
+}
+
 /* ── Terminal editor detection ─────────────────────────────────────────────── */
 
 static const char *tui_editors[] = {
@@ -687,7 +952,8 @@ static int is_terminal_editor(const char *editor) {
     for (int i = 0; tui_editors[i]; i++) {
         if (strcmp(base, tui_editors[i]) == 0) return 1;
     }
-    return 0;
+    if (is_known_gui_editor(editor)) return 0;
+    return editor_cache_lookup(editor) == 't';
 }
 
 /* ── Terminal editor path (exec directly, no pager) ────────────────────────── */
@@ -717,6 +983,80 @@ static pid_t spawn_editor(const char *editor, const char *file, int detach_stdin
     return ed_pid;
 }
 
+/* An editor still running this long after launch is taken to be GUI. */
+#define EDITOR_PROBE_MS 150
+
+#ifndef __APPLE__
+static int g_chld_pipe[2] = { -1, -1 };
+
+static void on_sigchld(int sig) {
+    (void)sig;
+    int err = errno;
+    (void)write(g_chld_pipe[1], "c", 1);
+    errno = err;
+}
+#endif
+
+/* Wait up to ms for child pid to exit, woken by the exit itself (kqueue
+ * EVFILT_PROC on macOS, SIGCHLD elsewhere) rather than a sleep loop;
+ * returns 1 with *status once it exited, 0 at the deadline. */
+static int wait_child_exit(pid_t pid, int ms, int *status) {
+    double deadline = elapsed_ms() + ms;
+    int exited = 0;
+#ifdef __APPLE__
+    int kq = kqueue();
+    struct kevent kev;
+    EV_SET(&kev, pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, NULL);
+    int armed = kq >= 0 && kevent(kq, &kev, 1, NULL, 0, NULL) == 0;
+    /* ESRCH: it exited before the knote was added; waitpid reaps it. */
+    while (!(exited = waitpid(pid, status, WNOHANG) > 0)) {
+        int left = (int)(deadline - elapsed_ms());
+        if (left <= 0) break;
+        if (!armed) {
+            usleep(1000);
+            continue;
+        }
+        struct timespec ts = { left / 1000, (long)(left % 1000) * 1000000L };
+        (void)kevent(kq, NULL, 0, &kev, 1, &ts);
+    }
+    if (kq >= 0) close(kq);
+#else
+    struct sigaction sa, old;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigchld;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    int armed = pipe(g_chld_pipe) == 0;
+    if (armed) {
+        fcntl(g_chld_pipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(g_chld_pipe[1], F_SETFL, O_NONBLOCK);
+        armed = sigaction(SIGCHLD, &sa, &old) == 0;
+    }
+    /* Installed before the first waitpid, so an exit is either reaped here
+     * or wakes the poll: the pager child's exit wakes it too. */
+    while (!(exited = waitpid(pid, status, WNOHANG) > 0)) {
+        int left = (int)(deadline - elapsed_ms());
+        if (left <= 0) break;
+        if (!armed) {
+            usleep(1000);
+            continue;
+        }
+        struct pollfd pfd = { g_chld_pipe[0], POLLIN, 0 };
+        if (poll(&pfd, 1, left) > 0) {
+            char buf[16];
+            while (read(g_chld_pipe[0], buf, sizeof(buf)) > 0) {}
+        }
+    }
+    if (armed) sigaction(SIGCHLD, &old, NULL);
+    if (g_chld_pipe[0] >= 0) {
+        close(g_chld_pipe[0]);
+        close(g_chld_pipe[1]);
+        g_chld_pipe[0] = g_chld_pipe[1] = -1;
+    }
+#endif
+    return exited;
+}
+
 static int generic_editor_path(const char *editor, const char *file) {
     /* Fast GUI path:
      * 1) explicit CLAUDE_PAGER_EDITOR_TYPE=gui
@@ -724,14 +1064,16 @@ static int generic_editor_path(const char *editor, const char *file) {
     const char *type = getenv("CLAUDE_PAGER_EDITOR_TYPE");
     int forced_gui = type && strcmp(type, "gui") == 0;
     int known_gui = is_known_gui_editor(editor);
+    int cached_gui = !forced_gui && !known_gui && editor_cache_lookup(editor) == 'g';
 
-    if (forced_gui || known_gui) {
+    if (forced_gui || known_gui || cached_gui) {
         pid_t ed_pid = spawn_editor(editor, file, 0);
         if (ed_pid < 0) return 1;
-        DBG("fast GUI path: editor forked pid=%d%s%s\n",
+        DBG("fast GUI path: editor forked pid=%d%s%s%s\n",
             (int)ed_pid,
             forced_gui ? " (forced gui)" : "",
-            known_gui ? " (known gui)" : "");
+            known_gui ? " (known gui)" : "",
+            cached_gui ? " (probed gui before)" : "");
 
         pid_t pager_pid = fork_pager((int)ed_pid, -1);
         DBG("pager forked pid=%d\n", (int)pager_pid);
@@ -750,7 +1092,7 @@ static int generic_editor_path(const char *editor, const char *file) {
     /* Unknown editor path (optimistic):
      * launch editor + pager immediately (zero GUI latency), then watch
      * for 150ms. If editor exits quickly, classify as TUI and re-launch
-     * with a real terminal. */
+     * with a real terminal.  Either way the result is cached. */
     pid_t ed_pid = spawn_editor(editor, file, 1);
     if (ed_pid < 0) return 1;
     DBG("optimistic path: editor forked pid=%d (stdin detached)\n", (int)ed_pid);
@@ -759,21 +1101,21 @@ static int generic_editor_path(const char *editor, const char *file) {
     DBG("pager forked pid=%d\n", (int)pager_pid);
 
     int probe_status = 0;
-    for (int i = 0; i < 15; i++) {
-        usleep(10000);
-        if (waitpid(ed_pid, &probe_status, WNOHANG) > 0) {
-            DBG("optimistic probe: editor exited in %dms (status=%d) — TUI detected\n",
-                (i + 1) * 10, probe_status);
-            if (pager_pid > 0) {
-                kill(pager_pid, SIGTERM);
-                waitpid(pager_pid, NULL, 0);
-            }
-            DBG("re-launching as TUI editor (exec with tty)\n");
-            return terminal_editor_path(editor, file);
+    double probe_start = elapsed_ms();
+    if (wait_child_exit(ed_pid, EDITOR_PROBE_MS, &probe_status)) {
+        DBG("optimistic probe: editor exited in %.1fms (status=%d) — TUI detected\n",
+            elapsed_ms() - probe_start, probe_status);
+        if (pager_pid > 0) {
+            kill(pager_pid, SIGTERM);
+            waitpid(pager_pid, NULL, 0);
         }
+        editor_cache_record(editor, 't');
+        DBG("re-launching as TUI editor (exec with tty)\n");
+        return terminal_editor_path(editor, file);
     }
 
-    DBG("optimistic probe: editor alive after 150ms — GUI confirmed\n");
+    DBG("optimistic probe: editor alive after %dms — GUI confirmed\n", EDITOR_PROBE_MS);
+    editor_cache_record(editor, 'g');
 
     /* Wait for editor to close */
     int status;
@@ -831,51 +1173,49 @@ int main(int argc, char *argv[]) {
     }
     setenv("_CLAUDE_PAGER_ACTIVE", "1", 1);
 
-    /* Claude Code may not export settings env vars to editor process.
-     * If CLAUDE_PAGER_EDITOR_TYPE isn't in env, read it from settings.json. */
+    /* Claude Code may not export settings env vars to editor process,
+     * so whatever isn't in env is read from settings.json, in one pass. */
+    static SettingsEnv settings;
     const char *editor_type = getenv("CLAUDE_PAGER_EDITOR_TYPE");
-    static char settings_editor_type[32];
-    if ((!editor_type || !editor_type[0]) && home &&
-        read_settings_editor_type(home, settings_editor_type,
-                                  sizeof(settings_editor_type)) == 0) {
-        if (strcmp(settings_editor_type, "tui") == 0 ||
-            strcmp(settings_editor_type, "gui") == 0) {
-            setenv("CLAUDE_PAGER_EDITOR_TYPE", settings_editor_type, 1);
+    const char *bench_mode = getenv("CLAUDE_PAGER_BENCH");
+    const char *editor = getenv("CLAUDE_PAGER_EDITOR");
+    const char *source = "CLAUDE_PAGER_EDITOR";
+    int need_settings = !editor_type || !editor_type[0] || !bench_mode || !bench_mode[0] ||
+                        !editor || !editor[0];
+    if (need_settings && read_settings_env(home, &settings) == 0)
+        DBG("settings.json env read\n");
+
+    /* If CLAUDE_PAGER_EDITOR_TYPE isn't in env, take it from settings.json. */
+    if ((!editor_type || !editor_type[0]) && settings.editor_type[0]) {
+        if (strcmp(settings.editor_type, "tui") == 0 ||
+            strcmp(settings.editor_type, "gui") == 0) {
+            setenv("CLAUDE_PAGER_EDITOR_TYPE", settings.editor_type, 1);
             editor_type = getenv("CLAUDE_PAGER_EDITOR_TYPE");
         }
     }
 
     /* Optional benchmark probes (pager tcdrain+DSR) */
-    const char *bench_mode = getenv("CLAUDE_PAGER_BENCH");
-    static char settings_bench_mode[32];
-    if ((!bench_mode || !bench_mode[0]) && home &&
-        read_settings_bench_mode(home, settings_bench_mode,
-                                 sizeof(settings_bench_mode)) == 0) {
-        if (strieq(settings_bench_mode, "1") ||
-            strieq(settings_bench_mode, "true") ||
-            strieq(settings_bench_mode, "yes") ||
-            strieq(settings_bench_mode, "on")) {
+    if ((!bench_mode || !bench_mode[0]) && settings.bench[0]) {
+        if (strieq(settings.bench, "1") ||
+            strieq(settings.bench, "true") ||
+            strieq(settings.bench, "yes") ||
+            strieq(settings.bench, "on")) {
             setenv("CLAUDE_PAGER_BENCH", "1", 1);
-        } else if (strieq(settings_bench_mode, "0") ||
-                   strieq(settings_bench_mode, "false") ||
-                   strieq(settings_bench_mode, "no") ||
-                   strieq(settings_bench_mode, "off")) {
+        } else if (strieq(settings.bench, "0") ||
+                   strieq(settings.bench, "false") ||
+                   strieq(settings.bench, "no") ||
+                   strieq(settings.bench, "off")) {
             setenv("CLAUDE_PAGER_BENCH", "0", 1);
         }
         bench_mode = getenv("CLAUDE_PAGER_BENCH");
     }
 
     /* Resolve editor: CLAUDE_PAGER_EDITOR (env or settings.json) → VISUAL → EDITOR */
-    const char *editor = getenv("CLAUDE_PAGER_EDITOR");
-    const char *source = "CLAUDE_PAGER_EDITOR";
-    static char settings_editor[512];
-    if (!editor || !editor[0]) {
+    if ((!editor || !editor[0]) && settings.editor[0]) {
         /* Claude Code doesn't export env section to editor process,
          * so read it directly from settings.json */
-        if (read_settings_editor(home, settings_editor, sizeof(settings_editor)) == 0) {
-            editor = settings_editor;
-            source = "settings.json env.CLAUDE_PAGER_EDITOR";
-        }
+        editor = settings.editor;
+        source = "settings.json env.CLAUDE_PAGER_EDITOR";
     }
     DBG("env CLAUDE_PAGER_EDITOR=%s\n", editor ? editor : "(null)");
     DBG("env CLAUDE_PAGER_EDITOR_TYPE=%s\n", editor_type ? editor_type : "(null)");
@@ -6,24 +6,53 @@
 #include "pager.h"
 
 #include <ctype.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/file.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/select.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 #include <errno.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/event.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+/* String scanning kernels; build with -DPAGER_NO_SIMD for the scalar path. */
+#if !defined(PAGER_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define JSCAN_AVX2 1
+#elif !defined(PAGER_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define JSCAN_SSE2 1
+#elif !defined(PAGER_NO_SIMD) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JSCAN_NEON 1
+#endif
 
 /* ── ANSI ──────────────────────────────────────────────────────────────── */
 
@@ -79,7 +108,6 @@
 #define FBLK "\xe2\x96\x88"
 #define EBLK "\xe2\x96\x91"
 #define DOT "\xc2\xb7"
-#define WRAP_PLACEHOLDER "\x1f"
 #define TL  "\xe2\x94\x8c"
 #define TR  "\xe2\x94\x90"
 #define BL  "\xe2\x94\x94"
@@ -91,6 +119,9 @@
 /* ── Globals ───────────────────────────────────────────────────────────── */
 
 static int g_cols = 100, g_rows = 24, g_crows = 21;
+/* Width the render worker's current pass lays rows out at; 0 on threads
+ * that render with g_cols, see render_cols(). */
+static _Thread_local int t_render_cols = 0;
 static int g_fd = -1;
 static struct termios g_old;
 static volatile sig_atomic_t g_resize = 0, g_quit = 0;
@@ -147,11 +178,29 @@ typedef struct {
     int valid;
 } FileStamp;
 
+#define QUEUE_LOG_TAIL 64
+#define QUEUE_LOG_COMPACT_OPS 64
+
+/* How much of the queue log g_queue reflects: the file identity, the byte
+ * offset read up to, the FNV-1a hash of those bytes and their last
+ * QUEUE_LOG_TAIL bytes (to spot a rewrite of equal or greater length), and
+ * the count of update/delete lines since the last compaction. */
+typedef struct {
+    int valid;
+    dev_t dev;
+    ino_t ino;
+    off_t off;
+    unsigned long long hash;
+    char tail[QUEUE_LOG_TAIL];
+    int tail_len;
+    int ops;
+} QueueLog;
+
 typedef struct {
     int row;
     int x0;
     int x1;
-    char *uri;
+    const char *uri;    /* interned, see uri_intern() */
 } LinkSpan;
 
 typedef struct {
@@ -164,6 +213,7 @@ static LinkMap g_link_map = {0};
 
 static QueueItems g_queue = {0};
 static FileStamp g_queue_stamp = {0};
+static QueueLog g_queue_log = {0};
 static char g_queue_path[PATH_MAX] = "";
 static char g_queue_fingerprint[17] = "";
 static int g_queue_enabled = 0;
@@ -264,13 +314,18 @@ static int env_enabled_default_on(const char *name) {
            strcasecmp(v, "on") == 0;
 }
 
+/* Allocations made by this thread, see PERF_RELOAD_ALLOCS. */
+static _Thread_local long long t_allocs = 0;
+
 static void *xmalloc(size_t n) {
+    t_allocs++;
     void *p = malloc(n);
     if (!p) g_oom = 1;
     return p;
 }
 
 static void *xrealloc(void *p, size_t n) {
+    t_allocs++;
     void *q = realloc(p, n);
     if (!q) g_oom = 1;
     return q;
@@ -435,6 +490,65 @@ static int probe_sync_2026(int fd, int timeout_ms, int *status_out, int *raw_len
     return (st == 1 || st == 2) ? 1 : 0;
 }
 
+/* The probe is a terminal round trip before the first frame, so its answer
+ * is kept in ~/.claude/pager-terminals, one "<terminal>\t<on|off>\t<time>"
+ * line per terminal program, version and TERM, in or out of tmux/ssh.  An
+ * answer older than SYNC_CACHE_TTL_S is probed again; a probe that timed
+ * out is not recorded.  Later lines win. */
+#define SYNC_CACHE_TTL_S (24 * 3600)
+#define SYNC_CACHE_MAX   (16 * 1024)
+
+static int sync_cache_path(char *out, size_t outlen) {
+    const char *home = getenv("HOME");
+    if (!home || !*home) return 0;
+    int n = snprintf(out, outlen, "%s/.claude/pager-terminals", home);
+    return n > 0 && (size_t)n < outlen;
+}
+
+static void sync_cache_key(char *out, size_t outlen) {
+    const char *tp = getenv("TERM_PROGRAM"), *tv = getenv("TERM_PROGRAM_VERSION"), *term = getenv("TERM");
+    snprintf(out, outlen, "%s|%s|%s|%s%s", tp ? tp : "", tv ? tv : "", term ? term : "",
+             getenv("TMUX") ? "tmux" : "", getenv("SSH_TTY") ? "ssh" : "");
+    for (char *c = out; *c; c++) {
+        if (*c == '\t' || *c == '\n') *c = ' ';
+    }
+}
+
+/* 1 or 0 as last probed for key, -1 if unknown or stale. */
+static int sync_cache_lookup(const char *key) {
+    char path[PATH_MAX];
+    if (!sync_cache_path(path, sizeof(path))) return -1;
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char line[512];
+    size_t klen = strlen(key);
+    int on = -1;
+    long long at = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, key, klen) != 0 || line[klen] != '\t') continue;
+        const char *v = line + klen + 1;
+        if (strncmp(v, "on\t", 3) == 0) on = 1, at = strtoll(v + 3, NULL, 10);
+        else if (strncmp(v, "off\t", 4) == 0) on = 0, at = strtoll(v + 4, NULL, 10);
+    }
+    fclose(f);
+    long long age = (long long)time(NULL) - at;
+    return on >= 0 && age >= 0 && age < SYNC_CACHE_TTL_S ? on : -1;
+}
+
+static void sync_cache_record(const char *key, int on) {
+    char path[PATH_MAX];
+    if (!sync_cache_path(path, sizeof(path))) return;
+    /* Past its cap the file starts over; dropped terminals probe again. */
+    struct stat st;
+    int trunc = stat(path, &st) == 0 && st.st_size > SYNC_CACHE_MAX;
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (trunc ? O_TRUNC : 0), 0600);
+    if (fd < 0) return;
+    char line[512];
+    int n = snprintf(line, sizeof(line), "%s\t%s\t%lld\n", key, on ? "on" : "off", (long long)time(NULL));
+    if (n > 0 && n < (int)sizeof(line)) (void)write_all(fd, line, (size_t)n);
+    close(fd);
+}
+
 static void sync_init(int fd) {
     const char *m = getenv("CLAUDE_PAGER_SYNC");
     int mode = 0;
@@ -460,9 +574,19 @@ static void sync_init(int fd) {
         return;
     }
 
+    char key[320];
+    sync_cache_key(key, sizeof(key));
+    int cached = sync_cache_lookup(key);
+    if (cached >= 0) {
+        g_sync_enabled = cached;
+        PDBG("sync init auto decision=%s cached terminal=%s\n", cached ? "on" : "off", key);
+        return;
+    }
+
     int probe_ms = parse_env_int_range("CLAUDE_PAGER_SYNC_PROBE_MS", 5, 1000, 30);
     int st = -1, raw = 0;
     g_sync_enabled = probe_sync_2026(fd, probe_ms, &st, &raw);
+    if (st >= 0) sync_cache_record(key, g_sync_enabled);
     PDBG("sync init auto decision=%s decrqm_status=%d raw_len=%d probe_ms=%d tmux=%d\n",
          g_sync_enabled ? "on" : "off", st, raw, probe_ms, getenv("TMUX") ? 1 : 0);
 }
@@ -519,6 +643,69 @@ static void bench_probe_terminal_ready(int tty_fd, const char *label) {
     );
 }
 
+/* ── Perf counters ─────────────────────────────────────────────────────── */
+
+/* Per-stage counters and power-of-two histograms, recorded only in bench
+ * mode (CLAUDE_PAGER_BENCH) and appended as one JSON line to
+ * CLAUDE_PAGER_BENCH_OUT (default /tmp/claude-pager-perf.jsonl) when the
+ * pager exits.  Parse and render are recorded by the render worker, the
+ * rest by the UI thread, so no stat is written from two threads. */
+enum {
+    PERF_PARSE_US,          /* ingest of one transcript change */
+    PERF_RENDER_US,         /* rendering the items it added */
+    PERF_RELOAD_ALLOCS,     /* allocations made by one such load */
+    PERF_DRAW_US,           /* composing and emitting one frame */
+    PERF_FRAME_BYTES,       /* bytes one frame wrote */
+    PERF_FLUSH_BYTES,       /* bytes per g_ob flush */
+    PERF_INPUT_FRAMES,      /* frames drawn for one input event */
+    PERF_NSTATS
+};
+
+static const char *const perf_names[PERF_NSTATS] = {
+    "parse_us", "render_us", "reload_allocs", "draw_us", "frame_bytes", "flush_bytes", "input_frames",
+};
+
+#define PERF_BUCKETS 40
+
+typedef struct {
+    long long n, sum, min, max;
+    long long bucket[PERF_BUCKETS];   /* bucket b counts values in [2^(b-1), 2^b) */
+} PerfStat;
+
+static PerfStat g_perf[PERF_NSTATS];
+static long long g_out_bytes = 0;
+
+static void perf_add(int which, long long v) {
+    PerfStat *st = &g_perf[which];
+    if (v < 0) v = 0;
+    int b = 0;
+    for (long long x = v; x > 0 && b < PERF_BUCKETS - 1; x >>= 1) b++;
+    st->bucket[b]++;
+    if (st->n == 0 || v < st->min) st->min = v;
+    if (v > st->max) st->max = v;
+    st->n++;
+    st->sum += v;
+}
+
+/* Upper bound of the bucket holding the q-quantile, capped at the max. */
+static long long perf_quantile(const PerfStat *st, double q) {
+    long long want = (long long)(q * (double)st->n + 0.999999), seen = 0;
+    for (int b = 0; b < PERF_BUCKETS; b++) {
+        seen += st->bucket[b];
+        if (seen >= want) {
+            long long hi = b == 0 ? 0 : (1LL << b) - 1;
+            return hi < st->max ? hi : st->max;
+        }
+    }
+    return st->max;
+}
+
+/* g_cols belongs to the UI thread; a worker pass keeps the width it
+ * started with so every row of it is laid out alike. */
+static int render_cols(void) {
+    return t_render_cols > 0 ? t_render_cols : g_cols;
+}
+
 static void geo_update(void) {
     struct winsize ws;
     if (g_fd >= 0 && ioctl(g_fd, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
@@ -538,8 +725,18 @@ static void geo_update(void) {
     if (g_crows < 1) g_crows = 1;
 }
 
-static void on_winch(int s) { (void)s; g_resize = 1; }
-static void on_term(int s)  { (void)s; g_quit = 1; }
+static int g_wake_pipe[2] = { -1, -1 };
+
+static void wake_main_loop(void) {
+    if (g_wake_pipe[1] >= 0) {
+        char c = 1;
+        ssize_t w = write(g_wake_pipe[1], &c, 1);
+        (void)w;
+    }
+}
+
+static void on_winch(int s) { (void)s; g_resize = 1; wake_main_loop(); }
+static void on_term(int s)  { (void)s; g_quit = 1; wake_main_loop(); }
 
 static void install_signal_handlers(void) {
     struct sigaction sa_term;
@@ -562,14 +759,145 @@ static void install_signal_handlers(void) {
 static char g_ob[256*1024];
 static int g_ol;
 
+/* Long runs that stay put until the flush (frame rows) are queued by
+ * pointer in g_iov instead of being copied into g_ob; g_ob_mark is how much
+ * of g_ob the queue already covers.  ob_flush() sends it all in one
+ * writev(). */
+#define OB_IOV_MAX 64
+#define OB_REF_MIN 128
+static struct iovec g_iov[OB_IOV_MAX];
+static int g_iovn;
+static int g_ob_mark;
+
+static int writev_all(int fd, struct iovec *v, int n) {
+    while (n > 0) {
+        ssize_t w = writev(fd, v, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (w == 0) return -1;
+        while (n > 0 && (size_t)w >= v->iov_len) { w -= (ssize_t)v->iov_len; v++; n--; }
+        if (n > 0) {
+            v->iov_base = (char *)v->iov_base + w;
+            v->iov_len -= (size_t)w;
+        }
+    }
+    return 0;
+}
+
+static void ob_queue(const char *s, size_t n) {
+    if (n == 0) return;
+    if (g_iovn > 0) {
+        struct iovec *v = &g_iov[g_iovn - 1];
+        if ((const char *)v->iov_base + v->iov_len == s) { v->iov_len += n; return; }
+    }
+    g_iov[g_iovn].iov_base = (void *)s;
+    g_iov[g_iovn].iov_len = n;
+    g_iovn++;
+}
+
 static void ob_flush(void) {
-    if (g_ol <= 0 || g_fd < 0) return;
-    if (write_all(g_fd, g_ob, (size_t)g_ol) != 0) g_quit = 1;
-    g_ol = 0;
+    if (g_fd < 0) { g_ol = g_ob_mark = g_iovn = 0; return; }
+    ob_queue(g_ob + g_ob_mark, (size_t)(g_ol - g_ob_mark));
+    size_t n = 0;
+    for (int i = 0; i < g_iovn; i++) n += g_iov[i].iov_len;
+    if (n > 0) {
+        if (g_bench_mode) perf_add(PERF_FLUSH_BYTES, (long long)n);
+        g_out_bytes += (long long)n;
+        if (writev_all(g_fd, g_iov, g_iovn) != 0) g_quit = 1;
+    }
+    g_ol = g_ob_mark = g_iovn = 0;
+}
+
+/* While draw() composes a frame, output is captured per screen row into
+ * g_frame instead of g_ob; frame_commit() then emits only the rows whose
+ * bytes differ from what the previous frame left on screen.  A row is a
+ * list of pieces: bytes copied into buf, or (ob_ref) pointers to bytes that
+ * outlive the frame, such as the rendered rows themselves. */
+typedef struct {
+    const char *ext;  /* NULL: the bytes are at buf + off */
+    size_t off;
+    int len;
+} FramePiece;
+
+typedef struct {
+    unsigned long long hash;
+    int piece0, npiece;
+    int owner;  /* row whose bytes paint this one (itself unless wrapped onto) */
+    int span;   /* screen rows an owner's bytes cover once painted */
+    int dirty;
+} FrameRow;
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+    FramePiece *pieces;
+    int npieces, pieces_cap;
+    FrameRow *rows;               /* 1-based screen rows */
+    unsigned long long *prev;     /* row hashes currently on screen */
+    int rows_cap;
+    int cur;
+    int capture;
+    int valid;
+    int nrows, ncols;
+    int body_top, body_end;       /* scrollable body rows [top, end) */
+    int prev_body_top, prev_body_end;
+    int last_rows_emitted;
+    int last_shift;
+} Frame;
+
+static Frame g_frame;
+
+static FramePiece *frame_piece(void) {
+    if (g_frame.npieces == g_frame.pieces_cap) {
+        int nc = g_frame.pieces_cap ? g_frame.pieces_cap * 2 : 256;
+        FramePiece *np = xrealloc(g_frame.pieces, sizeof(FramePiece) * (size_t)nc);
+        if (!np) { g_frame.valid = 0; return NULL; }
+        g_frame.pieces = np;
+        g_frame.pieces_cap = nc;
+    }
+    return &g_frame.pieces[g_frame.npieces++];
+}
+
+static void frame_append(const char *s, int n) {
+    if (g_frame.cur <= 0) return;
+    if (g_frame.len + (size_t)n > g_frame.cap) {
+        size_t nc = g_frame.cap ? g_frame.cap : 64 * 1024;
+        while (nc < g_frame.len + (size_t)n) nc *= 2;
+        char *nb = xrealloc(g_frame.buf, nc);
+        if (!nb) { g_frame.valid = 0; return; }
+        g_frame.buf = nb;
+        g_frame.cap = nc;
+    }
+    FramePiece *last = g_frame.npieces > g_frame.rows[g_frame.cur].piece0 ? &g_frame.pieces[g_frame.npieces - 1] : NULL;
+    if (last && !last->ext && last->off + (size_t)last->len == g_frame.len) {
+        last->len += n;
+    } else {
+        FramePiece *pc = frame_piece();
+        if (!pc) return;
+        pc->ext = NULL;
+        pc->off = g_frame.len;
+        pc->len = n;
+    }
+    memcpy(g_frame.buf + g_frame.len, s, (size_t)n);
+    g_frame.len += (size_t)n;
+}
+
+static void frame_ref(const char *s, int n) {
+    if (g_frame.cur <= 0) return;
+    FramePiece *last = g_frame.npieces > g_frame.rows[g_frame.cur].piece0 ? &g_frame.pieces[g_frame.npieces - 1] : NULL;
+    if (last && last->ext && last->ext + last->len == s) { last->len += n; return; }
+    FramePiece *pc = frame_piece();
+    if (!pc) return;
+    pc->ext = s;
+    pc->off = 0;
+    pc->len = n;
 }
 
 static void ob_raw(const char *s, int n) {
     if (!s || n <= 0) return;
+    if (g_frame.capture) { frame_append(s, n); return; }
     while (n > 0) {
         int room = (int)sizeof(g_ob) - g_ol;
         if (room <= 0) {
@@ -586,6 +914,20 @@ static void ob_raw(const char *s, int n) {
     }
 }
 
+/* Like ob_raw(), but keeps a pointer to a long run instead of copying it:
+ * s must stay unchanged until the next ob_flush(), or while a frame is
+ * captured, until frame_commit(). */
+static void ob_ref(const char *s, int n) {
+    if (!s || n <= 0) return;
+    if (g_frame.capture) { frame_ref(s, n); return; }
+    if (n < OB_REF_MIN) { ob_raw(s, n); return; }
+    /* Two slots here and one for the tail ob_flush() queues. */
+    if (g_iovn + 3 > OB_IOV_MAX) ob_flush();
+    ob_queue(g_ob + g_ob_mark, (size_t)(g_ol - g_ob_mark));
+    g_ob_mark = g_ol;
+    ob_queue(s, (size_t)n);
+}
+
 static void ob(const char *s) {
     if (!s) return;
     ob_raw(s, (int)strlen(s));
@@ -622,10 +964,78 @@ static const char *jws(const char *p) {
     return p;
 }
 
+/* First byte at or after p that is a quote, a backslash or a control byte
+ * (the terminating NUL included).  Vector loads are aligned, so they never
+ * reach into a page the string does not touch. */
+#if defined(JSCAN_AVX2)
+static unsigned jscan_mask(const char *a) {
+    __m256i v = _mm256_load_si256((const __m256i *)(const void *)a);
+    __m256i ctl = _mm256_set1_epi8(0x1f);
+    __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+                                _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctl), ctl));
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+#define JSCAN_W 32
+#elif defined(JSCAN_SSE2)
+static unsigned jscan_mask(const char *a) {
+    __m128i v = _mm_load_si128((const __m128i *)(const void *)a);
+    __m128i ctl = _mm_set1_epi8(0x1f);
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                          _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                             _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+#define JSCAN_W 16
+#endif
+
+#if defined(JSCAN_W)
+static const char *jscan_str(const char *p) {
+    unsigned mis = (unsigned)((uintptr_t)p & (JSCAN_W - 1));
+    const char *a = p - mis;
+    unsigned m = jscan_mask(a) >> mis;
+    if (m) return p + __builtin_ctz(m);
+    for (;;) {
+        a += JSCAN_W;
+        m = jscan_mask(a);
+        if (m) return a + __builtin_ctz(m);
+    }
+}
+#elif defined(JSCAN_NEON)
+/* Four mask bits per byte, from the narrowing-shift trick. */
+static uint64_t jscan_mask(const char *a) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)a);
+    uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\'))),
+                            vcltq_u8(v, vdupq_n_u8(0x20)));
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+
+static const char *jscan_str(const char *p) {
+    unsigned mis = (unsigned)((uintptr_t)p & 15);
+    const char *a = p - mis;
+    uint64_t m = jscan_mask(a) >> (mis * 4);
+    if (m) return p + (__builtin_ctzll(m) >> 2);
+    for (;;) {
+        a += 16;
+        m = jscan_mask(a);
+        if (m) return a + (__builtin_ctzll(m) >> 2);
+    }
+}
+#else
+static const char *jscan_str(const char *p) {
+    while (*p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) p++;
+    return p;
+}
+#endif
+
 static const char *jskip_s(const char *p) {
     p++;
-    while (*p) { if (*p=='\\') { p+=2; continue; } if (*p=='"') return p+1; p++; }
-    return p;
+    for (;;) {
+        p = jscan_str(p);
+        if (*p == '"') return p + 1;
+        if (*p == '\0') return p;
+        p += (*p == '\\' && p[1]) ? 2 : 1;
+    }
 }
 
 static const char *jskip(const char *p) {
@@ -666,10 +1076,82 @@ static const char *jfind(const char *p, const char *key) {
     return NULL;
 }
 
+/* The top-level members of one object, found in a single pass so looking up
+ * several keys does not re-walk the values in front of each.  Members past
+ * JOBJ_MAX are left unscanned at `rest`. */
+#define JOBJ_MAX 32
+typedef struct {
+    const char *key[JOBJ_MAX];
+    int klen[JOBJ_MAX];
+    const char *val[JOBJ_MAX];
+    const char *vend[JOBJ_MAX];     /* just past each value */
+    int n;
+    const char *rest;
+    const char *end;    /* just past the closing brace, if scanned */
+} JObj;
+
+static void jobj_index(JObj *o, const char *p) {
+    o->n = 0;
+    o->rest = o->end = NULL;
+    if (!p) return;
+    p = jws(p);
+    if (*p != '{') return;
+    p++;
+    while (*p && *p != '}') {
+        p = jws(p);
+        if (*p != '"') break;
+        if (o->n == JOBJ_MAX) { o->rest = p; return; }
+        const char *ks = p + 1;
+        p = jskip_s(p);
+        o->key[o->n] = ks;
+        o->klen[o->n] = (int)(p - ks - 1);
+        p = jws(p);
+        if (*p == ':') p = jws(p + 1);
+        o->val[o->n] = p;
+        p = jskip(p);
+        o->vend[o->n++] = p;
+        p = jws(p);
+        if (*p == ',') p++;
+    }
+    if (*p == '}') o->end = p + 1;
+}
+
+/* The value of `key`, and in *end where it stops (NULL past JOBJ_MAX). */
+static const char *jobj_get_end(const JObj *o, const char *key, const char **end) {
+    size_t kl = strlen(key);
+    if (end) *end = NULL;
+    for (int i = 0; i < o->n; i++) {
+        if ((size_t)o->klen[i] == kl && memcmp(o->key[i], key, kl) == 0) {
+            if (end) *end = o->vend[i];
+            return o->val[i];
+        }
+    }
+    return o->rest ? jfind(o->rest, key) : NULL;
+}
+
+static const char *jobj_get(const JObj *o, const char *key) {
+    return jobj_get_end(o, key, NULL);
+}
+
+/* Skip the object at p, reusing the end an index already found. */
+static const char *jobj_skip(const JObj *o, const char *p) {
+    return o->end ? o->end : jskip(p);
+}
+
 static int jstr(const char *p, char *buf, int mx) {
     if (!p || *p != '"') return 0;
     p++; int i = 0;
     while (*p && i < mx - 1) {
+        /* Copy the escape-free run in one go. */
+        const char *q = jscan_str(p);
+        if (q > p) {
+            int run = (int)(q - p);
+            if (run > mx - 1 - i) run = mx - 1 - i;
+            memcpy(buf + i, p, (size_t)run);
+            i += run;
+            p += run;
+            continue;
+        }
         if (*p == '"') break;
         if (*p == '\\') {
             p++;
@@ -736,6 +1218,7 @@ static void queue_clear_items(void) {
     for (int i = 0; i < g_queue.n; i++) queue_item_free(&g_queue.d[i]);
     free(g_queue.d);
     memset(&g_queue, 0, sizeof(g_queue));
+    memset(&g_queue_log, 0, sizeof(g_queue_log));
     g_queue_fingerprint[0] = '\0';
 }
 
@@ -1315,7 +1798,16 @@ static void queue_json_escape(const char *src, char *dst, size_t dstlen) {
             if (j + 2 >= dstlen) break;
             dst[j++] = '\\';
             dst[j++] = 't';
-        } else if (c >= 0x20) {
+        } else if (c == '\b' || c == '\f') {
+            if (j + 2 >= dstlen) break;
+            dst[j++] = '\\';
+            dst[j++] = c == '\b' ? 'b' : 'f';
+        } else if (c < 0x20 || c == 0x7f) {
+            /* As jq writes them, so the hook's reply is unchanged. */
+            if (j + 6 >= dstlen) break;
+            snprintf(dst + j, 7, "\\u%04x", c);
+            j += 6;
+        } else {
             dst[j++] = (char)c;
         }
     }
@@ -1829,80 +2321,243 @@ static void queue_build_prompt_with_refs(const char *in, char *out, size_t outle
     if (body[0]) strncat(out, body, outlen - used - 1);
 }
 
-static int queue_append_prompt(const char *prompt) {
-    if (!g_queue_enabled || !g_queue_path[0] || !prompt || !*prompt) return -1;
+/* Since format 2 the queue file is an operation log.  A line without "op"
+ * adds an item: plain text, or the JSON object the pager writes, exactly as
+ * in format 1.  {"op":"update","id":...,"prompt":...} and
+ * {"op":"delete","id":...} change an added item by its id.  The pager reads
+ * only what was appended since it last looked, appends its own changes
+ * without reading them back, and rewrites the file as plain adds once
+ * QUEUE_LOG_COMPACT_OPS changes have piled up.  A rewrite by anyone (a
+ * compaction, the Stop hook's pop, another tool) shows up as a new inode, a
+ * shorter file or a changed tail, and is read again from the start. */
+static void queue_log_forget(void) {
+    memset(&g_queue_log, 0, sizeof(g_queue_log));
+}
+
+static void queue_log_start(QueueLog *lg, const struct stat *st) {
+    memset(lg, 0, sizeof(*lg));
+    lg->valid = 1;
+    lg->dev = st->st_dev;
+    lg->ino = st->st_ino;
+    lg->hash = 1469598103934665603ULL;
+}
+
+/* Account for bytes now covered by the log state. */
+static void queue_log_consume(QueueLog *lg, const char *s, size_t n) {
+    lg->hash = queue_hash_update(lg->hash, (const unsigned char *)s, n);
+    lg->off += (off_t)n;
+    if (n >= QUEUE_LOG_TAIL) {
+        memcpy(lg->tail, s + n - QUEUE_LOG_TAIL, QUEUE_LOG_TAIL);
+        lg->tail_len = QUEUE_LOG_TAIL;
+        return;
+    }
+    int keep = lg->tail_len;
+    if (keep > QUEUE_LOG_TAIL - (int)n) keep = QUEUE_LOG_TAIL - (int)n;
+    memmove(lg->tail, lg->tail + lg->tail_len - keep, (size_t)keep);
+    memcpy(lg->tail + keep, s, n);
+    lg->tail_len = keep + (int)n;
+}
 
-    char enriched[QUEUE_INPUT_MAX * 2];
-    queue_build_prompt_with_refs(prompt, enriched, sizeof(enriched));
-    const char *src = enriched[0] ? enriched : prompt;
+static int queue_find_id(const char *id) {
+    if (!id || !*id) return -1;
+    for (int i = 0; i < g_queue.n; i++) {
+        if (g_queue.d[i].persisted_id && strcmp(g_queue.d[i].persisted_id, id) == 0) return i;
+    }
+    return -1;
+}
 
-    long long ts = now_us();
-    char id[64];
-    snprintf(id, sizeof(id), "%lld", ts);
-    QueueItem item = {
-        .prompt = (char *)src,
-        .persisted_id = id,
-        .added_us = ts,
-        .has_added_us = 1,
-        .encoding_json = 1,
-        .raw_json = NULL,
-    };
-    char line[QUEUE_INPUT_MAX * 2 + 512];
-    if (!queue_serialize_item_line(&item, line, sizeof(line))) return -1;
-    size_t line_len = strlen(line);
-    if (line_len + 1 >= sizeof(line)) return -1;
-    line[line_len++] = '\n';
-    line[line_len] = '\0';
+static void queue_remove_at(int idx) {
+    if (idx < 0 || idx >= g_queue.n) return;
+    queue_item_free(&g_queue.d[idx]);
+    for (int i = idx; i + 1 < g_queue.n; i++) g_queue.d[i] = g_queue.d[i + 1];
+    g_queue.n--;
+    if (g_queue.selected > idx) g_queue.selected--;
+    queue_clamp_selection();
+}
 
-    int lock_fd = queue_lock_open(g_queue_path);
-    if (lock_fd < 0) return -1;
+/* Apply one log line (newline stripped) read from disk. */
+static void queue_log_apply(char *line) {
+    const char *ov = (*line == '{') ? jfind(line, "op") : NULL;
+    if (ov && *ov == '"') {
+        const char *end = queue_skip_json_value(line);
+        if (!end || *jws(end)) return;  /* torn or unknown: skip it */
+        char op[16], id[256] = "";
+        (void)jstr(ov, op, sizeof(op));
+        const char *iv = jfind(line, "id");
+        if (iv && *iv == '"') (void)jstr(iv, id, sizeof(id));
+        int at = queue_find_id(id);
+        g_queue_log.ops++;
+        if (at < 0) return;
+        if (strcmp(op, "delete") == 0) {
+            queue_remove_at(at);
+            if (g_edit_index == at) g_edit_index = -1;
+            else if (g_edit_index > at) g_edit_index--;
+        } else if (strcmp(op, "update") == 0) {
+            const char *pv = jfind(line, "prompt");
+            char prompt[QUEUE_INPUT_MAX];
+            if (pv && *pv == '"' && jstr(pv, prompt, sizeof(prompt)) > 0) {
+                char *p = xstrdup(prompt);
+                if (!p) return;
+                free(g_queue.d[at].prompt);
+                g_queue.d[at].prompt = p;
+                g_queue.d[at].encoding_json = 1;
+            }
+        }
+        return;
+    }
+    const char *pv = (*line == '{') ? jfind(line, "prompt") : NULL;
+    if (pv && *pv == '"') {
+        char prompt[QUEUE_INPUT_MAX];
+        char item_id[256];
+        item_id[0] = '\0';
+        const char *iv = jfind(line, "id");
+        if (iv && *iv == '"') (void)jstr(iv, item_id, sizeof(item_id));
+        const char *av = jfind(line, "added_us");
+        long long added_us = av ? strtoll(jws(av), NULL, 10) : 0;
+        int has_added_us = av != NULL;
+        if (jstr(pv, prompt, sizeof(prompt)) > 0) {
+            (void)queue_push_item(
+                prompt,
+                item_id[0] ? item_id : NULL,
+                added_us,
+                has_added_us,
+                1,
+                line
+            );
+        }
+    } else {
+        (void)queue_push_item(line, NULL, 0, 0, 0, NULL);
+    }
+}
 
-    int fd = open(g_queue_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
-    int ok = -1;
-    if (fd >= 0) {
-        ok = write_all(fd, line, line_len) == 0 ? 0 : -1;
+/* Bring g_queue up to the log on disk: apply the complete lines appended
+ * since the last read, or everything when the file was replaced.  Returns
+ * 1 when g_queue changed. */
+static int queue_log_catch_up(void) {
+    int old_n = g_queue.n;
+    int fd = open(g_queue_path, O_RDONLY);
+    if (fd < 0) {
+        queue_clear_items();
+        return old_n > 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
         close(fd);
+        return 0;
     }
-    queue_lock_close(lock_fd);
+    QueueLog *lg = &g_queue_log;
+    int fresh = !lg->valid || lg->dev != st.st_dev || lg->ino != st.st_ino || st.st_size < lg->off;
+    if (!fresh && lg->tail_len > 0) {
+        char t[QUEUE_LOG_TAIL];
+        fresh = pread(fd, t, (size_t)lg->tail_len, lg->off - lg->tail_len) != lg->tail_len ||
+                memcmp(t, lg->tail, (size_t)lg->tail_len) != 0;
+    }
+    int changed = 0;
+    if (fresh) {
+        changed = old_n > 0;
+        queue_clear_items();
+        queue_log_start(lg, &st);
+        old_n = 0;
+    }
+    size_t want = st.st_size > lg->off ? (size_t)(st.st_size - lg->off) : 0;
+    char *buf = want ? xmalloc(want + 1) : NULL;
+    ssize_t got = buf ? pread(fd, buf, want, lg->off) : 0;
+    close(fd);
+    size_t used = got > 0 ? (size_t)got : 0;
+    while (used > 0 && buf[used - 1] != '\n') used--;  /* leave a torn last line */
+    if (used > 0) {
+        queue_log_consume(lg, buf, used);
+        for (char *p = buf, *e = buf + used; p < e;) {
+            char *nl = memchr(p, '\n', (size_t)(e - p));
+            size_t len = (size_t)(nl - p);
+            *nl = '\0';
+            while (len > 0 && p[len - 1] == '\r') p[--len] = '\0';
+            if (len > 0) queue_log_apply(p);
+            p = nl + 1;
+        }
+        changed = 1;
+    }
+    free(buf);
+    queue_hash_hex(lg->hash, g_queue_fingerprint, sizeof(g_queue_fingerprint));
+    if (g_queue.n > old_n) g_queue.selected = g_queue.n - 1;
+    queue_clamp_selection();
+    return changed;
+}
+
+/* Read the whole log again, dropping what g_queue holds. */
+static void queue_log_reload(void) {
+    queue_log_forget();
     g_queue_stamp.valid = 0;
-    g_queue_fingerprint[0] = '\0';
-    return ok;
+    (void)queue_log_catch_up();
 }
 
-static int queue_write_all_items(void) {
-    if (!g_queue_enabled || !g_queue_path[0]) return -1;
-    int lock_fd = queue_lock_open(g_queue_path);
-    if (lock_fd < 0) return -1;
+static int queue_load_from_disk(void) {
+    if (!g_queue_enabled || !g_queue_path[0]) return 0;
 
-    char current_fp[17];
-    if (!queue_fingerprint_file(g_queue_path, current_fp, sizeof(current_fp))) {
-        queue_lock_close(lock_fd);
-        return -1;
+    struct stat st;
+    if (stat(g_queue_path, &st) != 0) {
+        g_queue_stamp.valid = 0;
+        if (g_queue.n > 0) {
+            queue_clear_items();
+            queue_recalc_rows();
+            return 1;
+        }
+        queue_log_forget();
+        return 0;
     }
-    if (g_queue_fingerprint[0] != '\0' && strcmp(current_fp, g_queue_fingerprint) != 0) {
-        queue_lock_close(lock_fd);
-        return QUEUE_WRITE_CONFLICT;
+    if (!file_stamp_changed(g_queue_path, &g_queue_stamp)) return 0;
+    if (!queue_log_catch_up()) return 0;
+    queue_recalc_rows();
+    return 1;
+}
+
+/* Append one of the pager's own lines (newline included).  The caller holds
+ * the lock, has caught up and already made the change in g_queue, so the
+ * bytes are only accounted for, and the watcher's next look at the file
+ * finds nothing new. */
+static int queue_log_append_own(const char *line, size_t len, int is_op) {
+    int fd = open(g_queue_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (fd < 0) return -1;
+    struct stat st;
+    int ok = fstat(fd, &st) == 0 && write_all(fd, line, len) == 0;
+    close(fd);
+    QueueLog *lg = &g_queue_log;
+    if (ok && !lg->valid && st.st_size == 0) queue_log_start(lg, &st);
+    if (!ok || !lg->valid || lg->dev != st.st_dev || lg->ino != st.st_ino || lg->off != st.st_size) {
+        /* Someone wrote without the lock; read it all next time. */
+        queue_log_forget();
+        g_queue_stamp.valid = 0;
+        return ok ? 0 : -1;
     }
+    queue_log_consume(lg, line, len);
+    if (is_op) lg->ops++;
+    queue_hash_hex(lg->hash, g_queue_fingerprint, sizeof(g_queue_fingerprint));
+    (void)file_stamp_changed(g_queue_path, &g_queue_stamp);
+    return 0;
+}
 
+/* Rewrite the log as one add per item in g_queue; the caller holds the
+ * lock. */
+static int queue_write_items_locked(void) {
     if (g_queue.n <= 0) {
         (void)unlink(g_queue_path);
+        queue_log_forget();
         g_queue_stamp.valid = 0;
         g_queue_fingerprint[0] = '\0';
-        queue_lock_close(lock_fd);
         return 0;
     }
 
     char tmp[PATH_MAX];
     snprintf(tmp, sizeof(tmp), "%s.tmp.XXXXXX", g_queue_path);
     int fd = mkstemp(tmp);
-    if (fd < 0) {
-        queue_lock_close(lock_fd);
-        return -1;
-    }
+    if (fd < 0) return -1;
     (void)fchmod(fd, 0600);
 
-    int ok = 0;
-    for (int i = 0; i < g_queue.n; i++) {
+    struct stat st;
+    QueueLog lg;
+    int ok = fstat(fd, &st) == 0 ? 0 : -1;
+    if (ok == 0) queue_log_start(&lg, &st);
+    for (int i = 0; ok == 0 && i < g_queue.n; i++) {
         char line[QUEUE_INPUT_MAX * 2 + 512];
         if (!queue_serialize_item_line(&g_queue.d[i], line, sizeof(line))) {
             ok = -1;
@@ -1918,117 +2573,283 @@ static int queue_write_all_items(void) {
             ok = -1;
             break;
         }
+        queue_log_consume(&lg, line, n);
     }
     close(fd);
 
     if (ok == 0) {
         if (rename(tmp, g_queue_path) != 0) ok = -1;
     }
-    if (ok != 0) (void)unlink(tmp);
-
-    g_queue_stamp.valid = 0;
-    g_queue_fingerprint[0] = '\0';
-    queue_lock_close(lock_fd);
-    return ok;
+    if (ok != 0) {
+        (void)unlink(tmp);
+        queue_log_forget();
+        g_queue_stamp.valid = 0;
+        return ok;
+    }
+    g_queue_log = lg;
+    queue_hash_hex(lg.hash, g_queue_fingerprint, sizeof(g_queue_fingerprint));
+    (void)file_stamp_changed(g_queue_path, &g_queue_stamp);
+    return 0;
 }
 
-static void queue_set_input_from_selected(void) {
-    if (g_queue.n <= 0) return;
-    queue_clamp_selection();
-    if (g_queue.selected < 0 || g_queue.selected >= g_queue.n) return;
-    const char *src = g_queue.d[g_queue.selected].prompt ? g_queue.d[g_queue.selected].prompt : "";
-    input_set_text(src);
-    g_edit_index = g_queue.selected;
-    queue_set_notice("editing queued prompt");
+static void queue_log_maybe_compact(void) {
+    if (g_queue_log.ops >= QUEUE_LOG_COMPACT_OPS) (void)queue_write_items_locked();
 }
 
-static int queue_cycle_edit(int dir) {
-    if (g_queue.n <= 0) return 0;
-    if (dir == 0) return 0;
+static int queue_append_prompt(const char *prompt) {
+    if (!g_queue_enabled || !g_queue_path[0] || !prompt || !*prompt) return -1;
 
-    if (g_edit_index < 0) {
-        input_snapshot_draft_if_needed();
-        g_queue.selected = (dir < 0) ? (g_queue.n - 1) : 0;
-        queue_set_input_from_selected();
-        return 1;
-    }
+    char enriched[QUEUE_INPUT_MAX * 2];
+    queue_build_prompt_with_refs(prompt, enriched, sizeof(enriched));
+    const char *src = enriched[0] ? enriched : prompt;
 
-    int next = g_queue.selected + dir;
-    if (next < 0 || next >= g_queue.n) {
-        if (input_restore_draft()) {
-            g_edit_index = -1;
-            queue_set_notice("draft restored");
-            return 1;
-        }
-        return 0;
-    }
+    long long ts = now_us();
+    char id[64];
+    snprintf(id, sizeof(id), "%lld", ts);
+    QueueItem item = {
+        .prompt = (char *)src,
+        .persisted_id = id,
+        .added_us = ts,
+        .has_added_us = 1,
+        .encoding_json = 1,
+        .raw_json = NULL,
+    };
+    char line[QUEUE_INPUT_MAX * 2 + 512];
+    if (!queue_serialize_item_line(&item, line, sizeof(line))) return -1;
+    size_t line_len = strlen(line);
+    if (line_len + 1 >= sizeof(line)) return -1;
+    line[line_len++] = '\n';
+    line[line_len] = '\0';
 
-    g_queue.selected = next;
-    queue_set_input_from_selected();
-    return 1;
+    int lock_fd = queue_lock_open(g_queue_path);
+    if (lock_fd < 0) return -1;
+
+    (void)queue_log_catch_up();
+    int ok = -1;
+    if (queue_push_item(src, id, ts, 1, 1, NULL)) {
+        ok = queue_log_append_own(line, line_len, 0);
+        if (ok != 0) queue_item_free(&g_queue.d[--g_queue.n]);
+        else g_queue.selected = g_queue.n - 1;
+    }
+    queue_lock_close(lock_fd);
+    return ok;
 }
 
-static int queue_load_from_disk(void) {
-    if (!g_queue_enabled || !g_queue_path[0]) return 0;
+/* Rewrite the whole file from g_queue, unless it changed since it was last
+ * read (QUEUE_WRITE_CONFLICT).  Needed for items without an id, which the
+ * log cannot name. */
+static int queue_write_all_items(void) {
+    if (!g_queue_enabled || !g_queue_path[0]) return -1;
+    int lock_fd = queue_lock_open(g_queue_path);
+    if (lock_fd < 0) return -1;
 
-    struct stat st;
-    if (stat(g_queue_path, &st) != 0) {
-        g_queue_stamp.valid = 0;
-        if (g_queue.n > 0) {
-            queue_clear_items();
-            queue_recalc_rows();
-            return 1;
+    char current_fp[17];
+    if (!queue_fingerprint_file(g_queue_path, current_fp, sizeof(current_fp))) {
+        queue_lock_close(lock_fd);
+        return -1;
+    }
+    if (g_queue_fingerprint[0] != '\0' && strcmp(current_fp, g_queue_fingerprint) != 0) {
+        queue_lock_close(lock_fd);
+        return QUEUE_WRITE_CONFLICT;
+    }
+    int ok = queue_write_items_locked();
+    queue_lock_close(lock_fd);
+    return ok;
+}
+
+/* Append an "update" or "delete" line for the item with `id`, after
+ * catching up under the lock.  `text` is the new prompt for updates. */
+static int queue_log_change(const char *op, const char *id, const char *text) {
+    int lock_fd = queue_lock_open(g_queue_path);
+    if (lock_fd < 0) return -1;
+    (void)queue_log_catch_up();
+    int at = queue_find_id(id), rc = QUEUE_WRITE_CONFLICT;
+    char *updated = text ? xstrdup(text) : NULL;
+    if (at >= 0 && (!text || updated)) {
+        char esc_id[512];
+        char esc_prompt[QUEUE_INPUT_MAX * 2];
+        char line[QUEUE_INPUT_MAX * 2 + 512];
+        queue_json_escape(id, esc_id, sizeof(esc_id));
+        int n;
+        if (text) {
+            queue_json_escape(text, esc_prompt, sizeof(esc_prompt));
+            n = snprintf(line, sizeof(line), "{\"op\":\"%s\",\"id\":\"%s\",\"prompt\":\"%s\"}\n", op, esc_id, esc_prompt);
+        } else {
+            n = snprintf(line, sizeof(line), "{\"op\":\"%s\",\"id\":\"%s\"}\n", op, esc_id);
+        }
+        rc = -1;
+        if (n > 0 && (size_t)n < sizeof(line)) {
+            if (text) {
+                free(g_queue.d[at].prompt);
+                g_queue.d[at].prompt = updated;
+                g_queue.d[at].encoding_json = 1;
+                updated = NULL;
+                g_queue.selected = at;
+            } else {
+                queue_remove_at(at);
+            }
+            if (g_queue.n == 0) rc = queue_write_items_locked();  /* drop the file */
+            else rc = queue_log_append_own(line, (size_t)n, 1);
+            if (rc == 0) queue_log_maybe_compact();
+            else queue_log_reload();
         }
-        return 0;
     }
-    if (!file_stamp_changed(g_queue_path, &g_queue_stamp)) return 0;
+    free(updated);
+    queue_lock_close(lock_fd);
+    return rc;
+}
+
+/* Replace item idx's prompt on disk and in g_queue. */
+static int queue_update_item(int idx, const char *text) {
+    if (!g_queue_enabled || !g_queue_path[0] || idx < 0 || idx >= g_queue.n || !text) return -1;
+    QueueItem *it = &g_queue.d[idx];
+    if (it->persisted_id && *it->persisted_id) {
+        char id[256];
+        snprintf(id, sizeof(id), "%s", it->persisted_id);
+        return queue_log_change("update", id, text);
+    }
+    char *updated = xstrdup(text);
+    if (!updated) return -1;
+    free(it->prompt);
+    it->prompt = updated;
+    it->encoding_json = 1;
+    int rc = queue_write_all_items();
+    if (rc != 0) queue_log_reload();
+    else g_queue.selected = idx;
+    return rc;
+}
+
+/* Remove item idx on disk and from g_queue. */
+static int queue_delete_item(int idx) {
+    if (!g_queue_enabled || !g_queue_path[0] || idx < 0 || idx >= g_queue.n) return -1;
+    QueueItem *it = &g_queue.d[idx];
+    if (it->persisted_id && *it->persisted_id) {
+        char id[256];
+        snprintf(id, sizeof(id), "%s", it->persisted_id);
+        return queue_log_change("delete", id, NULL);
+    }
+    queue_remove_at(idx);
+    int rc = queue_write_all_items();
+    if (rc != 0) queue_log_reload();
+    return rc;
+}
+
+/* Pop the first queued item under the pager's lock, for the Stop hook.
+ * Returns 1 with the item's prompt in *out, 0 when there is nothing
+ * queued, -1 on error.  What is left is written back as plain adds. */
+static int queue_pop_head(const char *path, char **out) {
+    *out = NULL;
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+    snprintf(g_queue_path, sizeof(g_queue_path), "%s", path);
+    int lock_fd = queue_lock_open(path);
+    if (lock_fd < 0) return -1;
+    queue_log_reload();
+    int rc = 0;
+    if (g_queue.n > 0) {
+        *out = xstrdup(g_queue.d[0].prompt);
+        queue_remove_at(0);
+        rc = *out ? 1 : -1;
+    }
+    if (rc >= 0 && queue_write_items_locked() != 0) rc = -1;
+    queue_lock_close(lock_fd);
+    queue_clear_items();
+    if (rc < 0) {
+        free(*out);
+        *out = NULL;
+    }
+    return rc;
+}
 
-    FILE *f = fopen(g_queue_path, "r");
-    if (!f) return 0;
+/* The Stop hook's answer: block with the popped prompt as the reason, or
+ * let Claude stop when nothing was queued. */
+static char *queue_hook_reply(const char *prompt) {
+    if (!prompt || !*prompt) return xstrdup("{\"ok\":true}\n");
+    size_t n = strlen(prompt) * 6 + 1;
+    char *esc = xmalloc(n);
+    char *out = esc ? xmalloc(n + 40) : NULL;
+    if (out) {
+        queue_json_escape(prompt, esc, n);
+        snprintf(out, n + 40, "{\"decision\":\"block\",\"reason\":\"%s\"}\n", esc);
+    }
+    free(esc);
+    return out;
+}
 
-    int old_n = g_queue.n;
-    queue_clear_items();
-    unsigned long long hash = 1469598103934665603ULL;
+int run_queue_pop(int in_fd, int out_fd) {
+    char *in = NULL;
+    size_t len = 0, cap = 0;
+    for (;;) {
+        if (len + 4096 + 1 > cap) {
+            if (cap >= (1u << 24)) break;
+            size_t nc = cap ? cap * 2 : 8192;
+            char *ni = xrealloc(in, nc);
+            if (!ni) break;
+            in = ni;
+            cap = nc;
+        }
+        ssize_t r = read(in_fd, in + len, cap - len - 1);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        len += (size_t)r;
+    }
+    if (in) in[len] = '\0';
+
+    char sid[256] = "";
+    const char *sv = in ? jfind(in, "session_id") : NULL;
+    if (sv && *sv == '"') (void)jstr(sv, sid, sizeof(sid));
+    free(in);
 
+    int rc = 0;
     char *line = NULL;
-    size_t cap = 0;
-    ssize_t len = 0;
-    while ((len = getline(&line, &cap, f)) != -1) {
-        hash = queue_hash_update(hash, (const unsigned char *)line, (size_t)len);
-        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
-        if (len <= 0) continue;
-        const char *pv = (*line == '{') ? jfind(line, "prompt") : NULL;
-        if (pv && *pv == '"') {
-            char prompt[QUEUE_INPUT_MAX];
-            char item_id[256];
-            item_id[0] = '\0';
-            const char *iv = jfind(line, "id");
-            if (iv && *iv == '"') (void)jstr(iv, item_id, sizeof(item_id));
-            const char *av = jfind(line, "added_us");
-            long long added_us = av ? strtoll(jws(av), NULL, 10) : 0;
-            int has_added_us = av != NULL;
-            if (jstr(pv, prompt, sizeof(prompt)) > 0) {
-                (void)queue_push_item(
-                    prompt,
-                    item_id[0] ? item_id : NULL,
-                    added_us,
-                    has_added_us,
-                    1,
-                    line
-                );
-            }
-        } else {
-            (void)queue_push_item(line, NULL, 0, 0, 0, NULL);
+    char path[PATH_MAX];
+    if (sid[0]) {
+        setenv("CLAUDE_SESSION_ID", sid, 1);
+        if (pager_queue_attachment_for_transcript(NULL, path, sizeof(path), NULL, 0) != 0 ||
+            queue_pop_head(path, &line) < 0) {
+            rc = 1;
         }
     }
-    int read_ok = ferror(f) == 0;
+    char *reply = queue_hook_reply(line);
+    if (!reply || write_all(out_fd, reply, strlen(reply)) != 0) rc = 1;
+    free(reply);
     free(line);
-    fclose(f);
-    if (!read_ok) return 0;
-    queue_hash_hex(hash, g_queue_fingerprint, sizeof(g_queue_fingerprint));
+    return rc;
+}
 
-    if (g_queue.n > old_n) g_queue.selected = g_queue.n - 1;
-    queue_recalc_rows();
+static void queue_set_input_from_selected(void) {
+    if (g_queue.n <= 0) return;
+    queue_clamp_selection();
+    if (g_queue.selected < 0 || g_queue.selected >= g_queue.n) return;
+    const char *src = g_queue.d[g_queue.selected].prompt ? g_queue.d[g_queue.selected].prompt : "";
+    input_set_text(src);
+    g_edit_index = g_queue.selected;
+    queue_set_notice("editing queued prompt");
+}
+
+static int queue_cycle_edit(int dir) {
+    if (g_queue.n <= 0) return 0;
+    if (dir == 0) return 0;
+
+    if (g_edit_index < 0) {
+        input_snapshot_draft_if_needed();
+        g_queue.selected = (dir < 0) ? (g_queue.n - 1) : 0;
+        queue_set_input_from_selected();
+        return 1;
+    }
+
+    int next = g_queue.selected + dir;
+    if (next < 0 || next >= g_queue.n) {
+        if (input_restore_draft()) {
+            g_edit_index = -1;
+            queue_set_notice("draft restored");
+            return 1;
+        }
+        return 0;
+    }
+
+    g_queue.selected = next;
+    queue_set_input_from_selected();
     return 1;
 }
 
@@ -2081,6 +2902,10 @@ static void input_pending_push(unsigned char c) {
     g_input_pending[g_input_pending_len++] = c;
 }
 
+static int input_pending_has(void) {
+    return g_input_pending_pos < g_input_pending_len;
+}
+
 static int input_pending_pop(void) {
     if (g_input_pending_pos >= g_input_pending_len) {
         input_pending_reset();
@@ -2139,14 +2964,46 @@ static void input_pending_consume_chunk(const unsigned char *buf, ssize_t n) {
 
 /* ── Dynamic line array ────────────────────────────────────────────────── */
 
+/* One logical line.  Its text is NUL-terminated in the Lines arena; how many
+ * screen rows it takes depends on the width and comes from the wrap index. */
 typedef struct {
-    char **d;
-    int n, cap;
+    uint32_t off;
+    int len;
+    int width;          /* visible columns */
+    int fold;           /* wraps at the terminal width (pushed by L_pushw) */
+    int link0, nlink;   /* OSC-8 spans in Lines.links */
+} LineRow;
+
+/* An OSC-8 link run measured when the line was pushed, in columns of the
+ * unwrapped line; drawing splits it at the current width. */
+typedef struct {
+    int x0, x1;
+    const char *uri;
+} LineLink;
+
+/* Rows form a ring (`cap` is a power of two, row i sits at head + i) so
+ * dropping old rows is O(1).  Their text is bump-allocated; bytes of dropped
+ * or truncated rows stay dead until the arena is compacted. */
+typedef struct {
+    LineRow *rows;
+    int head, n, cap;
+    char *arena;
+    size_t arena_len, arena_cap;
+    size_t arena_live;
+    LineLink *links;    /* same lifetime rules as the arena */
+    int nlinks, links_cap, links_live;
     int max_keep;
     int drop_chunk;
     int dropped_total;
+    int rows_below;     /* rows of items past a viewport window, see worker_window() */
+    int after_blank;    /* while empty, pretend the row before the first is blank */
+    int *vrow;          /* wrap index: vrow[i] = screen rows above line i */
+    int vrow_n, vrow_cap, vrow_cols;
 } Lines;
 
+static int vlen(const char *s);
+static void L_add_links(Lines *l, LineRow *r, const char *s);
+
 static void L_init(Lines *l) {
     memset(l, 0, sizeof(*l));
     l->drop_chunk = 256;
@@ -2164,18 +3021,102 @@ static void L_set_limit(Lines *l, int max_keep) {
     }
 }
 
+static LineRow *L_row(const Lines *l, int i) {
+    return &l->rows[(l->head + i) & (l->cap - 1)];
+}
+
+static const char *L_get(const Lines *l, int i) {
+    return l->arena + L_row(l, i)->off;
+}
+
+static void L_row_dead(Lines *l, const LineRow *r) {
+    l->arena_live -= (size_t)r->len + 1;
+    l->links_live -= r->nlink;
+}
+
+static void L_compact_links(Lines *l) {
+    int dead = l->nlinks - l->links_live;
+    if (dead < 1024 || dead < l->links_live) return;
+    int at = 0;
+    for (int i = 0; i < l->n; i++) {
+        LineRow *r = L_row(l, i);
+        if (r->nlink <= 0) continue;
+        memmove(l->links + at, l->links + r->link0, sizeof(LineLink) * (size_t)r->nlink);
+        r->link0 = at;
+        at += r->nlink;
+    }
+    l->nlinks = at;
+}
+
+/* Copy live row text to a fresh arena in row order once most of it is dead. */
+static void L_compact(Lines *l) {
+    L_compact_links(l);
+    size_t dead = l->arena_len - l->arena_live;
+    if (dead < (256u << 10) || dead < l->arena_live) return;
+    size_t ncap = l->arena_live > 0 ? l->arena_live : 1;
+    char *na = xmalloc(ncap);
+    if (!na) return;
+    size_t at = 0;
+    for (int i = 0; i < l->n; i++) {
+        LineRow *r = L_row(l, i);
+        memcpy(na + at, l->arena + r->off, (size_t)r->len + 1);
+        r->off = (uint32_t)at;
+        at += (size_t)r->len + 1;
+    }
+    free(l->arena);
+    l->arena = na;
+    l->arena_len = at;
+    l->arena_cap = ncap;
+}
+
 static int L_drop_head(Lines *l, int drop) {
     if (!l || drop <= 0 || l->n <= 0) return 0;
     if (drop > l->n) drop = l->n;
-    for (int i = 0; i < drop; i++) free(l->d[i]);
-    memmove(l->d, l->d + drop, (size_t)(l->n - drop) * sizeof(char *));
+    for (int i = 0; i < drop; i++) L_row_dead(l, L_row(l, i));
+    l->head = (l->head + drop) & (l->cap - 1);
     l->n -= drop;
     l->dropped_total += drop;
+    l->vrow_n = 0;
+    L_compact(l);
     return drop;
 }
 
-static void L_push(Lines *l, const char *s) {
-    if (!l || !s || g_oom) return;
+static int L_grow_rows(Lines *l) {
+    if (l->n < l->cap) return 1;
+    int ncap = l->cap ? l->cap * 2 : 128;
+    LineRow *nr = xmalloc(sizeof(LineRow) * (size_t)ncap);
+    if (!nr) return 0;
+    for (int i = 0; i < l->n; i++) nr[i] = *L_row(l, i);
+    free(l->rows);
+    l->rows = nr;
+    l->cap = ncap;
+    l->head = 0;
+    return 1;
+}
+
+/* Append text to the arena; returns its offset or -1. */
+static long long L_store(Lines *l, const char *s, int len) {
+    size_t need = l->arena_len + (size_t)len + 1;
+    if (need > UINT32_MAX) { g_oom = 1; return -1; }
+    if (need > l->arena_cap) {
+        size_t ncap = l->arena_cap ? l->arena_cap : 16384;
+        while (ncap < need) ncap *= 2;
+        if (ncap > (size_t)UINT32_MAX + 1) ncap = (size_t)UINT32_MAX + 1;
+        char *na = xrealloc(l->arena, ncap);
+        if (!na) return -1;
+        l->arena = na;
+        l->arena_cap = ncap;
+    }
+    size_t off = l->arena_len;
+    memcpy(l->arena + off, s, (size_t)len);
+    l->arena[off + (size_t)len] = '\0';
+    l->arena_len = need;
+    l->arena_live += (size_t)len + 1;
+    return (long long)off;
+}
+
+static void L_push_row(Lines *l, const char *s, int fold) {
+    if (!l || g_oom) return;
     if (l->max_keep > 0) {
         int chunk = l->drop_chunk > 0 ? l->drop_chunk : 1;
         int high = l->max_keep + chunk;
@@ -2184,60 +3125,157 @@ static void L_push(Lines *l, const char *s) {
             if (drop > 0) L_drop_head(l, drop);
         }
     }
-    if (l->n >= l->cap) {
-        int ncap = l->cap ? l->cap * 2 : 128;
-        char **nd = xrealloc(l->d, sizeof(char*) * (size_t)ncap);
-        if (!nd) return;
-        l->d = nd;
-        l->cap = ncap;
-    }
-    char *cp = xstrdup(s);
-    if (!cp) return;
-    l->d[l->n++] = cp;
+    if (!L_grow_rows(l)) return;
+    LineRow r = {0, (int)strlen(s), 0, fold, 0, 0};
+    long long off = L_store(l, s, r.len);
+    if (off < 0) return;
+    r.off = (uint32_t)off;
+    r.width = vlen(s);
+    L_add_links(l, &r, s);
+    l->n++;
+    *L_row(l, l->n - 1) = r;
+}
+
+static void L_push(Lines *l, const char *s) {
+    if (!s) return;
+    L_push_row(l, s, 0);
 }
 
 static void L_push_blank_once(Lines *l) {
     if (!l) return;
-    if (l->n == 0 || !l->d || !l->d[l->n - 1] || l->d[l->n - 1][0] != '\0') {
+    if (l->n == 0 ? !l->after_blank : L_row(l, l->n - 1)->len != 0) {
         L_push(l, "");
     }
 }
 
-static int line_is_wrap_placeholder(const char *s) {
-    return s && s[0] == WRAP_PLACEHOLDER[0] && s[1] == '\0';
-}
-
 static void L_prepend(Lines *l, const char *s) {
     if (!l || !s || g_oom) return;
-    if (l->n >= l->cap) {
-        int ncap = l->cap ? l->cap * 2 : 128;
-        char **nd = xrealloc(l->d, sizeof(char*) * (size_t)ncap);
-        if (!nd) return;
-        l->d = nd;
-        l->cap = ncap;
-    }
-    char *cp = xstrdup(s);
-    if (!cp) return;
-    memmove(l->d + 1, l->d, (size_t)l->n * sizeof(char *));
-    l->d[0] = cp;
+    if (!L_grow_rows(l)) return;
+    LineRow r = {0, (int)strlen(s), 0, 0, 0, 0};
+    long long off = L_store(l, s, r.len);
+    if (off < 0) return;
+    r.off = (uint32_t)off;
+    r.width = vlen(s);
+    L_add_links(l, &r, s);
+    l->head = (l->head - 1) & (l->cap - 1);
     l->n++;
+    l->vrow_n = 0;
+    *L_row(l, 0) = r;
     if (l->max_keep > 0 && l->n > l->max_keep) {
-        free(l->d[l->n - 1]);
+        L_row_dead(l, L_row(l, l->n - 1));
         l->n--;
     }
 }
 
+/* Drop rows from the tail so rendering can resume from an earlier item. */
+static void L_truncate(Lines *l, int n) {
+    if (!l || n < 0 || n >= l->n) return;
+    for (int i = n; i < l->n; i++) L_row_dead(l, L_row(l, i));
+    l->n = n;
+    if (l->vrow_n > n + 1) l->vrow_n = n + 1;
+    L_compact(l);
+}
+
+/* Undo L_prepend; unlike L_drop_head the row is not counted as dropped. */
+static void L_pop_head(Lines *l) {
+    if (!l || l->n <= 0) return;
+    L_row_dead(l, L_row(l, 0));
+    l->head = (l->head + 1) & (l->cap - 1);
+    l->n--;
+    l->vrow_n = 0;
+}
+
 static void L_free(Lines *l) {
     if (!l) return;
     int keep = l->max_keep;
     int chunk = l->drop_chunk;
-    for (int i=0; i<l->n; i++) free(l->d[i]);
-    free(l->d);
+    free(l->rows);
+    free(l->arena);
+    free(l->links);
+    free(l->vrow);
     L_init(l);
     l->max_keep = keep;
     l->drop_chunk = chunk;
 }
 
+/* Copy rows from..n-1 of src with only their live text and link spans; link
+ * URIs are interned and shared.  The wrap index is not copied.  Returns 0
+ * on allocation failure, leaving dst empty. */
+static int L_clone(Lines *dst, const Lines *src, int from) {
+    L_init(dst);
+    dst->max_keep = src->max_keep;
+    dst->drop_chunk = src->drop_chunk;
+    dst->dropped_total = src->dropped_total;
+    dst->rows_below = src->rows_below;
+    if (from < 0) from = 0;
+    int n = src->n - from;
+    if (n <= 0) return 1;
+    size_t bytes = 0;
+    int nlinks = 0;
+    for (int i = from; i < src->n; i++) {
+        const LineRow *r = L_row(src, i);
+        bytes += (size_t)r->len + 1;
+        nlinks += r->nlink;
+    }
+    int cap = 128;
+    while (cap < n) cap *= 2;
+    dst->rows = xmalloc(sizeof(LineRow) * (size_t)cap);
+    dst->arena = xmalloc(bytes > 0 ? bytes : 1);
+    dst->links = nlinks > 0 ? xmalloc(sizeof(LineLink) * (size_t)nlinks) : NULL;
+    if (!dst->rows || !dst->arena || (nlinks > 0 && !dst->links)) {
+        L_free(dst);
+        return 0;
+    }
+    dst->cap = cap;
+    dst->arena_cap = bytes > 0 ? bytes : 1;
+    dst->links_cap = nlinks;
+    for (int i = 0; i < n; i++) {
+        LineRow r = *L_row(src, from + i);
+        memcpy(dst->arena + dst->arena_len, src->arena + r.off, (size_t)r.len + 1);
+        r.off = (uint32_t)dst->arena_len;
+        dst->arena_len += (size_t)r.len + 1;
+        if (r.nlink > 0) {
+            memcpy(dst->links + dst->nlinks, src->links + r.link0, sizeof(LineLink) * (size_t)r.nlink);
+            r.link0 = dst->nlinks;
+            dst->nlinks += r.nlink;
+        }
+        dst->rows[i] = r;
+    }
+    dst->n = n;
+    dst->arena_live = dst->arena_len;
+    dst->links_live = dst->nlinks;
+    return 1;
+}
+
+/* Append every row of src, reusing its measured widths and link spans. */
+static int L_append(Lines *dst, const Lines *src) {
+    for (int i = 0; i < src->n; i++) {
+        const LineRow *sr = L_row(src, i);
+        if (!L_grow_rows(dst)) return 0;
+        long long off = L_store(dst, src->arena + sr->off, sr->len);
+        if (off < 0) return 0;
+        LineRow r = *sr;
+        r.off = (uint32_t)off;
+        if (r.nlink > 0) {
+            if (dst->nlinks + r.nlink > dst->links_cap) {
+                int nc = dst->links_cap ? dst->links_cap : 64;
+                while (nc < dst->nlinks + r.nlink) nc *= 2;
+                LineLink *nd = xrealloc(dst->links, sizeof(LineLink) * (size_t)nc);
+                if (!nd) return 0;
+                dst->links = nd;
+                dst->links_cap = nc;
+            }
+            memcpy(dst->links + dst->nlinks, src->links + r.link0, sizeof(LineLink) * (size_t)r.nlink);
+            r.link0 = dst->nlinks;
+            dst->nlinks += r.nlink;
+            dst->links_live += r.nlink;
+        }
+        dst->n++;
+        *L_row(dst, dst->n - 1) = r;
+    }
+    return 1;
+}
+
 /* ── ANSI-aware visible length ─────────────────────────────────────────── */
 
 static int vlen(const char *s) {
@@ -2259,29 +3297,83 @@ static int vlen(const char *s) {
     return n;
 }
 
+/* Push a line that wraps at the terminal width.  Its row count is left to
+ * the wrap index, so a resize only has to rebuild that. */
 static void L_pushw(Lines *l, const char *s) {
-    L_push(l, s);
-    int v = vlen(s);
-    if (v > g_cols) {
-        int extra = (v + g_cols - 1) / g_cols - 1;
-        for (int i = 0; i < extra; i++) L_push(l, WRAP_PLACEHOLDER);
-    }
+    if (!s) return;
+    L_push_row(l, s, 1);
 }
 
-static int normalize_off_visual(const Lines *l, int off, int dir) {
-    if (!l || l->n <= 0) return 0;
-    if (off < 0) off = 0;
-    if (off >= l->n) off = l->n - 1;
-    if (!line_is_wrap_placeholder(l->d[off])) return off;
+/* ── Wrap index ────────────────────────────────────────────────────────── */
 
-    if (dir >= 0) {
-        while (off < l->n && line_is_wrap_placeholder(l->d[off])) off++;
-        if (off >= l->n) off = l->n - 1;
-        while (off > 0 && line_is_wrap_placeholder(l->d[off])) off--;
-    } else {
-        while (off > 0 && line_is_wrap_placeholder(l->d[off])) off--;
+/* Screen rows line i takes at the current width. */
+static int L_line_rows(const Lines *l, int i) {
+    const LineRow *r = L_row(l, i);
+    if (!r->fold || g_cols <= 0 || r->width <= g_cols) return 1;
+    return (r->width + g_cols - 1) / g_cols;
+}
+
+/* Screen rows above line i (0 <= i <= n).  The prefix sums are rebuilt when
+ * the width changes or head rows go away, and extended as lines are pushed. */
+static int L_vrow(Lines *l, int i) {
+    if (i <= 0) return 0;
+    if (i > l->n) i = l->n;
+    if (l->vrow_cols != g_cols) {
+        l->vrow_cols = g_cols;
+        l->vrow_n = 0;
+    }
+    if (l->vrow_n <= i) {
+        if (l->vrow_cap < l->n + 1) {
+            int nc = l->vrow_cap ? l->vrow_cap : 256;
+            while (nc < l->n + 1) nc *= 2;
+            int *nv = xrealloc(l->vrow, sizeof(int) * (size_t)nc);
+            if (!nv) return i;
+            l->vrow = nv;
+            l->vrow_cap = nc;
+        }
+        if (l->vrow_n < 1) { l->vrow[0] = 0; l->vrow_n = 1; }
+        for (int k = l->vrow_n; k <= l->n; k++) l->vrow[k] = l->vrow[k - 1] + L_line_rows(l, k - 1);
+        l->vrow_n = l->n + 1;
+    }
+    return l->vrow[i];
+}
+
+/* The line shown at screen row v.  A row inside a wrapped line resolves to
+ * that line when moving back and to the next one when moving forward. */
+static int L_line_at_vrow(Lines *l, int v, int dir) {
+    if (l->n <= 0 || v <= 0) return 0;
+    int lo = 0, hi = l->n - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (L_vrow(l, mid) <= v) lo = mid;
+        else hi = mid - 1;
     }
-    return off;
+    if (dir >= 0 && L_vrow(l, lo) < v && lo + 1 < l->n) lo++;
+    return lo;
+}
+
+/* The line under screen row `row` when line `off` is drawn at row `top`,
+ * or -1 past either end. */
+static int L_line_at_row(Lines *l, int off, int top, int row) {
+    if (row < top) return -1;
+    int v = L_vrow(l, off) + (row - top);
+    if (v >= L_vrow(l, l->n)) return -1;
+    return L_line_at_vrow(l, v, -1);
+}
+
+/* Move the top line by `delta` screen rows. */
+static int L_scroll(Lines *l, int off, int delta) {
+    int total = L_vrow(l, l->n);
+    int v = L_vrow(l, off) + delta;
+    if (v > total - 1) v = total - 1;
+    if (v < 0) v = 0;
+    return L_line_at_vrow(l, v, delta);
+}
+
+/* Top line that puts the last line on the bottom of `rows` screen rows. */
+static int L_bottom_off(Lines *l, int rows) {
+    int v = L_vrow(l, l->n) - rows;
+    return L_line_at_vrow(l, v > 0 ? v : 0, -1);
 }
 
 /* ── OSC-8 linkification ──────────────────────────────────────────────── */
@@ -2346,6 +3438,23 @@ static int uri_path_is_safe(const char *path, int plen);
 static void uri_encode_path(char *dst, int dstmax, const char *src, int srclen);
 static int expand_path_to_abs(char *dst, int dstmax, const char *path, int plen);
 
+/* The same few paths come up in row after row of a session, so targets
+ * that need expanding or encoding are remembered in a small direct-mapped
+ * table keyed by the path as written.  Rendering only happens on the worker,
+ * so like the other render caches it is a plain global.  Longer paths are
+ * built every time. */
+#define URI_MEMO_SLOTS 64
+#define URI_MEMO_PATH  192
+#define URI_MEMO_URI   576
+
+typedef struct {
+    int plen;                   /* 0 = empty */
+    char path[URI_MEMO_PATH];
+    char uri[URI_MEMO_URI];
+} UriMemo;
+
+static UriMemo g_uri_memo[URI_MEMO_SLOTS];
+
 static int build_file_uri_target(char *dst, int dstmax, const char *path, int plen) {
     if (!dst || dstmax < 16 || !path || plen <= 0) return 0;
     if (!allow_remote_file_links()) return 0;
@@ -2355,6 +3464,16 @@ static int build_file_uri_target(char *dst, int dstmax, const char *path, int pl
         return (n > 0 && n < dstmax) ? 1 : 0;
     }
 
+    UriMemo *m = NULL;
+    if (plen < URI_MEMO_PATH) {
+        m = &g_uri_memo[queue_hash_update(1469598103934665603ULL, (const unsigned char *)path, (size_t)plen) &
+                        (URI_MEMO_SLOTS - 1)];
+        if (m->plen == plen && memcmp(m->path, path, (size_t)plen) == 0) {
+            int n = snprintf(dst, (size_t)dstmax, "%s", m->uri);
+            return (n > 0 && n < dstmax) ? 1 : 0;
+        }
+    }
+
     char abs_path[8192];
     int alen = expand_path_to_abs(abs_path, sizeof(abs_path), path, plen);
     if (alen <= 0) return 0;
@@ -2362,7 +3481,13 @@ static int build_file_uri_target(char *dst, int dstmax, const char *path, int pl
     char enc[16384];
     uri_encode_path(enc, sizeof(enc), abs_path, alen);
     int n = snprintf(dst, (size_t)dstmax, "file://%s", enc);
-    return (n > 0 && n < dstmax) ? 1 : 0;
+    if (n <= 0 || n >= dstmax) return 0;
+    if (m && n < URI_MEMO_URI) {
+        memcpy(m->path, path, (size_t)plen);
+        memcpy(m->uri, dst, (size_t)n + 1);
+        m->plen = plen;
+    }
+    return 1;
 }
 
 static int uri_is_unreserved(unsigned char c) {
@@ -2530,7 +3655,7 @@ static void shorten_path(char *dst, int dstmax, const char *path, int plen) {
 static void linkify(char *dst, int dstmax, const char *src) {
     int o = 0;
     const char *p = src;
-    int compact_labels = !(looks_like_table_row(src) || looks_like_tool_header_row(src));
+    int compact_labels = -1;    /* decided at the first link */
     int in_osc8_label = 0;
 
     #define LF_CH(ch)  do { if (o < dstmax-1) dst[o++] = (ch); } while(0)
@@ -2583,6 +3708,7 @@ static void linkify(char *dst, int dstmax, const char *src) {
             int ulen = (int)(p - start);
             if (ulen > 10 && o + ulen + 200 < dstmax) {
                 char label[256];
+                if (compact_labels < 0) compact_labels = !(looks_like_table_row(src) || looks_like_tool_header_row(src));
                 if (compact_labels) {
                     shorten_url(label, sizeof(label), start, ulen);
                 } else {
@@ -2633,6 +3759,7 @@ static void linkify(char *dst, int dstmax, const char *src) {
                 p = sp;
                 if (o + fplen + 512 < dstmax) {
                     char label[256];
+                    if (compact_labels < 0) compact_labels = !(looks_like_table_row(src) || looks_like_tool_header_row(src));
                     if (compact_labels) {
                         shorten_path(label, sizeof(label), start, fplen);
                     } else {
@@ -2670,13 +3797,22 @@ static void linkify(char *dst, int dstmax, const char *src) {
     #undef LF_S
 }
 
+/* Can linkify() change s?  Every URL and path it links has a '/' at the
+ * start of the row, after a lead boundary, or after a "~" that is (the
+ * "//" of a URL follows ':'), so rows with no such '/' are pushed as they
+ * are.  memchr only stops at slashes; most tool output has few. */
+static int linkify_candidate(const char *s) {
+    size_t n = strlen(s);
+    for (const char *p = s; (p = memchr(p, '/', n - (size_t)(p - s))) != NULL; p++) {
+        if (p == s || is_path_lead_boundary((unsigned char)p[-1])) return 1;
+        if (p[-1] == '~' && (p - 1 == s || is_path_lead_boundary((unsigned char)p[-2]))) return 1;
+    }
+    return 0;
+}
+
 static void L_pushw_link(Lines *l, const char *s) {
     if (!s) { L_pushw(l, ""); return; }
-    if (!strstr(s, "http://") &&
-        !strstr(s, "https://") &&
-        !strstr(s, "~/") &&
-        !strstr(s, "/") &&
-        !strstr(s, "\033]8;;")) {
+    if (!linkify_candidate(s)) {
         L_pushw(l, s);
         return;
     }
@@ -2685,19 +3821,100 @@ static void L_pushw_link(Lines *l, const char *s) {
     L_pushw(l, lb);
 }
 
+/* ── Link URI table ───────────────────────────────────────────────────── */
+
+/* URIs met while rendering, interned so rows and the per-frame link map
+ * share a single copy and compare by pointer.  Entries live until the pager
+ * exits.  The render worker interns while the UI thread looks up, so access
+ * goes through g_uris_mu. */
+typedef struct {
+    char **d;
+    int n, cap;
+    int *slot;          /* open addressing, index + 1, 0 = empty */
+    int nslot;
+} UriTab;
+
+static UriTab g_uris = {0};
+static pthread_mutex_t g_uris_mu = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *uri_lookup_locked(const char *s, size_t n, int add) {
+    unsigned long long h = queue_hash_update(1469598103934665603ULL, (const unsigned char *)s, n);
+    if (g_uris.nslot > 0) {
+        for (int k = (int)(h & (unsigned long long)(g_uris.nslot - 1)); g_uris.slot[k];
+             k = (k + 1) & (g_uris.nslot - 1)) {
+            const char *u = g_uris.d[g_uris.slot[k] - 1];
+            if (strncmp(u, s, n) == 0 && u[n] == '\0') return u;
+        }
+    }
+    if (!add) return NULL;
+    if ((g_uris.n + 1) * 2 > g_uris.nslot) {
+        int ns = g_uris.nslot ? g_uris.nslot * 2 : 256;
+        int *nsl = calloc((size_t)ns, sizeof(int));
+        if (!nsl) { g_oom = 1; return NULL; }
+        for (int i = 0; i < g_uris.n; i++) {
+            const char *u = g_uris.d[i];
+            unsigned long long uh = queue_hash_update(1469598103934665603ULL,
+                                                      (const unsigned char *)u, strlen(u));
+            int k = (int)(uh & (unsigned long long)(ns - 1));
+            while (nsl[k]) k = (k + 1) & (ns - 1);
+            nsl[k] = i + 1;
+        }
+        free(g_uris.slot);
+        g_uris.slot = nsl;
+        g_uris.nslot = ns;
+    }
+    if (g_uris.n >= g_uris.cap) {
+        int nc = g_uris.cap ? g_uris.cap * 2 : 128;
+        char **nd = xrealloc(g_uris.d, sizeof(char *) * (size_t)nc);
+        if (!nd) return NULL;
+        g_uris.d = nd;
+        g_uris.cap = nc;
+    }
+    char *cp = xmalloc(n + 1);
+    if (!cp) return NULL;
+    memcpy(cp, s, n);
+    cp[n] = '\0';
+    int k = (int)(h & (unsigned long long)(g_uris.nslot - 1));
+    while (g_uris.slot[k]) k = (k + 1) & (g_uris.nslot - 1);
+    g_uris.d[g_uris.n++] = cp;
+    g_uris.slot[k] = g_uris.n;
+    return cp;
+}
+
+static const char *uri_lookup_n(const char *s, size_t n, int add) {
+    if (!s || !n) return NULL;
+    pthread_mutex_lock(&g_uris_mu);
+    const char *u = uri_lookup_locked(s, n, add);
+    pthread_mutex_unlock(&g_uris_mu);
+    return u;
+}
+
+static const char *uri_intern(const char *s) {
+    return s ? uri_lookup_n(s, strlen(s), 1) : NULL;
+}
+
+static void uri_tab_free(void) {
+    for (int i = 0; i < g_uris.n; i++) free(g_uris.d[i]);
+    free(g_uris.d);
+    free(g_uris.slot);
+    memset(&g_uris, 0, sizeof(g_uris));
+}
+
+/* ── Link map ─────────────────────────────────────────────────────────── */
+
 static void link_map_clear(void) {
-    for (int i = 0; i < g_link_map.n; i++) free(g_link_map.d[i].uri);
     free(g_link_map.d);
     g_link_map.d = NULL;
     g_link_map.n = 0;
     g_link_map.cap = 0;
 }
 
+/* Spans arrive in screen-row order, which link_map_hit() relies on. */
 static void link_map_add(int row, int x0, int x1, const char *uri) {
     if (!uri || !*uri || row <= 0 || x0 <= 0 || x1 < x0) return;
     if (g_link_map.n > 0) {
         LinkSpan *last = &g_link_map.d[g_link_map.n - 1];
-        if (last->row == row && last->x1 + 1 == x0 && strcmp(last->uri, uri) == 0) {
+        if (last->row == row && last->x1 + 1 == x0 && last->uri == uri) {
             last->x1 = x1;
             return;
         }
@@ -2712,18 +3929,24 @@ static void link_map_add(int row, int x0, int x1, const char *uri) {
     g_link_map.d[g_link_map.n].row = row;
     g_link_map.d[g_link_map.n].x0 = x0;
     g_link_map.d[g_link_map.n].x1 = x1;
-    g_link_map.d[g_link_map.n].uri = strdup(uri);
-    if (!g_link_map.d[g_link_map.n].uri) return;
+    g_link_map.d[g_link_map.n].uri = uri;
     g_link_map.n++;
 }
 
-static int link_map_track_line(const char *s, int start_row) {
-    if (!s || start_row <= 0) return 0;
-    int row = start_row;
+typedef void (*LinkRunFn)(void *ctx, int dy, int x0, int x1, const char *uri);
+
+/* Walk a rendered row the way the terminal lays it out at `cols` (no wrapping
+ * when cols <= 0) and report each run of cells under one OSC-8 target.
+ * Returns the screen rows used. */
+static int link_scan_line(const char *s, int cols, LinkRunFn fn, void *ctx) {
+    if (!s) return 0;
+    int row = 0;
     int col = 1;
     char active_uri[8192] = "";
-    int active = 0;
+    const char *active = NULL;
+    int run_dy = 0, run_x0 = 0, run_x1 = -1;
     int slen = (int)strlen(s);
+    #define LINK_RUN_END() do { if (run_x1 >= run_x0 && active) fn(ctx, run_dy, run_x0, run_x1, active); run_x1 = -1; } while (0)
 
     for (int i = 0; s[i]; ) {
         unsigned char c = (unsigned char)s[i];
@@ -2734,6 +3957,7 @@ static int link_map_track_line(const char *s, int start_row) {
             continue;
         }
         if (c == 0x1b && s[i + 1] == ']' && s[i + 2] == '8' && s[i + 3] == ';') {
+            LINK_RUN_END();
             i += 4;
             int sep = 0;
             while (s[i]) {
@@ -2742,7 +3966,7 @@ static int link_map_track_line(const char *s, int start_row) {
                 if (s[i] == 0x1b && s[i + 1] == '\\') { i += 2; break; }
                 i++;
             }
-            if (!sep) { active = 0; active_uri[0] = '\0'; continue; }
+            if (!sep) { active = NULL; active_uri[0] = '\0'; continue; }
             int o = 0;
             while (s[i]) {
                 if (s[i] == '\a') { i++; break; }
@@ -2751,7 +3975,7 @@ static int link_map_track_line(const char *s, int start_row) {
                 i++;
             }
             active_uri[o] = '\0';
-            active = (active_uri[0] != '\0');
+            active = active_uri[0] ? active_uri : NULL;
             continue;
         }
         if (c == 0x1b && s[i + 1] == ']') {
@@ -2768,24 +3992,84 @@ static int link_map_track_line(const char *s, int start_row) {
             continue;
         }
 
-        if (col > g_cols) {
+        if (cols > 0 && col > cols) {
+            LINK_RUN_END();
             row++;
             col = 1;
         }
 
         int next = input_next_boundary(s, slen, i);
-        if (active) link_map_add(row, col, col, active_uri);
+        if (active) {
+            if (run_x1 < run_x0) { run_dy = row; run_x0 = col; }
+            run_x1 = col;
+        }
         col++;
         i = next;
     }
+    LINK_RUN_END();
+    #undef LINK_RUN_END
+    return row + 1;
+}
+
+static void L_link_run(void *ctx, int dy, int x0, int x1, const char *uri) {
+    (void)dy;
+    Lines *l = ctx;
+    const char *u = uri_intern(uri);
+    if (!u) return;
+    if (l->nlinks >= l->links_cap) {
+        int nc = l->links_cap ? l->links_cap * 2 : 64;
+        LineLink *nd = xrealloc(l->links, sizeof(LineLink) * (size_t)nc);
+        if (!nd) return;
+        l->links = nd;
+        l->links_cap = nc;
+    }
+    l->links[l->nlinks++] = (LineLink){x0, x1, u};
+}
+
+/* Measure a pushed row's link spans once, so drawing never rescans it. */
+static void L_add_links(Lines *l, LineRow *r, const char *s) {
+    if (!strstr(s, "\033]8;")) return;
+    r->link0 = l->nlinks;
+    link_scan_line(s, 0, L_link_run, l);
+    r->nlink = l->nlinks - r->link0;
+    l->links_live += r->nlink;
+}
+
+/* Replay a line's cached spans into the frame's link map, split into one
+ * run per screen row at the current width. */
+static void L_track_links(const Lines *l, int i, int start_row) {
+    const LineRow *r = L_row(l, i);
+    int cols = g_cols > 0 ? g_cols : INT_MAX;
+    for (int k = 0; k < r->nlink; k++) {
+        const LineLink *lk = &l->links[r->link0 + k];
+        for (int x = lk->x0; x <= lk->x1; ) {
+            int dy = (x - 1) / cols;
+            int x1 = (dy + 1) * cols;
+            if (x1 > lk->x1) x1 = lk->x1;
+            link_map_add(start_row + dy, x - dy * cols, x1 - dy * cols, lk->uri);
+            x = x1 + 1;
+        }
+    }
+}
 
-    return row - start_row + 1;
+static int L_row_has_link(const Lines *l, int i, const char *uri) {
+    const LineRow *r = L_row(l, i);
+    for (int k = 0; k < r->nlink; k++) {
+        if (l->links[r->link0 + k].uri == uri) return 1;
+    }
+    return 0;
 }
 
 static const char *link_map_hit(int row, int x) {
-    for (int i = 0; i < g_link_map.n; i++) {
+    int lo = 0, hi = g_link_map.n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (g_link_map.d[mid].row < row) lo = mid + 1;
+        else hi = mid;
+    }
+    for (int i = lo; i < g_link_map.n && g_link_map.d[i].row == row; i++) {
         LinkSpan *sp = &g_link_map.d[i];
-        if (sp->row == row && x >= sp->x0 && x <= sp->x1) return sp->uri;
+        if (x >= sp->x0 && x <= sp->x1) return sp->uri;
     }
     return NULL;
 }
@@ -2843,7 +4127,7 @@ static void draw_hover_footer_uri(void) {
 }
 
 static void emit_line_with_hover(const char *s, int start_row) {
-    if (!s || !*s || !g_hover_uri[0] || g_hover_row < start_row) { ob(s ? s : ""); return; }
+    if (!s || !*s || !g_hover_uri[0] || g_hover_row < start_row) { if (s) ob_ref(s, (int)strlen(s)); return; }
 
     int row = start_row;
     int col = 1;
@@ -2859,7 +4143,7 @@ static void emit_line_with_hover(const char *s, int start_row) {
             int j = i + 2;
             while (s[j] && !isalpha((unsigned char)s[j]) && s[j] != '~') j++;
             if (s[j]) j++;
-            ob_raw(s + i, j - i);
+            ob_ref(s + i, j - i);
             i = j;
             continue;
         }
@@ -2876,7 +4160,7 @@ static void emit_line_with_hover(const char *s, int start_row) {
             if (!sep) {
                 active_uri[0] = '\0';
                 active_hover = 0;
-                ob_raw(s + i, j - i);
+                ob_ref(s + i, j - i);
                 i = j;
                 continue;
             }
@@ -2894,7 +4178,7 @@ static void emit_line_with_hover(const char *s, int start_row) {
                 if (s[j] == 0x1b && s[j + 1] == '\\') { j += 2; break; }
                 j++;
             }
-            ob_raw(s + i, j - i);
+            ob_ref(s + i, j - i);
             i = j;
             continue;
         }
@@ -2906,14 +4190,14 @@ static void emit_line_with_hover(const char *s, int start_row) {
                 if (s[j] == 0x1b && s[j + 1] == '\\') { j += 2; break; }
                 j++;
             }
-            ob_raw(s + i, j - i);
+            ob_ref(s + i, j - i);
             i = j;
             continue;
         }
 
         if (c == 0x1b) {
             int j = i + (s[i + 1] ? 2 : 1);
-            ob_raw(s + i, j - i);
+            ob_ref(s + i, j - i);
             i = j;
             continue;
         }
@@ -2931,7 +4215,7 @@ static void emit_line_with_hover(const char *s, int start_row) {
         }
 
         int next = input_next_boundary(s, slen, i);
-        ob_raw(s + i, next - i);
+        ob_ref(s + i, next - i);
         col++;
         i = next;
     }
@@ -2954,9 +4238,37 @@ static void open_uri_async(const char *uri) {
 
 /* ── Transcript items ──────────────────────────────────────────────────── */
 
-enum { IT_HUM, IT_AST, IT_TU, IT_TR };
-typedef struct { int type; char *text; char *label; int is_err; } Item;
-typedef struct { Item *d; int n, cap; } Items;
+enum { IT_HUM, IT_AST, IT_TU, IT_TR, IT_AGENT };
+/* Where an item's text comes from.  Owned text lives in `text`; the others
+ * are views of a JSON value in the mapped transcript, decoded on demand by
+ * item_text() and dropped again after rendering.  SRC_PATCH is a
+ * toolUseResult object whose structuredPatch becomes the diff payload. */
+enum { SRC_OWNED, SRC_JSTR, SRC_JBLOCKS, SRC_PATCH };
+
+/* Read-only mapping of a transcript.  The reservation extends at least one
+ * zero-filled page past the file so the NUL-terminated JSON scanner always
+ * stops inside it. */
+typedef struct {
+    int fd;
+    char *base;
+    size_t len;         /* file bytes covered by the mapping */
+    size_t span;        /* whole reservation, guard included */
+} TranscriptMap;
+
+typedef struct {
+    int type; char *text; char *label; int is_err;
+    int line0;          /* first Lines row (counting dropped rows) it rendered to */
+    int src;            /* SRC_* */
+    size_t src_off;     /* offset of the JSON value for view-backed text */
+    size_t src_len;     /* and its length, 0 until known */
+    const TranscriptMap *map;   /* transcript it came from */
+} Item;
+typedef struct {
+    Item *d; int n, cap;
+    int dirty;          /* an already-pushed item was rewritten in place ... */
+    int dirty_from;     /* ... and this is the lowest such index */
+    const TranscriptMap *map;   /* transcript new items come from */
+} Items;
 
 static void I_push(Items *it, int type, char *text, char *label, int err) {
     if (!it || g_oom) {
@@ -2977,11 +4289,35 @@ static void I_push(Items *it, int type, char *text, char *label, int err) {
     }
     Item *e = &it->d[it->n++];
     e->type = type; e->text = text; e->label = label; e->is_err = err;
+    e->line0 = 0;
+    e->src = SRC_OWNED;
+    e->src_off = 0;
+    e->src_len = 0;
+    e->map = it->map;
+}
+
+/* Push an item whose text stays in the transcript until it is rendered.
+ * `end`, when the parser already knows it, is just past the value. */
+static void I_push_view(Items *it, int type, int src, const char *val, const char *end, int err) {
+    if (!it || !it->map || !val) return;
+    int n = it->n;
+    I_push(it, type, NULL, NULL, err);
+    if (it->n == n) return;
+    it->d[n].src = src;
+    it->d[n].src_off = (size_t)(val - it->map->base);
+    it->d[n].src_len = end > val ? (size_t)(end - val) : 0;
+}
+
+static void I_mark_dirty(Items *it, int idx) {
+    if (!it->dirty || idx < it->dirty_from) it->dirty_from = idx;
+    it->dirty = 1;
 }
 
 static void I_free(Items *it) {
+    const TranscriptMap *map = it->map;
     for (int i=0; i<it->n; i++) { free(it->d[i].text); free(it->d[i].label); }
     free(it->d); memset(it, 0, sizeof(*it));
+    it->map = map;
 }
 
 static void skip_st_terminated(const char *s, int len, int *idx, int allow_bel) {
@@ -3081,16 +4417,52 @@ static const char *sanitize_line_view(const char *src, int slen, char *buf, int
     return buf;
 }
 
-static int is_systag(const char *s) {
-    return strstr(s,"<local-command-caveat") || strstr(s,"<command-name") ||
-           strstr(s,"<system-reminder") || strstr(s,"<user-prompt-submit-hook");
+static const char *mem_find(const char *hay, size_t n, const char *needle, size_t m) {
+    if (m == 0) return hay;
+    while (n >= m) {
+        const char *c = memchr(hay, needle[0], n - m + 1);
+        if (!c) return NULL;
+        if (memcmp(c, needle, m) == 0) return c;
+        n -= (size_t)(c - hay) + 1;
+        hay = c + 1;
+    }
+    return NULL;
 }
 
-static const char *lbl_keys[] = {
-    "command","file_path","path","pattern","query","url","content","description",NULL
-};
+/* The markers are plain ASCII, so matching the raw JSON span is equivalent
+ * to matching the decoded text. */
+static int is_systag_span(const char *s, size_t n) {
+    static const char *tags[] = {
+        "<local-command-caveat", "<command-name", "<system-reminder", "<user-prompt-submit-hook", NULL
+    };
+    for (int i = 0; tags[i]; i++) {
+        if (mem_find(s, n, tags[i], strlen(tags[i]))) return 1;
+    }
+    return 0;
+}
 
-/* Extract trimmed, sanitized string from JSON value at p */
+/* True when a JSON string decodes to nothing but the spaces and newlines
+ * extract_text() trims, i.e. it would not produce an item. */
+static int jstr_blank(const char *p) {
+    if (!p || *p != '"') return 1;
+    for (p++; *p && *p != '"'; ) {
+        if (*p == ' ') { p++; continue; }
+        if (*p != '\\') return 0;
+        if (p[1] == 'n' || p[1] == 'r') { p += 2; continue; }
+        if (p[1] == 'u' && (strncmp(p + 2, "0020", 4) == 0 || strncasecmp(p + 2, "000a", 4) == 0)) {
+            p += 6;
+            continue;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static const char *lbl_keys[] = {
+    "command","file_path","path","pattern","query","url","content","description",NULL
+};
+
+/* Extract trimmed, sanitized string from JSON value at p */
 static char *extract_text(const char *p, int bufmax, int sanitize_out) {
     if (!p || *p != '"') return NULL;
     if (bufmax < 4) return NULL;
@@ -3199,13 +4571,47 @@ static void sb_free(SBuf *b) {
     b->cap = 0;
 }
 
-static char *build_structured_patch_payload(const char *tool_use_result,
+/* Append the perf counters as one JSON line; see PERF_NSTATS. */
+static void perf_dump(const char *transcript) {
+    if (!g_bench_mode) return;
+    const char *path = getenv("CLAUDE_PAGER_BENCH_OUT");
+    if (!path || !*path) path = "/tmp/claude-pager-perf.jsonl";
+    SBuf b;
+    sb_init(&b);
+    struct stat tsb;
+    long long tbytes = transcript && stat(transcript, &tsb) == 0 ? (long long)tsb.st_size : 0;
+    sb_printf(&b, "{\"ts_us\":%lld,\"pid\":%d,\"transcript_bytes\":%lld", now_us(), (int)getpid(), tbytes);
+    for (int i = 0; i < PERF_NSTATS; i++) {
+        const PerfStat *st = &g_perf[i];
+        sb_printf(&b, ",\"%s\":{\"n\":%lld,\"sum\":%lld,\"min\":%lld,\"max\":%lld,"
+                      "\"p50\":%lld,\"p95\":%lld,\"p99\":%lld,\"hist\":[",
+                  perf_names[i], st->n, st->sum, st->min, st->max,
+                  perf_quantile(st, 0.50), perf_quantile(st, 0.95), perf_quantile(st, 0.99));
+        int first = 1;
+        for (int k = 0; k < PERF_BUCKETS; k++) {
+            if (!st->bucket[k]) continue;
+            sb_printf(&b, "%s[%lld,%lld]", first ? "" : ",", k == 0 ? 0 : (1LL << k) - 1, st->bucket[k]);
+            first = 0;
+        }
+        sb_puts(&b, "]}");
+    }
+    sb_puts(&b, "}\n");
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd >= 0 && b.d) {
+        (void)write_all(fd, b.d, (size_t)b.n);
+    }
+    if (fd >= 0) close(fd);
+    PDBG("bench perf dump path=%s ok=%d\n", path, fd >= 0 && !g_oom);
+    sb_free(&b);
+}
+
+static char *build_structured_patch_payload(const JObj *tool_use_result,
                                             int *out_add,
                                             int *out_del) {
     if (out_add) *out_add = 0;
     if (out_del) *out_del = 0;
     if (!tool_use_result) return NULL;
-    const char *sp = jfind(tool_use_result, "structuredPatch");
+    const char *sp = jobj_get(tool_use_result, "structuredPatch");
     if (!sp) return NULL;
     sp = jws(sp);
     if (*sp != '[') return NULL;
@@ -3215,7 +4621,7 @@ static char *build_structured_patch_payload(const char *tool_use_result,
     if (!sb_puts(&sb, "CP_SP1\n")) { sb_free(&sb); return NULL; }
 
     char file_path[4096] = "";
-    const char *fp = jfind(tool_use_result, "filePath");
+    const char *fp = jobj_get(tool_use_result, "filePath");
     if (fp && *fp == '"') jstr(fp, file_path, sizeof(file_path));
     if (file_path[0]) {
         if (!sb_puts(&sb, "F\t") ||
@@ -3230,17 +4636,19 @@ static char *build_structured_patch_payload(const char *tool_use_result,
     const char *el = jws(sp);
     if (*el == '[') el = jws(el + 1);
     while (el && *el && *el != ']') {
+        JObj po;
+        jobj_index(&po, el);
         if (*el == '{') {
-            int old_start = jint(jfind(el, "oldStart"));
-            int old_lines = jint(jfind(el, "oldLines"));
-            int new_start = jint(jfind(el, "newStart"));
-            int new_lines = jint(jfind(el, "newLines"));
+            int old_start = jint(jobj_get(&po, "oldStart"));
+            int old_lines = jint(jobj_get(&po, "oldLines"));
+            int new_start = jint(jobj_get(&po, "newStart"));
+            int new_lines = jint(jobj_get(&po, "newLines"));
             if (!sb_printf(&sb, "P\t%d\t%d\t%d\t%d\n", old_start, old_lines, new_start, new_lines)) {
                 sb_free(&sb);
                 return NULL;
             }
 
-            const char *lv = jfind(el, "lines");
+            const char *lv = jobj_get(&po, "lines");
             if (lv) lv = jws(lv);
             if (lv && *lv == '[') {
                 const char *lp = jws(lv);
@@ -3272,7 +4680,7 @@ static char *build_structured_patch_payload(const char *tool_use_result,
             }
             patch_count++;
         }
-        el = jskip(el);
+        el = jobj_skip(&po, el);
         el = jws(el);
         if (*el == ',') el = jws(el + 1);
     }
@@ -3286,18 +4694,18 @@ static char *build_structured_patch_payload(const char *tool_use_result,
     return sb_take(&sb);
 }
 
-static void extract_tool_use_result_meta(const char *tool_use_result,
+static void extract_tool_use_result_meta(const JObj *tool_use_result,
                                          char *kind, int kind_sz,
                                          char *file_path, int file_path_sz) {
     if (kind && kind_sz > 0) kind[0] = '\0';
     if (file_path && file_path_sz > 0) file_path[0] = '\0';
     if (!tool_use_result) return;
     if (kind && kind_sz > 0) {
-        const char *kv = jfind(tool_use_result, "type");
+        const char *kv = jobj_get(tool_use_result, "type");
         if (kv && *kv == '"') jstr(kv, kind, kind_sz);
     }
     if (file_path && file_path_sz > 0) {
-        const char *fp = jfind(tool_use_result, "filePath");
+        const char *fp = jobj_get(tool_use_result, "filePath");
         if (fp && *fp == '"') jstr(fp, file_path, file_path_sz);
     }
 }
@@ -3306,7 +4714,8 @@ static void relabel_last_tool_use(Items *items, const char *op_name, const char
     if (!items || items->n <= 0 || !op_name || !*op_name) return;
     for (int i = items->n - 1; i >= 0; i--) {
         Item *it = &items->d[i];
-        if (it->type != IT_TU) continue;
+        /* Merged subagents' tool calls interleave with this one's. */
+        if (it->type != IT_TU || it->map != items->map) continue;
         if (it->text && (strncmp(it->text, "Write", 5) == 0 ||
                          strncmp(it->text, "Edit", 4) == 0 ||
                          strncmp(it->text, "MultiEdit", 9) == 0 ||
@@ -3321,6 +4730,7 @@ static void relabel_last_tool_use(Items *items, const char *op_name, const char
                 free(it->label);
                 it->label = xstrdup("");
             }
+            I_mark_dirty(items, i);
         }
         break;
     }
@@ -3328,168 +4738,486 @@ static void relabel_last_tool_use(Items *items, const char *op_name, const char
 
 /* ── Transcript parser ─────────────────────────────────────────────────── */
 
-static void parse_transcript(const char *path, Items *items,
-                             int *out_tok, double *out_pct, int ctx_lim) {
-    FILE *f = fopen(path, "r");
-    if (!f) return;
+/* Join the "text" blocks of a tool_result content array, trimmed like
+ * extract_text().  The raw array length bounds the decoded size. */
+static char *join_text_blocks(const char *rc, int sanitize_out) {
+    rc = jws(rc);
+    int bmax = (int)(jskip(rc) - rc) + 1;
+    char *buf = xmalloc((size_t)bmax); int bi=0;
+    if (!buf) return NULL;
+    const char *sub = rc;
+    if (*sub=='[') sub=jws(sub+1);
+    while (sub && *sub && *sub!=']') {
+        if (*sub=='{' && jstreq(jfind(sub,"type"),"text")) {
+            const char *sv = jfind(sub,"text");
+            if (sv && *sv=='"') {
+                if (bi>0 && bi<bmax-1) buf[bi++]='\n';
+                bi += jstr(sv, buf+bi, bmax-bi);
+            }
+        }
+        sub=jskip(sub); sub=jws(sub); if(*sub==',') sub=jws(sub+1);
+    }
+    buf[bi]='\0';
+    char *s=buf; while(*s==' '||*s=='\n') s++;
+    char *e=s+strlen(s); while(e>s&&(e[-1]==' '||e[-1]=='\n')) e--; *e='\0';
+    char *text = NULL;
+    if (*s) { text = sanitize_out ? sanitize(s) : xstrdup(s); }
+    free(buf);
+    return text;
+}
 
-    char *line = NULL; size_t lsz = 0; ssize_t len;
-    int li = 0, lcc = 0, lcr = 0;
+static int jblocks_blank(const char *rc) {
+    const char *sub = jws(rc);
+    if (*sub=='[') sub=jws(sub+1);
+    while (sub && *sub && *sub!=']') {
+        if (*sub=='{' && jstreq(jfind(sub,"type"),"text") && !jstr_blank(jfind(sub,"text"))) return 0;
+        sub=jskip(sub); sub=jws(sub); if(*sub==',') sub=jws(sub+1);
+    }
+    return 1;
+}
 
-    while ((len = getline(&line, &lsz, f)) != -1) {
-        while (len>0 && (line[len-1]=='\n'||line[len-1]=='\r')) line[--len]='\0';
-        if (len == 0) continue;
+/* Text of an item, decoded from the mapped transcript on first use. */
+static const char *item_text(Item *it) {
+    if (it->text || it->src == SRC_OWNED) return it->text;
+    const TranscriptMap *m = it->map;
+    if (!m || !m->base || it->src_off >= m->len) return NULL;
+    const char *v = m->base + it->src_off;
+    int sanitize_out = g_perf_compat ? 1 : 0;
+    if (it->src == SRC_JSTR) {
+        it->text = extract_text(v, (int)(jskip_s(v) - v) + 1, sanitize_out);
+    } else if (it->src == SRC_PATCH) {
+        JObj to;
+        jobj_index(&to, v);
+        it->text = build_structured_patch_payload(&to, NULL, NULL);
+    } else {
+        it->text = join_text_blocks(v, sanitize_out);
+    }
+    return it->text;
+}
 
-        const char *tv = jfind(line, "type");
-        const char *msg = jfind(line, "message");
-        if (!tv || !msg) continue;
-        const char *ct = jfind(msg, "content");
-
-        if (jstreq(tv, "assistant")) {
-            const char *usg = jfind(msg, "usage");
-            if (usg) {
-                const char *v;
-                if ((v = jfind(usg, "input_tokens"))) li = jint(v);
-                if ((v = jfind(usg, "cache_creation_input_tokens"))) lcc = jint(v);
-                if ((v = jfind(usg, "cache_read_input_tokens"))) lcr = jint(v);
-            }
-            if (!ct || *jws(ct) != '[') continue;
-            const char *el = jws(ct);
-            if (*el=='[') el = jws(el+1);
-            while (el && *el && *el!=']') {
-                if (*el=='{') {
-                    const char *bt = jfind(el, "type");
-                    if (jstreq(bt, "text")) {
-                        char *t = extract_text(jfind(el, "text"), (int)len+1, g_perf_compat ? 1 : 0);
-                        if (t) I_push(items, IT_AST, t, NULL, 0);
-                    } else if (jstreq(bt, "tool_use")) {
-                        char nm[128] = "?";
-                        char nm_disp[1536] = "";
-                        const char *nv = jfind(el, "name");
-                        if (nv) jstr(nv, nm, sizeof(nm));
-                        snprintf(nm_disp, sizeof(nm_disp), "%s", nm);
-                        char lbl[256] = "";
-                        const char *inp = jfind(el, "input");
-                        if (inp) {
-                            for (int k=0; lbl_keys[k]; k++) {
-                                const char *lv = jfind(inp, lbl_keys[k]);
-                                if (lv && *lv=='"') { jstr(lv, lbl, sizeof(lbl)); break; }
-                            }
-                            if (!lbl[0]) {
-                                const char *p2 = jws(inp);
-                                if (*p2=='{') p2++;
-                                p2 = jws(p2);
-                                if (*p2=='"') { p2=jskip_s(p2); p2=jws(p2); if(*p2==':') p2=jws(p2+1); if(*p2=='"') jstr(p2,lbl,sizeof(lbl)); }
-                            }
+/* Drop decoded text again; the mapping can always reproduce it. */
+static void item_release_text(Item *it) {
+    if (it->src == SRC_OWNED) return;
+    free(it->text);
+    it->text = NULL;
+}
+
+/* Where parsing stopped in a transcript that is still being appended to.
+ * Claude writes whole JSONL records, so everything before `offset` has been
+ * consumed and a change only needs the bytes after it. */
+typedef struct {
+    int valid;              /* map.fd is open */
+    dev_t dev;
+    ino_t ino;
+    off_t offset;           /* just past the last complete record */
+    int li, lcc, lcr;       /* usage from the latest assistant record */
+    TranscriptMap map;
+} IngestCursor;
+
+enum { INGEST_NONE, INGEST_APPEND, INGEST_REBUILD };
+
+/* Parse one record.  `line` points into the mapping and is not terminated;
+ * the scanner stays inside a well-formed object, and anything that does not
+ * start like one is skipped so jws() cannot run on into the next record. */
+static void parse_transcript_line(const char *line, size_t len, Items *items, IngestCursor *cur) {
+    while (len > 0 && (line[0] == ' ' || line[0] == '\t')) { line++; len--; }
+    if (len == 0 || line[0] != '{') return;
+
+    /* Each object is indexed once; the lookups below only compare keys. */
+    JObj lo, mo;
+    jobj_index(&lo, line);
+    const char *tv = jobj_get(&lo, "type");
+    const char *msg = jobj_get(&lo, "message");
+    if (!tv || !msg) return;
+    jobj_index(&mo, msg);
+    const char *ct = jobj_get(&mo, "content");
+
+    if (jstreq(tv, "assistant")) {
+        const char *usg = jobj_get(&mo, "usage");
+        if (usg) {
+            JObj uo;
+            jobj_index(&uo, usg);
+            const char *v;
+            if ((v = jobj_get(&uo, "input_tokens"))) cur->li = jint(v);
+            if ((v = jobj_get(&uo, "cache_creation_input_tokens"))) cur->lcc = jint(v);
+            if ((v = jobj_get(&uo, "cache_read_input_tokens"))) cur->lcr = jint(v);
+        }
+        if (!ct || *jws(ct) != '[') return;
+        const char *el = jws(ct);
+        if (*el=='[') el = jws(el+1);
+        while (el && *el && *el!=']') {
+            JObj eo;
+            jobj_index(&eo, el);
+            if (*el=='{') {
+                const char *bt = jobj_get(&eo, "type");
+                if (jstreq(bt, "text")) {
+                    const char *tx_end;
+                    const char *tx = jobj_get_end(&eo, "text", &tx_end);
+                    if (!jstr_blank(tx)) I_push_view(items, IT_AST, SRC_JSTR, tx, tx_end, 0);
+                } else if (jstreq(bt, "tool_use")) {
+                    char nm[128] = "?";
+                    char nm_disp[1536] = "";
+                    const char *nv = jobj_get(&eo, "name");
+                    if (nv) jstr(nv, nm, sizeof(nm));
+                    snprintf(nm_disp, sizeof(nm_disp), "%s", nm);
+                    char lbl[256] = "";
+                    const char *inp = jobj_get(&eo, "input");
+                    JObj io;
+                    jobj_index(&io, inp);
+                    if (inp) {
+                        for (int k=0; lbl_keys[k]; k++) {
+                            const char *lv = jobj_get(&io, lbl_keys[k]);
+                            if (lv && *lv=='"') { jstr(lv, lbl, sizeof(lbl)); break; }
                         }
-                        if (strcasecmp(nm, "Read") == 0 && inp) {
-                            int lim = jint(jfind(inp, "limit"));
-                            if (lim > 0) {
-                                snprintf(nm_disp, sizeof(nm_disp), "Read %d lines", lim);
-                                lbl[0] = '\0';
-                            }
-                        } else if ((strcasecmp(nm, "Edit") == 0 || strcasecmp(nm, "MultiEdit") == 0) && inp) {
-                            char fpb[1200] = "";
-                            const char *fpv = jfind(inp, "file_path");
+                        if (!lbl[0] && io.n > 0 && *io.val[0]=='"') jstr(io.val[0], lbl, sizeof(lbl));
+                    }
+                    if (strcasecmp(nm, "Read") == 0 && inp) {
+                        int lim = jint(jobj_get(&io, "limit"));
+                        if (lim > 0) {
+                            snprintf(nm_disp, sizeof(nm_disp), "Read %d lines", lim);
+                            lbl[0] = '\0';
+                        }
+                    } else if ((strcasecmp(nm, "Edit") == 0 || strcasecmp(nm, "MultiEdit") == 0) && inp) {
+                        char fpb[1200] = "";
+                        const char *fpv = jobj_get(&io, "file_path");
+                        if (fpv && *fpv == '"') jstr(fpv, fpb, sizeof(fpb));
+                        if (!fpb[0]) {
+                            fpv = jobj_get(&io, "path");
                             if (fpv && *fpv == '"') jstr(fpv, fpb, sizeof(fpb));
-                            if (!fpb[0]) {
-                                fpv = jfind(inp, "path");
-                                if (fpv && *fpv == '"') jstr(fpv, fpb, sizeof(fpb));
-                            }
-                            if (fpb[0]) {
-                                snprintf(nm_disp, sizeof(nm_disp), "Update(%s)", fpb);
-                                lbl[0] = '\0';
-                            } else {
-                                snprintf(nm_disp, sizeof(nm_disp), "Update");
-                            }
                         }
-                        if (strlen(lbl)>72) { lbl[69]='.'; lbl[70]='.'; lbl[71]='.'; lbl[72]='\0'; }
-                        I_push(items, IT_TU, sanitize(nm_disp), sanitize(lbl), 0);
+                        if (fpb[0]) {
+                            snprintf(nm_disp, sizeof(nm_disp), "Update(%s)", fpb);
+                            lbl[0] = '\0';
+                        } else {
+                            snprintf(nm_disp, sizeof(nm_disp), "Update");
+                        }
                     }
+                    if (strlen(lbl)>72) { lbl[69]='.'; lbl[70]='.'; lbl[71]='.'; lbl[72]='\0'; }
+                    I_push(items, IT_TU, sanitize(nm_disp), sanitize(lbl), 0);
                 }
-                el = jskip(el); el = jws(el); if (*el==',') el=jws(el+1);
             }
-        } else if (jstreq(tv, "user")) {
-            if (ct && *jws(ct)=='"') {
-                char *t = extract_text(ct, (int)len+1, g_perf_compat ? 1 : 0);
-                if (t && !is_systag(t)) I_push(items, IT_HUM, t, NULL, 0);
-                else free(t);
-            } else if (ct && *jws(ct)=='[') {
-                const char *tur = jfind(line, "toolUseResult");
-                int sp_add = 0, sp_del = 0;
-                int sp_used = 0;
-                char *sp_payload = build_structured_patch_payload(tur, &sp_add, &sp_del);
-                char tur_kind[64] = "";
-                char tur_path[1200] = "";
-                extract_tool_use_result_meta(tur, tur_kind, sizeof(tur_kind), tur_path, sizeof(tur_path));
-                if (sp_payload) {
-                    if (strcasecmp(tur_kind, "create") == 0) {
-                        relabel_last_tool_use(items, "Create", tur_path);
-                    } else if (strcasecmp(tur_kind, "update") == 0 || strcasecmp(tur_kind, "edit") == 0) {
-                        relabel_last_tool_use(items, "Update", tur_path);
-                    } else if (tur_path[0]) {
-                        relabel_last_tool_use(items, "Update", tur_path);
-                    }
+            el = jobj_skip(&eo, el); el = jws(el); if (*el==',') el=jws(el+1);
+        }
+    } else if (jstreq(tv, "user")) {
+        if (ct && *jws(ct)=='"') {
+            const char *tx = jws(ct);
+            const char *tx_end = jskip_s(tx);
+            if (!jstr_blank(tx) && !is_systag_span(tx, (size_t)(tx_end - tx))) {
+                I_push_view(items, IT_HUM, SRC_JSTR, tx, tx_end, 0);
+            }
+        } else if (ct && *jws(ct)=='[') {
+            const char *tur_end;
+            const char *tur = jobj_get_end(&lo, "toolUseResult", &tur_end);
+            JObj to;
+            jobj_index(&to, tur);
+            const JObj *tro = tur ? &to : NULL;
+            int sp_add = 0, sp_del = 0;
+            int sp_used = 0;
+            char *sp_payload = build_structured_patch_payload(tro, &sp_add, &sp_del);
+            char tur_kind[64] = "";
+            char tur_path[1200] = "";
+            extract_tool_use_result_meta(tro, tur_kind, sizeof(tur_kind), tur_path, sizeof(tur_path));
+            if (sp_payload) {
+                if (strcasecmp(tur_kind, "create") == 0) {
+                    relabel_last_tool_use(items, "Create", tur_path);
+                } else if (strcasecmp(tur_kind, "update") == 0 || strcasecmp(tur_kind, "edit") == 0) {
+                    relabel_last_tool_use(items, "Update", tur_path);
+                } else if (tur_path[0]) {
+                    relabel_last_tool_use(items, "Update", tur_path);
                 }
-                const char *el = jws(ct);
-                if (*el=='[') el=jws(el+1);
-                while (el && *el && *el!=']') {
-                    if (*el=='{') {
-                        const char *bt = jfind(el, "type");
-                        if (jstreq(bt, "tool_result")) {
-                            const char *rc = jfind(el, "content");
-                            char *text = NULL;
-                            int ie = 0;
-                            int handled_struct_patch = 0;
-                            const char *ev = jfind(el, "is_error");
-                            if (ev && (*ev=='t'||*ev=='T')) ie=1;
-                            if (!ie && sp_payload && !sp_used) {
-                                char sbuf[128];
-                                snprintf(sbuf, sizeof(sbuf), "Added %d lines, removed %d lines", sp_add, sp_del);
-                                I_push(items, IT_TR, sanitize(sbuf), NULL, 0);
-                                I_push(items, IT_TR, sp_payload, NULL, 0);
-                                sp_payload = NULL;
-                                sp_used = 1;
-                                handled_struct_patch = 1;
-                            }
-                            if (!handled_struct_patch && rc && *jws(rc)=='"') {
-                                text = extract_text(rc, (int)len+1, g_perf_compat ? 1 : 0);
-                            } else if (!handled_struct_patch && rc && *jws(rc)=='[') {
-                                int bmax = (int)len+1;
-                                char *buf = xmalloc((size_t)bmax); int bi=0;
-                                if (!buf) break;
-                                const char *sub = jws(rc);
-                                if (*sub=='[') sub=jws(sub+1);
-                                while (sub && *sub && *sub!=']') {
-                                    if (*sub=='{' && jstreq(jfind(sub,"type"),"text")) {
-                                        const char *sv = jfind(sub,"text");
-                                        if (sv && *sv=='"') {
-                                            if (bi>0 && bi<bmax-1) buf[bi++]='\n';
-                                            bi += jstr(sv, buf+bi, bmax-bi);
-                                        }
-                                    }
-                                    sub=jskip(sub); sub=jws(sub); if(*sub==',') sub=jws(sub+1);
-                                }
-                                buf[bi]='\0';
-                                char *s=buf; while(*s==' '||*s=='\n') s++;
-                                char *e=s+strlen(s); while(e>s&&(e[-1]==' '||e[-1]=='\n')) e--; *e='\0';
-                                if (*s) { text = g_perf_compat ? sanitize(s) : xstrdup(s); }
-                                free(buf);
-                            }
-                            if (text) {
-                                I_push(items, IT_TR, text, NULL, ie);
-                            }
+            }
+            const char *el = jws(ct);
+            if (*el=='[') el=jws(el+1);
+            while (el && *el && *el!=']') {
+                JObj eo;
+                jobj_index(&eo, el);
+                if (*el=='{') {
+                    const char *bt = jobj_get(&eo, "type");
+                    if (jstreq(bt, "tool_result")) {
+                        const char *rc_end;
+                        const char *rc = jobj_get_end(&eo, "content", &rc_end);
+                        int ie = 0;
+                        int handled_struct_patch = 0;
+                        const char *ev = jobj_get(&eo, "is_error");
+                        if (ev && (*ev=='t'||*ev=='T')) ie=1;
+                        if (!ie && sp_payload && !sp_used) {
+                            char sbuf[128];
+                            snprintf(sbuf, sizeof(sbuf), "Added %d lines, removed %d lines", sp_add, sp_del);
+                            I_push(items, IT_TR, sanitize(sbuf), NULL, 0);
+                            /* The payload is rebuilt from the transcript
+                             * when the diff is drawn. */
+                            I_push_view(items, IT_TR, SRC_PATCH, jws(tur), tur_end, 0);
+                            sp_used = 1;
+                            handled_struct_patch = 1;
+                        }
+                        if (!handled_struct_patch && rc && *jws(rc)=='"') {
+                            if (!jstr_blank(jws(rc))) I_push_view(items, IT_TR, SRC_JSTR, jws(rc), rc_end, ie);
+                        } else if (!handled_struct_patch && rc && *jws(rc)=='[') {
+                            if (!jblocks_blank(rc)) I_push_view(items, IT_TR, SRC_JBLOCKS, jws(rc), rc_end, ie);
                         }
                     }
-                    el=jskip(el); el=jws(el); if(*el==',') el=jws(el+1);
                 }
-                if (sp_payload) free(sp_payload);
+                el=jobj_skip(&eo, el); el=jws(el); if(*el==',') el=jws(el+1);
             }
+            if (sp_payload) free(sp_payload);
         }
     }
-    free(line); fclose(f);
-    int tot = li + lcc + lcr;
-    if (tot > 0) { *out_tok = tot; *out_pct = (double)tot / ctx_lim * 100.0; }
+}
+
+static void ingest_usage(const IngestCursor *cur, int ctx_lim, int *out_tok, double *out_pct) {
+    int tot = cur->li + cur->lcc + cur->lcr;
+    *out_tok = 0; *out_pct = 0;
+    if (tot > 0 && ctx_lim > 0) { *out_tok = tot; *out_pct = (double)tot / ctx_lim * 100.0; }
+}
+
+static void ingest_close(IngestCursor *cur) {
+    if (cur->valid) {
+        if (cur->map.base) munmap(cur->map.base, cur->map.span);
+        close(cur->map.fd);
+    }
+    memset(cur, 0, sizeof(*cur));
+}
+
+/* Grow the mapping to cover `size` bytes.  A fresh zero reservation is made
+ * one page larger than the file and the file is mapped over its start. */
+static int map_extend(TranscriptMap *m, size_t size) {
+    if (size <= m->len) return 0;
+    long pg = sysconf(_SC_PAGESIZE);
+    if (pg <= 0) pg = 4096;
+    size_t span = ((size + (size_t)pg - 1) / (size_t)pg + 1) * (size_t)pg;
+    void *res = mmap(NULL, span, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (res == MAP_FAILED) return -1;
+    if (mmap(res, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, m->fd, 0) == MAP_FAILED) {
+        munmap(res, span);
+        return -1;
+    }
+    if (m->base) munmap(m->base, m->span);
+    m->base = res;
+    m->len = size;
+    m->span = span;
+    return 0;
+}
+
+/* Open the transcript at the cursor, or check that it is still the file
+ * the cursor read, and map what it holds now.  A different inode, a file
+ * shorter than the cursor, or a cursor that no longer sits just past a
+ * newline means the transcript was replaced or rewritten: `items` (when
+ * given) are dropped and the cursor starts over (INGEST_REBUILD).  The
+ * shrink check runs before the old mapping is touched, since pages past a
+ * truncated end would fault. */
+static int ingest_begin(const char *path, Items *items, IngestCursor *cur) {
+    struct stat sb;
+    if (stat(path, &sb) != 0) return INGEST_NONE;
+
+    if (cur->valid &&
+        (cur->dev != sb.st_dev || cur->ino != sb.st_ino || sb.st_size < cur->offset)) {
+        if (items) I_free(items);
+        ingest_close(cur);
+    }
+    if (cur->valid && cur->offset > 0) {
+        char last = 0;
+        if (pread(cur->map.fd, &last, 1, cur->offset - 1) != 1 || last != '\n') {
+            if (items) I_free(items);
+            ingest_close(cur);
+        }
+    }
+    int rc = INGEST_APPEND;
+    if (!cur->valid) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return INGEST_NONE;
+        if (fstat(fd, &sb) != 0) { close(fd); return INGEST_NONE; }
+        if (items) I_free(items);
+        cur->valid = 1;
+        cur->dev = sb.st_dev;
+        cur->ino = sb.st_ino;
+        cur->map.fd = fd;
+        rc = INGEST_REBUILD;
+    }
+    if (sb.st_size > cur->offset && map_extend(&cur->map, (size_t)sb.st_size) != 0) {
+        PDBG("transcript mmap failed size=%lld errno=%d\n", (long long)sb.st_size, errno);
+    }
+    return rc;
+}
+
+/* Read complete records appended since the cursor; see ingest_begin() for
+ * when the whole file is parsed again instead. */
+static int ingest_transcript(const char *path, Items *items, IngestCursor *cur) {
+    int rc = ingest_begin(path, items, cur);
+    if (rc == INGEST_NONE) return rc;
+    items->map = &cur->map;
+    off_t start = cur->offset;
+    if (cur->map.base && (size_t)start < cur->map.len) {
+        const char *base = cur->map.base;
+        const char *p = base + start, *end = base + cur->map.len;
+        while (p < end) {
+            /* A record without its newline is still being written; it is
+             * picked up from the same offset once it is complete. */
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            if (!nl) break;
+            parse_transcript_line(p, (size_t)(nl - p), items, cur);
+            p = nl + 1;
+        }
+        cur->offset = (off_t)(p - base);
+    }
+    if (rc == INGEST_APPEND && cur->offset == start) rc = INGEST_NONE;
+    return rc;
+}
+
+/* First-paint variant of ingest_transcript(): parse only the last `records`
+ * complete records.  *out_start receives where parsing began, 0 when the
+ * whole file was read. */
+static int ingest_transcript_tail(const char *path, Items *items, IngestCursor *cur,
+                                  int records, off_t *out_start) {
+    I_free(items);
+    ingest_close(cur);
+    *out_start = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return INGEST_NONE;
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) { close(fd); return INGEST_NONE; }
+    cur->valid = 1;
+    cur->dev = sb.st_dev;
+    cur->ino = sb.st_ino;
+    cur->map.fd = fd;
+    if (sb.st_size <= 0 || map_extend(&cur->map, (size_t)sb.st_size) != 0) return INGEST_NONE;
+
+    const char *base = cur->map.base;
+    size_t i = cur->map.len;
+    while (i > 0 && base[i - 1] != '\n') i--;      /* skip a record still being written */
+    int seen = 0;
+    while (i > 0) {
+        i--;
+        if (i > 0 && base[i - 1] == '\n' && ++seen >= records) break;
+    }
+    cur->offset = (off_t)i;
+    *out_start = cur->offset;
+    return ingest_transcript(path, items, cur);
+}
+
+/* ── Subagent transcripts ──────────────────────────────────────────────── */
+
+/* Subagents that Claude runs in parallel write their own transcripts next
+ * to the session's, under <session>/subagents/.  The render worker follows
+ * them along with the session (AgentSource) and merges their records into
+ * the one item list by timestamp; see ingest_merged(). */
+#define AGENTS_MAX 16
+#define MERGE_WINDOW 64     /* records buffered per transcript while merging */
+
+typedef struct {
+    char path[PATH_MAX];
+    char name[64];          /* file name without .jsonl, shown on its dividers */
+    IngestCursor cur;
+    FileStamp st;
+} AgentSource;
+
+/* The subagent directory of a "<dir>/<session>.jsonl" transcript, or ""
+ * when they are not followed (CLAUDE_PAGER_SUBAGENTS=0). */
+static void agents_dir_for(const char *transcript, char *out, size_t cap) {
+    size_t n = transcript ? strlen(transcript) : 0;
+    out[0] = '\0';
+    if (g_perf_compat || !env_enabled_default_on("CLAUDE_PAGER_SUBAGENTS")) return;
+    if (n <= 6 || strcmp(transcript + n - 6, ".jsonl") != 0) return;
+    int w = snprintf(out, cap, "%.*s/subagents", (int)(n - 6), transcript);
+    if (w < 0 || (size_t)w >= cap) out[0] = '\0';
+}
+
+/* A record's "timestamp" ("2025-06-01T12:34:56.789Z") as a number that
+ * orders the same way, 0 when it has none. */
+static long long record_ts(const char *line, size_t len) {
+    if (len == 0 || *line != '{') return 0;
+    const char *v = jfind(line, "timestamp");
+    if (!v || *v != '"') return 0;
+    int y, mo, d, h, mi, sec, ms = 0;
+    if (sscanf(v + 1, "%4d-%2d-%2dT%2d:%2d:%2d.%3d", &y, &mo, &d, &h, &mi, &sec, &ms) < 6) return 0;
+    return ((((long long)y * 12 + mo) * 31 + d) * 24 + h) * 3600000LL + mi * 60000LL + sec * 1000LL + ms;
+}
+
+typedef struct {
+    size_t off, len;
+    long long ts;
+} MergeRec;
+
+typedef struct {
+    const char *path;
+    const char *name;       /* NULL for the session itself */
+    IngestCursor *cur;
+    MergeRec win[MERGE_WINDOW];
+    int wn, wi;             /* buffered records, and the next one */
+    size_t scan;            /* where the next fill starts */
+    long long ts;           /* carried over to records without one */
+} MergeSource;
+
+/* Buffer the next complete records of one transcript. */
+static void merge_fill(MergeSource *s) {
+    const TranscriptMap *m = &s->cur->map;
+    s->wn = s->wi = 0;
+    while (m->base && s->wn < MERGE_WINDOW && s->scan < m->len) {
+        const char *p = m->base + s->scan;
+        const char *nl = memchr(p, '\n', m->len - s->scan);
+        if (!nl) break;
+        size_t len = (size_t)(nl - p);
+        long long ts = record_ts(p, len);
+        if (ts > 0) s->ts = ts;
+        s->win[s->wn++] = (MergeRec){s->scan, len, s->ts};
+        s->scan += len + 1;
+    }
+}
+
+/* Insert a divider naming the transcript items from `at` on came from. */
+static void I_insert_agent(Items *items, int at, const char *name) {
+    int n = items->n;
+    I_push(items, IT_AGENT, sanitize(name), NULL, 0);
+    if (items->n == n) return;
+    Item d = items->d[n];
+    memmove(&items->d[at + 1], &items->d[at], sizeof(Item) * (size_t)(n - at));
+    items->d[at] = d;
+}
+
+/* ingest_transcript() over the session (src[0]) and its subagents at once.
+ * What each transcript gained is merged by timestamp, with no more than
+ * MERGE_WINDOW records of each buffered at a time.  A record that lands
+ * after a later one was shown goes at the end, as in a single transcript.
+ * An item from another transcript than the one before it follows an
+ * IT_AGENT divider.  A rewritten subagent transcript rebuilds everything,
+ * like a rewritten session does. */
+static int ingest_merged(Items *items, MergeSource *src, int n) {
+    int rc = ingest_begin(src[0].path, items, src[0].cur);
+    if (rc == INGEST_NONE) return rc;
+    for (int k = 1; k < n; k++) {
+        IngestCursor *c = src[k].cur;
+        if (rc == INGEST_REBUILD) ingest_close(c);
+        int was_valid = c->valid;
+        if (ingest_begin(src[k].path, NULL, c) == INGEST_REBUILD && was_valid) {
+            I_free(items);
+            for (int j = 0; j < n; j++) ingest_close(src[j].cur);
+            return ingest_merged(items, src, n);
+        }
+    }
+    int moved = 0;
+    for (int k = 0; k < n; k++) {
+        src[k].scan = (size_t)src[k].cur->offset;
+        src[k].ts = 0;
+        merge_fill(&src[k]);
+    }
+    for (;;) {
+        MergeSource *s = NULL;
+        for (int k = 0; k < n; k++) {
+            if (src[k].wi < src[k].wn && (!s || src[k].win[src[k].wi].ts < s->win[s->wi].ts)) s = &src[k];
+        }
+        if (!s) break;
+        MergeRec r = s->win[s->wi++];
+        const TranscriptMap *prev = items->n > 0 ? items->d[items->n - 1].map : &src[0].cur->map;
+        int n0 = items->n;
+        items->map = &s->cur->map;
+        parse_transcript_line(s->cur->map.base + r.off, r.len, items, s->cur);
+        if (items->n > n0 && items->map != prev) I_insert_agent(items, n0, s->name ? s->name : "main session");
+        s->cur->offset = (off_t)(r.off + r.len + 1);
+        moved = 1;
+        if (s->wi == s->wn) merge_fill(s);
+    }
+    items->map = &src[0].cur->map;
+    if (rc == INGEST_APPEND && !moved) rc = INGEST_NONE;
+    return rc;
 }
 
 /* ── Inline markdown: **bold** and `code` ──────────────────────────────── */
@@ -3515,6 +5243,353 @@ static void fmt_inline(char *dst, int mx, const char *src) {
     #undef A
 }
 
+/* ── Syntax highlighting ───────────────────────────────────────────────── */
+
+/* Byte classes for the tokenizer: identifiers start with a letter or '_'
+ * and continue through digits and UTF-8 bytes. */
+#define SYN_WORD  1
+#define SYN_LEAD  2
+#define SYN_DIGIT 4
+
+static const unsigned char g_syn_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 0, 0, 0, 0, 0, 0,
+    0, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 3,
+    0, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+/* Keyword sets are perfect hashes built offline: each word sits in the slot
+ * syn_kw_slot() gives it, so a lookup is one probe and one compare.  Adding
+ * a word means searching (a, b) again for a table without collisions. */
+static const char *const g_kw_generic[8] = {
+    [0] = "None", [1] = "true", [3] = "false", [6] = "null",
+};
+static const char *const g_kw_c[256] = {
+    [0] = "switch", [3] = "bool", [5] = "const", [13] = "nullptr",
+    [20] = "default", [24] = "NULL", [35] = "int", [51] = "class",
+    [52] = "float", [57] = "break", [61] = "register", [65] = "double",
+    [66] = "delete", [67] = "extern", [81] = "long", [82] = "continue",
+    [84] = "case", [87] = "sizeof", [88] = "else", [90] = "typedef",
+    [100] = "false", [104] = "inline", [123] = "using", [126] = "enum",
+    [129] = "goto", [131] = "virtual", [133] = "unsigned", [135] = "new",
+    [144] = "if", [146] = "signed", [153] = "namespace", [154] = "protected",
+    [161] = "return", [166] = "union", [172] = "private", [173] = "auto",
+    [176] = "true", [186] = "do", [189] = "template", [191] = "typename",
+    [197] = "constexpr", [201] = "volatile", [210] = "this", [213] = "while",
+    [221] = "char", [226] = "short", [229] = "public", [237] = "struct",
+    [242] = "restrict", [252] = "for", [253] = "void", [255] = "static",
+};
+static const char *const g_kw_python[128] = {
+    [0] = "with", [1] = "continue", [2] = "yield", [16] = "if",
+    [22] = "raise", [27] = "return", [28] = "or", [29] = "import",
+    [34] = "not", [37] = "as", [38] = "class", [40] = "del", [41] = "False",
+    [46] = "async", [47] = "pass", [48] = "global", [49] = "True",
+    [55] = "else", [62] = "while", [64] = "lambda", [67] = "assert",
+    [72] = "in", [78] = "await", [80] = "finally", [82] = "for",
+    [88] = "self", [89] = "and", [93] = "try", [98] = "break",
+    [99] = "except", [101] = "is", [103] = "nonlocal", [106] = "None",
+    [107] = "from", [117] = "elif", [120] = "def",
+};
+static const char *const g_kw_js[128] = {
+    [0] = "implements", [5] = "const", [7] = "break", [8] = "switch",
+    [12] = "default", [16] = "for", [19] = "type", [22] = "try",
+    [24] = "yield", [28] = "let", [30] = "true", [33] = "typeof",
+    [34] = "case", [35] = "extends", [36] = "continue", [40] = "enum",
+    [41] = "async", [43] = "catch", [44] = "delete", [48] = "from",
+    [52] = "await", [58] = "throw", [66] = "function", [68] = "if",
+    [69] = "class", [71] = "finally", [73] = "super", [78] = "else",
+    [83] = "while", [84] = "instanceof", [87] = "import", [90] = "false",
+    [97] = "debugger", [100] = "in", [101] = "undefined", [102] = "var",
+    [104] = "of", [109] = "return", [111] = "export", [112] = "null",
+    [114] = "as", [116] = "do", [117] = "void", [121] = "new",
+    [122] = "interface", [124] = "this",
+};
+static const char *const g_kw_go[64] = {
+    [5] = "import", [6] = "iota", [7] = "defer", [9] = "chan",
+    [11] = "select", [14] = "for", [15] = "false", [17] = "else",
+    [18] = "switch", [19] = "const", [20] = "nil", [23] = "true",
+    [24] = "var", [26] = "type", [27] = "struct", [31] = "return",
+    [32] = "func", [33] = "case", [35] = "go", [36] = "if", [39] = "continue",
+    [40] = "break", [42] = "goto", [44] = "map", [45] = "range",
+    [48] = "default", [51] = "fallthrough", [60] = "package",
+    [61] = "interface",
+};
+static const char *const g_kw_rust[128] = {
+    [5] = "unsafe", [15] = "loop", [16] = "false", [17] = "self", [19] = "in",
+    [20] = "use", [27] = "Ok", [33] = "break", [37] = "as", [40] = "static",
+    [42] = "where", [43] = "await", [44] = "fn", [46] = "while",
+    [49] = "Self", [50] = "for", [51] = "enum", [56] = "ref", [60] = "match",
+    [66] = "dyn", [67] = "mod", [68] = "extern", [69] = "continue",
+    [80] = "super", [82] = "crate", [83] = "if", [85] = "Some",
+    [92] = "const", [94] = "pub", [96] = "move", [100] = "struct",
+    [101] = "else", [102] = "Err", [103] = "type", [105] = "impl",
+    [106] = "true", [110] = "trait", [115] = "return", [120] = "let",
+    [121] = "mut", [123] = "None", [126] = "async",
+};
+static const char *const g_kw_shell[64] = {
+    [7] = "do", [8] = "export", [11] = "true", [13] = "return", [16] = "done",
+    [17] = "false", [18] = "case", [20] = "else", [21] = "if", [25] = "then",
+    [27] = "readonly", [28] = "elif", [29] = "in", [30] = "function",
+    [31] = "while", [36] = "until", [40] = "for", [42] = "esac",
+    [44] = "local", [51] = "fi",
+};
+
+typedef struct {
+    const char *const *kw;
+    int mask, a, b;
+    char comment[3];    /* line comment opener */
+} SynLang;
+
+enum { SYN_GENERIC, SYN_C, SYN_PY, SYN_JS, SYN_GO, SYN_RUST, SYN_SH, SYN_NLANG };
+
+static const SynLang g_syn_langs[SYN_NLANG] = {
+    [SYN_GENERIC] = { g_kw_generic,   7, 1, 4,   "#" },
+    [SYN_C]       = { g_kw_c,       255, 6, 29,  "//" },
+    [SYN_PY]      = { g_kw_python,  127, 8, 72,  "#" },
+    [SYN_JS]      = { g_kw_js,      127, 14, 83, "//" },
+    [SYN_GO]      = { g_kw_go,       63, 8, 54,  "//" },
+    [SYN_RUST]    = { g_kw_rust,    127, 17, 27, "//" },
+    [SYN_SH]      = { g_kw_shell,    63, 1, 14,  "#" },
+};
+
+/* Fence tags and file extensions share one list. */
+static const struct { const char *name; int lang; } g_syn_names[] = {
+    { "c", SYN_C }, { "h", SYN_C }, { "cc", SYN_C }, { "cpp", SYN_C }, { "cxx", SYN_C },
+    { "c++", SYN_C }, { "hh", SYN_C }, { "hpp", SYN_C }, { "m", SYN_C }, { "mm", SYN_C },
+    { "objc", SYN_C },
+    { "py", SYN_PY }, { "pyi", SYN_PY }, { "python", SYN_PY }, { "python3", SYN_PY },
+    { "js", SYN_JS }, { "jsx", SYN_JS }, { "mjs", SYN_JS }, { "cjs", SYN_JS },
+    { "ts", SYN_JS }, { "tsx", SYN_JS }, { "javascript", SYN_JS }, { "typescript", SYN_JS },
+    { "go", SYN_GO }, { "golang", SYN_GO },
+    { "rs", SYN_RUST }, { "rust", SYN_RUST },
+    { "sh", SYN_SH }, { "bash", SYN_SH }, { "zsh", SYN_SH }, { "shell", SYN_SH },
+};
+
+/* Language of the diff being rendered; diff_append_syntax() reads it. */
+static const SynLang *g_syn_lang = &g_syn_langs[SYN_GENERIC];
+
+static int syn_kw_slot(const SynLang *lg, const unsigned char *s, int n) {
+    return ((s[0] * lg->a) ^ (s[n - 1] * lg->b) ^ (s[n >> 1] + n)) & lg->mask;
+}
+
+static int syn_is_keyword(const SynLang *lg, const char *s, int n) {
+    if (n <= 0) return 0;
+    const char *k = lg->kw[syn_kw_slot(lg, (const unsigned char *)s, n)];
+    return k && strncmp(k, s, (size_t)n) == 0 && k[n] == '\0';
+}
+
+static const SynLang *syn_lang_named(const char *s, int n) {
+    if (!s || n <= 0) return NULL;
+    for (size_t i = 0; i < sizeof(g_syn_names) / sizeof(g_syn_names[0]); i++) {
+        const char *nm = g_syn_names[i].name;
+        if (strncasecmp(nm, s, (size_t)n) == 0 && nm[n] == '\0') return &g_syn_langs[g_syn_names[i].lang];
+    }
+    return NULL;
+}
+
+/* The tag after a code fence ("```python title=x"), or NULL when it names
+ * no language we know and the block stays unstyled. */
+static const SynLang *syn_lang_for_tag(const char *tag) {
+    while (*tag == ' ' || *tag == '`') tag++;
+    int n = 0;
+    while (tag[n] && tag[n] != ' ' && tag[n] != '\t' && tag[n] != '{' && tag[n] != ',') n++;
+    return syn_lang_named(tag, n);
+}
+
+/* Diffs of files with an unknown extension keep the generic keywords. */
+static const SynLang *syn_lang_for_path(const char *path, int n) {
+    int dot = -1;
+    for (int i = 0; i < n; i++) {
+        if (path[i] == '/') dot = -1;
+        else if (path[i] == '.') dot = i;
+    }
+    const SynLang *lg = dot >= 0 ? syn_lang_named(path + dot + 1, n - dot - 1) : NULL;
+    return lg ? lg : &g_syn_langs[SYN_GENERIC];
+}
+
+static void diff_append_raw(char *out, int outsz, int *o, const char *s, int n) {
+    if (!out || outsz <= 1 || !o || !s || n <= 0) return;
+    if (*o >= outsz - 1) return;
+    int room = outsz - 1 - *o;
+    if (n > room) n = room;
+    memcpy(out + *o, s, (size_t)n);
+    *o += n;
+    out[*o] = '\0';
+}
+
+static void diff_append_str(char *out, int outsz, int *o, const char *s) {
+    if (!s) return;
+    diff_append_raw(out, outsz, o, s, (int)strlen(s));
+}
+
+static void syn_append(char *out, int outsz, int *o, const SynLang *lg,
+                       const char *base, const char *text, int tlen) {
+    if (!out || outsz <= 1 || !o || !base || !text || tlen <= 0) return;
+    int i = 0;
+    while (i < tlen && *o < outsz - 1) {
+        unsigned char c = (unsigned char)text[i];
+        unsigned char cls = g_syn_class[c];
+        if (c == (unsigned char)lg->comment[0] &&
+            (!lg->comment[1] || (i + 1 < tlen && text[i + 1] == lg->comment[1]))) {
+            diff_append_str(out, outsz, o, C_HDM);
+            diff_append_raw(out, outsz, o, text + i, tlen - i);
+            diff_append_str(out, outsz, o, base);
+            break;
+        }
+        if (c == '"' || c == '\'') {
+            char q = (char)c;
+            int s = i++;
+            while (i < tlen) {
+                if (text[i] == '\\' && i + 1 < tlen) { i += 2; continue; }
+                if (text[i] == q) { i++; break; }
+                i++;
+            }
+            diff_append_str(out, outsz, o, C_SYN_STR);
+            diff_append_raw(out, outsz, o, text + s, i - s);
+            diff_append_str(out, outsz, o, base);
+            continue;
+        }
+        if (cls & SYN_DIGIT) {
+            int s = i++;
+            while (i < tlen) {
+                unsigned char d = (unsigned char)text[i];
+                if (!(g_syn_class[d] & SYN_DIGIT) && d != '.' && d != '_') break;
+                i++;
+            }
+            diff_append_str(out, outsz, o, C_SYN_NUM);
+            diff_append_raw(out, outsz, o, text + s, i - s);
+            diff_append_str(out, outsz, o, base);
+            continue;
+        }
+        if (cls & SYN_LEAD) {
+            int s = i++;
+            while (i < tlen && (g_syn_class[(unsigned char)text[i]] & SYN_WORD)) i++;
+            int j = i;
+            while (j < tlen && (text[j] == ' ' || text[j] == '\t')) j++;
+            int assign = (j < tlen && text[j] == '=') ? 1 : 0;
+            int kw = syn_is_keyword(lg, text + s, i - s);
+            if (assign) diff_append_str(out, outsz, o, C_HUM);
+            else if (kw) diff_append_str(out, outsz, o, C_SYN_KW);
+            diff_append_raw(out, outsz, o, text + s, i - s);
+            if (assign || kw) diff_append_str(out, outsz, o, base);
+            continue;
+        }
+        diff_append_raw(out, outsz, o, text + i, 1);
+        i++;
+    }
+}
+
+static void diff_append_syntax(char *out, int outsz, int *o, const char *base, const char *text, int tlen) {
+    syn_append(out, outsz, o, g_syn_lang, base, text, tlen);
+}
+
+/* Styled rows of whole diff and code blocks, keyed by the block's text and
+ * everything else that shapes its rows.  A rebuild, a resize back to a
+ * width seen before, or a window sliding back over a block replays the
+ * rows instead of tokenizing and linkifying them again. */
+#define SYN_CACHE_SLOTS 256
+#define SYN_CACHE_BYTES (4u << 20)
+
+enum { SYN_BLOCK_DIFF = 1, SYN_BLOCK_PATCH, SYN_BLOCK_CODE };
+
+typedef struct {
+    unsigned long long h;       /* 0 = empty */
+    int n;
+    size_t len;
+    char *buf;                  /* n fold flags, then n NUL-terminated rows */
+} SynCache;
+
+static SynCache *g_syn_cache = NULL;
+static size_t g_syn_cache_bytes = 0;
+static int g_syn_cache_hits = 0, g_syn_cache_misses = 0;
+
+static void syn_cache_free(void) {
+    if (g_syn_cache)
+        for (int i = 0; i < SYN_CACHE_SLOTS; i++) free(g_syn_cache[i].buf);
+    free(g_syn_cache);
+    g_syn_cache = NULL;
+    g_syn_cache_bytes = 0;
+}
+
+static unsigned long long syn_cache_key(int kind, const char *text, size_t len,
+                                        const char *conn, int a, int b) {
+    if (g_perf_compat || !text) return 0;
+    int parts[4] = { kind, render_cols(), a, b };
+    unsigned long long h = queue_hash_update(1469598103934665603ULL, (const unsigned char *)parts, sizeof(parts));
+    if (conn) h = queue_hash_update(h, (const unsigned char *)conn, strlen(conn) + 1);
+    h = queue_hash_update(h, (const unsigned char *)text, len);
+    return h ? h : 1;
+}
+
+/* Push the rows cached under h onto L; returns 0 on a miss. */
+static int syn_cache_replay(Lines *L, unsigned long long h) {
+    if (!h) return 0;
+    const SynCache *c = g_syn_cache ? &g_syn_cache[h % SYN_CACHE_SLOTS] : NULL;
+    if (!c || c->h != h) {
+        g_syn_cache_misses++;
+        return 0;
+    }
+    const char *s = c->buf + c->n;
+    for (int i = 0; i < c->n; i++) {
+        L_push_row(L, s, c->buf[i]);
+        s += strlen(s) + 1;
+    }
+    g_syn_cache_hits++;
+    return 1;
+}
+
+/* Keep rows n0.. of L under h.  If the line cap dropped rows while the
+ * block rendered, some of them are gone and the block is not kept. */
+static void syn_cache_store(Lines *L, unsigned long long h, int n0, int dropped0) {
+    if (!h || g_oom || L->dropped_total != dropped0 || L->n <= n0) return;
+    int n = L->n - n0;
+    size_t len = (size_t)n;
+    for (int i = n0; i < L->n; i++) len += (size_t)L_row(L, i)->len + 1;
+    if (len > SYN_CACHE_BYTES / 16) return;
+    if (!g_syn_cache) {
+        g_syn_cache = xmalloc(SYN_CACHE_SLOTS * sizeof(SynCache));
+        if (!g_syn_cache) return;
+        memset(g_syn_cache, 0, SYN_CACHE_SLOTS * sizeof(SynCache));
+    }
+    SynCache *c = &g_syn_cache[h % SYN_CACHE_SLOTS];
+    g_syn_cache_bytes -= c->len;
+    free(c->buf);
+    memset(c, 0, sizeof(*c));
+    if (g_syn_cache_bytes + len > SYN_CACHE_BYTES) {
+        for (int i = 0; i < SYN_CACHE_SLOTS; i++) {
+            free(g_syn_cache[i].buf);
+            memset(&g_syn_cache[i], 0, sizeof(SynCache));
+        }
+        g_syn_cache_bytes = 0;
+    }
+    char *buf = xmalloc(len);
+    if (!buf) return;
+    char *s = buf + n;
+    for (int i = 0; i < n; i++) {
+        const LineRow *r = L_row(L, n0 + i);
+        buf[i] = (char)r->fold;
+        memcpy(s, L->arena + r->off, (size_t)r->len + 1);
+        s += r->len + 1;
+    }
+    c->h = h;
+    c->n = n;
+    c->len = len;
+    c->buf = buf;
+    g_syn_cache_bytes += len;
+}
+
 /* ── Markdown renderer ─────────────────────────────────────────────────── */
 
 static const char *md_tail_start(const char *text, int keep_lines, int *omitted_lines) {
@@ -3717,7 +5792,7 @@ static void md_render_table_block(Lines *L,
         if (widths[c] < 3) widths[c] = 3;
         sum += widths[c];
     }
-    int max_sum = g_cols - (3 * ncol + 3);
+    int max_sum = render_cols() - (3 * ncol + 3);
     int min_sum = ncol * 3;
     if (max_sum < min_sum) max_sum = min_sum;
     while (sum > max_sum) {
@@ -3780,6 +5855,18 @@ static void md_render_table_block(Lines *L,
     L_push(L, line);
 }
 
+/* End of the fenced block whose body starts at p: just past its closing
+ * fence line, or NULL while the fence is still open. */
+static const char *md_fence_end(const char *p) {
+    while (*p) {
+        const char *eol = strchr(p, '\n');
+        int fence = p[0] == '`' && p[1] == '`' && p[2] == '`';
+        p = eol ? eol + 1 : p + strlen(p);
+        if (fence) return p;
+    }
+    return NULL;
+}
+
 static void render_md(Lines *L, const char *text, int keep_tail_lines) {
     if (!text) return;
     static int table_enabled = -1;
@@ -3791,6 +5878,10 @@ static void render_md(Lines *L, const char *text, int keep_tail_lines) {
         table_max_cols = parse_env_int_range("CLAUDE_PAGER_MD_TABLE_MAX_COLS", 1, MD_TBL_MAX_COLS, 8);
     }
     int in_code = 0;
+    const SynLang *code_lang = NULL;
+    const char *code_end = NULL;
+    unsigned long long code_key = 0;
+    int code_n0 = 0, code_drop0 = 0;
     char lb[8192], sb[8192], fb[16384];
     int omitted = 0;
     const char *p = md_tail_start(text, keep_tail_lines, &omitted);
@@ -3801,6 +5892,7 @@ static void render_md(Lines *L, const char *text, int keep_tail_lines) {
     }
 
     while (*p) {
+        const char *ls = p;
         const char *eol = strchr(p, '\n');
         int ll = eol ? (int)(eol-p) : (int)strlen(p);
         if (ll >= (int)sizeof(lb)) ll = (int)sizeof(lb)-1;
@@ -3808,17 +5900,38 @@ static void render_md(Lines *L, const char *text, int keep_tail_lines) {
         p = eol ? eol+1 : p+ll;
         const char *line = sanitize_line_view(lb, ll, sb, sizeof(sb), NULL);
 
-        if (line[0]=='`' && line[1]=='`' && line[2]=='`') { in_code = !in_code; continue; }
+        if (line[0]=='`' && line[1]=='`' && line[2]=='`') {
+            in_code = !in_code;
+            if (in_code) {
+                code_lang = syn_lang_for_tag(line + 3);
+                code_end = md_fence_end(p);
+                code_key = code_end ? syn_cache_key(SYN_BLOCK_CODE, ls, (size_t)(code_end - ls), NULL, 0, 0) : 0;
+                if (syn_cache_replay(L, code_key)) { p = code_end; in_code = 0; continue; }
+                code_n0 = L->n;
+                code_drop0 = L->dropped_total;
+            } else if (p == code_end) {
+                syn_cache_store(L, code_key, code_n0, code_drop0);
+            }
+            continue;
+        }
 
         if (in_code) {
-            int vl = (int)strlen(line), pad = g_cols-6-vl;
+            int vl = (int)strlen(line), pad = render_cols()-6-vl;
             if (pad<0) pad=0;
-            snprintf(fb, sizeof(fb), C_SEP VL RS C_CBG C_CFG " %s%*s" RS, line, pad, "");
+            if (code_lang) {
+                char body[12288];
+                int bo = 0;
+                body[0] = '\0';
+                syn_append(body, sizeof(body), &bo, code_lang, C_CBG C_CFG, line, vl);
+                snprintf(fb, sizeof(fb), C_SEP VL RS C_CBG C_CFG " %s%*s" RS, body, pad, "");
+            } else {
+                snprintf(fb, sizeof(fb), C_SEP VL RS C_CBG C_CFG " %s%*s" RS, line, pad, "");
+            }
             L_pushw_link(L, fb); continue;
         }
 
         /* Tables */
-        if (table_enabled && g_cols >= 72 && looks_like_table_row(line)) {
+        if (table_enabled && render_cols() >= 72 && looks_like_table_row(line)) {
             char sep_raw[8192], sep_san[8192];
             int sep_len = 0;
             const char *after_sep = p;
@@ -3868,7 +5981,7 @@ static void render_md(Lines *L, const char *text, int keep_tail_lines) {
                     L_push_blank_once(L);
                     snprintf(fb, sizeof(fb), BO C_AST "%s" RS, ht);
                     L_push(L, fb);
-                    int ul = (int)strlen(ht)+2; if(ul>g_cols) ul=g_cols;
+                    int ul = (int)strlen(ht)+2; if(ul>render_cols()) ul=render_cols();
                     char sep[512]; int si=0;
                     si += snprintf(sep+si, sizeof(sep)-si, "%s", C_SEP);
                     for (int i=0; i<ul && si+4<(int)sizeof(sep); i++) si+=snprintf(sep+si,sizeof(sep)-si,HL);
@@ -4148,135 +6261,53 @@ static int compute_diff_gutter_width(const char *text, int max_show) {
     return w;
 }
 
-static void diff_append_raw(char *out, int outsz, int *o, const char *s, int n) {
-    if (!out || outsz <= 1 || !o || !s || n <= 0) return;
-    if (*o >= outsz - 1) return;
-    int room = outsz - 1 - *o;
-    if (n > room) n = room;
-    memcpy(out + *o, s, (size_t)n);
-    *o += n;
-    out[*o] = '\0';
+static void render_diff_row(Lines *L, const char *conn, const char *style, int gutter_w,
+                            int old_ln, int new_ln, char mark, const char *text, int tlen,
+                            int allow_linkify) {
+    char b[32768];
+    char body[24576];
+    char lo[24], ln[24];
+    const char *mc = (mark == '+') ? C_DFG : (mark == '-') ? C_DFR : (mark == '@' || mark == '*') ? C_DFC : C_HDM;
+    if (old_ln > 0) snprintf(lo, sizeof(lo), "%*d", gutter_w, old_ln);
+    else snprintf(lo, sizeof(lo), "%*s", gutter_w, "");
+    if (new_ln > 0) snprintf(ln, sizeof(ln), "%*d", gutter_w, new_ln);
+    else snprintf(ln, sizeof(ln), "%*s", gutter_w, "");
+    int bo = 0;
+    body[0] = '\0';
+    if (mark == '+' || mark == '-' || mark == ' ') diff_append_syntax(body, sizeof(body), &bo, style, text, tlen);
+    else diff_append_raw(body, sizeof(body), &bo, text, tlen);
+    snprintf(b, sizeof(b), RS "%s%s%s %s %s%c%s %s", conn, style, lo, ln, mc, mark, style, body);
+    if (allow_linkify) L_pushw_link(L, b);
+    else L_pushw(L, b);
 }
 
-static void diff_append_str(char *out, int outsz, int *o, const char *s) {
-    if (!s) return;
-    diff_append_raw(out, outsz, o, s, (int)strlen(s));
+static void diff_inline_bounds(const char *old_t, int old_len,
+                               const char *new_t, int new_len,
+                               int *old_s, int *old_e,
+                               int *new_s, int *new_e) {
+    int pre = 0;
+    while (pre < old_len && pre < new_len && old_t[pre] == new_t[pre]) pre++;
+
+    int os = old_len - 1;
+    int ns = new_len - 1;
+    while (os >= pre && ns >= pre && old_t[os] == new_t[ns]) { os--; ns--; }
+
+    if (old_s) *old_s = pre;
+    if (old_e) *old_e = os + 1;
+    if (new_s) *new_s = pre;
+    if (new_e) *new_e = ns + 1;
 }
 
-static int diff_is_word_char(unsigned char c) {
-    return (isalnum(c) || c == '_' || c >= 0x80);
+static int utf8_is_cont_byte(unsigned char c) {
+    return (c & 0xC0u) == 0x80u;
 }
 
-static int diff_is_keyword_token(const char *text, int s, int e) {
-    int n = e - s;
-    if (n == 4 && !memcmp(text + s, "true", 4)) return 1;
-    if (n == 5 && !memcmp(text + s, "false", 5)) return 1;
-    if (n == 4 && !memcmp(text + s, "null", 4)) return 1;
-    if (n == 4 && !memcmp(text + s, "None", 4)) return 1;
-    return 0;
-}
-
-static void diff_append_syntax(char *out, int outsz, int *o, const char *base, const char *text, int tlen) {
-    if (!out || outsz <= 1 || !o || !base || !text || tlen <= 0) return;
-    int i = 0;
-    while (i < tlen && *o < outsz - 1) {
-        unsigned char c = (unsigned char)text[i];
-        if (c == '#') {
-            diff_append_str(out, outsz, o, C_HDM);
-            diff_append_raw(out, outsz, o, text + i, tlen - i);
-            diff_append_str(out, outsz, o, base);
-            break;
-        }
-        if (c == '"' || c == '\'') {
-            char q = (char)c;
-            int s = i++;
-            while (i < tlen) {
-                if (text[i] == '\\' && i + 1 < tlen) { i += 2; continue; }
-                if (text[i] == q) { i++; break; }
-                i++;
-            }
-            diff_append_str(out, outsz, o, C_SYN_STR);
-            diff_append_raw(out, outsz, o, text + s, i - s);
-            diff_append_str(out, outsz, o, base);
-            continue;
-        }
-        if (isdigit(c)) {
-            int s = i++;
-            while (i < tlen) {
-                unsigned char d = (unsigned char)text[i];
-                if (!isdigit(d) && d != '.' && d != '_') break;
-                i++;
-            }
-            diff_append_str(out, outsz, o, C_SYN_NUM);
-            diff_append_raw(out, outsz, o, text + s, i - s);
-            diff_append_str(out, outsz, o, base);
-            continue;
-        }
-        if (diff_is_word_char(c) && (isalpha(c) || c == '_')) {
-            int s = i++;
-            while (i < tlen && diff_is_word_char((unsigned char)text[i])) i++;
-            int j = i;
-            while (j < tlen && (text[j] == ' ' || text[j] == '\t')) j++;
-            int assign = (j < tlen && text[j] == '=') ? 1 : 0;
-            int kw = diff_is_keyword_token(text, s, i);
-            if (assign) diff_append_str(out, outsz, o, C_HUM);
-            else if (kw) diff_append_str(out, outsz, o, C_SYN_KW);
-            diff_append_raw(out, outsz, o, text + s, i - s);
-            if (assign || kw) diff_append_str(out, outsz, o, base);
-            continue;
-        }
-        diff_append_raw(out, outsz, o, text + i, 1);
-        i++;
-    }
-}
-
-static void render_diff_row(Lines *L, const char *conn, const char *style, int gutter_w,
-                            int old_ln, int new_ln, char mark, const char *text, int tlen,
-                            int allow_linkify) {
-    char b[32768];
-    char body[24576];
-    char lo[24], ln[24];
-    const char *mc = (mark == '+') ? C_DFG : (mark == '-') ? C_DFR : (mark == '@' || mark == '*') ? C_DFC : C_HDM;
-    if (old_ln > 0) snprintf(lo, sizeof(lo), "%*d", gutter_w, old_ln);
-    else snprintf(lo, sizeof(lo), "%*s", gutter_w, "");
-    if (new_ln > 0) snprintf(ln, sizeof(ln), "%*d", gutter_w, new_ln);
-    else snprintf(ln, sizeof(ln), "%*s", gutter_w, "");
-    int bo = 0;
-    body[0] = '\0';
-    if (mark == '+' || mark == '-' || mark == ' ') diff_append_syntax(body, sizeof(body), &bo, style, text, tlen);
-    else diff_append_raw(body, sizeof(body), &bo, text, tlen);
-    snprintf(b, sizeof(b), RS "%s%s%s %s %s%c%s %s", conn, style, lo, ln, mc, mark, style, body);
-    if (allow_linkify) L_pushw_link(L, b);
-    else L_pushw(L, b);
-}
-
-static void diff_inline_bounds(const char *old_t, int old_len,
-                               const char *new_t, int new_len,
-                               int *old_s, int *old_e,
-                               int *new_s, int *new_e) {
-    int pre = 0;
-    while (pre < old_len && pre < new_len && old_t[pre] == new_t[pre]) pre++;
-
-    int os = old_len - 1;
-    int ns = new_len - 1;
-    while (os >= pre && ns >= pre && old_t[os] == new_t[ns]) { os--; ns--; }
-
-    if (old_s) *old_s = pre;
-    if (old_e) *old_e = os + 1;
-    if (new_s) *new_s = pre;
-    if (new_e) *new_e = ns + 1;
-}
-
-static int utf8_is_cont_byte(unsigned char c) {
-    return (c & 0xC0u) == 0x80u;
-}
-
-static int utf8_clamp_left(const char *s, int len, int pos) {
-    if (!s || len <= 0) return 0;
-    if (pos < 0) pos = 0;
-    if (pos > len) pos = len;
-    while (pos > 0 && pos < len && utf8_is_cont_byte((unsigned char)s[pos])) pos--;
-    return pos;
+static int utf8_clamp_left(const char *s, int len, int pos) {
+    if (!s || len <= 0) return 0;
+    if (pos < 0) pos = 0;
+    if (pos > len) pos = len;
+    while (pos > 0 && pos < len && utf8_is_cont_byte((unsigned char)s[pos])) pos--;
+    return pos;
 }
 
 static int utf8_clamp_right(const char *s, int len, int pos) {
@@ -4287,13 +6318,17 @@ static int utf8_clamp_right(const char *s, int len, int pos) {
     return pos;
 }
 
-#define DIFF_TOK_MAX 192
+#define DIFF_TOK_MAX 512
 #define DIFF_RNG_MAX 48
+#define DIFF_EDIT_MAX 64        /* token edits Myers may spend before giving up */
+#define DIFF_MEMO_SLOTS 512
 
 static int diff_tok_class(unsigned char c) {
     return (isalnum(c) || c == '_' || c >= 0x80) ? 1 : 0;
 }
 
+/* Past max_tok the last token swallows the rest of the line, so a long
+ * line still diffs, just more coarsely at its end. */
 static int diff_split_tokens(const char *t, int len, int *ts, int *te, int max_tok) {
     if (!t || len <= 0 || !ts || !te || max_tok <= 0) return 0;
     int n = 0, i = 0;
@@ -4302,6 +6337,7 @@ static int diff_split_tokens(const char *t, int len, int *ts, int *te, int max_t
         int cls = diff_tok_class((unsigned char)t[i]);
         i++;
         while (i < len && diff_tok_class((unsigned char)t[i]) == cls) i++;
+        if (n == max_tok - 1) i = len;
         ts[n] = s;
         te[n] = i;
         n++;
@@ -4309,6 +6345,14 @@ static int diff_split_tokens(const char *t, int len, int *ts, int *te, int max_t
     return n;
 }
 
+static int diff_count_tokens(const char *t, int len) {
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+        if (i == 0 || diff_tok_class((unsigned char)t[i]) != diff_tok_class((unsigned char)t[i - 1])) n++;
+    }
+    return n;
+}
+
 static int diff_tok_eq(const char *a, int as, int ae, const char *b, int bs, int be) {
     int al = ae - as, bl = be - bs;
     if (al != bl) return 0;
@@ -4316,75 +6360,183 @@ static int diff_tok_eq(const char *a, int as, int ae, const char *b, int bs, int
     return memcmp(a + as, b + bs, (size_t)al) == 0;
 }
 
-static int diff_token_ranges(const char *old_t, int old_len,
-                             const char *new_t, int new_len,
-                             int *ors, int *ore, int *orc,
-                             int *nrs, int *nre, int *nrc) {
-    if (orc) *orc = 0;
-    if (nrc) *nrc = 0;
-    if (!old_t || !new_t || old_len <= 0 || new_len <= 0) return 0;
-
-    int ots[DIFF_TOK_MAX], ote[DIFF_TOK_MAX];
-    int nts[DIFF_TOK_MAX], nte[DIFF_TOK_MAX];
-    int on = diff_split_tokens(old_t, old_len, ots, ote, DIFF_TOK_MAX);
-    int nn = diff_split_tokens(new_t, new_len, nts, nte, DIFF_TOK_MAX);
-    if (on <= 0 || nn <= 0 || on >= DIFF_TOK_MAX - 1 || nn >= DIFF_TOK_MAX - 1) return 0;
+/* Token boundaries are class changes, so widening a byte position to
+ * the run holding byte pos-1 lands on a boundary of both lines. */
+static int diff_run_start(const char *t, int pos) {
+    if (pos <= 0) return 0;
+    int cls = diff_tok_class((unsigned char)t[pos - 1]);
+    while (pos > 0 && diff_tok_class((unsigned char)t[pos - 1]) == cls) pos--;
+    return pos;
+}
 
-    static int dp[DIFF_TOK_MAX + 1][DIFF_TOK_MAX + 1];
-    memset(dp, 0, sizeof(dp));
-    for (int i = on - 1; i >= 0; i--) {
-        for (int j = nn - 1; j >= 0; j--) {
-            if (diff_tok_eq(old_t, ots[i], ote[i], new_t, nts[j], nte[j])) dp[i][j] = dp[i + 1][j + 1] + 1;
-            else dp[i][j] = dp[i + 1][j] >= dp[i][j + 1] ? dp[i + 1][j] : dp[i][j + 1];
-        }
-    }
+static int diff_run_end(const char *t, int len, int pos) {
+    if (pos <= 0 || pos >= len) return pos;
+    int cls = diff_tok_class((unsigned char)t[pos - 1]);
+    while (pos < len && diff_tok_class((unsigned char)t[pos]) == cls) pos++;
+    return pos;
+}
 
-    int old_match[DIFF_TOK_MAX];
-    int new_match[DIFF_TOK_MAX];
-    memset(old_match, 0, sizeof(old_match));
-    memset(new_match, 0, sizeof(new_match));
-    int i = 0, j = 0;
-    while (i < on && j < nn) {
-        if (diff_tok_eq(old_t, ots[i], ote[i], new_t, nts[j], nte[j])) {
-            old_match[i] = 1;
-            new_match[j] = 1;
-            i++;
-            j++;
-        } else if (dp[i + 1][j] >= dp[i][j + 1]) {
-            i++;
-        } else {
-            j++;
-        }
-    }
+/* Myers' greedy O(ND) diff over tokens, marking the tokens of one
+ * shortest edit script as matched.  Returns 0 when more than
+ * DIFF_EDIT_MAX edits are needed; the trace of V rows costs
+ * O(D^2) ints rather than the O(N*M) of an LCS table. */
+static int diff_myers_match(const char *old_t, const int *ots, const int *ote, int on,
+                            const char *new_t, const int *nts, const int *nte, int nn,
+                            unsigned char *old_match, unsigned char *new_match) {
+    static int trace[(DIFF_EDIT_MAX + 1) * (DIFF_EDIT_MAX + 1)];
+    int v[2 * DIFF_EDIT_MAX + 3];
+    const int vo = DIFF_EDIT_MAX + 1;
+    v[vo + 1] = 0;
+    int dend = -1;
+    for (int d = 0; d <= DIFF_EDIT_MAX && dend < 0; d++) {
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && v[vo + k - 1] < v[vo + k + 1])) ? v[vo + k + 1] : v[vo + k - 1] + 1;
+            int y = x - k;
+            while (x < on && y < nn && diff_tok_eq(old_t, ots[x], ote[x], new_t, nts[y], nte[y])) { x++; y++; }
+            v[vo + k] = x;
+            if (x >= on && y >= nn) dend = d;
+        }
+        memcpy(trace + d * d, v + vo - d, (size_t)(2 * d + 1) * sizeof(int));
+    }
+    if (dend < 0) return 0;
+
+    memset(old_match, 0, (size_t)on);
+    memset(new_match, 0, (size_t)nn);
+    int x = on, y = nn;
+    for (int d = dend; d > 0; d--) {
+        const int *vp = trace + (d - 1) * (d - 1) + (d - 1);   /* vp[k] for |k| < d */
+        int k = x - y;
+        int down = k == -d || (k != d && vp[k - 1] < vp[k + 1]);
+        int pk = down ? k + 1 : k - 1;
+        int px = vp[pk], py = px - pk;
+        int mx = down ? px : px + 1;
+        while (x > mx) { x--; y--; old_match[x] = 1; new_match[y] = 1; }
+        x = px;
+        y = py;
+    }
+    while (x > 0 && y > 0) { x--; y--; old_match[x] = 1; new_match[y] = 1; }
+    return 1;
+}
 
-    int oc = 0;
-    i = 0;
-    while (i < on && oc < DIFF_RNG_MAX) {
-        while (i < on && old_match[i]) i++;
-        if (i >= on) break;
+static int diff_collect_ranges(const int *ts, const int *te, int n,
+                               const unsigned char *match, int base,
+                               int *rs, int *re) {
+    int c = 0, i = 0;
+    while (i < n && c < DIFF_RNG_MAX) {
+        while (i < n && match[i]) i++;
+        if (i >= n) break;
         int s = i;
-        while (i < on && !old_match[i]) i++;
-        int e = i - 1;
-        if (ors && ore) { ors[oc] = ots[s]; ore[oc] = ote[e]; }
-        oc++;
-    }
-    int nc = 0;
-    j = 0;
-    while (j < nn && nc < DIFF_RNG_MAX) {
-        while (j < nn && new_match[j]) j++;
-        if (j >= nn) break;
-        int s = j;
-        while (j < nn && !new_match[j]) j++;
-        int e = j - 1;
-        if (nrs && nre) { nrs[nc] = nts[s]; nre[nc] = nte[e]; }
-        nc++;
+        while (i < n && !match[i]) i++;
+        if (rs && re) { rs[c] = base + ts[s]; re[c] = base + te[i - 1]; }
+        c++;
     }
+    return c;
+}
 
+static int diff_token_ranges_compute(const char *old_t, int old_len,
+                                     const char *new_t, int new_len,
+                                     int *ors, int *ore, int *orc,
+                                     int *nrs, int *nre, int *nrc) {
+    /* Only the span between the shared prefix and suffix, widened to
+     * token boundaries, needs a token diff. */
+    int pre = 0, oe = 0, ne = 0;
+    diff_inline_bounds(old_t, old_len, new_t, new_len, &pre, &oe, NULL, &ne);
+    int s = diff_run_start(old_t, pre);
+    int oend = diff_run_end(old_t, old_len, oe);
+    int nend = diff_run_end(new_t, new_len, ne);
+    int tail = old_len - oend < new_len - nend ? old_len - oend : new_len - nend;
+    oend = old_len - tail;
+    nend = new_len - tail;
+    if (oend <= s || nend <= s) return 0;
+
+    /* Myers costs O((N+M)*D), so a long middle is diffed in full from
+     * the heap; the stack arrays cap it only if that allocation fails. */
+    int stack_tok[4 * DIFF_TOK_MAX];
+    unsigned char stack_match[2 * DIFF_TOK_MAX];
+    int *tok = stack_tok, cap = DIFF_TOK_MAX;
+    unsigned char *match = stack_match;
+    int want = diff_count_tokens(old_t + s, oend - s);
+    int nwant = diff_count_tokens(new_t + s, nend - s);
+    if (nwant > want) want = nwant;
+    void *heap = NULL;
+    if (want > DIFF_TOK_MAX) {
+        heap = xmalloc((size_t)want * (4 * sizeof(int) + 2));
+        if (heap) {
+            tok = heap;
+            cap = want;
+            match = (unsigned char *)(tok + 4 * (size_t)want);
+        }
+    }
+    int *ots = tok, *ote = tok + cap, *nts = tok + 2 * cap, *nte = tok + 3 * cap;
+    unsigned char *old_match = match, *new_match = match + cap;
+    int on = diff_split_tokens(old_t + s, oend - s, ots, ote, cap);
+    int nn = diff_split_tokens(new_t + s, nend - s, nts, nte, cap);
+    int oc = 0, nc = 0;
+    if (on > 0 && nn > 0 &&
+        diff_myers_match(old_t + s, ots, ote, on, new_t + s, nts, nte, nn, old_match, new_match)) {
+        oc = diff_collect_ranges(ots, ote, on, old_match, s, ors, ore);
+        nc = diff_collect_ranges(nts, nte, nn, new_match, s, nrs, nre);
+    }
+    free(heap);
     if (orc) *orc = oc;
     if (nrc) *nrc = nc;
     return (oc > 0 && nc > 0) ? 1 : 0;
 }
 
+/* Paired -/+ lines recur on every re-render of the same tool result
+ * (resize, rebuild), so their token ranges are memoised by content. */
+typedef struct {
+    unsigned long long h;
+    int old_len, new_len;
+    int used, orc, nrc;
+    int ors[DIFF_RNG_MAX], ore[DIFF_RNG_MAX];
+    int nrs[DIFF_RNG_MAX], nre[DIFF_RNG_MAX];
+} DiffMemo;
+
+static DiffMemo *g_diff_memo = NULL;
+
+static void diff_memo_free(void) {
+    free(g_diff_memo);
+    g_diff_memo = NULL;
+}
+
+static int diff_token_ranges(const char *old_t, int old_len,
+                             const char *new_t, int new_len,
+                             int *ors, int *ore, int *orc,
+                             int *nrs, int *nre, int *nrc) {
+    if (orc) *orc = 0;
+    if (nrc) *nrc = 0;
+    if (!old_t || !new_t || old_len <= 0 || new_len <= 0) return 0;
+    if (g_perf_compat)
+        return diff_token_ranges_compute(old_t, old_len, new_t, new_len, ors, ore, orc, nrs, nre, nrc);
+
+    if (!g_diff_memo) {
+        g_diff_memo = xmalloc(DIFF_MEMO_SLOTS * sizeof(DiffMemo));
+        if (!g_diff_memo)
+            return diff_token_ranges_compute(old_t, old_len, new_t, new_len, ors, ore, orc, nrs, nre, nrc);
+        memset(g_diff_memo, 0, DIFF_MEMO_SLOTS * sizeof(DiffMemo));
+    }
+    unsigned long long h = queue_hash_update(1469598103934665603ULL, (const unsigned char *)old_t, (size_t)old_len);
+    h = queue_hash_update(h, (const unsigned char *)"\n", 1);
+    h = queue_hash_update(h, (const unsigned char *)new_t, (size_t)new_len);
+    if (!h) h = 1;
+    DiffMemo *m = &g_diff_memo[h % DIFF_MEMO_SLOTS];
+    if (m->h != h || m->old_len != old_len || m->new_len != new_len) {
+        m->h = 0;
+        m->used = diff_token_ranges_compute(old_t, old_len, new_t, new_len,
+                                            m->ors, m->ore, &m->orc, m->nrs, m->nre, &m->nrc);
+        if (!m->used) m->orc = m->nrc = 0;
+        m->h = h;
+        m->old_len = old_len;
+        m->new_len = new_len;
+    }
+    if (ors && ore) { memcpy(ors, m->ors, (size_t)m->orc * sizeof(int)); memcpy(ore, m->ore, (size_t)m->orc * sizeof(int)); }
+    if (nrs && nre) { memcpy(nrs, m->nrs, (size_t)m->nrc * sizeof(int)); memcpy(nre, m->nre, (size_t)m->nrc * sizeof(int)); }
+    if (orc) *orc = m->orc;
+    if (nrc) *nrc = m->nrc;
+    return m->used;
+}
+
 static void render_diff_row_hl(Lines *L, const char *conn,
                                const char *style, const char *hl_style,
                                int gutter_w, int old_ln, int new_ln, char mark,
@@ -4465,7 +6617,7 @@ static void render_diff_row_multi_hl(Lines *L, const char *conn,
     else L_pushw(L, b);
 }
 
-static void render_diff_block(Lines *L, const char *text, const char *conn, int max_show, int omitted_lines) {
+static void render_diff_rows(Lines *L, const char *text, const char *conn, int max_show, int omitted_lines) {
     char line[12000], sline[12000];
     char cur_path[2048] = "";
     char last_anchor_path[2048] = "";
@@ -4491,6 +6643,7 @@ static void render_diff_block(Lines *L, const char *text, const char *conn, int
 
         if (strncmp(view, "+++ ", 4) == 0 || strncmp(view, "--- ", 4) == 0) {
             normalize_diff_path(cur_path, sizeof(cur_path), view + 4);
+            g_syn_lang = syn_lang_for_path(cur_path, (int)strlen(cur_path));
             if (show_anchors && cur_path[0] && strcmp(last_anchor_path, cur_path) != 0 && shown < max_show) {
                 make_abs_path(abs_path, sizeof(abs_path), cur_path);
                 if (abs_path[0]) {
@@ -4602,6 +6755,22 @@ static void render_diff_block(Lines *L, const char *text, const char *conn, int
     }
 }
 
+/* Only the first max_show rows are read, plus the line one -/+ pair peeks
+ * at, so the key hashes that prefix rather than the whole tool result. */
+static void render_diff_block(Lines *L, const char *text, const char *conn, int max_show, int omitted_lines) {
+    const char *end = text;
+    for (int i = 0; *end && i < max_show + 2; i++) {
+        const char *eol = strchr(end, '\n');
+        end = eol ? eol + 1 : end + strlen(end);
+    }
+    unsigned long long key = syn_cache_key(SYN_BLOCK_DIFF, text, (size_t)(end - text), conn, max_show, omitted_lines);
+    if (syn_cache_replay(L, key)) return;
+    int n0 = L->n, drop0 = L->dropped_total;
+    render_diff_rows(L, text, conn, max_show, omitted_lines);
+    g_syn_lang = &g_syn_langs[SYN_GENERIC];
+    syn_cache_store(L, key, n0, drop0);
+}
+
 static int is_structured_patch_payload(const char *text) {
     return text && strncmp(text, "CP_SP1\n", 7) == 0;
 }
@@ -4710,7 +6879,7 @@ static void render_structured_patch_row(Lines *L, const char *conn,
     L_pushw_link(L, b);
 }
 
-static void render_structured_patch_block(Lines *L, const char *text, const char *conn, int max_show) {
+static void render_structured_patch_rows(Lines *L, const char *text, const char *conn, int max_show) {
     int total_rows = 0, max_ln = 0;
     analyze_structured_patch_payload(text, &total_rows, &max_ln);
     int gutter_w = dec_digits10(max_ln > 0 ? max_ln : 0);
@@ -4725,7 +6894,9 @@ static void render_structured_patch_block(Lines *L, const char *text, const char
         const char *e = strchr(p, '\n');
         int ll = e ? (int)(e - p) : (int)strlen(p);
         if (ll > 2 && p[1] == '\t') {
-            if (p[0] == 'P') {
+            if (p[0] == 'F') {
+                g_syn_lang = syn_lang_for_path(p + 2, ll - 2);
+            } else if (p[0] == 'P') {
                 int os = 0, ol = 0, ns = 0, nl = 0;
                 if (parse_patch_header_fields(p, ll, &os, &ol, &ns, &nl)) {
                     old_ln = os;
@@ -4825,8 +6996,21 @@ static void render_structured_patch_block(Lines *L, const char *text, const char
     }
 }
 
-static void render_items(Lines *L, Items *items) {
-    int prev_tu = 0;
+static void render_structured_patch_block(Lines *L, const char *text, const char *conn, int max_show) {
+    unsigned long long key = syn_cache_key(SYN_BLOCK_PATCH, text, strlen(text), conn, max_show, 0);
+    if (syn_cache_replay(L, key)) return;
+    int n0 = L->n, drop0 = L->dropped_total;
+    render_structured_patch_rows(L, text, conn, max_show);
+    g_syn_lang = &g_syn_langs[SYN_GENERIC];
+    syn_cache_store(L, key, n0, drop0);
+}
+
+/* Render items[from..] onto the end of L.  Each item remembers the row it
+ * started at so a later pass can truncate back to it and re-render. */
+static void render_items_range(Lines *L, Items *items, int from, int to) {
+    if (from < 0) from = 0;
+    if (to > items->n) to = items->n;
+    int prev_tu = (from > 0 && from <= items->n && items->d[from - 1].type == IT_TU);
     char b[16384];
     static int max_tool_lines = -1;
     static int max_diff_lines = -1;
@@ -4843,15 +7027,18 @@ static void render_items(Lines *L, Items *items) {
         show_tool_rail = env_enabled("CLAUDE_PAGER_TOOL_RAIL") ? 1 : 0;
     }
 
-    for (int i = 0; i < items->n; i++) {
+    for (int i = from; i < to; i++) {
         Item *it = &items->d[i];
+        it->line0 = L->dropped_total + L->n;
+        const char *text = item_text(it);
+        if (!text) text = "";
 
         switch (it->type) {
         case IT_HUM: {
             L_push_blank_once(L);
-            int nl = count_lines(it->text);
+            int nl = count_lines(text);
             int show = nl > MX_HUM ? MX_HUM : nl;
-            const char *p = it->text;
+            const char *p = text;
             char sb[16384];
             for (int ln=0; ln<show; ln++) {
                 const char *eol = strchr(p, '\n');
@@ -4883,29 +7070,35 @@ static void render_items(Lines *L, Items *items) {
                     md_keep = L->max_keep - L->n - 8;
                     if (md_keep < 1) md_keep = 1;
                 }
-                render_md(L, it->text, md_keep);
+                render_md(L, text, md_keep);
             }
             break;
 
         case IT_TU:
             L_push_blank_once(L);
             if (it->label && it->label[0])
-                snprintf(b, sizeof(b), C_TOL BUL RS " " BO C_AST "%s" RS " " DI C_HDM "%s" RS, it->text, it->label);
+                snprintf(b, sizeof(b), C_TOL BUL RS " " BO C_AST "%s" RS " " DI C_HDM "%s" RS, text, it->label);
             else
-                snprintf(b, sizeof(b), C_TOL BUL RS " " BO C_AST "%s" RS, it->text);
+                snprintf(b, sizeof(b), C_TOL BUL RS " " BO C_AST "%s" RS, text);
             L_pushw_link(L, b);
             break;
 
+        case IT_AGENT:
+            L_push_blank_once(L);
+            snprintf(b, sizeof(b), C_HDM "  " EMD " %s " EMD RS, text);
+            L_push(L, b);
+            break;
+
         case IT_TR: {
             const char *col = it->is_err ? C_ERR : C_RES;
             const char *conn = (prev_tu && show_tool_rail) ? "  " C_CONN VL RS " " : "  ";
-            if (!it->is_err && is_structured_patch_payload(it->text)) {
-                render_structured_patch_block(L, it->text, conn, max_diff_lines);
+            if (!it->is_err && is_structured_patch_payload(text)) {
+                render_structured_patch_block(L, text, conn, max_diff_lines);
                 break;
             }
             int df = 0, show = 0, has_more = 0, omitted = 0, total = 0;
             int detect_preview = max_diff_lines > max_tool_lines ? max_diff_lines : max_tool_lines;
-            analyze_tool_result(it->text, detect_preview, &show, &df, &has_more, &omitted, &total);
+            analyze_tool_result(text, detect_preview, &show, &df, &has_more, &omitted, &total);
             if (!df) {
                 show = total > max_tool_lines ? max_tool_lines : total;
                 omitted = total > show ? total - show : 0;
@@ -4916,9 +7109,9 @@ static void render_items(Lines *L, Items *items) {
                 has_more = omitted > 0;
             }
             if (df) {
-                render_diff_block(L, it->text, conn, show, omitted);
+                render_diff_block(L, text, conn, show, omitted);
             } else {
-                const char *p = it->text;
+                const char *p = text;
                 char sb[16384];
                 for (int ln=0; ln<show; ln++) {
                     const char *eol = strchr(p, '\n');
@@ -4941,95 +7134,721 @@ static void render_items(Lines *L, Items *items) {
         }
         }
         prev_tu = (it->type == IT_TU);
+        item_release_text(it);
     }
 }
 
-/* ── Drawing ───────────────────────────────────────────────────────────── */
-
-static void draw_sep(void) {
-    ob(C_SEP); for (int i=0; i<g_cols; i++) ob(HL); ob(RS);
+static void render_items_from(Lines *L, Items *items, int from) {
+    render_items_range(L, items, from, items->n);
 }
 
-static void draw_status(int tok, double pct, int cl) {
-    ob(C_BAN "  Editor open " EMD " edit and close to send" RS);
-    ob(DI);
-    if (g_queue_enabled) obf("  " DOT "  queue:%d", g_queue.n);
-    if (g_queue_notice[0]) obf("  " DOT "  %s", g_queue_notice);
-    ob(RS);
-    if (tok <= 0) return;
+/* ── SGR state ─────────────────────────────────────────────────────────── */
 
-    static const char *bar_levels[] = { " ", "\xe2\x96\x8f", "\xe2\x96\x8e", "\xe2\x96\x8d", "\xe2\x96\x8c", "\xe2\x96\x8b", "\xe2\x96\x8a", "\xe2\x96\x89", "\xe2\x96\x88" };
-    int bw = 8;
-    double scaled = pct / 100.0 * bw * 8.0;
-    if (scaled < 0.0) scaled = 0.0;
-    if (scaled > bw * 8.0) scaled = bw * 8.0;
+/* Rendered rows restate their style freely: a reset before every span, the
+ * same color again on the next run, a color that is replaced before any
+ * text uses it.  Over tmux/SSH those bytes are most of what a frame costs,
+ * so frame_commit() writes rows through an SgrPen, which follows the state
+ * a row asks for and writes only the difference, and only once some byte
+ * needs it.  Sequences it does not model pass through as they are, and so
+ * does the rest of their row. */
+#define SGR_BOLD    (1u << 0)
+#define SGR_DIM     (1u << 1)
+#define SGR_ITALIC  (1u << 2)
+#define SGR_UNDER   (1u << 3)
+#define SGR_BLINK   (1u << 4)
+#define SGR_REVERSE (1u << 5)
+#define SGR_HIDDEN  (1u << 6)
+#define SGR_STRIKE  (1u << 7)
+#define SGR_NATTR   8
 
-    char ct[64];
-    snprintf(ct, sizeof(ct), "%.0f%%  %.0fk/%dk", pct, tok/1000.0, cl/1000);
+static const unsigned char k_sgr_on[SGR_NATTR]  = { 1, 2, 3, 4, 5, 7, 8, 9 };
+static const unsigned char k_sgr_off[SGR_NATTR] = { 22, 22, 23, 24, 25, 27, 28, 29 };
 
-    int bvl = 70, cvl = bw + 3 + (int)strlen(ct), svl = 9;
-    int pad = g_cols - bvl - svl - cvl;
-    if (pad<0) pad=0;
+typedef struct {
+    unsigned attr;
+    unsigned char fgt, bgt;  /* 0 default, 1 basic (30-37, 90-97), 2 256-color, 3 rgb */
+    uint32_t fg, bg;
+} SgrState;
 
-    obf("%*s" DI "  " DOT "  " RS, pad, "");
-    ob(C_HDM "ctx " RS);
-    for (int i = 0; i < bw; i++) {
-        double rem = scaled - (double)(i * 8);
-        int level = (int)(rem + 0.0001);
-        if (level < 0) level = 0;
-        if (level > 8) level = 8;
-        if (i == 0) ob(C_SEP "[");
-        if (level > 0) {
-            const char *segc = (i < 4) ? C_BRG : (i < 6) ? C_BRY : C_BRR;
-            ob(segc);
-            ob(bar_levels[level]);
+typedef struct {
+    SgrState cur, want;  /* what the terminal has, what the row asked for */
+    int raw;             /* an unmodelled sequence was seen: copy the rest */
+} SgrPen;
+
+static int sgr_same(const SgrState *a, const SgrState *b) {
+    return a->attr == b->attr && a->fgt == b->fgt && a->bgt == b->bgt && a->fg == b->fg && a->bg == b->bg;
+}
+
+/* Apply one SGR parameter list; 0 when it uses anything not modelled. */
+static int sgr_apply(SgrState *st, const char *p, int n) {
+    int v[32], nv = 0, x = 0;
+    for (int i = 0; i <= n; i++) {
+        if (i == n || p[i] == ';') {
+            if (nv == (int)(sizeof(v) / sizeof(v[0]))) return 0;
+            v[nv++] = x;
+            x = 0;
+        } else if (p[i] >= '0' && p[i] <= '9' && x < 1000) {
+            x = x * 10 + (p[i] - '0');
         } else {
-            ob(C_SEP DOT);
+            return 0;
         }
-        if (i == bw - 1) ob(C_SEP "]");
     }
-    ob(RS DI " "); ob(ct); ob(RS);
+    for (int i = 0; i < nv; i++) {
+        int c = v[i], k;
+        if (c == 0) { memset(st, 0, sizeof(*st)); continue; }
+        for (k = 0; k < SGR_NATTR && k_sgr_on[k] != c; k++) {}
+        if (k < SGR_NATTR) { st->attr |= 1u << k; continue; }
+        if (c == 22) { st->attr &= ~(SGR_BOLD | SGR_DIM); continue; }
+        for (k = 2; k < SGR_NATTR && k_sgr_off[k] != c; k++) {}
+        if (k < SGR_NATTR) { st->attr &= ~(1u << k); continue; }
+        int bg = (c >= 40 && c <= 49) || (c >= 100 && c <= 107);
+        unsigned char *t = bg ? &st->bgt : &st->fgt;
+        uint32_t *col = bg ? &st->bg : &st->fg;
+        if ((c >= 30 && c <= 37) || (c >= 40 && c <= 47)) { *t = 1; *col = (uint32_t)(c % 10); }
+        else if ((c >= 90 && c <= 97) || (c >= 100 && c <= 107)) { *t = 1; *col = (uint32_t)(c % 10 + 8); }
+        else if (c == 39 || c == 49) { *t = 0; *col = 0; }
+        else if ((c == 38 || c == 48) && i + 2 < nv && v[i + 1] == 5 && v[i + 2] <= 255) {
+            *t = 2; *col = (uint32_t)v[i + 2]; i += 2;
+        } else if ((c == 38 || c == 48) && i + 4 < nv && v[i + 1] == 2 &&
+                   v[i + 2] <= 255 && v[i + 3] <= 255 && v[i + 4] <= 255) {
+            *t = 3; *col = (uint32_t)(v[i + 2] << 16 | v[i + 3] << 8 | v[i + 4]); i += 4;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
 }
 
-static void draw_queue_panel(void) {
-    if (g_queue_rows <= 0) return;
+typedef struct {
+    char d[160];
+    int n;
+} SgrBuf;
+
+/* Append one parameter (snprintf is too slow for every transition of a
+ * frame). */
+static void sgr_code(SgrBuf *b, unsigned c) {
+    char t[4];
+    int k = 0;
+    do { t[k++] = (char)('0' + c % 10); c /= 10; } while (c && k < 4);
+    if (b->n > 2) b->d[b->n++] = ';';
+    while (k > 0) b->d[b->n++] = t[--k];
+}
+
+static void sgr_color(SgrBuf *b, unsigned base, unsigned char t, uint32_t c) {
+    if (t == 0) { sgr_code(b, base + 9); return; }
+    if (t == 1) { sgr_code(b, c < 8 ? base + c : base + 52 + c); return; }
+    sgr_code(b, base + 8);
+    if (t == 2) {
+        sgr_code(b, 5);
+        sgr_code(b, c);
+    } else {
+        sgr_code(b, 2);
+        sgr_code(b, c >> 16);
+        sgr_code(b, (c >> 8) & 255);
+        sgr_code(b, c & 255);
+    }
+}
+
+/* Write the sequence taking the terminal from `from` to `to`: whichever is
+ * shorter of switching off what went away and on what is new, or a reset
+ * followed by everything `to` has. */
+static void sgr_diff(const SgrState *from, const SgrState *to) {
+    SgrBuf inc = { "\033[", 2 }, full = { "\033[", 2 };
+    unsigned gone = from->attr & ~to->attr, add = to->attr & ~from->attr;
+    if (gone & (SGR_BOLD | SGR_DIM)) {
+        sgr_code(&inc, 22);
+        add |= to->attr & (SGR_BOLD | SGR_DIM);
+    }
+    for (int k = 2; k < SGR_NATTR; k++) if (gone & (1u << k)) sgr_code(&inc, k_sgr_off[k]);
+    for (int k = 0; k < SGR_NATTR; k++) if (add & (1u << k)) sgr_code(&inc, k_sgr_on[k]);
+    if (from->fgt != to->fgt || from->fg != to->fg) sgr_color(&inc, 30, to->fgt, to->fg);
+    if (from->bgt != to->bgt || from->bg != to->bg) sgr_color(&inc, 40, to->bgt, to->bg);
+
+    /* A reset can only win when something has to be switched off. */
+    SgrBuf *b = &inc;
+    if (gone || (from->fgt && !to->fgt) || (from->bgt && !to->bgt)) {
+        sgr_code(&full, 0);
+        for (int k = 0; k < SGR_NATTR; k++) if (to->attr & (1u << k)) sgr_code(&full, k_sgr_on[k]);
+        if (to->fgt) sgr_color(&full, 30, to->fgt, to->fg);
+        if (to->bgt) sgr_color(&full, 40, to->bgt, to->bg);
+        if (full.n <= inc.n) b = &full;
+    }
+    b->d[b->n++] = 'm';
+    ob_raw(b->d, b->n);
+}
+
+static void sgr_settle(SgrPen *pen) {
+    if (sgr_same(&pen->cur, &pen->want)) return;
+    sgr_diff(&pen->cur, &pen->want);
+    pen->cur = pen->want;
+}
+
+/* End of the escape sequence at s[i] (s[i] == ESC), or -1 if it runs past n. */
+static int esc_end(const char *s, int i, int n) {
+    if (i + 1 >= n) return -1;
+    if (s[i + 1] == '[') {
+        for (int j = i + 2; j < n; j++) {
+            unsigned char c = (unsigned char)s[j];
+            if (c >= 0x40 && c <= 0x7e) return j + 1;
+        }
+        return -1;
+    }
+    if (s[i + 1] == ']') {
+        for (int j = i + 2; j < n; j++) {
+            if (s[j] == '\a') return j + 1;
+            if (s[j] == 0x1b && j + 1 < n && s[j + 1] == '\\') return j + 2;
+        }
+        return -1;
+    }
+    return i + 2;
+}
 
-    int qsep_row = g_rows - 3 - g_queue_rows;
-    if (qsep_row < 2) qsep_row = 2;
+/* Write row bytes through the pen.  SGR sequences only change what the
+ * row wants; any other byte first brings the terminal up to it. */
+static void sgr_write(SgrPen *pen, const char *s, int n) {
+    int run = 0;
+    for (int i = 0; !pen->raw && i < n;) {
+        const char *e = memchr(s + i, 0x1b, (size_t)(n - i));
+        if (!e) break;
+        i = (int)(e - s);
+        int j = esc_end(s, i, n);
+        if (j > 0 && (s[i + 1] != '[' || s[j - 1] != 'm')) { i = j; continue; }
+        if (i > run) {
+            sgr_settle(pen);
+            ob_ref(s + run, i - run);
+        }
+        run = i;
+        SgrState next = pen->want;
+        if (j < 0 || !sgr_apply(&next, s + i + 2, j - i - 3)) {
+            sgr_settle(pen);
+            pen->raw = 1;
+            break;
+        }
+        pen->want = next;
+        run = i = j;
+    }
+    if (run < n) {
+        sgr_settle(pen);
+        ob_ref(s + run, n - run);
+    }
+}
 
-    obf("\033[%d;1H", qsep_row);
-    ob(C_SEP);
-    for (int i = 0; i < g_cols; i++) ob(HL);
-    ob(RS);
-    ob("\033[K");
+/* ── Frame damage ──────────────────────────────────────────────────────── */
 
-    int row = qsep_row + 1;
-    int item_rows = g_queue.n;
-    if (item_rows > QUEUE_SHOW_MAX) item_rows = QUEUE_SHOW_MAX;
-    if (item_rows < 0) item_rows = 0;
+#define FRAME_SHIFT_MAX 4
+#define FRAME_HASH_SEED 1469598103934665603ULL
 
-    if (g_queue.n > 0) {
-        obf("\033[%d;1H", row++);
-        ob(C_QBG);
-        obf("  " BUL " Queue(%d)", g_queue.n);
-        if (g_edit_index >= 0) ob(C_QACC "  editing history" RS C_QBG);
-        else if (g_input_draft_saved) ob(C_QACC "  draft stashed" RS C_QBG);
-        ob("\033[K");
-        ob(RS);
+static int frame_begin(void) {
+    int need = g_rows + 2;
+    if (need > g_frame.rows_cap) {
+        FrameRow *nr = xrealloc(g_frame.rows, sizeof(FrameRow) * (size_t)need);
+        if (!nr) return -1;
+        g_frame.rows = nr;
+        unsigned long long *np = xrealloc(g_frame.prev, sizeof(unsigned long long) * (size_t)need);
+        if (!np) return -1;
+        g_frame.prev = np;
+        g_frame.rows_cap = need;
+        g_frame.valid = 0;
+    }
+    for (int r = 0; r < need; r++) {
+        FrameRow *fr = &g_frame.rows[r];
+        memset(fr, 0, sizeof(*fr));
+        fr->owner = r;
+        fr->span = 1;
+    }
+    g_frame.len = 0;
+    g_frame.npieces = 0;
+    g_frame.cur = 0;
+    g_frame.capture = 1;
+    return 0;
+}
 
-        int max_scroll = g_queue.n - item_rows;
-        if (max_scroll < 0) max_scroll = 0;
-        if (g_queue.scroll_off > max_scroll) g_queue.scroll_off = max_scroll;
-        if (g_queue.selected < g_queue.scroll_off) g_queue.scroll_off = g_queue.selected;
-        if (g_queue.selected >= g_queue.scroll_off + item_rows) {
-            g_queue.scroll_off = g_queue.selected - item_rows + 1;
-        }
-        if (g_queue.scroll_off < 0) g_queue.scroll_off = 0;
+static void frame_close_row(void) {
+    if (g_frame.cur <= 0) return;
+    FrameRow *fr = &g_frame.rows[g_frame.cur];
+    fr->npiece = g_frame.npieces - fr->piece0;
+    g_frame.cur = 0;
+}
+
+/* Start capturing bytes for screen row r; a row drawn twice keeps the last. */
+static void frame_row(int r) {
+    frame_close_row();
+    if (r < 1 || r > g_rows) return;
+    FrameRow *fr = &g_frame.rows[r];
+    fr->piece0 = g_frame.npieces;
+    fr->npiece = 0;
+    fr->owner = r;
+    fr->span = 1;
+    g_frame.cur = r;
+}
+
+/* Row r shows the terminal-wrapped tail of the line painted at owner. */
+static void frame_cont(int r, int owner) {
+    if (r < 1 || r > g_rows || owner < 1 || owner >= r) return;
+    g_frame.rows[r].owner = owner;
+    g_frame.rows[r].npiece = 0;
+}
+
+static void frame_span(int r, int span) {
+    if (r < 1 || r > g_rows) return;
+    g_frame.rows[r].span = span > 1 ? span : 1;
+}
+
+static void frame_hash_rows(void) {
+    for (int r = 1; r <= g_rows; r++) {
+        FrameRow *fr = &g_frame.rows[r];
+        unsigned long long h;
+        if (fr->owner != r) {
+            h = g_frame.rows[fr->owner].hash ^ ((unsigned long long)(r - fr->owner) * 0x9e3779b97f4a7c15ULL);
+        } else {
+            h = FRAME_HASH_SEED;
+            for (int k = 0; k < fr->npiece; k++) {
+                const FramePiece *pc = &g_frame.pieces[fr->piece0 + k];
+                const char *b = pc->ext ? pc->ext : g_frame.buf + pc->off;
+                h = queue_hash_update(h, (const unsigned char *)b, (size_t)pc->len);
+            }
+            h = queue_hash_update(h, (const unsigned char *)&fr->span, sizeof(fr->span));
+        }
+        fr->hash = h | 1ULL;
+    }
+}
+
+/* When the body moved by a few rows (wheel scroll), let the terminal shift
+ * it with a scroll region so only the rows scrolled into view get painted.
+ * Returns the shift applied to prev (> 0: content moved up). */
+static int frame_try_shift(void) {
+    int top = g_frame.body_top, end = g_frame.body_end;
+    if (top != g_frame.prev_body_top || end != g_frame.prev_body_end) return 0;
+    if (end - top < 2 * FRAME_SHIFT_MAX) return 0;
+    unsigned long long *prev = g_frame.prev;
+    int same = 0;
+    for (int r = top; r < end; r++) same += (prev[r] == g_frame.rows[r].hash);
+    int best = 0, best_hits = same;
+    for (int k = -FRAME_SHIFT_MAX; k <= FRAME_SHIFT_MAX; k++) {
+        if (k == 0) continue;
+        int hits = 0;
+        for (int r = top; r < end; r++) {
+            int src = r + k;
+            if (src >= top && src < end && prev[src] == g_frame.rows[r].hash) hits++;
+        }
+        if (hits > best_hits) { best_hits = hits; best = k; }
+    }
+    if (best == 0 || best_hits - same < 2) return 0;
+
+    int n = best > 0 ? best : -best;
+    obf(RS "\033[%d;%dr\033[%d%c\033[r", top, end - 1, n, best > 0 ? 'S' : 'T');
+    if (best > 0) {
+        for (int r = top; r < end; r++) prev[r] = (r + best < end) ? prev[r + best] : 0;
+    } else {
+        for (int r = end - 1; r >= top; r--) prev[r] = (r + best >= top) ? prev[r + best] : 0;
+    }
+    return best;
+}
+
+/* Write one captured row.  Rows are composed as if from a reset; the pen
+ * carries what the last row left on the terminal, so the reset is only
+ * written when that state is not known to be plain already. */
+static void frame_emit_row(SgrPen *pen, const FrameRow *fr) {
+    if (pen->raw || g_perf_compat) {
+        ob(RS);
+        memset(pen, 0, sizeof(*pen));
+        pen->raw = g_perf_compat;
+    }
+    memset(&pen->want, 0, sizeof(pen->want));
+    for (int k = 0; k < fr->npiece; k++) {
+        const FramePiece *pc = &g_frame.pieces[fr->piece0 + k];
+        sgr_write(pen, pc->ext ? pc->ext : g_frame.buf + pc->off, pc->len);
+    }
+    sgr_settle(pen);
+}
+
+/* Emit the captured frame. Rows are repainted when their hash differs from
+ * what is on screen, when they belong to a repainted wrapped line, or when
+ * a repainted line above spilled onto them. */
+static void frame_commit(int full) {
+    frame_close_row();
+    g_frame.capture = 0;
+    int n = g_rows;
+    if (g_frame.rows_cap < n + 2) { g_frame.valid = 0; return; }
+    frame_hash_rows();
+    if (!g_frame.valid || g_frame.nrows != n || g_frame.ncols != g_cols || g_perf_compat) full = 1;
+
+    g_frame.last_rows_emitted = 0;
+    g_frame.last_shift = 0;
+    int any = full;
+    for (int r = 1; r <= n && !any; r++) any = (g_frame.prev[r] != g_frame.rows[r].hash);
+    if (!any) return;
+
+    g_ol = 0;
+    if (g_sync_enabled) { ob("\033[?2026h"); g_sync_begin_count++; }
+    ob(full ? "\033[?25l\033[2J" : "\033[?25l");
+    if (!full) g_frame.last_shift = frame_try_shift();
+
+    for (int r = 1; r <= n; r++) {
+        FrameRow *fr = &g_frame.rows[r];
+        if (full || g_frame.prev[r] != fr->hash) g_frame.rows[fr->owner].dirty = 1;
+    }
+    int spill_to = 0;
+    SgrPen pen;
+    memset(&pen, 0, sizeof(pen));
+    pen.raw = 1;  /* nothing is known about the terminal's state yet */
+    for (int r = 1; r <= n; r++) {
+        FrameRow *fr = &g_frame.rows[r];
+        if (fr->owner != r) continue;
+        if (r <= spill_to) fr->dirty = 1;
+        if (!fr->dirty) continue;
+        obf("\033[%d;1H", r);
+        frame_emit_row(&pen, fr);
+        g_frame.last_rows_emitted++;
+        if (r + fr->span - 1 > spill_to) spill_to = r + fr->span - 1;
+    }
+
+    if (g_sync_enabled) { ob("\033[?2026l"); g_sync_end_count++; }
+    ob_flush();
+
+    for (int r = 1; r <= n; r++) g_frame.prev[r] = g_frame.rows[r].hash;
+    g_frame.prev_body_top = g_frame.body_top;
+    g_frame.prev_body_end = g_frame.body_end;
+    g_frame.nrows = n;
+    g_frame.ncols = g_cols;
+    g_frame.valid = 1;
+}
+
+static void frame_free(void) {
+    free(g_frame.buf);
+    free(g_frame.pieces);
+    free(g_frame.rows);
+    free(g_frame.prev);
+    memset(&g_frame, 0, sizeof(g_frame));
+}
+
+/* ── Search ────────────────────────────────────────────────────────────── */
+
+/* `/` (Ctrl+F while composing) searches the transcript's items, not the
+ * rows kept for display, so text a render cap or viewport window left out
+ * is found too.  The worker scans the items where their text lives, in the
+ * mapped transcript for view-backed ones, and keeps the list of matching
+ * items; a query that extends the previous one only rechecks that list,
+ * and one shortened back to an earlier query reuses its list.
+ * The reader lands on the first rendered row showing the match, or on the
+ * item's first row when the match is in text the renderer collapsed.
+ * Matching ignores ASCII case unless the query has an uppercase letter. */
+#define SEARCH_MAX 256
+#define SEARCH_ROW_MAX 4096
+#define SEARCH_HL_ON  "\033[7m"
+#define SEARCH_HL_OFF "\033[27m"
+
+typedef struct {
+    char q[SEARCH_MAX];         /* lowercased when icase */
+    int n;
+    int icase;
+    char jq[SEARCH_MAX * 2];    /* q as it appears inside a JSON string */
+    int jn;
+} SearchPat;
+
+/* The items matching one query, ascending; the worker keeps one level per
+ * refinement so that backspacing finds the shorter query's list intact. */
+#define SEARCH_LEVELS 8
+typedef struct {
+    SearchPat pat;
+    int *hits;
+    int n, cap;
+    int upto;                   /* items checked against pat */
+} SearchLevel;
+
+enum { SEARCH_OFF, SEARCH_TYPING, SEARCH_BROWSE };
+
+typedef struct {
+    int mode;
+    char buf[SEARCH_MAX];       /* the query as typed */
+    int len;
+    SearchPat pat;              /* what rows are highlighted for */
+    int sent;                   /* request awaiting its answer, 0 if none */
+    int origin_row, origin_uscroll;  /* where typing started, for Esc */
+    int row;                    /* current match, transcript row; -1 none */
+    int hit, hits;              /* its item among the matching ones */
+} SearchState;
+
+static SearchState g_search = { .row = -1, .hit = -1 };
+
+static void search_pat_init(SearchPat *p, const char *q) {
+    memset(p, 0, sizeof(*p));
+    p->icase = 1;
+    for (const char *s = q; *s; s++) if (*s >= 'A' && *s <= 'Z') p->icase = 0;
+    for (; *q && p->n < SEARCH_MAX - 1; q++) {
+        char c = *q;
+        if (p->icase && c >= 'A' && c <= 'Z') c = (char)(c + 32);
+        p->q[p->n++] = c;
+        if (c == '"' || c == '\\') p->jq[p->jn++] = '\\';
+        p->jq[p->jn++] = c;
+    }
+}
+
+static int search_eq(const char *s, const char *q, size_t m, int icase) {
+    if (!icase) return memcmp(s, q, m) == 0;
+    for (size_t i = 0; i < m; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 'A' && c <= 'Z') c = (unsigned char)(c + 32);
+        if (c != (unsigned char)q[i]) return 0;
+    }
+    return 1;
+}
+
+/* First occurrence of q[0..m) in s[0..n), m > 0.  Candidates are where
+ * both the first and the last byte match, a vector at a time; folding
+ * ORs 0x20 into bytes compared with a lowercase letter, which only
+ * uppercase letters map onto.  Loads stay inside s. */
+static const char *search_mem(const char *s, size_t n, const char *q, size_t m, int icase) {
+    if (m == 0 || m > n) return NULL;
+    unsigned char f = (unsigned char)q[0];
+    unsigned char ff = (icase && f >= 'a' && f <= 'z') ? 0x20 : 0;
+    size_t i = 0;
+#if defined(JSCAN_AVX2) || defined(JSCAN_SSE2) || defined(JSCAN_NEON)
+    unsigned char l = (unsigned char)q[m - 1];
+    unsigned char lf = (icase && l >= 'a' && l <= 'z') ? 0x20 : 0;
+#endif
+#if defined(JSCAN_AVX2)
+    __m256i vf = _mm256_set1_epi8((char)f), vl = _mm256_set1_epi8((char)l);
+    __m256i mf = _mm256_set1_epi8((char)ff), ml = _mm256_set1_epi8((char)lf);
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(const void *)(s + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(const void *)(s + i + m - 1));
+        unsigned k = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_or_si256(a, mf), vf), _mm256_cmpeq_epi8(_mm256_or_si256(b, ml), vl)));
+        for (; k; k &= k - 1) {
+            const char *c = s + i + __builtin_ctz(k);
+            if (search_eq(c, q, m, icase)) return c;
+        }
+    }
+#elif defined(JSCAN_SSE2)
+    __m128i vf = _mm_set1_epi8((char)f), vl = _mm_set1_epi8((char)l);
+    __m128i mf = _mm_set1_epi8((char)ff), ml = _mm_set1_epi8((char)lf);
+#define SEARCH_SSE2_HITS(o) _mm_and_si128( \
+        _mm_cmpeq_epi8(_mm_or_si128(_mm_loadu_si128((const __m128i *)(const void *)(s + i + (o))), mf), vf), \
+        _mm_cmpeq_epi8(_mm_or_si128(_mm_loadu_si128((const __m128i *)(const void *)(s + i + (o) + m - 1)), ml), vl))
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m128i e0 = SEARCH_SSE2_HITS(0), e1 = SEARCH_SSE2_HITS(16);
+        if (!_mm_movemask_epi8(_mm_or_si128(e0, e1))) continue;
+        unsigned k = (unsigned)_mm_movemask_epi8(e0) | (unsigned)_mm_movemask_epi8(e1) << 16;
+        for (; k; k &= k - 1) {
+            const char *c = s + i + __builtin_ctz(k);
+            if (search_eq(c, q, m, icase)) return c;
+        }
+    }
+#undef SEARCH_SSE2_HITS
+#elif defined(JSCAN_NEON)
+    uint8x16_t vf = vdupq_n_u8(f), vl = vdupq_n_u8(l), mf = vdupq_n_u8(ff), ml = vdupq_n_u8(lf);
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        uint8x16_t a = vld1q_u8((const uint8_t *)s + i), b = vld1q_u8((const uint8_t *)s + i + m - 1);
+        uint8x16_t e = vandq_u8(vceqq_u8(vorrq_u8(a, mf), vf), vceqq_u8(vorrq_u8(b, ml), vl));
+        uint64_t k = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(e), 4)), 0);
+        for (; k; k &= ~(0xfULL << (__builtin_ctzll(k) & ~3))) {
+            const char *c = s + i + (__builtin_ctzll(k) >> 2);
+            if (search_eq(c, q, m, icase)) return c;
+        }
+    }
+#endif
+    for (; i + m <= n; i++) {
+        if (((unsigned char)s[i] | ff) == f && search_eq(s + i, q, m, icase)) return s + i;
+    }
+    return NULL;
+}
+
+/* Whether the contents of a JSON string, s[0..n) between its quotes,
+ * decode to text containing the pattern.  A hit that begins on the second
+ * byte of an escape is not one. */
+static int search_jstr(const char *s, size_t n, const SearchPat *p) {
+    for (const char *h = s; (h = search_mem(h, n - (size_t)(h - s), p->jq, (size_t)p->jn, p->icase)) != NULL; h++) {
+        int bs = 0;
+        for (const char *b = h; b > s && b[-1] == '\\'; b--) bs++;
+        if (!(bs & 1)) return 1;
+    }
+    return 0;
+}
+
+/* Whether an item's label or text contains the pattern.  View-backed text
+ * is searched as JSON in the mapping, so nothing is decoded. */
+static int search_item(Item *it, const SearchPat *p) {
+    size_t m = (size_t)p->n;
+    if (it->label && search_mem(it->label, strlen(it->label), p->q, m, p->icase)) return 1;
+    if (it->text || it->src == SRC_OWNED) return it->text && search_mem(it->text, strlen(it->text), p->q, m, p->icase);
+    if (it->src == SRC_PATCH) {
+        /* Diff lines are reflowed while the payload is built, so it is
+         * searched as built. */
+        const char *t = item_text(it);
+        int hit = t && search_mem(t, strlen(t), p->q, m, p->icase);
+        item_release_text(it);
+        return hit;
+    }
+    const TranscriptMap *map = it->map;
+    if (!map || !map->base || it->src_off >= map->len) return 0;
+    const char *v = map->base + it->src_off;
+    if (!it->src_len) it->src_len = (size_t)((it->src == SRC_JSTR ? jskip_s(v) : jskip(v)) - v);
+    size_t vn = it->src_len;
+    if (it->src == SRC_JSTR) return vn >= 2 && search_jstr(v + 1, vn - 2, p);
+    /* A text block can only match where the whole array does. */
+    if (!search_mem(v, vn, p->jq, (size_t)p->jn, p->icase)) return 0;
+    const char *sub = jws(v);
+    if (*sub == '[') sub = jws(sub + 1);
+    while (sub && *sub && *sub != ']') {
+        if (*sub == '{' && jstreq(jfind(sub, "type"), "text")) {
+            const char *sv = jfind(sub, "text");
+            if (sv && *sv == '"') {
+                const char *se = jskip_s(sv);
+                if (se - sv >= 2 && search_jstr(sv + 1, (size_t)(se - sv - 2), p)) return 1;
+            }
+        }
+        sub = jskip(sub); sub = jws(sub); if (*sub == ',') sub = jws(sub + 1);
+    }
+    return 0;
+}
+
+/* The visible bytes of a rendered row, escape sequences left out, with
+ * where each one sits in the row; rows past `cap` visible bytes are only
+ * searched that far. */
+static int search_row_text(const char *s, int len, char *vis, int *at, int cap) {
+    int nv = 0;
+    for (int i = 0; i < len && nv < cap;) {
+        if (s[i] == 0x1b) {
+            int j = esc_end(s, i, len);
+            i = j < 0 ? len : j;
+            continue;
+        }
+        vis[nv] = s[i];
+        at[nv++] = i++;
+    }
+    return nv;
+}
+
+static int search_row_has(const char *s, int len, const SearchPat *p) {
+    if (p->n <= 0) return 0;
+    if (!memchr(s, 0x1b, (size_t)len)) return search_mem(s, (size_t)len, p->q, (size_t)p->n, p->icase) != NULL;
+    char vis[SEARCH_ROW_MAX];
+    int at[SEARCH_ROW_MAX];
+    int nv = search_row_text(s, len, vis, at, SEARCH_ROW_MAX);
+    return search_mem(vis, (size_t)nv, p->q, (size_t)p->n, p->icase) != NULL;
+}
+
+/* Write a row with every match in reverse video, restated after any
+ * sequence inside it in case that was a reset. */
+static void emit_line_with_match(const char *s, int len, const SearchPat *p) {
+    char vis[SEARCH_ROW_MAX];
+    int at[SEARCH_ROW_MAX];
+    int nv = search_row_text(s, len, vis, at, SEARCH_ROW_MAX);
+    int pos = 0;
+    const char *h;
+    for (int v = 0; v < nv && (h = search_mem(vis + v, (size_t)(nv - v), p->q, (size_t)p->n, p->icase)) != NULL;) {
+        int a = (int)(h - vis), b = a + p->n;
+        int sa = at[a], sb = at[b - 1] + 1;
+        ob_ref(s + pos, sa - pos);
+        ob(SEARCH_HL_ON);
+        for (int i = sa; i < sb;) {
+            if (s[i] == 0x1b) {
+                int j = esc_end(s, i, len);
+                if (j < 0) j = len;
+                ob_ref(s + i, j - i);
+                ob(SEARCH_HL_ON);
+                i = j;
+                continue;
+            }
+            const char *e = memchr(s + i, 0x1b, (size_t)(sb - i));
+            int j = e ? (int)(e - s) : sb;
+            ob_ref(s + i, j - i);
+            i = j;
+        }
+        ob(SEARCH_HL_OFF);
+        pos = sb;
+        v = b;
+    }
+    ob_ref(s + pos, len - pos);
+}
+
+/* ── Drawing ───────────────────────────────────────────────────────────── */
+
+static void draw_sep(void) {
+    ob(C_SEP); for (int i=0; i<g_cols; i++) ob(HL); ob(RS);
+}
+
+static void draw_status(int tok, double pct, int cl) {
+    ob(C_BAN "  Editor open " EMD " edit and close to send" RS);
+    ob(DI);
+    if (g_queue_enabled) obf("  " DOT "  queue:%d", g_queue.n);
+    if (g_queue_notice[0]) obf("  " DOT "  %s", g_queue_notice);
+    ob(RS);
+    if (tok <= 0) return;
+
+    static const char *bar_levels[] = { " ", "\xe2\x96\x8f", "\xe2\x96\x8e", "\xe2\x96\x8d", "\xe2\x96\x8c", "\xe2\x96\x8b", "\xe2\x96\x8a", "\xe2\x96\x89", "\xe2\x96\x88" };
+    int bw = 8;
+    double scaled = pct / 100.0 * bw * 8.0;
+    if (scaled < 0.0) scaled = 0.0;
+    if (scaled > bw * 8.0) scaled = bw * 8.0;
+
+    char ct[64];
+    snprintf(ct, sizeof(ct), "%.0f%%  %.0fk/%dk", pct, tok/1000.0, cl/1000);
+
+    int bvl = 70, cvl = bw + 3 + (int)strlen(ct), svl = 9;
+    int pad = g_cols - bvl - svl - cvl;
+    if (pad<0) pad=0;
+
+    obf("%*s" DI "  " DOT "  " RS, pad, "");
+    ob(C_HDM "ctx " RS);
+    for (int i = 0; i < bw; i++) {
+        double rem = scaled - (double)(i * 8);
+        int level = (int)(rem + 0.0001);
+        if (level < 0) level = 0;
+        if (level > 8) level = 8;
+        if (i == 0) ob(C_SEP "[");
+        if (level > 0) {
+            const char *segc = (i < 4) ? C_BRG : (i < 6) ? C_BRY : C_BRR;
+            ob(segc);
+            ob(bar_levels[level]);
+        } else {
+            ob(C_SEP DOT);
+        }
+        if (i == bw - 1) ob(C_SEP "]");
+    }
+    ob(RS DI " "); ob(ct); ob(RS);
+}
+
+static void draw_queue_panel(void) {
+    if (g_queue_rows <= 0) return;
+
+    int qsep_row = g_rows - 3 - g_queue_rows;
+    if (qsep_row < 2) qsep_row = 2;
+
+    frame_row(qsep_row);
+    ob(C_SEP);
+    for (int i = 0; i < g_cols; i++) ob(HL);
+    ob(RS);
+    ob("\033[K");
+
+    int row = qsep_row + 1;
+    int item_rows = g_queue.n;
+    if (item_rows > QUEUE_SHOW_MAX) item_rows = QUEUE_SHOW_MAX;
+    if (item_rows < 0) item_rows = 0;
+
+    if (g_queue.n > 0) {
+        frame_row(row++);
+        ob(C_QBG);
+        obf("  " BUL " Queue(%d)", g_queue.n);
+        if (g_edit_index >= 0) ob(C_QACC "  editing history" RS C_QBG);
+        else if (g_input_draft_saved) ob(C_QACC "  draft stashed" RS C_QBG);
+        ob("\033[K");
+        ob(RS);
+
+        int max_scroll = g_queue.n - item_rows;
+        if (max_scroll < 0) max_scroll = 0;
+        if (g_queue.scroll_off > max_scroll) g_queue.scroll_off = max_scroll;
+        if (g_queue.selected < g_queue.scroll_off) g_queue.scroll_off = g_queue.selected;
+        if (g_queue.selected >= g_queue.scroll_off + item_rows) {
+            g_queue.scroll_off = g_queue.selected - item_rows + 1;
+        }
+        if (g_queue.scroll_off < 0) g_queue.scroll_off = 0;
     }
 
     for (int i = 0; i < item_rows; i++) {
         int idx = g_queue.scroll_off + i;
-        obf("\033[%d;1H", row++);
+        frame_row(row++);
         ob(C_QBG);
         if (idx < g_queue.n) {
             char compact[1024];
@@ -5066,7 +7885,7 @@ static void draw_queue_panel(void) {
     else snprintf(label, sizeof(label), " Prompt ");
     int label_len = (int)strlen(label);
 
-    obf("\033[%d;1H", row++);
+    frame_row(row++);
     ob("  ");
     ob(C_QACC);
     ob(TL);
@@ -5092,7 +7911,7 @@ static void draw_queue_panel(void) {
         int cursor_drawn = 0;
         int cells = 0;
 
-        obf("\033[%d;1H", row++);
+        frame_row(row++);
         ob("  ");
         ob(C_QACC); ob(VL); ob(RS);
         ob(C_QBG);
@@ -5125,7 +7944,7 @@ static void draw_queue_panel(void) {
         ob("\033[K");
     }
 
-    obf("\033[%d;1H", row++);
+    frame_row(row++);
     ob("  ");
     ob(C_QACC);
     ob(BL);
@@ -5145,7 +7964,29 @@ static void draw_hotkeys_footer(void) {
     }
     int maxw = g_cols - 2;
     int used = 0;
-    if (g_input_mode) {
+    if (g_search.mode != SEARCH_OFF) {
+        char count[48] = "";
+        if (g_search.sent) snprintf(count, sizeof(count), "  searching");
+        else if (g_search.hits > 0) snprintf(count, sizeof(count), "  %d/%d", g_search.hit + 1, g_search.hits);
+        else if (g_search.len > 0) snprintf(count, sizeof(count), "  no match");
+        footer_emit_plain("  ", &used, maxw);
+        footer_emit_styled(C_QACC, "/", &used, maxw);
+        footer_emit_plain(g_search.buf, &used, maxw);
+        if (g_search.mode == SEARCH_TYPING) footer_emit_styled(C_QSEL, " ", &used, maxw);
+        footer_emit_styled(C_HDM, count, &used, maxw);
+        footer_emit_plain("  ", &used, maxw);
+        if (g_search.mode == SEARCH_TYPING) {
+            footer_emit_styled(C_QACC, "Enter", &used, maxw);
+            footer_emit_plain(" keep  ", &used, maxw);
+            footer_emit_styled(C_QACC, "Esc", &used, maxw);
+            footer_emit_plain(" cancel", &used, maxw);
+        } else {
+            footer_emit_styled(C_QACC, "n/N", &used, maxw);
+            footer_emit_plain(" next/prev  ", &used, maxw);
+            footer_emit_styled(C_QACC, "Esc", &used, maxw);
+            footer_emit_plain(" close", &used, maxw);
+        }
+    } else if (g_input_mode) {
         footer_emit_plain("  ", &used, maxw);
         footer_emit_styled(C_HDM, "keys: ", &used, maxw);
         footer_emit_styled(C_QACC, "⇧↑/↓", &used, maxw);
@@ -5160,6 +8001,8 @@ static void draw_hotkeys_footer(void) {
         footer_emit_plain(" attach  ", &used, maxw);
         footer_emit_styled(C_QACC, "^D", &used, maxw);
         footer_emit_plain(" del  ", &used, maxw);
+        footer_emit_styled(C_QACC, "^F", &used, maxw);
+        footer_emit_plain(" find  ", &used, maxw);
         if (g_ctrl_quit_supported) {
             footer_emit_styled(C_QACC, "^Q", &used, maxw);
             footer_emit_plain(" close", &used, maxw);
@@ -5169,6 +8012,8 @@ static void draw_hotkeys_footer(void) {
         footer_emit_styled(C_HDM, "keys: ", &used, maxw);
         footer_emit_styled(C_QACC, "⇧↑/↓", &used, maxw);
         footer_emit_plain(" cycle/edit  ", &used, maxw);
+        footer_emit_styled(C_QACC, "/", &used, maxw);
+        footer_emit_plain(" find  ", &used, maxw);
         if (g_ctrl_quit_supported) {
             footer_emit_styled(C_QACC, "^Q", &used, maxw);
             footer_emit_plain(" close", &used, maxw);
@@ -5178,75 +8023,94 @@ static void draw_hotkeys_footer(void) {
 }
 
 static void draw(Lines *L, int off, int tok, double pct, int cl, int first) {
-    g_ol = 0;
     link_map_clear();
-    if (g_sync_enabled) { ob("\033[?2026h"); g_sync_begin_count++; }
-
-    if (first) ob("\033[?25l\033[2J\033[H");
-    else       ob("\033[?25l\033[H");
+    if (frame_begin() != 0) return;
+    long long t_draw0 = g_bench_mode ? now_us() : 0;
+    long long out0 = g_out_bytes;
 
-    draw_sep(); ob("\033[K\n");
+    frame_row(1);
+    draw_sep(); ob("\033[K");
     int row = 2;
+    /* Logical lines, not screen rows: lines a viewport window left out have
+     * no wrap measurement, so both sides count lines.  Lines the cap dropped
+     * are reported separately. */
+    int above = off + (g_last_capped_lines > 0 ? 0 : L->dropped_total);
 
-    if (off > 0) {
+    if (above > 0) {
+        frame_row(row);
         if (g_last_capped_lines > 0) {
-            obf(C_HDM "  " UAR " %d lines above  (scroll to view)  " ELL " (+%d capped)" RS "\033[K\n", off, g_last_capped_lines);
+            obf(C_HDM "  " UAR " %d lines above  (scroll to view)  " ELL " (+%d capped)" RS "\033[K", above, g_last_capped_lines);
         } else {
-            obf(C_HDM "  " UAR " %d lines above  (scroll to view)" RS "\033[K\n", off);
+            obf(C_HDM "  " UAR " %d lines above  (scroll to view)" RS "\033[K", above);
         }
         row++;
     }
-
-    int avail = g_crows - (off>0 ? 1 : 0);
-    int end = off + avail;
-    if (end > L->n) end = L->n;
-
-    for (int i = off; i < end; i++) {
-        if (line_is_wrap_placeholder(L->d[i])) {
-            row++;
-            continue;
-        }
-        (void)link_map_track_line(L->d[i], row);
-        emit_line_with_hover(L->d[i], row);
-        ob("\033[K\n");
+    g_frame.body_top = row;
+
+    int avail = g_crows - (above>0 ? 1 : 0);
+    int body_last = row + avail;
+
+    const char *hover_ref = g_hover_uri[0] ? uri_lookup_n(g_hover_uri, strlen(g_hover_uri), 0) : NULL;
+    int hover_line = hover_ref ? L_line_at_row(L, off, row, g_hover_row) : -1;
+    int search_hl = g_search.mode != SEARCH_OFF && g_search.pat.n > 0;
+    for (int i = off; i < L->n && row < body_last; i++) {
+        const char *ln = L_get(L, i);
+        int len = L_row(L, i)->len;
+        int rows = L_line_rows(L, i);
+        /* Wrapped rows and stray newlines both carry the bytes below the slot. */
+        int span = rows;
+        for (const char *nl = ln; (nl = memchr(nl, '\n', (size_t)(ln + len - nl))) != NULL; nl++) span++;
+        int owner = row;
+        frame_row(row);
+        frame_span(row, span);
+        L_track_links(L, i, row);
+        if (i == hover_line && L_row_has_link(L, i, hover_ref)) emit_line_with_hover(ln, row);
+        else if (search_hl && search_row_has(ln, len, &g_search.pat)) emit_line_with_match(ln, len, &g_search.pat);
+        else ob_ref(ln, len);
+        ob("\033[K");
         row++;
+        for (int k = 1; k < rows && row < body_last; k++) frame_cont(row++, owner);
     }
 
     int body_end = (g_queue_rows > 0) ? (g_rows - 3 - g_queue_rows) : (g_rows - 3);
     if (body_end < row) body_end = row;
-    while (row < body_end) { ob("\033[K\n"); row++; }
+    while (row < body_end) { frame_row(row); ob("\033[K"); row++; }
+    g_frame.body_end = body_end;
 
     draw_queue_panel();
 
     if (g_queue_rows <= 0) {
-        obf("\033[%d;1H", g_rows - 3);
+        frame_row(g_rows - 3);
         ob(C_SEP);
         for (int i = 0; i < g_cols; i++) ob(HL);
         ob(RS);
         ob("\033[K");
-        obf("\033[%d;1H", g_rows - 2);
+        frame_row(g_rows - 2);
         draw_status(tok, pct, cl);
         ob("\033[K");
-        obf("\033[%d;1H", g_rows - 1);
+        frame_row(g_rows - 1);
         ob(C_QBG);
         ob("\033[K");
-        obf("\033[%d;1H", g_rows); draw_hotkeys_footer();
+        frame_row(g_rows); draw_hotkeys_footer();
         ob("\033[K");
     } else {
-        obf("\033[%d;1H", g_rows - 2);
+        frame_row(g_rows - 2);
         ob(C_SEP);
         for (int i = 0; i < g_cols; i++) ob(HL);
         ob(RS);
         ob("\033[K");
-        obf("\033[%d;1H", g_rows - 1);
+        frame_row(g_rows - 1);
         draw_status(tok, pct, cl);
         ob("\033[K");
-        obf("\033[%d;1H", g_rows); draw_hotkeys_footer();
+        frame_row(g_rows); draw_hotkeys_footer();
         ob("\033[K");
     }
-    if (g_sync_enabled) { ob("\033[?2026l"); g_sync_end_count++; }
 
-    ob_flush();
+    frame_commit(first);
+    if (g_bench_mode) {
+        perf_add(PERF_DRAW_US, now_us() - t_draw0);
+        perf_add(PERF_FRAME_BYTES, g_out_bytes - out0);
+    }
 }
 
 /* ── Terminal ──────────────────────────────────────────────────────────── */
@@ -5305,6 +8169,9 @@ static void term_restore(void) {
 #define INP_WHEEL_DOWN 10020
 #define INP_MOUSE_OPEN 10021
 #define INP_MOUSE_MOVE 10022
+#define INP_SEARCH 10023
+#define INP_SEARCH_NEXT 10024
+#define INP_SEARCH_PREV 10025
 #define INP_CHAR_BASE 20000
 
 static int decode_sgr_mouse(const unsigned char *buf, ssize_t n) {
@@ -5495,6 +8362,7 @@ static int poll_input(int fd, int timeout_ms, int input_mode) {
             if (c == 0x11) return INP_CTRL_QUIT; /* Ctrl+Q */
             if (c == 0x04) return INP_QDELETE;   /* Ctrl+D */
             if (c == 0x16) return INP_ATTACH_CLIP; /* Ctrl+V */
+            if (c == 0x06) return INP_SEARCH;      /* Ctrl+F */
             if (c == '\t') return INP_CHAR_BASE + (int)' ';
             if (c == 0x1b) return INP_ESC;
             if (c == '\r') return INP_ENTER;
@@ -5525,13 +8393,2041 @@ static int poll_input(int fd, int timeout_ms, int input_mode) {
             return INP_QUEUE_UP;
         } else if (buf[i] == 'j') {
             return INP_QUEUE_DOWN;
+        } else if (buf[i] == '/' || buf[i] == 0x06) {
+            return INP_SEARCH;
+        } else if (buf[i] == 'n') {
+            return INP_SEARCH_NEXT;
+        } else if (buf[i] == 'N') {
+            return INP_SEARCH_PREV;
         }
     }
     return delta;
 }
 
+/* ── Watcher ───────────────────────────────────────────────────────────── */
+
+/* The main loop blocks here instead of waking every 20ms to stat files.
+ * kqueue (macOS) or inotify + pidfd (Linux) report transcript, queue and
+ * editor changes together with tty input and signals; without them the
+ * loop falls back to the short poll where every pass rechecks everything.
+ * A slow tick still rechecks everything in case an event was missed. */
+
+#define WATCH_TTY        0x01
+#define WATCH_TRANSCRIPT 0x02
+#define WATCH_QUEUE      0x04
+#define WATCH_PROC       0x08
+#define WATCH_ALL        (WATCH_TRANSCRIPT | WATCH_QUEUE | WATCH_PROC)
+
+#define WATCH_POLL_MS      20
+#define WATCH_TICK_MS      2000
+#define WATCH_PROC_POLL_MS 250
+
+typedef struct {
+    int active;
+    int fd;                       /* kqueue or inotify instance */
+    int proc_watched;
+    pid_t pid;
+    const char *transcript;
+    const char *queue;
+    const char *tname, *qname;
+    char tdir[PATH_MAX], qdir[PATH_MAX];
+    char adir[PATH_MAX];          /* the transcript's subagents, see agents_dir_for() */
+#if defined(__APPLE__)
+    int t_fd, q_fd, td_fd, qd_fd;
+    int ad_fd, a_fd[AGENTS_MAX];  /* the directory, and the files in it */
+#elif defined(__linux__)
+    int pid_fd;
+    int td_wd, qd_wd, ad_wd;
+#endif
+} Watcher;
+
+static const char *watch_split_dir(const char *path, char *dir, size_t dircap) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        snprintf(dir, dircap, ".");
+        return path;
+    }
+    size_t n = (size_t)(slash - path);
+    if (n == 0) n = 1;
+    if (n >= dircap) n = dircap - 1;
+    memcpy(dir, path, n);
+    dir[n] = '\0';
+    return slash + 1;
+}
+
+static void watch_drain(int fd) {
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0) {}
+}
+
+#if defined(__APPLE__)
+
+#define WATCH_VNODE_FLAGS (NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE)
+
+static int watch_vnode(Watcher *w, const char *path, int what, int *fd_out) {
+    if (*fd_out >= 0 || !path || !*path) return *fd_out;
+    int fd = open(path, O_EVTONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct kevent kev;
+    EV_SET(&kev, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, WATCH_VNODE_FLAGS, 0, (void *)(intptr_t)what);
+    if (kevent(w->fd, &kev, 1, NULL, 0, NULL) != 0) { close(fd); return -1; }
+    *fd_out = fd;
+    return fd;
+}
+
+static void watch_unvnode(int *fd) {
+    /* Closing the descriptor removes its knote. */
+    if (*fd >= 0) close(*fd);
+    *fd = -1;
+}
+
+/* A directory vnode only sees entries come and go, so each subagent
+ * transcript gets one of its own; they are all opened again whenever the
+ * directory changes.  The directory may not exist yet. */
+static void watch_agents(Watcher *w) {
+    if (!w->adir[0]) return;
+    if (w->ad_fd < 0 && watch_vnode(w, w->adir, WATCH_TRANSCRIPT, &w->ad_fd) < 0) return;
+    for (int i = 0; i < AGENTS_MAX; i++) watch_unvnode(&w->a_fd[i]);
+    DIR *d = opendir(w->adir);
+    if (!d) return;
+    struct dirent *de;
+    int n = 0;
+    while (n < AGENTS_MAX && (de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+        if (len <= 6 || strcmp(de->d_name + len - 6, ".jsonl") != 0) continue;
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "%s/%s", w->adir, de->d_name) >= (int)sizeof(path)) continue;
+        if (watch_vnode(w, path, WATCH_TRANSCRIPT, &w->a_fd[n]) >= 0) n++;
+    }
+    closedir(d);
+}
+
+static int watcher_backend_open(Watcher *w, int tty_fd) {
+    w->fd = kqueue();
+    if (w->fd < 0) return -1;
+    struct kevent kev[3];
+    int n = 0;
+    EV_SET(&kev[n++], tty_fd, EVFILT_READ, EV_ADD, 0, 0, (void *)(intptr_t)WATCH_TTY);
+    EV_SET(&kev[n++], g_wake_pipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+    if (kevent(w->fd, kev, n, NULL, 0, NULL) != 0) return -1;
+    if (w->pid > 0) {
+        EV_SET(&kev[0], w->pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, (void *)(intptr_t)WATCH_PROC);
+        w->proc_watched = kevent(w->fd, kev, 1, NULL, 0, NULL) == 0;
+    }
+    if (w->transcript) {
+        if (watch_vnode(w, w->tdir, WATCH_TRANSCRIPT, &w->td_fd) < 0) return -1;
+        (void)watch_vnode(w, w->transcript, WATCH_TRANSCRIPT, &w->t_fd);
+        watch_agents(w);
+    }
+    if (w->queue) {
+        if (watch_vnode(w, w->qdir, WATCH_QUEUE, &w->qd_fd) < 0) return -1;
+        (void)watch_vnode(w, w->queue, WATCH_QUEUE, &w->q_fd);
+    }
+    return 0;
+}
+
+static int watcher_backend_wait(Watcher *w, int tty_fd, int timeout_ms, int *flags_out) {
+    (void)tty_fd;
+    if (w->adir[0] && w->ad_fd < 0) watch_agents(w);
+    struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+    struct kevent ev[8];
+    int n = kevent(w->fd, NULL, 0, ev, 8, &ts);
+    if (n <= 0) return n;
+    int flags = 0, agents = 0;
+    for (int i = 0; i < n; i++) {
+        int what = (int)(intptr_t)ev[i].udata;
+        if (ev[i].filter == EVFILT_READ && what == 0) { watch_drain(g_wake_pipe[0]); continue; }
+        flags |= what;
+        if (ev[i].filter != EVFILT_VNODE) continue;
+        if ((int)ev[i].ident == w->ad_fd) {
+            agents = 1;
+            if (ev[i].fflags & (NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE)) watch_unvnode(&w->ad_fd);
+            continue;
+        }
+        if (!(ev[i].fflags & (NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE))) continue;
+        /* The file was replaced (queue rewrites rename over it); re-watch the new inode. */
+        if ((int)ev[i].ident == w->t_fd) watch_unvnode(&w->t_fd);
+        if ((int)ev[i].ident == w->q_fd) watch_unvnode(&w->q_fd);
+    }
+    if (flags & WATCH_TRANSCRIPT) (void)watch_vnode(w, w->transcript, WATCH_TRANSCRIPT, &w->t_fd);
+    if (flags & WATCH_QUEUE) (void)watch_vnode(w, w->queue, WATCH_QUEUE, &w->q_fd);
+    if (agents) watch_agents(w);
+    *flags_out = flags;
+    return n;
+}
+
+static void watcher_backend_close(Watcher *w) {
+    watch_unvnode(&w->t_fd);
+    watch_unvnode(&w->q_fd);
+    watch_unvnode(&w->td_fd);
+    watch_unvnode(&w->qd_fd);
+    watch_unvnode(&w->ad_fd);
+    for (int i = 0; i < AGENTS_MAX; i++) watch_unvnode(&w->a_fd[i]);
+}
+
+#elif defined(__linux__)
+
+/* Directory watches see appends to, and renames over, the files inside. */
+#define WATCH_DIR_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+static int watcher_backend_open(Watcher *w, int tty_fd) {
+    (void)tty_fd;
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) return -1;
+    if (w->transcript && (w->td_wd = inotify_add_watch(w->fd, w->tdir, WATCH_DIR_MASK)) < 0) return -1;
+    if (w->queue && (w->qd_wd = inotify_add_watch(w->fd, w->qdir, WATCH_DIR_MASK)) < 0) return -1;
+    /* Subagents may start later; watcher_backend_wait() tries again. */
+    if (w->adir[0]) w->ad_wd = inotify_add_watch(w->fd, w->adir, WATCH_DIR_MASK);
+#ifdef SYS_pidfd_open
+    if (w->pid > 0) {
+        w->pid_fd = (int)syscall(SYS_pidfd_open, w->pid, 0);
+        w->proc_watched = w->pid_fd >= 0;
+    }
+#endif
+    return 0;
+}
+
+static int watch_inotify_events(Watcher *w) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int flags = 0;
+    for (;;) {
+        ssize_t n = read(w->fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) { flags |= WATCH_ALL; continue; }
+            if ((ev->mask & IN_IGNORED) && ev->wd == w->ad_wd) { w->ad_wd = -1; continue; }
+            if (ev->len == 0) continue;
+            if (ev->wd == w->ad_wd) { flags |= WATCH_TRANSCRIPT; continue; }
+            /* Both paths may share one directory and therefore one wd. */
+            if (ev->wd == w->td_wd && w->tname && strcmp(ev->name, w->tname) == 0) flags |= WATCH_TRANSCRIPT;
+            if (ev->wd == w->qd_wd && w->qname && strcmp(ev->name, w->qname) == 0) flags |= WATCH_QUEUE;
+        }
+    }
+    return flags;
+}
+
+static int watcher_backend_wait(Watcher *w, int tty_fd, int timeout_ms, int *flags_out) {
+    if (w->adir[0] && w->ad_wd < 0) w->ad_wd = inotify_add_watch(w->fd, w->adir, WATCH_DIR_MASK);
+    struct pollfd pfd[4];
+    int n = 0;
+    pfd[n].fd = tty_fd; pfd[n].events = POLLIN; n++;
+    pfd[n].fd = g_wake_pipe[0]; pfd[n].events = POLLIN; n++;
+    pfd[n].fd = w->fd; pfd[n].events = POLLIN; n++;
+    if (w->pid_fd >= 0) { pfd[n].fd = w->pid_fd; pfd[n].events = POLLIN; n++; }
+    int rc = poll(pfd, (nfds_t)n, timeout_ms);
+    if (rc <= 0) return rc;
+    int flags = 0;
+    if (pfd[0].revents) flags |= WATCH_TTY;
+    if (pfd[1].revents) watch_drain(g_wake_pipe[0]);
+    if (pfd[2].revents) flags |= watch_inotify_events(w);
+    if (n > 3 && pfd[3].revents) flags |= WATCH_PROC;
+    *flags_out = flags;
+    return rc;
+}
+
+static void watcher_backend_close(Watcher *w) {
+    if (w->pid_fd >= 0) close(w->pid_fd);
+    w->pid_fd = -1;
+}
+
+#endif
+
+static void watcher_close(Watcher *w) {
+#if defined(__APPLE__) || defined(__linux__)
+    watcher_backend_close(w);
+#endif
+    if (w->fd >= 0) close(w->fd);
+    w->fd = -1;
+    w->active = 0;
+    w->proc_watched = 0;
+    for (int i = 0; i < 2; i++) {
+        if (g_wake_pipe[i] >= 0) close(g_wake_pipe[i]);
+        g_wake_pipe[i] = -1;
+    }
+}
+
+static void watcher_open(Watcher *w, int tty_fd, const char *transcript, const char *queue, pid_t pid) {
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+#if defined(__APPLE__)
+    w->t_fd = w->q_fd = w->td_fd = w->qd_fd = w->ad_fd = -1;
+    for (int i = 0; i < AGENTS_MAX; i++) w->a_fd[i] = -1;
+#elif defined(__linux__)
+    w->pid_fd = -1;
+    w->td_wd = w->qd_wd = w->ad_wd = -1;
+#endif
+    w->pid = pid;
+    if (transcript && *transcript) {
+        w->transcript = transcript;
+        w->tname = watch_split_dir(transcript, w->tdir, sizeof(w->tdir));
+        agents_dir_for(transcript, w->adir, sizeof(w->adir));
+    }
+    if (queue && *queue) {
+        w->queue = queue;
+        w->qname = watch_split_dir(queue, w->qdir, sizeof(w->qdir));
+    }
+    if (pipe(g_wake_pipe) != 0) {
+        g_wake_pipe[0] = g_wake_pipe[1] = -1;
+    } else {
+        for (int i = 0; i < 2; i++) {
+            fcntl(g_wake_pipe[i], F_SETFL, fcntl(g_wake_pipe[i], F_GETFL) | O_NONBLOCK);
+            fcntl(g_wake_pipe[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+#if defined(__APPLE__) || defined(__linux__)
+    if (g_wake_pipe[0] < 0 || env_enabled("CLAUDE_PAGER_STAT_POLL")) return;
+    if (watcher_backend_open(w, tty_fd) != 0) {
+        PDBG("watcher unavailable errno=%d; using stat poll\n", errno);
+        watcher_backend_close(w);
+        if (w->fd >= 0) close(w->fd);
+        w->fd = -1;
+        w->proc_watched = 0;
+        return;
+    }
+    w->active = 1;
+    PDBG("watcher active proc=%d\n", w->proc_watched);
+#else
+    (void)tty_fd;
+#endif
+}
+
+/* Block until something may need attention and return which WATCH_*
+ * sources to recheck. A zero timeout only collects pending events; any
+ * other value waits up to the safety tick. */
+static int watcher_wait(Watcher *w, int tty_fd, int timeout_ms) {
+    if (!w->active) {
+        if (timeout_ms != 0) {
+            fd_set fds;
+            struct timeval tv = { 0, WATCH_POLL_MS * 1000 };
+            int wake = g_wake_pipe[0];
+            FD_ZERO(&fds); FD_SET(tty_fd, &fds);
+            if (wake >= 0) FD_SET(wake, &fds);
+            if (select((wake > tty_fd ? wake : tty_fd) + 1, &fds, NULL, NULL, &tv) > 0 &&
+                wake >= 0 && FD_ISSET(wake, &fds)) {
+                watch_drain(wake);
+            }
+        }
+        return WATCH_ALL;
+    }
+    if (timeout_ms != 0) timeout_ms = (w->proc_watched || w->pid <= 0) ? WATCH_TICK_MS : WATCH_PROC_POLL_MS;
+    int flags = 0;
+#if defined(__APPLE__) || defined(__linux__)
+    int rc = watcher_backend_wait(w, tty_fd, timeout_ms, &flags);
+#else
+    int rc = 0;
+#endif
+    if (rc == 0 && timeout_ms > 0) return WATCH_ALL;
+    if (rc < 0) flags = 0;
+    if (!w->proc_watched && w->pid > 0) flags |= WATCH_PROC;
+    return flags;
+}
+
 /* ── Main loop ─────────────────────────────────────────────────────────── */
 
+#define TAIL_FIRST_MIN_BYTES (512 * 1024)
+
+/* Render just the end of a large transcript so the first frame does not wait
+ * for the whole file.  The record window grows until it fills a couple of
+ * screens; the render worker then goes on to load the full history. */
+static int render_tail_preview(const char *path, Lines *L, int want_rows,
+                               int ctx_lim, int *out_tok, double *out_pct) {
+    Items items; memset(&items, 0, sizeof(items));
+    IngestCursor cur; memset(&cur, 0, sizeof(cur));
+    off_t start = 0;
+    int used = 0;
+    long long t0 = now_us();
+    for (int records = 32; records <= 32768; records *= 4) {
+        if (ingest_transcript_tail(path, &items, &cur, records, &start) == INGEST_NONE) break;
+        L_free(L);
+        render_items_from(L, &items, 0);
+        used = 1;
+        if (L->n >= want_rows || start == 0) break;
+    }
+    if (used) {
+        ingest_usage(&cur, ctx_lim, out_tok, out_pct);
+        L_push(L, C_HDM "  " EMD " end of transcript " EMD RS);
+        L_push(L, ""); L_push(L, "");
+        if (start > 0) {
+            char b[128];
+            snprintf(b, sizeof(b), "  " C_HDM ELL " (loading %lld KB of earlier history)" RS,
+                     (long long)(start / 1024));
+            L_prepend(L, b);
+        }
+        PDBG("tail preview items=%d start=%lld lines=%d duration=%.2fms\n", items.n,
+             (long long)start, L->n, (double)(now_us() - t0) / 1000.0);
+    }
+    I_free(&items);
+    ingest_close(&cur);
+    return used;
+}
+
+/* ── Render worker ─────────────────────────────────────────────────────── */
+
+/* Parsing and rendering run on a worker thread so the UI loop keeps
+ * handling input and drawing while a transcript (re)loads.  The worker owns
+ * the items, the ingest cursor and a master Lines that it updates
+ * incrementally; after each load it publishes a Snapshot, which the UI
+ * thread takes over before waking up.  While the head rows stay put (no
+ * render cap, or nothing dropped yet) a snapshot only carries the rows past
+ * the prefix the UI already holds.
+ *
+ * Rows are numbered from the top of the transcript, counting the ones a
+ * cap dropped or a viewport window leaves out (L.dropped_total).  When
+ * the worker re-measures items above the rows it kept, `shift` says how
+ * far their numbers moved. */
+typedef struct {
+    Lines L;
+    int base;           /* rows of the UI's Lines kept ahead of L */
+    int tok;
+    double pct;
+    int preview;        /* tail preview; the full load follows */
+    int shift;
+    int view_seq;       /* viewport request this answers, 0 if none */
+    int view_row;       /* where the requested row is now; -1 for the tail */
+    int search_seq;     /* search request this answers, 0 if none */
+    int search_row;     /* the match's row, -1 for none */
+    int search_hit, search_hits;  /* its item among the matching ones */
+} Snapshot;
+
+/* One item's rows in a viewport window, cached apart from the window so
+ * scrolling back to it does not render it again. */
+typedef struct {
+    Lines *rows;        /* NULL until rendered, or once evicted */
+    int height;         /* measured rows, or an estimate until rendered; -1 unknown */
+    int after_blank;    /* context it was rendered in, see Lines.after_blank */
+    int ends_blank;     /* the row after it would follow a blank one; -1 unknown */
+    unsigned stamp;     /* LRU clock of its last use */
+} ItemBlock;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    int started;
+    int kick, stop;
+    /* Guarded by mu. */
+    Snapshot *pub;
+    int ui_stable;      /* rows of L unchanged since the UI's snapshot */
+    int pub_stable;     /* rows of L unchanged since the pending one */
+    const char *transcript;
+    int cols;           /* the UI's width, see worker_resize() */
+    int ctx_limit;
+    int tail_first;
+    int preview_rows;
+    int passes;
+    /* Owned by the worker thread. */
+    Items items;
+    IngestCursor cursor;
+    FileStamp st;
+    Lines L;
+    int mod_from;       /* first row changed since the last publish */
+    char cache_path[PATH_MAX];
+    unsigned long long cache_key;
+    long long cache_saved_us;
+    int cache_dirty;    /* rows changed since the last save */
+    int daemon;         /* this worker is the daemon's, see run_pager_daemon() */
+    int cache_hit;
+    int rendered;
+    int content_end;
+    int had_banner;
+    int load_seq;
+    int tok;
+    double pct;
+    /* Viewport window, on when view_rows > 0: L holds items win_lo up to
+     * win_hi, and the trailer when win_hi is the last; see worker_window(). */
+    int view_rows;
+    size_t blk_max;     /* bytes of cached item rows kept */
+    size_t blk_bytes;
+    ItemBlock *blk;
+    int blk_cap;
+    unsigned blk_clock;
+    int win_lo, win_hi;
+    int shift;          /* for the next snapshot */
+    int view_seq, view_req;     /* guarded by mu: the UI's latest request */
+    int view_served;
+    int view_ans_seq, view_ans_row;
+    /* Search, see worker_search_serve(). */
+    int srch_seq, srch_from, srch_dir;  /* guarded by mu: the UI's latest request */
+    char srch_req[SEARCH_MAX];
+    int srch_served;
+    SearchLevel srch_lv[SEARCH_LEVELS];  /* each level refines the one below */
+    int srch_depth;
+    int srch_ans_seq, srch_ans_row, srch_ans_hit;
+    /* Memory budget, on when rss_max > 0; see worker_budget(). */
+    size_t rss_max;
+    long rss_kb;        /* resident set after the last pass, -1 unknown */
+    int budget_passes;  /* passes that found it exceeded */
+    int budget_blocks;  /* cached blocks it evicted */
+    size_t budget_released;     /* transcript bytes handed back to the kernel */
+    /* Subagent transcripts followed along, see worker_agents_scan(). */
+    char agent_dir[PATH_MAX];   /* empty when off */
+    FileStamp agent_dir_st;
+    AgentSource *agents;        /* AGENTS_MAX slots, so their cursors stay put */
+    int nagents;
+} RenderWorker;
+
+static void snapshot_free(Snapshot *s) {
+    if (!s) return;
+    L_free(&s->L);
+    free(s);
+}
+
+static void worker_publish(RenderWorker *w, Snapshot *s, int stable) {
+    pthread_mutex_lock(&w->mu);
+    /* A snapshot the UI has not taken yet is simply superseded, but its
+     * renumbering and any request it answered carry over. */
+    Snapshot *old = w->pub;
+    if (old) {
+        if (!s->view_seq && old->view_seq) {
+            s->view_seq = old->view_seq;
+            s->view_row = old->view_row < 0 ? -1 : old->view_row + s->shift;
+        }
+        if (!s->search_seq && old->search_seq) {
+            s->search_seq = old->search_seq;
+            s->search_row = old->search_row < 0 ? -1 : old->search_row + s->shift;
+            s->search_hit = old->search_hit;
+            s->search_hits = old->search_hits;
+        }
+        s->shift += old->shift;
+    }
+    w->pub = s;
+    w->pub_stable = stable;
+    pthread_mutex_unlock(&w->mu);
+    snapshot_free(old);
+    wake_main_loop();
+}
+
+static Snapshot *worker_take(RenderWorker *w) {
+    pthread_mutex_lock(&w->mu);
+    Snapshot *s = w->pub;
+    w->pub = NULL;
+    if (s) w->ui_stable = w->pub_stable;
+    pthread_mutex_unlock(&w->mu);
+    return s;
+}
+
+/* Note that rows from `row` on changed; head changes pass 0. */
+static void worker_touch(RenderWorker *w, int row) {
+    if (row < w->mod_from) w->mod_from = row;
+}
+
+static void worker_publish_lines(RenderWorker *w) {
+    if (w->daemon) return;  /* no UI to publish to */
+    pthread_mutex_lock(&w->mu);
+    if (w->mod_from < w->ui_stable) w->ui_stable = w->mod_from;
+    if (w->mod_from < w->pub_stable) w->pub_stable = w->mod_from;
+    /* Whichever snapshot the UI ends up holding shares this prefix. */
+    int base = g_perf_compat ? 0 : w->ui_stable;
+    pthread_mutex_unlock(&w->mu);
+    w->mod_from = INT_MAX;
+    Snapshot *s = xmalloc(sizeof(*s));
+    if (!s) return;
+    if (!L_clone(&s->L, &w->L, base)) { free(s); return; }
+    s->base = base;
+    s->tok = w->tok;
+    s->pct = w->pct;
+    s->preview = 0;
+    s->shift = w->shift;
+    s->view_seq = w->view_ans_seq;
+    s->view_row = w->view_ans_row;
+    s->search_seq = w->srch_ans_seq;
+    s->search_row = w->srch_ans_row;
+    s->search_hit = w->srch_ans_hit;
+    s->search_hits = w->srch_depth ? w->srch_lv[w->srch_depth - 1].n : 0;
+    w->shift = 0;
+    w->view_ans_seq = 0;
+    w->srch_ans_seq = 0;
+    worker_publish(w, s, w->L.n);
+}
+
+/* Bring the UI's Lines up to a taken snapshot; consumes s->L. */
+static void snapshot_apply(Lines *L, Snapshot *s) {
+    if (s->base <= 0) {
+        L_free(L);
+        *L = s->L;
+        return;
+    }
+    L_truncate(L, s->base);
+    L_append(L, &s->L);
+    L->dropped_total = s->L.dropped_total;
+    L->rows_below = s->L.rows_below;
+    L_free(&s->L);
+}
+
+/* ── Viewport window ───────────────────────────────────────────────────── */
+
+/* With a viewport window the worker renders only the items around where
+ * the reader is, about view_rows rows of them, instead of the whole
+ * transcript.  Every item still has a height, measured when it was last
+ * rendered or guessed from its text, so rows keep transcript-wide numbers:
+ * L.dropped_total rows sit above the window and L.rows_below under it.
+ * Rendered items are cached one by one (ItemBlock) up to blk_max bytes,
+ * least recently used first out.  The UI asks for a new window when it
+ * nears either edge (worker_view()); while the window holds the tail it
+ * follows appends and drops whole items off its head. */
+#define VIEW_ROWS_DEFAULT 4000
+#define VIEW_CACHE_MB_DEFAULT 16
+
+/* Rows an item should take, counted from its text without rendering it.
+ * A diff's rows are only known once its payload is built. */
+static int item_estimate_rows(Item *it) {
+    if (it->type == IT_TU || it->type == IT_AGENT) return 2;
+    int built = it->src == SRC_PATCH && !it->text;
+    const char *text = built ? item_text(it) : it->text;
+    int nl = 0;
+    if (text || it->src == SRC_OWNED || built) {
+        for (const char *p = text; p && (p = strchr(p, '\n')); p++) nl++;
+    } else if (it->map && it->map->base && it->src_off < it->map->len) {
+        const char *v = it->map->base + it->src_off;
+        const char *end = it->src_len ? v + it->src_len : it->src == SRC_JSTR ? jskip_s(v) : jskip(v);
+        for (const char *p = v; p < end && (p = memchr(p, '\\', (size_t)(end - p))); p += 2) {
+            if (p + 1 < end && p[1] == 'n') nl++;
+        }
+    }
+    int lines = nl + 1, rows = 1 + lines;
+    if (it->type == IT_HUM) rows = 1 + (lines > MX_HUM ? MX_HUM + 1 : lines);
+    if (it->type == IT_TR) {
+        int cap = is_structured_patch_payload(text) ? MX_DIF : MX_RES;
+        rows = lines > cap ? cap + 1 : lines;
+    }
+    if (built) item_release_text(it);
+    return rows;
+}
+
+static size_t L_bytes(const Lines *l) {
+    return sizeof(*l) + l->arena_cap + sizeof(LineRow) * (size_t)l->cap +
+           sizeof(LineLink) * (size_t)l->links_cap + sizeof(int) * (size_t)l->vrow_cap;
+}
+
+static int worker_blk_reserve(RenderWorker *w, int n) {
+    if (n <= w->blk_cap) return 1;
+    int nc = w->blk_cap ? w->blk_cap : 256;
+    while (nc < n) nc *= 2;
+    ItemBlock *nb = xrealloc(w->blk, sizeof(ItemBlock) * (size_t)nc);
+    if (!nb) return 0;
+    for (int i = w->blk_cap; i < nc; i++) nb[i] = (ItemBlock){NULL, -1, 0, -1, 0};
+    w->blk = nb;
+    w->blk_cap = nc;
+    return 1;
+}
+
+static void worker_blk_drop(RenderWorker *w, int i) {
+    ItemBlock *b = &w->blk[i];
+    if (b->rows) {
+        w->blk_bytes -= L_bytes(b->rows);
+        L_free(b->rows);
+        free(b->rows);
+        b->rows = NULL;
+    }
+}
+
+/* Forget items from `from` on (they were relabelled or rebuilt). */
+static void worker_blk_reset(RenderWorker *w, int from) {
+    for (int i = from; i < w->blk_cap; i++) {
+        worker_blk_drop(w, i);
+        w->blk[i] = (ItemBlock){NULL, -1, 0, -1, 0};
+    }
+}
+
+static void worker_blk_free(RenderWorker *w) {
+    worker_blk_reset(w, 0);
+    free(w->blk);
+    w->blk = NULL;
+    w->blk_cap = 0;
+    w->blk_bytes = 0;
+}
+
+static int worker_item_rows(RenderWorker *w, int i) {
+    ItemBlock *b = &w->blk[i];
+    if (b->height < 0) b->height = item_estimate_rows(&w->items.d[i]);
+    return b->height;
+}
+
+/* Number every item's first row from the heights; content_end follows the
+ * last one. */
+static void worker_relayout(RenderWorker *w) {
+    int row = 0;
+    for (int i = 0; i < w->items.n; i++) {
+        w->items.d[i].line0 = row;
+        row += worker_item_rows(w, i);
+    }
+    w->content_end = row;
+}
+
+typedef struct {
+    unsigned stamp;
+    int i;
+} BlkAge;
+
+static int blk_age_cmp(const void *a, const void *b) {
+    unsigned x = ((const BlkAge *)a)->stamp, y = ((const BlkAge *)b)->stamp;
+    return x < y ? -1 : x > y;
+}
+
+/* Drop the least recently used blocks outside the window until the cache
+ * is back under three quarters of blk_max. */
+static void worker_blk_evict(RenderWorker *w) {
+    if (w->blk_bytes <= w->blk_max) return;
+    int n = 0;
+    for (int i = 0; i < w->items.n; i++) {
+        if (w->blk[i].rows && (i < w->win_lo || i >= w->win_hi)) n++;
+    }
+    BlkAge *age = n > 0 ? xmalloc(sizeof(BlkAge) * (size_t)n) : NULL;
+    if (!age) return;
+    n = 0;
+    for (int i = 0; i < w->items.n; i++) {
+        if (w->blk[i].rows && (i < w->win_lo || i >= w->win_hi)) age[n++] = (BlkAge){w->blk[i].stamp, i};
+    }
+    qsort(age, (size_t)n, sizeof(*age), blk_age_cmp);
+    size_t low = w->blk_max / 4 * 3;
+    for (int k = 0; k < n && w->blk_bytes > low; k++) worker_blk_drop(w, age[k].i);
+    free(age);
+}
+
+/* Resident set of the process in KB, -1 when unknown. */
+static long rss_now_kb(void) {
+#if defined(__APPLE__)
+    mach_task_basic_info_data_t ti;
+    mach_msg_type_number_t n = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&ti, &n) != KERN_SUCCESS) return -1;
+    return (long)(ti.resident_size / 1024);
+#elif defined(__linux__)
+    char b[128];
+    int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, b, sizeof(b) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    b[n] = '\0';
+    long size = 0, res = 0;
+    if (sscanf(b, "%ld %ld", &size, &res) != 2) return -1;
+    return res * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return -1;
+#endif
+}
+
+/* Hold the process under CLAUDE_PAGER_MAX_RSS_MB.  Over budget, every
+ * cached block outside the window goes, then the transcript pages that
+ * parsing and rendering faulted in: the mapping is private and never
+ * written, so the kernel reads them back from the file when an item is
+ * rendered or searched again.  Decoded item text is already dropped after
+ * each render, and the window bounds the rows themselves. */
+static void worker_budget(RenderWorker *w) {
+    if (w->rss_max == 0) return;
+    long kb = rss_now_kb();
+    w->rss_kb = kb;
+    if (kb < 0 || (size_t)kb << 10 <= w->rss_max) return;
+    w->budget_passes++;
+    for (int i = 0; i < w->items.n && i < w->blk_cap; i++) {
+        if (w->blk[i].rows && (i < w->win_lo || i >= w->win_hi)) {
+            worker_blk_drop(w, i);
+            w->budget_blocks++;
+        }
+    }
+    long pg = sysconf(_SC_PAGESIZE);
+    if (pg <= 0) pg = 4096;
+    for (int k = -1; k < w->nagents; k++) {
+        TranscriptMap *m = k < 0 ? &w->cursor.map : &w->agents[k].cur.map;
+        size_t whole = m->len / (size_t)pg * (size_t)pg;
+        if (m->base && whole > 0 && madvise(m->base, whole, MADV_DONTNEED) == 0) w->budget_released += whole;
+    }
+    syn_cache_free();
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    w->rss_kb = rss_now_kb();
+    PDBG("memory budget rss=%ldKB now=%ldKB max=%zuKB blocks=%d released=%zuKB\n", kb, w->rss_kb,
+         w->rss_max >> 10, w->budget_blocks, w->budget_released >> 10);
+}
+
+/* Item i's rows, rendered as if they followed a blank row or not. */
+static const Lines *worker_block(RenderWorker *w, int i, int after_blank) {
+    ItemBlock *b = &w->blk[i];
+    b->stamp = ++w->blk_clock;
+    if (b->rows && b->after_blank == after_blank) return b->rows;
+    worker_blk_drop(w, i);
+    Lines *rows = xmalloc(sizeof(*rows));
+    if (!rows) return NULL;
+    L_init(rows);
+    rows->after_blank = after_blank;
+    render_items_range(rows, &w->items, i, i + 1);
+    b->rows = rows;
+    b->after_blank = after_blank;
+    b->height = rows->n;
+    w->blk_bytes += L_bytes(rows);
+    return rows;
+}
+
+/* Append item i to the window's rows. */
+static void worker_window_append(RenderWorker *w, int i) {
+    Lines *L = &w->L;
+    int after_blank = L->n > 0 ? L_row(L, L->n - 1)->len == 0 : (i > 0 && w->blk[i - 1].ends_blank > 0);
+    const Lines *rows = worker_block(w, i, after_blank);
+    w->items.d[i].line0 = L->dropped_total + L->n;
+    if (rows) L_append(L, rows);
+    w->blk[i].height = rows ? rows->n : 0;
+    w->blk[i].ends_blank = L->n > 0 ? L_row(L, L->n - 1)->len == 0 : after_blank;
+}
+
+static void worker_window_trailer(RenderWorker *w) {
+    Lines *L = &w->L;
+    w->content_end = L->dropped_total + L->n;
+    L->rows_below = 0;
+    L_push(L, C_HDM "  " EMD " end of transcript " EMD RS);
+    L_push(L, ""); L_push(L, "");
+}
+
+/* The items to keep around item k (items.n for the tail): half the rows
+ * from k on, the rest above it. */
+static void worker_window_pick(RenderWorker *w, int k, int *lo, int *hi) {
+    int n = w->items.n, rows = 0;
+    int h = k < n ? k : n;
+    while (h < n && (h == k || rows < w->view_rows / 2)) rows += worker_item_rows(w, h++);
+    int l = k < n ? k : n;
+    while (l > 0 && rows < w->view_rows) rows += worker_item_rows(w, --l);
+    *lo = l;
+    *hi = h;
+}
+
+/* Rebuild the window's rows for items lo..hi-1 from cached blocks. */
+static void worker_window_build(RenderWorker *w, int lo, int hi) {
+    Lines *L = &w->L;
+    int n = w->items.n;
+    int ref = w->win_lo < n ? w->win_lo : -1;
+    int ref_row = ref >= 0 ? w->items.d[ref].line0 : 0;
+    worker_relayout(w);
+    L_free(L);
+    L->dropped_total = lo < n ? w->items.d[lo].line0 : w->content_end;
+    for (int i = lo; i < hi; i++) worker_window_append(w, i);
+    w->win_lo = lo;
+    w->win_hi = hi;
+    worker_relayout(w);
+    if (hi >= n) worker_window_trailer(w);
+    else L->rows_below = w->content_end - w->items.d[hi].line0;
+    if (ref >= 0) w->shift += w->items.d[ref].line0 - ref_row;
+    worker_touch(w, 0);
+    worker_blk_evict(w);
+}
+
+/* worker_render() for a viewport window. */
+static void worker_render_view(RenderWorker *w, int from) {
+    Lines *L = &w->L;
+    int n = w->items.n;
+    if (!worker_blk_reserve(w, n)) return;
+    int at_tail = w->win_hi >= w->rendered;
+    worker_blk_reset(w, from);
+    if (from == 0) {
+        int lo, hi;
+        w->win_lo = w->win_hi = 0;
+        worker_window_pick(w, n, &lo, &hi);
+        worker_window_build(w, lo, hi);
+    } else if (at_tail && from >= w->win_lo) {
+        /* Following the tail: render what changed onto the end. */
+        int keep = (from < w->rendered ? w->items.d[from].line0 : w->content_end) - L->dropped_total;
+        L_truncate(L, keep);
+        worker_touch(w, keep);
+        for (int i = from; i < n; i++) worker_window_append(w, i);
+        w->win_hi = n;
+        worker_window_trailer(w);
+        if (L->n > 2 * w->view_rows) {
+            int drop = 0, lo = w->win_lo;
+            while (lo < n - 1 && L->n - drop - w->blk[lo].height >= w->view_rows) drop += w->blk[lo++].height;
+            L_drop_head(L, drop);
+            w->win_lo = lo;
+            worker_touch(w, 0);
+        }
+        worker_blk_evict(w);
+    } else if (from >= w->win_hi) {
+        /* Appended under a window elsewhere: only the count below grows. */
+        worker_relayout(w);
+        L->rows_below = w->content_end - w->items.d[w->win_hi].line0;
+    } else {
+        worker_window_build(w, w->win_lo, at_tail ? n : w->win_hi);
+    }
+    w->rendered = n;
+}
+
+/* The last item starting at or above `row`; there must be one. */
+static int worker_item_at(const RenderWorker *w, int row) {
+    int a = 0, b = w->items.n - 1;
+    while (a < b) {
+        int mid = a + (b - a + 1) / 2;
+        if (w->items.d[mid].line0 <= row) a = mid;
+        else b = mid - 1;
+    }
+    return a;
+}
+
+/* Serve the UI's latest viewport request: keep the window around the row
+ * it asked for (-1 for the tail) and say where that row is now. */
+static void worker_view_serve(RenderWorker *w) {
+    pthread_mutex_lock(&w->mu);
+    int seq = w->view_seq, row = w->view_req;
+    pthread_mutex_unlock(&w->mu);
+    if (!w->view_rows || seq == w->view_served || w->items.n <= 0) return;
+    w->view_served = seq;
+    if (!worker_blk_reserve(w, w->items.n)) return;
+    int n = w->items.n, lo, hi, k = n, delta = 0;
+    if (row >= 0) {
+        k = worker_item_at(w, row);
+        delta = row - w->items.d[k].line0;
+    }
+    long long t0 = now_us();
+    worker_window_pick(w, k, &lo, &hi);
+    worker_window_build(w, lo, hi);
+    if (k < n) {
+        int h = w->blk[k].height;
+        if (delta >= h) delta = h > 0 ? h - 1 : 0;
+        if (delta < 0) delta = 0;
+        w->view_ans_row = w->items.d[k].line0 + delta;
+    } else {
+        w->view_ans_row = -1;
+    }
+    w->view_ans_seq = seq;
+    PDBG("viewport window row=%d items=%d..%d rows=%d above=%d below=%d cached=%zuKB duration=%.2fms\n",
+         row, lo, hi, w->L.n, w->L.dropped_total, w->L.rows_below, w->blk_bytes >> 10,
+         (double)(now_us() - t0) / 1000.0);
+    worker_publish_lines(w);
+}
+
+/* ── Transcript search ─────────────────────────────────────────────────── */
+
+/* Rows are numbered as in Snapshot, so without a viewport window a capped
+ * master's banner row counts too. */
+static int worker_search_bias(const RenderWorker *w) {
+    return w->view_rows > 0 ? 0 : w->had_banner;
+}
+
+/* Forget what is known about items from `from` on (they were rewritten). */
+static void worker_search_forget(RenderWorker *w, int from) {
+    for (int d = 0; d < w->srch_depth; d++) {
+        SearchLevel *lv = &w->srch_lv[d];
+        while (lv->n > 0 && lv->hits[lv->n - 1] >= from) lv->n--;
+        if (lv->upto > from) lv->upto = from;
+    }
+}
+
+static int worker_search_reserve(SearchLevel *lv, int n) {
+    if (n > lv->cap) {
+        int nc = lv->cap ? lv->cap : 256;
+        while (nc < n) nc *= 2;
+        int *nh = xrealloc(lv->hits, sizeof(int) * (size_t)nc);
+        if (!nh) return 0;
+        lv->hits = nh;
+        lv->cap = nc;
+    }
+    return 1;
+}
+
+/* Does every match of p also match o?  It does when p contains o. */
+static int search_pat_within(const SearchPat *p, const SearchPat *o) {
+    return o->n > 0 && p->n >= o->n && search_mem(p->q, (size_t)p->n, o->q, (size_t)o->n, o->icase);
+}
+
+/* Bring the top level up to pattern p.  Levels whose pattern p does not
+ * contain are popped (a backspace lands on the level it typed over), and
+ * when one is left only the items that matched it are checked against p,
+ * plus any appended since; only a fresh query scans the whole transcript. */
+static void worker_search_collect(RenderWorker *w, const SearchPat *p) {
+    int n = w->items.n;
+    if (p->n <= 0) {
+        w->srch_depth = 0;
+        return;
+    }
+    while (w->srch_depth > 0 && !search_pat_within(p, &w->srch_lv[w->srch_depth - 1].pat)) w->srch_depth--;
+    SearchLevel *base = w->srch_depth ? &w->srch_lv[w->srch_depth - 1] : NULL;
+    SearchLevel *lv = base;
+    int same = base && p->n == base->pat.n && p->icase == base->pat.icase && memcmp(p->q, base->pat.q, (size_t)p->n) == 0;
+    if (!same && w->srch_depth < SEARCH_LEVELS) lv = &w->srch_lv[w->srch_depth++];
+    if (!worker_search_reserve(lv, n)) {
+        w->srch_depth = 0;
+        return;
+    }
+    int kept = 0, start = 0;
+    if (same) {
+        kept = lv->n;
+        start = lv->upto;
+    } else if (base) {
+        /* lv may be base itself once the stack is full: kept never passes j. */
+        start = base->upto;
+        for (int j = 0, nb = base->n; j < nb; j++) {
+            int i = base->hits[j];
+            if (search_item(&w->items.d[i], p)) lv->hits[kept++] = i;
+        }
+    }
+    for (int i = start; i < n; i++) {
+        if (search_item(&w->items.d[i], p)) lv->hits[kept++] = i;
+    }
+    lv->n = kept;
+    lv->upto = n;
+    lv->pat = *p;
+}
+
+/* Where item k's rows are in L, moving a viewport window to the item
+ * first if need be; 0 when the render cap dropped them. */
+static int worker_search_span(RenderWorker *w, int k, int *r0, int *h) {
+    for (int pass = 0; pass < 2; pass++) {
+        const Lines *L = &w->L;
+        int a = w->items.d[k].line0 - L->dropped_total + worker_search_bias(w);
+        int b = (k + 1 < w->items.n ? w->items.d[k + 1].line0 : w->content_end) - L->dropped_total + worker_search_bias(w);
+        if (a >= 0 && a < L->n) {
+            *r0 = a;
+            *h = (b < L->n ? b : L->n) - a;
+            return 1;
+        }
+        if (pass || w->view_rows <= 0 || !worker_blk_reserve(w, w->items.n)) break;
+        int lo, hi;
+        worker_window_pick(w, k, &lo, &hi);
+        worker_window_build(w, lo, hi);
+    }
+    return 0;
+}
+
+/* The first row of item k, from `start` on in direction dir, that shows
+ * the pattern; -1 if none does.  An item whose match shows on none of its
+ * rows (collapsed tool output, say) matches on its first one. */
+static int worker_search_row(RenderWorker *w, int k, int start, int dir) {
+    int r0, h, fallback = dir > 0 ? start <= 0 : start >= 0;
+    if (!worker_search_span(w, k, &r0, &h)) return fallback ? 0 : -1;
+    const Lines *L = &w->L;
+    const SearchPat *p = &w->srch_lv[w->srch_depth - 1].pat;
+    if (dir < 0 && start >= h) start = h - 1;
+    if (dir > 0 && start < 0) start = 0;
+    for (int r = start; r >= 0 && r < h; r += dir) {
+        if (search_row_has(L_get(L, r0 + r), L_row(L, r0 + r)->len, p)) return r;
+    }
+    for (int r = 0; r < h; r++) {
+        if (search_row_has(L_get(L, r0 + r), L_row(L, r0 + r)->len, p)) return -1;
+    }
+    return fallback ? 0 : -1;
+}
+
+/* The match after (dir > 0), before (dir < 0) or at or after (dir == 0)
+ * row `from`, wrapping around the transcript. */
+static int worker_search_step(RenderWorker *w, int from, int dir, int *hit, int *row) {
+    if (w->srch_depth <= 0 || w->items.n <= 0) return 0;
+    const int *hits = w->srch_lv[w->srch_depth - 1].hits;
+    int nh = w->srch_lv[w->srch_depth - 1].n, fwd = dir >= 0;
+    if (nh <= 0) return 0;
+    int bias = worker_search_bias(w);
+    from -= bias;
+    if (from < 0) from = 0;
+    int k0 = worker_item_at(w, from), rel = from - w->items.d[k0].line0;
+    int a = 0, b = nh;
+    while (a < b) {
+        int mid = a + (b - a) / 2;
+        if (hits[mid] < k0) a = mid + 1;
+        else b = mid;
+    }
+    int here = a < nh && hits[a] == k0;
+    if (here) {
+        int r = worker_search_row(w, k0, fwd ? rel + (dir > 0) : rel - 1, fwd ? 1 : -1);
+        if (r >= 0) {
+            *hit = a;
+            *row = w->items.d[k0].line0 + r + bias;
+            return 1;
+        }
+    }
+    int j = fwd ? a + here : a - 1;
+    j = (j % nh + nh) % nh;
+    int k = hits[j];
+    int r = worker_search_row(w, k, fwd ? 0 : INT_MAX, fwd ? 1 : -1);
+    *hit = j;
+    *row = w->items.d[k].line0 + (r > 0 ? r : 0) + bias;
+    return 1;
+}
+
+/* Serve the UI's latest search request with the matching row, moving a
+ * viewport window to it. */
+static void worker_search_serve(RenderWorker *w) {
+    char q[SEARCH_MAX];
+    pthread_mutex_lock(&w->mu);
+    int seq = w->srch_seq, from = w->srch_from, dir = w->srch_dir;
+    memcpy(q, w->srch_req, sizeof(q));
+    pthread_mutex_unlock(&w->mu);
+    if (seq == w->srch_served) return;
+    w->srch_served = seq;
+    long long t0 = now_us();
+    SearchPat p;
+    search_pat_init(&p, q);
+    worker_search_collect(w, &p);
+    long long t1 = now_us();
+    w->srch_ans_row = -1;
+    w->srch_ans_hit = -1;
+    (void)worker_search_step(w, from, dir, &w->srch_ans_hit, &w->srch_ans_row);
+    w->srch_ans_seq = seq;
+    PDBG("search len=%d dir=%d hits=%d hit=%d row=%d scan=%.2fms total=%.2fms\n",
+         p.n, dir, w->srch_depth ? w->srch_lv[w->srch_depth - 1].n : 0, w->srch_ans_hit, w->srch_ans_row,
+         (double)(t1 - t0) / 1000.0, (double)(now_us() - t0) / 1000.0);
+    worker_publish_lines(w);
+}
+
+/* ── Render cache ──────────────────────────────────────────────────────── */
+
+/* The worker's state after a load (items, ingest cursor and rendered rows)
+ * is kept in ~/.claude/pager-cache, one file per transcript, so the next
+ * open only ingests what was appended since.  A file is used only when its
+ * version, width/environment key, inode and the bytes just before the saved
+ * offset all still match. */
+#define RCACHE_MAGIC "CPRCACHE"
+#define RCACHE_KEEP 32
+#define RCACHE_TAIL 4096
+#define RCACHE_SAVE_US 1000000LL
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t abi;
+    uint64_t key;
+    uint64_t dev, ino;
+    int64_t offset;
+    uint64_t tail_hash;
+    int32_t li, lcc, lcr;
+    int32_t rendered, content_end, had_banner, dropped_total;
+    int32_t win_lo, win_hi, rows_below;
+    int32_t nitems, nrows, nlinks;
+    uint64_t arena_len;
+} RenderCacheHeader;
+
+#define RCACHE_ABI ((uint32_t)(sizeof(RenderCacheHeader) << 16 | sizeof(LineRow) << 8 | sizeof(LineLink)))
+
+/* Settings that change what rendering produces, besides the width, the cap
+ * (or viewport windows) and the host and directory that file links resolve against. */
+static const char *const rcache_env[] = {
+    "CLAUDE_PAGER_LINK_REMOTE", "CLAUDE_PAGER_MD_TABLES", "CLAUDE_PAGER_MD_TABLE_MAX_ROWS",
+    "CLAUDE_PAGER_MD_TABLE_MAX_COLS", "CLAUDE_PAGER_DIFF_ANCHOR", "CLAUDE_PAGER_DIFF_HUNK_REF",
+    "CLAUDE_PAGER_MAX_RESULT_LINES", "CLAUDE_PAGER_MAX_DIFF_LINES", "CLAUDE_PAGER_TOOL_RAIL",
+    NULL
+};
+
+static unsigned long long render_cache_key(const RenderWorker *w) {
+    unsigned long long key = 1469598103934665603ULL;
+    int v[4] = { render_cols(), w->L.max_keep, w->view_rows > 0, (getenv("SSH_CONNECTION") || getenv("SSH_TTY")) ? 1 : 0 };
+    key = queue_hash_update(key, (const unsigned char *)v, sizeof(v));
+    char host[256] = "";
+    (void)gethostname(host, sizeof(host) - 1);
+    const char *vals[] = { host, getenv("HOME"), getenv("PWD") };
+    for (int i = 0; i < 3; i++) {
+        const char *s = vals[i] ? vals[i] : "";
+        key = queue_hash_update(key, (const unsigned char *)s, strlen(s) + 1);
+    }
+    for (int i = 0; rcache_env[i]; i++) {
+        const char *s = getenv(rcache_env[i]);
+        if (!s) continue;
+        key = queue_hash_update(key, (const unsigned char *)rcache_env[i], strlen(rcache_env[i]) + 1);
+        key = queue_hash_update(key, (const unsigned char *)s, strlen(s) + 1);
+    }
+    return key;
+}
+
+/* ~/.claude/pager-cache/<hash of the transcript path><ext> */
+static int render_cache_file(const char *transcript, const char *ext, char *out, size_t outlen) {
+    const char *home = getenv("HOME");
+    if (!home || !*home || !transcript || !*transcript) return 0;
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/.claude", home);
+    (void)mkdir(dir, 0700);
+    snprintf(dir, sizeof(dir), "%s/.claude/pager-cache", home);
+    (void)mkdir(dir, 0700);
+    char hex[17];
+    queue_hash_hex(queue_hash_update(1469598103934665603ULL, (const unsigned char *)transcript, strlen(transcript)),
+                   hex, sizeof(hex));
+    int n = snprintf(out, outlen, "%s/%s%s", dir, hex, ext);
+    return n > 0 && (size_t)n < outlen;
+}
+
+/* Hash of the bytes just before `offset`, to notice a rewritten prefix. */
+static int render_cache_tail_hash(int fd, off_t offset, uint64_t *out) {
+    char buf[RCACHE_TAIL];
+    off_t at = offset > RCACHE_TAIL ? offset - RCACHE_TAIL : 0;
+    size_t n = (size_t)(offset - at);
+    if (pread(fd, buf, n, at) != (ssize_t)n) return 0;
+    *out = queue_hash_update(1469598103934665603ULL, (const unsigned char *)buf, n);
+    return 1;
+}
+
+static int render_cache_put_str(SBuf *b, const char *s) {
+    int32_t n = s ? (int32_t)strlen(s) : -1;
+    return sb_putn(b, (const char *)&n, sizeof(n)) && (n <= 0 || sb_putn(b, s, n));
+}
+
+/* Keep only the newest RCACHE_KEEP files. */
+static void render_cache_prune(const char *path) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) return;
+    *slash = '\0';
+    DIR *d = opendir(dir);
+    if (!d) return;
+    int dfd = dirfd(d);
+    struct { char name[64]; time_t mtime; } keep[RCACHE_KEEP];
+    int n = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+        if (len < 7 || len >= sizeof(keep[0].name) || strcmp(de->d_name + len - 6, ".cache") != 0) continue;
+        struct stat st;
+        if (fstatat(dfd, de->d_name, &st, 0) != 0) continue;
+        /* Sorted newest first; whatever falls off the end goes. */
+        if (n == RCACHE_KEEP) {
+            if (st.st_mtime <= keep[n - 1].mtime) { unlinkat(dfd, de->d_name, 0); continue; }
+            unlinkat(dfd, keep[--n].name, 0);
+        }
+        int at = n++;
+        while (at > 0 && keep[at - 1].mtime < st.st_mtime) { keep[at] = keep[at - 1]; at--; }
+        memcpy(keep[at].name, de->d_name, len + 1);
+        keep[at].mtime = st.st_mtime;
+    }
+    closedir(d);
+}
+
+static void render_cache_save(RenderWorker *w) {
+    const IngestCursor *cur = &w->cursor;
+    const Lines *L = &w->L;
+    if (!w->cache_path[0] || !cur->valid || cur->offset <= 0 || g_oom) return;
+    RenderCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, RCACHE_MAGIC, sizeof(h.magic));
+    h.version = PAGER_RENDER_CACHE_VERSION;
+    h.abi = RCACHE_ABI;
+    h.key = w->cache_key;
+    h.dev = (uint64_t)cur->dev;
+    h.ino = (uint64_t)cur->ino;
+    h.offset = (int64_t)cur->offset;
+    if (!render_cache_tail_hash(cur->map.fd, cur->offset, &h.tail_hash)) return;
+    h.li = cur->li; h.lcc = cur->lcc; h.lcr = cur->lcr;
+    h.rendered = w->rendered;
+    h.content_end = w->content_end;
+    h.had_banner = w->had_banner;
+    h.dropped_total = L->dropped_total;
+    h.win_lo = w->win_lo;
+    h.win_hi = w->win_hi;
+    h.rows_below = L->rows_below;
+    h.nitems = w->items.n;
+    h.nrows = L->n;
+    for (int i = 0; i < L->n; i++) {
+        h.nlinks += L_row(L, i)->nlink;
+        h.arena_len += (uint64_t)L_row(L, i)->len + 1;
+    }
+
+    SBuf b;
+    sb_init(&b);
+    int ok = sb_putn(&b, (const char *)&h, sizeof(h));
+    for (int i = 0; ok && i < w->items.n; i++) {
+        const Item *it = &w->items.d[i];
+        int32_t f[4] = { it->type, it->is_err, it->line0, it->src };
+        uint64_t off[2] = { (uint64_t)it->src_off, (uint64_t)it->src_len };
+        ok = sb_putn(&b, (const char *)f, sizeof(f)) && sb_putn(&b, (const char *)off, sizeof(off)) &&
+             render_cache_put_str(&b, it->src == SRC_OWNED ? it->text : NULL) &&
+             render_cache_put_str(&b, it->label);
+    }
+    uint32_t at = 0;
+    int link0 = 0;
+    for (int i = 0; ok && i < L->n; i++) {
+        LineRow r = *L_row(L, i);
+        r.off = at;
+        r.link0 = link0;
+        at += (uint32_t)r.len + 1;
+        link0 += r.nlink;
+        ok = sb_putn(&b, (const char *)&r, sizeof(r));
+    }
+    for (int i = 0; ok && i < L->n; i++) {
+        ok = sb_putn(&b, L_get(L, i), L_row(L, i)->len + 1);
+    }
+    for (int i = 0; ok && i < L->n; i++) {
+        const LineRow *r = L_row(L, i);
+        for (int k = 0; ok && k < r->nlink; k++) {
+            const LineLink *lk = &L->links[r->link0 + k];
+            int32_t x[2] = { lk->x0, lk->x1 };
+            ok = sb_putn(&b, (const char *)x, sizeof(x)) && render_cache_put_str(&b, lk->uri);
+        }
+    }
+
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.XXXXXX", w->cache_path);
+    int fd = ok ? mkstemp(tmp) : -1;
+    if (fd >= 0) {
+        ssize_t wr = 0;
+        while (wr < b.n) {
+            ssize_t k = write(fd, b.d + wr, (size_t)(b.n - wr));
+            if (k <= 0) break;
+            wr += k;
+        }
+        ok = wr == b.n;
+        if (close(fd) != 0) ok = 0;
+        if (!ok || rename(tmp, w->cache_path) != 0) { unlink(tmp); ok = 0; }
+    }
+    if (fd >= 0 && ok && w->cache_saved_us == 0) render_cache_prune(w->cache_path);
+    w->cache_saved_us = now_us();
+    w->cache_dirty = 0;
+    PDBG("render cache save ok=%d bytes=%d items=%d rows=%d offset=%lld\n",
+         fd >= 0 && ok, b.n, h.nitems, h.nrows, (long long)h.offset);
+    sb_free(&b);
+}
+
+typedef struct {
+    const char *p, *end;
+    int bad;
+} RenderCacheReader;
+
+static const void *render_cache_take(RenderCacheReader *r, size_t n) {
+    if (r->bad || (size_t)(r->end - r->p) < n) { r->bad = 1; return NULL; }
+    const void *v = r->p;
+    r->p += n;
+    return v;
+}
+
+static int render_cache_i32(RenderCacheReader *r) {
+    int32_t v = 0;
+    const void *p = render_cache_take(r, sizeof(v));
+    if (p) memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* A NUL-terminated copy of the next string, or NULL when it was absent. */
+static char *render_cache_str(RenderCacheReader *r) {
+    int32_t n = render_cache_i32(r);
+    if (n < 0 || r->bad) return NULL;
+    const char *s = render_cache_take(r, (size_t)n);
+    if (!s) return NULL;
+    char *d = xmalloc((size_t)n + 1);
+    if (!d) { r->bad = 1; return NULL; }
+    memcpy(d, s, (size_t)n);
+    d[n] = '\0';
+    return d;
+}
+
+/* Restore the worker from its cache file; 0 leaves it untouched. */
+static int render_cache_load(RenderWorker *w) {
+    if (!w->cache_path[0]) return 0;
+    int cfd = open(w->cache_path, O_RDONLY | O_CLOEXEC);
+    if (cfd < 0) return 0;
+    struct stat cs;
+    if (fstat(cfd, &cs) != 0 || cs.st_size < (off_t)sizeof(RenderCacheHeader)) { close(cfd); return 0; }
+    void *map = mmap(NULL, (size_t)cs.st_size, PROT_READ, MAP_PRIVATE, cfd, 0);
+    close(cfd);
+    if (map == MAP_FAILED) return 0;
+    RenderCacheReader r = { map, (const char *)map + cs.st_size, 0 };
+    RenderCacheHeader h;
+    memcpy(&h, render_cache_take(&r, sizeof(h)), sizeof(h));
+    const char *why = NULL;
+    int tfd = -1;
+    struct stat ts;
+    uint64_t tail = 0;
+    if (memcmp(h.magic, RCACHE_MAGIC, sizeof(h.magic)) != 0 || h.version != PAGER_RENDER_CACHE_VERSION ||
+        h.abi != RCACHE_ABI) why = "version";
+    else if (h.key != w->cache_key) why = "key";
+    else if ((tfd = open(w->transcript, O_RDONLY | O_CLOEXEC)) < 0 || fstat(tfd, &ts) != 0) why = "open";
+    else if ((uint64_t)ts.st_dev != h.dev || (uint64_t)ts.st_ino != h.ino || ts.st_size < h.offset) why = "inode";
+    else if (!render_cache_tail_hash(tfd, (off_t)h.offset, &tail) || tail != h.tail_hash) why = "prefix";
+    if (why) {
+        PDBG("render cache miss reason=%s\n", why);
+        if (tfd >= 0) close(tfd);
+        munmap(map, (size_t)cs.st_size);
+        return 0;
+    }
+
+    Items items;
+    memset(&items, 0, sizeof(items));
+    Lines L;
+    L_init(&L);
+    L_set_limit(&L, w->L.max_keep);
+    for (int i = 0; i < h.nitems && !r.bad; i++) {
+        int f[4];
+        for (int k = 0; k < 4; k++) f[k] = render_cache_i32(&r);
+        uint64_t off = 0, len = 0;
+        const void *op = render_cache_take(&r, sizeof(off) * 2);
+        if (op) {
+            memcpy(&off, op, sizeof(off));
+            memcpy(&len, (const char *)op + sizeof(off), sizeof(len));
+        }
+        char *text = render_cache_str(&r);
+        char *label = render_cache_str(&r);
+        int n = items.n;
+        I_push(&items, f[0], text, label, f[1]);
+        if (items.n == n) { r.bad = 1; break; }
+        items.d[n].line0 = f[2];
+        items.d[n].src = f[3];
+        items.d[n].src_off = (size_t)off;
+        items.d[n].src_len = (size_t)len;
+        if (f[3] < SRC_OWNED || f[3] > SRC_PATCH) r.bad = 1;
+        if (f[3] != SRC_OWNED && (off >= (uint64_t)h.offset || len > (uint64_t)h.offset - off)) r.bad = 1;
+    }
+    const LineRow *rows = render_cache_take(&r, sizeof(LineRow) * (size_t)(h.nrows > 0 ? h.nrows : 0));
+    const char *arena = render_cache_take(&r, (size_t)h.arena_len);
+    if (h.nrows < 0 || h.nlinks < 0) r.bad = 1;
+    if (!r.bad && h.nrows > 0) {
+        L.cap = 128;
+        while (L.cap < h.nrows) L.cap *= 2;
+        L.rows = xmalloc(sizeof(LineRow) * (size_t)L.cap);
+        L.arena = xmalloc((size_t)h.arena_len);
+        L.links = h.nlinks > 0 ? xmalloc(sizeof(LineLink) * (size_t)h.nlinks) : NULL;
+        if (!L.rows || !L.arena || (h.nlinks > 0 && !L.links)) r.bad = 1;
+    }
+    if (!r.bad && h.nrows > 0) {
+        memcpy(L.rows, rows, sizeof(LineRow) * (size_t)h.nrows);
+        memcpy(L.arena, arena, (size_t)h.arena_len);
+        L.n = h.nrows;
+        L.arena_len = L.arena_cap = L.arena_live = (size_t)h.arena_len;
+        L.links_cap = h.nlinks;
+        for (int i = 0; i < L.n && !r.bad; i++) {
+            const LineRow *lr = &L.rows[i];
+            if ((uint64_t)lr->off + (uint64_t)lr->len >= h.arena_len || lr->link0 != L.nlinks ||
+                lr->nlink < 0 || L.nlinks + lr->nlink > h.nlinks || L.arena[lr->off + (uint32_t)lr->len] != '\0') {
+                r.bad = 1;
+                break;
+            }
+            for (int k = 0; k < lr->nlink && !r.bad; k++) {
+                int x0 = render_cache_i32(&r), x1 = render_cache_i32(&r);
+                char *uri = render_cache_str(&r);
+                const char *u = uri ? uri_intern(uri) : NULL;
+                free(uri);
+                if (!u) { r.bad = 1; break; }
+                L.links[L.nlinks++] = (LineLink){x0, x1, u};
+            }
+        }
+        L.links_live = L.nlinks;
+    }
+    L.dropped_total = h.dropped_total;
+    L.rows_below = h.rows_below;
+    if (w->view_rows > 0 && (h.win_lo < 0 || h.win_lo > h.win_hi || h.win_hi > h.nitems ||
+                             !worker_blk_reserve(w, h.nitems))) r.bad = 1;
+    munmap(map, (size_t)cs.st_size);
+    if (r.bad || g_oom) {
+        PDBG("render cache miss reason=corrupt\n");
+        close(tfd);
+        I_free(&items);
+        L_free(&L);
+        return 0;
+    }
+
+    I_free(&w->items);
+    ingest_close(&w->cursor);
+    L_free(&w->L);
+    w->items = items;
+    w->L = L;
+    IngestCursor *cur = &w->cursor;
+    cur->valid = 1;
+    cur->dev = ts.st_dev;
+    cur->ino = ts.st_ino;
+    cur->map.fd = tfd;
+    cur->offset = (off_t)h.offset;
+    cur->li = h.li; cur->lcc = h.lcc; cur->lcr = h.lcr;
+    w->items.map = &cur->map;
+    for (int i = 0; i < w->items.n; i++) w->items.d[i].map = &cur->map;
+    if (map_extend(&cur->map, (size_t)h.offset) != 0) PDBG("render cache mmap failed errno=%d\n", errno);
+    w->rendered = h.rendered;
+    w->content_end = h.content_end;
+    w->had_banner = h.had_banner;
+    if (w->view_rows > 0) {
+        /* Blocks are not saved; heights come back from the item numbering. */
+        worker_blk_reset(w, 0);
+        for (int i = 0; i < w->items.n; i++) {
+            int end = i + 1 < w->items.n ? w->items.d[i + 1].line0 : w->content_end;
+            w->blk[i].height = end - w->items.d[i].line0;
+        }
+        w->win_lo = h.win_lo;
+        w->win_hi = h.win_hi;
+    }
+    ingest_usage(cur, w->ctx_limit, &w->tok, &w->pct);
+    worker_touch(w, 0);
+    w->cache_hit = 1;
+    PDBG("render cache hit items=%d rows=%d offset=%lld\n", items.n, L.n, (long long)h.offset);
+    return 1;
+}
+
+#define DAEMON_SYNC_MS 500
+
+/* The daemon's socket sits next to the cache file it keeps current. */
+static int render_daemon_addr(const char *transcript, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    return render_cache_file(transcript, ".sock", addr->sun_path, sizeof(addr->sun_path));
+}
+
+/* Ask a running daemon to bring the cache up to date at this width before
+ * it is loaded.  Without a daemon, or if it does not answer in time, the
+ * cache is used as it is. */
+static void render_cache_daemon_sync(RenderWorker *w) {
+    struct sockaddr_un addr;
+    if (!render_daemon_addr(w->transcript, &addr)) return;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return;
+    }
+    long long t0 = now_us();
+    char req[32], rep[64];
+    int n = snprintf(req, sizeof(req), "sync %d\n", render_cols());
+    int got = 0;
+    if (write_all(fd, req, (size_t)n) == 0) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        while (got < (int)sizeof(rep) - 1 && poll(&pfd, 1, DAEMON_SYNC_MS) > 0) {
+            ssize_t k = read(fd, rep + got, sizeof(rep) - 1 - (size_t)got);
+            if (k <= 0) break;
+            got += (int)k;
+            if (rep[got - 1] == '\n') break;
+        }
+    }
+    rep[got] = '\0';
+    close(fd);
+    char *nl = strchr(rep, '\n');
+    if (nl) *nl = '\0';
+    PDBG("render daemon sync reply=%s duration=%.2fms\n", got ? rep : "(timeout)",
+         (double)(now_us() - t0) / 1000.0);
+}
+
+/* Render items from `from` on over the rows they produced before (0
+ * renders everything), then the trailer and the cap banner. */
+static void worker_render(RenderWorker *w, int from) {
+    Lines *L = &w->L;
+    if (w->view_rows > 0) {
+        long long t0 = now_us();
+        worker_render_view(w, from);
+        if (g_bench_mode) perf_add(PERF_RENDER_US, now_us() - t0);
+        PDBG("viewport render load=%d from=%d items=%d..%d rows=%d above=%d below=%d duration=%.2fms\n",
+             w->load_seq, from, w->win_lo, w->win_hi, L->n, L->dropped_total, L->rows_below,
+             (double)(now_us() - t0) / 1000.0);
+        return;
+    }
+    int keep = 0;
+    if (from > 0) {
+        keep = (from < w->rendered ? w->items.d[from].line0 : w->content_end) - L->dropped_total;
+        if (keep < 0) from = 0;
+    }
+    int dropped = L->dropped_total;
+    if (from == 0) {
+        L_free(L);
+        worker_touch(w, 0);
+    } else {
+        if (w->had_banner) { L_pop_head(L); worker_touch(w, 0); }
+        L_truncate(L, keep);
+        worker_touch(w, keep);
+    }
+    long long t_render0 = now_us();
+    PDBG("markdown render start load=%d from=%d\n", w->load_seq, from);
+    render_items_from(L, &w->items, from);
+    long long t_render1 = now_us();
+    if (g_bench_mode) perf_add(PERF_RENDER_US, t_render1 - t_render0);
+    w->rendered = w->items.n;
+    w->content_end = L->dropped_total + L->n;
+    L_push(L, C_HDM "  " EMD " end of transcript " EMD RS);
+    L_push(L, ""); L_push(L, "");
+    if (L->max_keep > 0 && L->n > L->max_keep) {
+        L_drop_head(L, L->n - L->max_keep);
+    }
+    if (L->dropped_total != dropped) worker_touch(w, 0);
+    w->had_banner = L->dropped_total > 0 ? 1 : 0;
+    if (w->had_banner) {
+        char db[128];
+        snprintf(db, sizeof(db), "  " C_HDM ELL " (+%d older lines capped)" RS, L->dropped_total);
+        L_prepend(L, db);
+        PDBG("render cap dropped=%d keep=%d\n", L->dropped_total, L->n);
+    }
+    PDBG("markdown render end load=%d duration=%.2fms lines=%d\n",
+         w->load_seq, (double)(t_render1 - t_render0) / 1000.0, L->n);
+}
+
+/* Save the cache when rows changed, at most once a second unless forced.
+ * Rows rendered at another width (or with other settings) than the key
+ * describes are not saved, nor are rows with subagents merged in. */
+static void worker_cache_flush(RenderWorker *w, int force) {
+    if (!w->cache_path[0] || !w->cache_dirty || w->nagents > 0) return;
+    if (!force && w->cache_saved_us != 0 && now_us() - w->cache_saved_us < RCACHE_SAVE_US) return;
+    if (render_cache_key(w) != w->cache_key) return;
+    render_cache_save(w);
+}
+
+/* Pick up subagent transcripts that appeared since the last look, and say
+ * whether any of them changed. */
+static int worker_agents_scan(RenderWorker *w) {
+    int changed = 0;
+    if (file_stamp_changed(w->agent_dir, &w->agent_dir_st)) {
+        DIR *d = opendir(w->agent_dir);
+        struct dirent *de;
+        while (d && (de = readdir(d)) != NULL) {
+            size_t len = strlen(de->d_name);
+            if (len <= 6 || strcmp(de->d_name + len - 6, ".jsonl") != 0) continue;
+            char path[PATH_MAX];
+            if (snprintf(path, sizeof(path), "%s/%s", w->agent_dir, de->d_name) >= (int)sizeof(path)) continue;
+            int known = 0;
+            for (int i = 0; i < w->nagents && !known; i++) known = strcmp(w->agents[i].path, path) == 0;
+            if (known) continue;
+            if (w->nagents == AGENTS_MAX) {
+                PDBG("subagent limit reached; not following %s\n", path);
+                break;
+            }
+            if (!w->agents) {
+                w->agents = xmalloc(sizeof(AgentSource) * AGENTS_MAX);
+                if (!w->agents) break;
+                memset(w->agents, 0, sizeof(AgentSource) * AGENTS_MAX);
+            }
+            AgentSource *a = &w->agents[w->nagents++];
+            memcpy(a->path, path, strlen(path) + 1);
+            snprintf(a->name, sizeof(a->name), "%.*s", (int)(len - 6), de->d_name);
+            changed = 1;
+            PDBG("following subagent %s\n", path);
+        }
+        if (d) closedir(d);
+    }
+    for (int i = 0; i < w->nagents; i++) changed |= file_stamp_changed(w->agents[i].path, &w->agents[i].st);
+    return changed;
+}
+
+/* The session alone, or merged with its subagents once there are any. */
+static int worker_ingest(RenderWorker *w) {
+    if (w->nagents == 0) return ingest_transcript(w->transcript, &w->items, &w->cursor);
+    MergeSource *src = xmalloc(sizeof(MergeSource) * (size_t)(w->nagents + 1));
+    if (!src) return INGEST_NONE;
+    src[0] = (MergeSource){.path = w->transcript, .cur = &w->cursor};
+    for (int i = 0; i < w->nagents; i++) {
+        src[i + 1] = (MergeSource){.path = w->agents[i].path, .name = w->agents[i].name, .cur = &w->agents[i].cur};
+    }
+    int rc = ingest_merged(&w->items, src, w->nagents + 1);
+    free(src);
+    return rc;
+}
+
+static void worker_load(RenderWorker *w, int first) {
+    Items *items = &w->items;
+    long long allocs0 = t_allocs;
+    long long t_parse0 = now_us();
+    PDBG("parse start load=%d offset=%lld agents=%d\n", w->load_seq + 1, (long long)w->cursor.offset, w->nagents);
+    int ing = worker_ingest(w);
+    long long t_parse1 = now_us();
+    if (ing == INGEST_NONE) {
+        /* The UI waits for one snapshot before its first frame. */
+        if (first) worker_publish_lines(w);
+        return;
+    }
+    w->load_seq++;
+    if (g_bench_mode) perf_add(PERF_PARSE_US, t_parse1 - t_parse0);
+    ingest_usage(&w->cursor, w->ctx_limit, &w->tok, &w->pct);
+    PDBG("parse end load=%d mode=%s duration=%.2fms items=%d tok=%d pct=%.3f\n",
+         w->load_seq, ing == INGEST_REBUILD ? "full" : "append",
+         (double)(t_parse1 - t_parse0) / 1000.0, items->n, w->tok, w->pct);
+    /* Only items appended since the last pass are rendered, plus
+     * anything a tool result relabelled in place; a relabel
+     * above the render cap falls back to a full render. */
+    int from = ing == INGEST_REBUILD ? 0 : w->rendered;
+    if (items->dirty && items->dirty_from < from) from = items->dirty_from;
+    items->dirty = 0;
+    worker_search_forget(w, from);
+    if (ing == INGEST_REBUILD || from < items->n) worker_render(w, from);
+    worker_publish_lines(w);
+    if (g_bench_mode) perf_add(PERF_RELOAD_ALLOCS, t_allocs - allocs0);
+    w->cache_dirty = 1;
+    worker_cache_flush(w, 0);
+}
+
+/* One pass: the tail preview first for a large transcript, then whatever
+ * the ingest cursor has not seen yet. */
+static void worker_pass(RenderWorker *w) {
+    int first = w->passes++ == 0;
+    struct stat tsb;
+    int agents_changed = worker_agents_scan(w);
+    /* A cache hit is already a full render, so it needs no preview.  The
+     * cache holds one transcript, so it is left alone once subagents are
+     * merged in. */
+    if (first && w->nagents == 0 && w->cache_path[0] && !w->daemon) render_cache_daemon_sync(w);
+    if (first && w->nagents == 0 && render_cache_load(w)) {
+        worker_load(w, first);
+        return;
+    }
+    if (first && w->tail_first && stat(w->transcript, &tsb) == 0 && tsb.st_size >= TAIL_FIRST_MIN_BYTES) {
+        Snapshot *s = xmalloc(sizeof(*s));
+        if (s) {
+            memset(s, 0, sizeof(*s));
+            L_init(&s->L);
+            if (render_tail_preview(w->transcript, &s->L, w->preview_rows, w->ctx_limit, &s->tok, &s->pct)) {
+                s->preview = 1;
+                worker_publish(w, s, 0);
+            } else {
+                snapshot_free(s);
+            }
+        }
+    }
+    if (file_stamp_changed(w->transcript, &w->st) || agents_changed) worker_load(w, first);
+    else if (first) worker_publish_lines(w);
+    worker_view_serve(w);
+    worker_search_serve(w);
+    worker_budget(w);
+}
+
+static void *worker_main(void *arg) {
+    RenderWorker *w = arg;
+    pthread_mutex_lock(&w->mu);
+    while (!w->stop) {
+        if (!w->kick) {
+            pthread_cond_wait(&w->cv, &w->mu);
+            continue;
+        }
+        w->kick = 0;
+        t_render_cols = w->cols;
+        pthread_mutex_unlock(&w->mu);
+        worker_pass(w);
+        pthread_mutex_lock(&w->mu);
+    }
+    pthread_mutex_unlock(&w->mu);
+    return NULL;
+}
+
+/* Set a worker up without its thread; passes then run on the caller. */
+static void worker_init(RenderWorker *w, const char *transcript, int ctx_limit,
+                        int max_render_lines, int tail_first, int preview_rows) {
+    memset(w, 0, sizeof(*w));
+    w->mod_from = INT_MAX;
+    L_init(&w->L);
+    /* A viewport window bounds rows by itself, so the cap is for when it is off. */
+    w->view_rows = g_perf_compat ? 0 : parse_env_int_range("CLAUDE_PAGER_VIEW_ROWS", 0, 1000000, VIEW_ROWS_DEFAULT);
+    if (w->view_rows > 0 && w->view_rows < 200) w->view_rows = 200;
+    w->blk_max = (size_t)parse_env_int_range("CLAUDE_PAGER_VIEW_CACHE_MB", 1, 4096, VIEW_CACHE_MB_DEFAULT) << 20;
+    w->rss_max = (size_t)parse_env_int_range("CLAUDE_PAGER_MAX_RSS_MB", 0, 1 << 20, 0) << 20;
+    w->rss_kb = -1;
+    agents_dir_for(transcript, w->agent_dir, sizeof(w->agent_dir));
+    if (max_render_lines > 0 && w->view_rows <= 0) L_set_limit(&w->L, max_render_lines);
+    w->transcript = transcript;
+    w->cols = g_cols;
+    w->ctx_limit = ctx_limit;
+    w->tail_first = tail_first;
+    w->preview_rows = preview_rows;
+    if (!g_perf_compat && env_enabled_default_on("CLAUDE_PAGER_RENDER_CACHE") &&
+        render_cache_file(transcript, ".cache", w->cache_path, sizeof(w->cache_path))) {
+        w->cache_key = render_cache_key(w);
+    }
+    pthread_mutex_init(&w->mu, NULL);
+    pthread_cond_init(&w->cv, NULL);
+}
+
+static void worker_start(RenderWorker *w, const char *transcript, int ctx_limit,
+                         int max_render_lines, int tail_first, int preview_rows) {
+    worker_init(w, transcript, ctx_limit, max_render_lines, tail_first, preview_rows);
+    /* Signals stay with the UI thread, whose handlers wake its wait. */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    w->started = pthread_create(&w->thread, NULL, worker_main, w) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (!w->started) PDBG("render worker unavailable; rendering inline\n");
+}
+
+/* Ask for a pass after a transcript change; kicks coalesce while one runs. */
+static void worker_kick(RenderWorker *w) {
+    if (!w->started) {
+        worker_pass(w);
+        return;
+    }
+    pthread_mutex_lock(&w->mu);
+    w->kick = 1;
+    pthread_cond_signal(&w->cv);
+    pthread_mutex_unlock(&w->mu);
+}
+
+/* Pass the UI's new width on; rows already rendered keep theirs, and the
+ * next pass lays out new ones at this one. */
+static void worker_resize(RenderWorker *w, int cols) {
+    pthread_mutex_lock(&w->mu);
+    w->cols = cols;
+    pthread_mutex_unlock(&w->mu);
+}
+
+/* Ask for the viewport window around transcript row `row` (-1 for the
+ * tail); returns the request's number, which the answering snapshot
+ * carries in view_seq. */
+static int worker_view(RenderWorker *w, int row) {
+    pthread_mutex_lock(&w->mu);
+    int seq = ++w->view_seq;
+    w->view_req = row;
+    pthread_mutex_unlock(&w->mu);
+    worker_kick(w);
+    return seq;
+}
+
+/* Ask for the match of query q after (dir > 0), before (dir < 0) or at or
+ * after (dir == 0) transcript row `from`; returns the request's number,
+ * which the answering snapshot carries in search_seq. */
+static int worker_search(RenderWorker *w, const char *q, int from, int dir) {
+    pthread_mutex_lock(&w->mu);
+    int seq = ++w->srch_seq;
+    snprintf(w->srch_req, sizeof(w->srch_req), "%s", q);
+    w->srch_from = from;
+    w->srch_dir = dir;
+    pthread_mutex_unlock(&w->mu);
+    worker_kick(w);
+    return seq;
+}
+
+static void worker_stop(RenderWorker *w) {
+    if (w->started) {
+        pthread_mutex_lock(&w->mu);
+        w->stop = 1;
+        pthread_cond_signal(&w->cv);
+        pthread_mutex_unlock(&w->mu);
+        pthread_join(w->thread, NULL);
+        w->started = 0;
+    }
+    snapshot_free(worker_take(w));
+    pthread_cond_destroy(&w->cv);
+    pthread_mutex_destroy(&w->mu);
+    L_free(&w->L);
+    worker_blk_free(w);
+    for (int i = 0; i < SEARCH_LEVELS; i++) free(w->srch_lv[i].hits);
+    I_free(&w->items);
+    ingest_close(&w->cursor);
+    for (int i = 0; i < w->nagents; i++) ingest_close(&w->agents[i].cur);
+    free(w->agents);
+    w->agents = NULL;
+    w->nagents = 0;
+}
+
+/* ── Resident daemon ───────────────────────────────────────────────────── */
+
+/* `claude-pager-c --daemon` is started for one session by the SessionStart
+ * hook.  It follows the transcript like the render worker and keeps the
+ * render cache current, so a Ctrl-G open only has to map it.  An opening
+ * pager first sends its width (render_cache_daemon_sync()); the daemon
+ * re-renders if the width changed, catches up, saves and answers.  It exits
+ * with the session's process or when the transcript goes away. */
+
+static int daemon_listen(const char *transcript, struct sockaddr_un *addr) {
+    if (!render_daemon_addr(transcript, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    /* A live daemon answers; a dead one only left its socket behind. */
+    if (connect(fd, (struct sockaddr *)addr, sizeof(*addr)) == 0) {
+        close(fd);
+        errno = EADDRINUSE;
+        return -1;
+    }
+    close(fd);
+    unlink(addr->sun_path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) != 0 || listen(fd, 8) != 0) {
+        close(fd);
+        return -1;
+    }
+    (void)chmod(addr->sun_path, 0600);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+static void daemon_serve(RenderWorker *w, int cfd) {
+    fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) & ~O_NONBLOCK);
+    char req[64];
+    int got = 0;
+    struct pollfd pfd = { cfd, POLLIN, 0 };
+    while (got < (int)sizeof(req) - 1 && poll(&pfd, 1, DAEMON_SYNC_MS) > 0) {
+        ssize_t k = read(cfd, req + got, sizeof(req) - 1 - (size_t)got);
+        if (k <= 0) break;
+        got += (int)k;
+        if (req[got - 1] == '\n') break;
+    }
+    req[got] = '\0';
+    int cols = 0;
+    if (sscanf(req, "sync %d", &cols) != 1 || cols < 1 || cols > 10000) {
+        (void)write_all(cfd, "error\n", 6);
+        return;
+    }
+    long long t0 = now_us();
+    if (cols != g_cols) {
+        g_cols = cols;
+        w->cache_key = render_cache_key(w);
+        if (w->passes > 0) {
+            worker_render(w, 0);
+            w->cache_dirty = 1;
+        }
+    }
+    worker_pass(w);
+    worker_cache_flush(w, 1);
+    (void)write_all(cfd, "ok\n", 3);
+    PDBG("daemon sync cols=%d rows=%d duration=%.2fms\n", cols, w->L.n, (double)(now_us() - t0) / 1000.0);
+}
+
+int run_pager_daemon(const char *transcript, int watch_pid, int ctx_limit) {
+    if (!transcript || !*transcript || watch_pid <= 0) return 1;
+    g_oom = 0;
+    g_allow_remote_file_links = -1;
+    g_perf_compat = env_enabled("CLAUDE_PAGER_PERF_COMPAT");
+    if (g_perf_compat || !env_enabled_default_on("CLAUDE_PAGER_RENDER_CACHE")) return 1;
+    if (ctx_limit <= 0) ctx_limit = 200000;
+
+    struct sockaddr_un addr;
+    int lfd = daemon_listen(transcript, &addr);
+    if (lfd < 0) return errno == EADDRINUSE ? 0 : 1;
+    /* Detach, so the hook that started the daemon returns at once; the
+     * socket is already listening, so an early connect just queues. */
+    pid_t pid = fork();
+    if (pid != 0) {
+        close(lfd);
+        return pid > 0 ? 0 : 1;
+    }
+    setsid();
+    int nul = open("/dev/null", O_RDWR);
+    if (nul >= 0) {
+        dup2(nul, STDIN_FILENO);
+        dup2(nul, STDOUT_FILENO);
+        dup2(nul, STDERR_FILENO);
+        if (nul > STDERR_FILENO) close(nul);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    dbg_open();
+    PDBG("daemon start transcript=%s pid=%d\n", transcript, watch_pid);
+
+    int max_render_lines = parse_env_int_range("CLAUDE_PAGER_MAX_RENDER_LINES", 0, 2000000, 20000);
+    RenderWorker w;
+    worker_init(&w, transcript, ctx_limit, max_render_lines, 0, 0);
+    w.daemon = 1;
+    Watcher watch;
+    watcher_open(&watch, lfd, transcript, NULL, (pid_t)watch_pid);
+    worker_pass(&w);
+    for (;;) {
+        int due = watcher_wait(&watch, lfd, -1);
+        if ((due & WATCH_PROC) && kill((pid_t)watch_pid, 0) != 0 && errno == ESRCH) break;
+        if (due & WATCH_TRANSCRIPT) {
+            struct stat st;
+            if (stat(transcript, &st) != 0) break;
+            worker_pass(&w);
+        }
+        for (;;) {
+            int cfd = accept(lfd, NULL, NULL);
+            if (cfd < 0) break;
+            daemon_serve(&w, cfd);
+            close(cfd);
+        }
+        worker_cache_flush(&w, 0);
+    }
+    worker_cache_flush(&w, 1);
+    PDBG("daemon exit\n");
+    watcher_close(&watch);
+    close(lfd);
+    unlink(addr.sun_path);
+    worker_stop(&w);
+    _exit(0);
+}
+
+/* Ask the worker for the match from the reader's position: typing searches
+ * again from where it started, n/N step from the current match while it
+ * is on screen and from the top row otherwise. */
+static void search_send(RenderWorker *w, Lines *L, int off, int dir) {
+    search_pat_init(&g_search.pat, g_search.buf);
+    int from = dir == 0 ? g_search.origin_row : L->dropped_total + off;
+    if (dir != 0 && g_search.row >= 0) {
+        int i = g_search.row - L->dropped_total;
+        if (i >= off && i < L->n && L_vrow(L, i) - L_vrow(L, off) < g_crows) from = g_search.row;
+    }
+    g_search.sent = worker_search(w, g_search.buf, from, dir);
+}
+
+static void search_start(const Lines *L, int off, int uscroll) {
+    g_search.mode = SEARCH_TYPING;
+    g_search.buf[0] = '\0';
+    g_search.len = 0;
+    g_search.pat.n = 0;
+    g_search.origin_row = L->dropped_total + off;
+    g_search.origin_uscroll = uscroll;
+    g_search.row = -1;
+    g_search.hit = -1;
+    g_search.hits = 0;
+}
+
+/* Keys while searching; returns 1 when inp was a search key, 2 when the
+ * reader should also go back to where the search started.  w is NULL
+ * without a transcript. */
+static int search_key(int inp, RenderWorker *w, Lines *L, int off, int uscroll) {
+    if (inp == INP_NONE) return 0;
+    int scroll = inp == INP_WHEEL_UP || inp == INP_WHEEL_DOWN || inp == INP_MOUSE_IGNORE ||
+                 inp == INP_MOUSE_MOVE || inp == INP_MOUSE_OPEN ||
+                 inp == -(g_crows - 1) || inp == (g_crows - 1);
+    if (inp == INP_SEARCH) {
+        if (!w) {
+            queue_set_notice("nothing to search");
+            return 1;
+        }
+        search_start(L, off, uscroll);
+        return 1;
+    }
+    if (g_search.mode == SEARCH_OFF) {
+        if ((inp == INP_SEARCH_NEXT || inp == INP_SEARCH_PREV) && w && g_search.len > 0) {
+            g_search.mode = SEARCH_BROWSE;
+            search_send(w, L, off, inp == INP_SEARCH_NEXT ? 1 : -1);
+            return 1;
+        }
+        return 0;
+    }
+    if (g_search.mode == SEARCH_TYPING) {
+        if (inp >= INP_CHAR_BASE && g_search.len + 1 < SEARCH_MAX) {
+            g_search.buf[g_search.len++] = (char)(inp - INP_CHAR_BASE);
+            g_search.buf[g_search.len] = '\0';
+            search_send(w, L, off, 0);
+        } else if (inp == INP_BACKSPACE && g_search.len > 0) {
+            g_search.len = input_prev_boundary(g_search.buf, g_search.len);
+            g_search.buf[g_search.len] = '\0';
+            if (g_search.len > 0) {
+                search_send(w, L, off, 0);
+            } else {
+                g_search.pat.n = 0;
+                g_search.sent = 0;
+                g_search.row = -1;
+                g_search.hits = 0;
+                return 2;
+            }
+        } else if (inp == INP_ENTER) {
+            g_search.mode = g_search.len > 0 ? SEARCH_BROWSE : SEARCH_OFF;
+        } else if (inp == INP_ESC) {
+            g_search.mode = SEARCH_OFF;
+            g_search.sent = 0;
+            return 2;
+        } else if ((inp == -1 || inp == 1) && g_search.len > 0) {
+            search_send(w, L, off, inp);
+        } else if (scroll) {
+            return 0;
+        }
+        return 1;
+    }
+    if (inp == INP_SEARCH_NEXT || inp == INP_CHAR_BASE + 'n') {
+        search_send(w, L, off, 1);
+        return 1;
+    }
+    if (inp == INP_SEARCH_PREV || inp == INP_CHAR_BASE + 'N') {
+        search_send(w, L, off, -1);
+        return 1;
+    }
+    if (inp == INP_ESC) {
+        g_search.mode = SEARCH_OFF;
+        return 1;
+    }
+    /* Anything else leaves the search and does what it always does. */
+    if (!scroll) g_search.mode = SEARCH_OFF;
+    return 0;
+}
+
+/* Land on a search answer, the match a third of the way down; returns 2
+ * when there is none and the reader goes back to where typing started. */
+static int search_apply(const Snapshot *snap, Lines *L, int *off, int *uscroll) {
+    g_search.sent = 0;
+    g_search.row = snap->search_row;
+    g_search.hit = snap->search_hit;
+    g_search.hits = snap->search_hits;
+    if (g_search.row < 0) return g_search.mode == SEARCH_TYPING ? 2 : 0;
+    int i = g_search.row - L->dropped_total;
+    if (i < 0) {
+        queue_set_notice("match is above the render cap");
+        i = 0;
+    }
+    if (i >= L->n) i = L->n > 0 ? L->n - 1 : 0;
+    *off = L_scroll(L, i, -(g_crows / 3));
+    *uscroll = 1;
+    return 1;
+}
+
 void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit, int control_fd) {
     g_fd = tty_fd;
     g_quit = 0;
@@ -5550,6 +10446,9 @@ void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit
     g_last_capped_lines = 0;
     g_queue_rows = 0;
     g_queue_enabled = 0;
+    memset(&g_search, 0, sizeof(g_search));
+    g_search.row = -1;
+    g_search.hit = -1;
     g_ctrl_quit_supported = (control_fd >= 0);
     g_queue_stamp.valid = 0;
     g_input_mode = 0;
@@ -5561,6 +10460,8 @@ void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit
     queue_clear_items();
     if (ctx_limit <= 0) ctx_limit = 200000;
     g_bench_mode = env_enabled("CLAUDE_PAGER_BENCH");
+    memset(g_perf, 0, sizeof(g_perf));
+    g_out_bytes = 0;
     dbg_open();
     PDBG("run start transcript=%s editor_pid=%d ctx_limit=%d control_fd=%d\n",
          (transcript && transcript[0]) ? transcript : "(none)",
@@ -5593,91 +10494,112 @@ void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit
     int rehit_hover_after_draw = 0;
     int prev_dropped_total = 0;
     int prev_had_capped_banner = 0;
-    int load_seq = 0;
-    FileStamp st = {0};
+    int tail_rows = 0;
     int default_render_cap = g_perf_compat ? 0 : 20000;
     int max_render_lines = parse_env_int_range("CLAUDE_PAGER_MAX_RENDER_LINES", 0, 2000000, default_render_cap);
-    if (max_render_lines > 0) {
-        L_set_limit(&L, max_render_lines);
-        PDBG("render line cap=%d\n", max_render_lines);
+
+    Watcher watch;
+    watcher_open(&watch, tty_fd, transcript, g_queue_enabled ? g_queue_path : NULL, (pid_t)editor_pid);
+    int due = WATCH_ALL;
+
+    int have_transcript = transcript && transcript[0];
+    int have_snapshot = !have_transcript;
+    RenderWorker worker;
+    int virt = 0;
+    int view_sent = 0, view_off = 0, view_last = INT_MIN;
+    if (have_transcript) {
+        worker_start(&worker, transcript, ctx_limit, max_render_lines,
+                     env_enabled_default_on("CLAUDE_PAGER_TAIL_FIRST"), g_crows * 2);
+        virt = worker.view_rows > 0;
     }
+    if (virt) PDBG("viewport window rows=%d\n", worker.view_rows);
+    else if (max_render_lines > 0) PDBG("render line cap=%d\n", max_render_lines);
 
     while (!g_quit) {
-        if (editor_pid > 0 && kill(editor_pid, 0) != 0) break;
+        if ((due & WATCH_PROC) && editor_pid > 0 && kill(editor_pid, 0) != 0) break;
 
         if (g_resize) {
+            /* Lines keep their logical index; only the wrap index changes. */
             g_resize = 0; geo_update();
+            if (have_transcript) worker_resize(&worker, g_cols);
             queue_recalc_rows();
+            if (!uscroll) off = L_bottom_off(&L, g_crows - 1);
             first = 1;
         }
 
-        int cc = 0;
-        if (transcript && transcript[0]) {
-            if (file_stamp_changed(transcript, &st)) {
+        int cc = 0, search_restore = 0;
+        if (have_transcript) {
+            if (due & WATCH_TRANSCRIPT) worker_kick(&worker);
+            Snapshot *snap = worker_take(&worker);
+            if (snap) {
                 cc = 1;
-                load_seq++;
-                Items items; memset(&items, 0, sizeof(items));
-                tok = 0; pct = 0;
-                long long t_parse0 = now_us();
-                PDBG("parse start load=%d\n", load_seq);
-                parse_transcript(transcript, &items, &tok, &pct, ctx_limit);
-                long long t_parse1 = now_us();
-                PDBG("parse end load=%d duration=%.2fms tok=%d pct=%.3f\n",
-                     load_seq, (double)(t_parse1 - t_parse0) / 1000.0, tok, pct);
-                L_free(&L);
-                long long t_render0 = now_us();
-                PDBG("markdown render start load=%d\n", load_seq);
-                render_items(&L, &items);
-                long long t_render1 = now_us();
-                L_push(&L, C_HDM "  " EMD " end of transcript " EMD RS);
-                L_push(&L, ""); L_push(&L, "");
-                if (L.max_keep > 0 && L.n > L.max_keep) {
-                    L_drop_head(&L, L.n - L.max_keep);
-                }
-                int new_dropped_total = L.dropped_total;
-                int new_had_capped_banner = new_dropped_total > 0 ? 1 : 0;
-                if (!first) {
-                    int drop_delta = new_dropped_total - prev_dropped_total;
-                    int banner_delta = new_had_capped_banner - prev_had_capped_banner;
-                    int off_adjust = -drop_delta + banner_delta;
-                    if (off_adjust != 0) {
-                        off += off_adjust;
-                        PDBG("cap adjust load=%d off_adjust=%d drop_delta=%d banner_delta=%d off=%d\n",
-                             load_seq, off_adjust, drop_delta, banner_delta, off);
+                have_snapshot = 1;
+                snapshot_apply(&L, snap);
+                tok = snap->tok;
+                pct = snap->pct;
+                if (snap->preview) {
+                    tail_rows = L.n;
+                    off = L_bottom_off(&L, g_crows - 1);
+                } else if (virt) {
+                    /* Stay on the rows the reader was on: the one asked
+                     * for plus any scrolling since, or follow renumbering. */
+                    if (tail_rows > 0) {
+                        if (uscroll) off += L.n - tail_rows;
+                        tail_rows = 0;
+                    } else if (view_sent && snap->view_seq == view_sent) {
+                        if (snap->view_row >= 0) off = snap->view_row - L.dropped_total + (off - view_off);
+                        view_sent = 0;
+                    } else if (!first) {
+                        off += prev_dropped_total + snap->shift - L.dropped_total;
                     }
-                }
-                if (new_had_capped_banner) {
-                    char db[128];
-                    snprintf(db, sizeof(db), "  " C_HDM ELL " (+%d older lines capped)" RS, new_dropped_total);
-                    L_prepend(&L, db);
-                    g_last_capped_lines = new_dropped_total;
-                    PDBG("render cap dropped=%d keep=%d\n", new_dropped_total, L.n);
+                    prev_dropped_total = L.dropped_total;
+                    if (off >= L.n) off = L.n > 0 ? (L.n - 1) : 0;
+                    if (off < 0) off = 0;
+                    if (!uscroll) off = L_bottom_off(&L, g_crows - 1);
                 } else {
-                    g_last_capped_lines = 0;
+                    /* Carry the reader's position across rows the cap dropped. */
+                    int new_dropped_total = L.dropped_total;
+                    int new_had_capped_banner = new_dropped_total > 0 ? 1 : 0;
+                    if (!first) {
+                        int drop_delta = new_dropped_total - prev_dropped_total;
+                        int banner_delta = new_had_capped_banner - prev_had_capped_banner;
+                        int off_adjust = -drop_delta + banner_delta;
+                        if (off_adjust != 0) {
+                            off += off_adjust;
+                            PDBG("cap adjust off_adjust=%d drop_delta=%d banner_delta=%d off=%d\n",
+                                 off_adjust, drop_delta, banner_delta, off);
+                        }
+                    }
+                    g_last_capped_lines = new_had_capped_banner ? new_dropped_total : 0;
+                    if (tail_rows > 0) {
+                        /* Keep the rows the reader scrolled to in the preview. */
+                        if (uscroll) off += L.n - tail_rows;
+                        tail_rows = 0;
+                    }
+                    prev_dropped_total = new_dropped_total;
+                    prev_had_capped_banner = new_had_capped_banner;
+                    if (off < 0) off = 0;
+                    if (off >= L.n) off = L.n > 0 ? (L.n - 1) : 0;
+                    if (!uscroll) off = L_bottom_off(&L, g_crows - 1);
                 }
-                prev_dropped_total = new_dropped_total;
-                prev_had_capped_banner = new_had_capped_banner;
-                PDBG("markdown render end load=%d duration=%.2fms lines=%d\n",
-                     load_seq, (double)(t_render1 - t_render0) / 1000.0, L.n);
-                I_free(&items);
-                if (off < 0) off = 0;
-                if (off >= L.n) off = L.n > 0 ? (L.n - 1) : 0;
-                if (!uscroll) {
-                    int b = L.n-(g_crows-1);
-                    off = b>0 ? b : 0;
-                    off = normalize_off_visual(&L, off, -1);
-                } else {
-                    off = normalize_off_visual(&L, off, -1);
+                if (g_search.sent && snap->search_seq == g_search.sent) {
+                    search_restore = search_apply(snap, &L, &off, &uscroll) == 2;
+                    view_sent = 0;
+                    view_last = INT_MIN;
                 }
+                free(snap);
             }
         } else if (first) {
             cc = 1;
             L_push(&L, C_HDM "(transcript not found)" RS);
         }
 
-        if (queue_load_from_disk()) cc = 1;
+        if ((due & WATCH_QUEUE) && queue_load_from_disk()) cc = 1;
 
-        int inp = poll_input(tty_fd, (cc || first) ? 0 : 20, g_input_mode);
+        int busy = ((cc || first) && have_snapshot) || input_pending_has();
+        due = watcher_wait(&watch, tty_fd, busy ? 0 : -1);
+        int inp = poll_input(tty_fd, 0, g_input_mode || g_search.mode == SEARCH_TYPING);
+        int input_event = inp != INP_NONE, frames = 0;
         int sc = 0;
 
         if (inp == INP_CTRL_QUIT) {
@@ -5721,6 +10643,29 @@ void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit
             inp = INP_NONE;
         }
 
+        int sk = search_key(inp, have_transcript ? &worker : NULL, &L, off, uscroll);
+        if (sk) {
+            if (sk == 2) search_restore = 1;
+            inp = INP_NONE;
+            sc = 1;
+        }
+        if (search_restore) {
+            /* Back to where the search started, asking for its window
+             * again if the search moved the worker's elsewhere. */
+            int i = g_search.origin_row - L.dropped_total;
+            uscroll = g_search.origin_uscroll;
+            if (!uscroll) {
+                off = L_bottom_off(&L, g_crows - 1);
+            } else if (i >= 0 && i < L.n) {
+                off = i;
+            } else if (virt) {
+                view_sent = worker_view(&worker, g_search.origin_row);
+                view_off = off;
+                view_last = g_search.origin_row;
+            }
+            sc = 1;
+        }
+
         if (g_input_mode) {
             if (inp == INP_ESC) {
                 if (g_edit_index >= 0 && input_restore_draft()) {
@@ -5738,30 +10683,17 @@ void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit
             } else if (inp == INP_ENTER) {
                 if (g_input_len > 0) {
                     if (g_edit_index >= 0 && g_edit_index < g_queue.n) {
-                        char *updated = xstrdup(g_input_buf);
-                        if (!updated) {
-                            queue_set_notice("queue write failed");
+                        int write_rc = queue_update_item(g_edit_index, g_input_buf);
+                        if (write_rc == 0) {
+                            queue_set_notice("queue updated");
+                        } else if (write_rc == QUEUE_WRITE_CONFLICT) {
+                            queue_set_notice("queue changed on disk; reloaded");
                         } else {
-                            free(g_queue.d[g_edit_index].prompt);
-                            g_queue.d[g_edit_index].prompt = updated;
-                            g_queue.d[g_edit_index].encoding_json = 1;
-                            int write_rc = queue_write_all_items();
-                            if (write_rc == 0) {
-                                queue_set_notice("queue updated");
-                                (void)queue_load_from_disk();
-                                g_queue.selected = g_edit_index;
-                            } else if (write_rc == QUEUE_WRITE_CONFLICT) {
-                                (void)queue_load_from_disk();
-                                queue_set_notice("queue changed on disk; reloaded");
-                            } else {
-                                queue_set_notice("queue write failed");
-                            }
+                            queue_set_notice("queue write failed");
                         }
                     } else {
                         if (queue_append_prompt(g_input_buf) == 0) {
                             queue_set_notice("queued");
-                            (void)queue_load_from_disk();
-                            if (g_queue.n > 0) g_queue.selected = g_queue.n - 1;
                         } else {
                             queue_set_notice("queue write failed");
                         }
@@ -5816,17 +10748,10 @@ void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit
                     queue_clamp_selection();
                     int idx = g_edit_index >= 0 ? g_edit_index : g_queue.selected;
                     if (idx >= 0 && idx < g_queue.n) {
-                        queue_item_free(&g_queue.d[idx]);
-                        for (int i = idx; i + 1 < g_queue.n; i++) g_queue.d[i] = g_queue.d[i + 1];
-                        g_queue.n--;
-                        if (g_queue.selected >= g_queue.n) g_queue.selected = g_queue.n - 1;
-                        if (g_queue.selected < 0) g_queue.selected = 0;
-                        int write_rc = queue_write_all_items();
+                        int write_rc = queue_delete_item(idx);
                         if (write_rc == 0) {
-                            (void)queue_load_from_disk();
                             queue_set_notice("queue item removed");
                         } else if (write_rc == QUEUE_WRITE_CONFLICT) {
-                            (void)queue_load_from_disk();
                             queue_set_notice("queue changed on disk; reloaded");
                         } else {
                             queue_set_notice("queue write failed");
@@ -5876,31 +10801,19 @@ void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit
                 inp = INP_NONE;
             } else if (inp == INP_WHEEL_UP || inp == INP_WHEEL_DOWN) {
                 int delta = (inp == INP_WHEEL_UP) ? -1 : 1;
-                off += delta;
-                if (off < 0) off = 0;
-                int mx = L.n > 0 ? L.n - 1 : 0;
-                if (off > mx) off = mx;
-                off = normalize_off_visual(&L, off, delta);
+                off = L_scroll(&L, off, delta);
                 uscroll = 1;
                 hover_link_set("", 0);
                 rehit_hover_after_draw = 1;
                 sc = 1;
             } else if (inp == -(g_crows - 1) || inp == (g_crows - 1)) {
-                off += inp;
-                if (off < 0) off = 0;
-                int mx = L.n > 0 ? L.n - 1 : 0;
-                if (off > mx) off = mx;
-                off = normalize_off_visual(&L, off, inp);
+                off = L_scroll(&L, off, inp);
                 uscroll = 1;
                 hover_link_set("", 0);
                 rehit_hover_after_draw = 1;
                 sc = 1;
             } else if (inp != INP_NONE) {
-                off += inp;
-                if (off < 0) off = 0;
-                int mx = L.n > 0 ? L.n - 1 : 0;
-                if (off > mx) off = mx;
-                off = normalize_off_visual(&L, off, inp);
+                off = L_scroll(&L, off, inp);
                 uscroll = 1;
                 hover_link_set("", 0);
                 rehit_hover_after_draw = 1;
@@ -5933,27 +10846,26 @@ void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit
                     queue_clamp_selection();
                     sc = 1;
                 }
-            } else if (inp == INP_HOME) { off=0; uscroll=1; sc=1; }
-            else if (inp == INP_END) { int b=L.n-(g_crows-1); off=b>0?b:0; off = normalize_off_visual(&L, off, -1); uscroll=0; sc=1; }
+            } else if (inp == INP_HOME) {
+                off = 0; uscroll = 1; sc = 1;
+                if (virt && L.dropped_total > 0) {
+                    view_sent = worker_view(&worker, 0);
+                    view_off = 0;
+                    view_last = 0;
+                }
+            }
+            else if (inp == INP_END) { off = L_bottom_off(&L, g_crows - 1); uscroll=0; sc=1; }
             else if (inp == INP_MOUSE_IGNORE) { inp = INP_NONE; }
             else if (inp == INP_WHEEL_UP || inp == INP_WHEEL_DOWN) {
                 int delta = (inp == INP_WHEEL_UP) ? -1 : 1;
-                off += delta;
-                if (off<0) off=0;
-                int mx = L.n>0 ? L.n-1 : 0;
-                if (off>mx) off=mx;
-                off = normalize_off_visual(&L, off, delta);
+                off = L_scroll(&L, off, delta);
                 uscroll = 1;
                 hover_link_set("", 0);
                 rehit_hover_after_draw = 1;
                 sc = 1;
             }
             else if (inp != INP_NONE) {
-                off += inp;
-                if (off<0) off=0;
-                int mx = L.n>0 ? L.n-1 : 0;
-                if (off>mx) off=mx;
-                off = normalize_off_visual(&L, off, inp);
+                off = L_scroll(&L, off, inp);
                 uscroll = 1;
                 hover_link_set("", 0);
                 rehit_hover_after_draw = 1;
@@ -5961,12 +10873,32 @@ void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit
             }
         }
 
-        if (cc || sc || first) {
+        if (virt && have_snapshot && !view_sent && !g_search.sent) {
+            /* Move the worker's window before the reader runs off its ends. */
+            int margin = 2 * g_crows;
+            int top = L_vrow(&L, off), total = L_vrow(&L, L.n);
+            int want = INT_MIN;
+            if (!uscroll) {
+                if (L.rows_below > 0) want = -1;
+            } else if ((L.dropped_total > 0 && top < margin) ||
+                       (L.rows_below > 0 && total - top < g_crows + margin)) {
+                want = L.dropped_total + off;
+            }
+            if (want != INT_MIN && want != view_last) {
+                view_sent = worker_view(&worker, want);
+                view_off = off;
+                view_last = want;
+            }
+        }
+
+        if ((cc || sc || first) && have_snapshot) {
             draw(&L, off, tok, pct, ctx_limit, first);
+            frames++;
             if (rehit_hover_after_draw) {
                 rehit_hover_after_draw = 0;
                 if (refresh_hover_from_pointer()) {
                     draw(&L, off, tok, pct, ctx_limit, 0);
+                    frames++;
                 }
             }
             if (!first_draw_logged && first) {
@@ -5977,12 +10909,19 @@ void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit
             first = 0;
             if (g_exit_after_first_draw && first_draw_logged) break;
         }
-
+        if (input_event && g_bench_mode) perf_add(PERF_INPUT_FRAMES, frames);
     }
+    if (have_transcript) worker_stop(&worker);
+    perf_dump(transcript);
+    watcher_close(&watch);
     term_restore();
     PDBG("run end sync_begin=%d sync_end=%d sync_unwind_end=%d oom=%d\n",
          g_sync_begin_count, g_sync_end_count, g_sync_unwind_end_count, g_oom);
     L_free(&L);
     link_map_clear();
+    uri_tab_free();
+    diff_memo_free();
+    syn_cache_free();
+    frame_free();
     queue_clear_items();
 }
@@ -3,9 +3,12 @@
 
 #include <stddef.h>
 
-#define PAGER_QUEUE_FORMAT_VERSION 1
+#define PAGER_QUEUE_FORMAT_VERSION 2
+#define PAGER_RENDER_CACHE_VERSION 5
 
 void run_pager(int tty_fd, const char *transcript, int editor_pid, int ctx_limit, int control_fd);
+int run_pager_daemon(const char *transcript, int watch_pid, int ctx_limit);
+int run_queue_pop(int in_fd, int out_fd);
 int pager_queue_attachment_for_transcript(
     const char *transcript,
     char *queue_path,
@@ -0,0 +1,396 @@
+/*
+ * pager_bench.c — offline benchmark for the pager's parse/render/draw path.
+ *
+ *   pager_bench gen <size> <out.jsonl>     write a synthetic transcript (size: 100K, 10M, ...)
+ *   pager_bench run <transcript.jsonl>...  time each stage, one JSON object per file
+ *
+ * Like pager_wrap_tests.c it includes pager.c directly, so every stage runs
+ * the real code headless.  Stages repeat until they have BENCH_MAX_SAMPLES
+ * samples or have used BENCH_STAGE_US, and never fewer than
+ * BENCH_MIN_SAMPLES times.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "pager.c"
+
+#define BENCH_MIN_SAMPLES 3
+#define BENCH_MAX_SAMPLES 25
+#define BENCH_STAGE_US    2000000LL
+#define BENCH_COLS        100
+#define BENCH_ROWS        40
+
+/* ── Synthetic transcripts ─────────────────────────────────────────────── */
+
+static unsigned long long g_rng = 0x9e3779b97f4a7c15ULL;
+
+static unsigned rnd(unsigned n) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (unsigned)(g_rng % n);
+}
+
+static const char *const words[] = {
+    "render", "worker", "snapshot", "transcript", "the", "a", "cursor", "offset", "row",
+    "width", "link", "cache", "parse", "item", "frame", "queue", "editor", "terminal",
+    "session", "scroll", "buffer", "and", "of", "to", "with", "from", "index", "line",
+};
+#define NWORDS ((unsigned)(sizeof(words) / sizeof(words[0])))
+
+static void gen_words(SBuf *b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (i) sb_putc(b, ' ');
+        switch (rnd(24)) {
+        case 0: sb_printf(b, "`%s_%u`", words[rnd(NWORDS)], rnd(100)); break;
+        case 1: sb_printf(b, "**%s**", words[rnd(NWORDS)]); break;
+        case 2: sb_printf(b, "https://example.com/%s/%u", words[rnd(NWORDS)], rnd(1000)); break;
+        case 3: sb_printf(b, "src/%s/%s.c:%u", words[rnd(NWORDS)], words[rnd(NWORDS)], rnd(900) + 1); break;
+        default: sb_puts(b, words[rnd(NWORDS)]); break;
+        }
+    }
+}
+
+/* Markdown as an assistant writes it, already JSON-escaped. */
+static void gen_markdown(SBuf *b) {
+    int blocks = 2 + (int)rnd(8);
+    for (int k = 0; k < blocks; k++) {
+        switch (rnd(6)) {
+        case 0:
+            sb_puts(b, "## ");
+            gen_words(b, 3 + (int)rnd(4));
+            sb_puts(b, "\\n\\n");
+            break;
+        case 1:
+            for (int i = 0, n = 2 + (int)rnd(6); i < n; i++) {
+                sb_puts(b, "- ");
+                gen_words(b, 4 + (int)rnd(12));
+                sb_puts(b, "\\n");
+            }
+            sb_puts(b, "\\n");
+            break;
+        case 2:
+            sb_puts(b, "```c\\n");
+            for (int i = 0, n = 3 + (int)rnd(20); i < n; i++) {
+                sb_printf(b, "%*sif (%s->%s < %u) { return \\\"%s\\\"; }\\n", (int)rnd(4) * 4, "",
+                          words[rnd(NWORDS)], words[rnd(NWORDS)], rnd(64), words[rnd(NWORDS)]);
+            }
+            sb_puts(b, "```\\n\\n");
+            break;
+        case 3:
+            sb_puts(b, "| stage | before | after |\\n|---|---|---|\\n");
+            for (int i = 0, n = 2 + (int)rnd(6); i < n; i++) {
+                sb_printf(b, "| %s | %u ms | %u ms |\\n", words[rnd(NWORDS)], rnd(500), rnd(500));
+            }
+            sb_puts(b, "\\n");
+            break;
+        default:
+            gen_words(b, 20 + (int)rnd(80));
+            sb_puts(b, "\\n\\n");
+            break;
+        }
+    }
+}
+
+/* Tool output: code-like lines with the escapes real output carries. */
+static void gen_tool_output(SBuf *b, int lines) {
+    for (int i = 0; i < lines; i++) {
+        sb_printf(b, "%6d\\t%*s%s(%s, \\\"%s\\\\n\\\");", i + 1, (int)rnd(3) * 4, "",
+                  words[rnd(NWORDS)], words[rnd(NWORDS)], words[rnd(NWORDS)]);
+        if (rnd(4) == 0) gen_words(b, 3 + (int)rnd(8));
+        sb_puts(b, "\\n");
+    }
+}
+
+static void gen_usage(SBuf *b) {
+    sb_printf(b, ",\"usage\":{\"input_tokens\":%u,\"cache_creation_input_tokens\":%u,"
+                 "\"cache_read_input_tokens\":%u,\"output_tokens\":%u}",
+              rnd(4000), rnd(20000), rnd(150000), rnd(3000));
+}
+
+static void gen_record(SBuf *b, int *tool_id) {
+    unsigned kind = rnd(10);
+    if (kind < 2) {
+        sb_puts(b, "{\"type\":\"user\",\"message\":{\"role\":\"user\",\"content\":\"");
+        gen_words(b, 8 + (int)rnd(40));
+        sb_puts(b, "\"},\"uuid\":\"u\",\"timestamp\":\"2025-01-01T00:00:00Z\"}\n");
+    } else if (kind < 6) {
+        sb_puts(b, "{\"type\":\"assistant\",\"message\":{\"role\":\"assistant\",\"content\":"
+                   "[{\"type\":\"text\",\"text\":\"");
+        gen_markdown(b);
+        sb_puts(b, "\"}]");
+        gen_usage(b);
+        sb_puts(b, "},\"uuid\":\"a\"}\n");
+    } else {
+        int id = ++*tool_id;
+        int edit = kind == 9;
+        const char *file = words[rnd(NWORDS)];
+        sb_printf(b, "{\"type\":\"assistant\",\"message\":{\"role\":\"assistant\",\"content\":"
+                     "[{\"type\":\"tool_use\",\"id\":\"toolu_%d\",\"name\":\"%s\",\"input\":", id, edit ? "Edit" : "Bash");
+        if (edit) sb_printf(b, "{\"file_path\":\"/src/%s.c\",\"old_string\":\"a\",\"new_string\":\"b\"}", file);
+        else sb_printf(b, "{\"command\":\"rg -n %s src | head -%u\",\"description\":\"search\"}", file, rnd(400));
+        sb_puts(b, "}]");
+        gen_usage(b);
+        sb_puts(b, "}}\n");
+
+        sb_printf(b, "{\"type\":\"user\",\"message\":{\"role\":\"user\",\"content\":"
+                     "[{\"type\":\"tool_result\",\"tool_use_id\":\"toolu_%d\",\"content\":\"", id);
+        if (edit) sb_printf(b, "The file /src/%s.c has been updated.", file);
+        else gen_tool_output(b, rnd(8) == 0 ? 500 + (int)rnd(2000) : 5 + (int)rnd(120));
+        sb_puts(b, "\",\"is_error\":false}]}");
+        if (edit) {
+            int old_start = 1 + (int)rnd(800), n = 3 + (int)rnd(30);
+            sb_printf(b, ",\"toolUseResult\":{\"type\":\"update\",\"filePath\":\"/src/%s.c\",\"structuredPatch\":"
+                         "[{\"oldStart\":%d,\"oldLines\":%d,\"newStart\":%d,\"newLines\":%d,\"lines\":[",
+                      file, old_start, n, old_start, n);
+            for (int i = 0; i < n; i++) {
+                const char *mark = rnd(3) == 0 ? "-" : rnd(2) ? "+" : " ";
+                sb_printf(b, "%s\"%s    %s = %s(%u);\"", i ? "," : "", mark,
+                          words[rnd(NWORDS)], words[rnd(NWORDS)], rnd(100));
+            }
+            sb_puts(b, "]}]}");
+        }
+        sb_puts(b, "}\n");
+    }
+}
+
+static long long parse_size(const char *s) {
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (!end || v <= 0) return -1;
+    switch (*end) {
+    case 'k': case 'K': v *= 1024; break;
+    case 'm': case 'M': v *= 1024 * 1024; break;
+    case 'g': case 'G': v *= 1024.0 * 1024 * 1024; break;
+    case '\0': break;
+    default: return -1;
+    }
+    return (long long)v;
+}
+
+static int gen_main(const char *size_arg, const char *out) {
+    long long want = parse_size(size_arg);
+    if (want <= 0) {
+        fprintf(stderr, "pager_bench: bad size '%s'\n", size_arg);
+        return 2;
+    }
+    FILE *f = fopen(out, "w");
+    if (!f) {
+        perror(out);
+        return 1;
+    }
+    SBuf b;
+    sb_init(&b);
+    long long written = 0;
+    int tool_id = 0;
+    while (written < want) {
+        b.n = 0;
+        gen_record(&b, &tool_id);
+        if (fwrite(b.d, 1, (size_t)b.n, f) != (size_t)b.n) break;
+        written += b.n;
+    }
+    sb_free(&b);
+    return fclose(f) == 0 && written >= want ? 0 : 1;
+}
+
+/* ── Stages ────────────────────────────────────────────────────────────── */
+
+typedef struct {
+    double v[BENCH_MAX_SAMPLES];
+    int n;
+    long long start_us;
+} Samples;
+
+static void samples_begin(Samples *s) {
+    s->n = 0;
+    s->start_us = now_us();
+}
+
+static int samples_more(const Samples *s) {
+    if (s->n < BENCH_MIN_SAMPLES) return 1;
+    return s->n < BENCH_MAX_SAMPLES && now_us() - s->start_us < BENCH_STAGE_US;
+}
+
+static void samples_add(Samples *s, long long t0) {
+    if (s->n < BENCH_MAX_SAMPLES) s->v[s->n++] = (double)(now_us() - t0) / 1000.0;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile. */
+static double pct_of(const double *sorted, int n, double q) {
+    int i = (int)(q * n + 0.999999) - 1;
+    if (i < 0) i = 0;
+    if (i >= n) i = n - 1;
+    return sorted[i];
+}
+
+static void print_stage(const char *name, Samples *s) {
+    qsort(s->v, (size_t)s->n, sizeof(double), cmp_double);
+    printf(",\"%s_ms\":{\"n\":%d,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f}", name, s->n,
+           pct_of(s->v, s->n, 0.50), pct_of(s->v, s->n, 0.95), pct_of(s->v, s->n, 0.99), s->v[s->n - 1]);
+}
+
+static long peak_rss_kb(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+static int copy_file(const char *src, const char *dst) {
+    FILE *in = fopen(src, "r"), *out = fopen(dst, "w");
+    int ok = in && out;
+    char buf[1 << 16];
+    size_t n;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) ok = fwrite(buf, 1, n, out) == n;
+    if (in) fclose(in);
+    if (out && fclose(out) != 0) ok = 0;
+    return ok;
+}
+
+static void bench_file(const char *path, int max_render_lines) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "pager_bench: %s: %s\n", path, strerror(errno));
+        return;
+    }
+    printf("{\"file\":\"%s\",\"bytes\":%lld", path, (long long)st.st_size);
+
+    /* Parse: a cold ingest of the whole file. */
+    Samples s;
+    int nitems = 0;
+    samples_begin(&s);
+    while (samples_more(&s)) {
+        Items items; memset(&items, 0, sizeof(items));
+        IngestCursor cur; memset(&cur, 0, sizeof(cur));
+        long long t0 = now_us();
+        ingest_transcript(path, &items, &cur);
+        samples_add(&s, t0);
+        nitems = items.n;
+        I_free(&items);
+        ingest_close(&cur);
+    }
+    printf(",\"items\":%d", nitems);
+    print_stage("parse", &s);
+
+    /* Render: every item into Lines under the default render cap. */
+    Items items; memset(&items, 0, sizeof(items));
+    IngestCursor cur; memset(&cur, 0, sizeof(cur));
+    ingest_transcript(path, &items, &cur);
+    Lines L; L_init(&L);
+    L_set_limit(&L, max_render_lines);
+    samples_begin(&s);
+    while (samples_more(&s)) {
+        L_free(&L);
+        long long t0 = now_us();
+        render_items_from(&L, &items, 0);
+        samples_add(&s, t0);
+    }
+    printf(",\"rows\":%d", L.n);
+    print_stage("render", &s);
+
+    /* Draw: a full repaint, then one-row scrolls that go through the
+     * row diff.  Output goes to a temp file so its size can be reported. */
+    FILE *sink = tmpfile();
+    g_fd = sink ? fileno(sink) : -1;
+    int bottom = L_bottom_off(&L, g_crows - 1);
+    samples_begin(&s);
+    while (samples_more(&s)) {
+        frame_free();
+        long long t0 = now_us();
+        draw(&L, bottom, 0, 0.0, 200000, 1);
+        samples_add(&s, t0);
+    }
+    off_t full_bytes = sink ? lseek(g_fd, 0, SEEK_END) : 0;
+    print_stage("draw", &s);
+    printf(",\"draw_bytes\":%lld", (long long)full_bytes / (s.n > 0 ? s.n : 1));
+    samples_begin(&s);
+    int off = bottom;
+    off_t before = sink ? lseek(g_fd, 0, SEEK_END) : 0;
+    while (samples_more(&s)) {
+        off = L_scroll(&L, off, off > 0 ? -1 : 1);
+        long long t0 = now_us();
+        draw(&L, off, 0, 0.0, 200000, 0);
+        samples_add(&s, t0);
+    }
+    off_t scroll_bytes = sink ? lseek(g_fd, 0, SEEK_END) - before : 0;
+    print_stage("scroll", &s);
+    printf(",\"scroll_bytes\":%lld", (long long)scroll_bytes / (s.n > 0 ? s.n : 1));
+    if (sink) fclose(sink);
+    g_fd = -1;
+    frame_free();
+    L_free(&L);
+    I_free(&items);
+    ingest_close(&cur);
+
+    /* Steady state: a record lands and the worker brings the UI's rows up
+     * to date, as a live session does. */
+    char live[] = "/tmp/pager-bench-XXXXXX";
+    int fd = mkstemp(live);
+    if (fd >= 0 && (close(fd), copy_file(path, live))) {
+        RenderWorker w;
+        worker_init(&w, live, 200000, max_render_lines, 0, 0);
+        worker_pass(&w);
+        Lines ui; L_init(&ui);
+        Snapshot *snap = worker_take(&w);
+        if (snap) { snapshot_apply(&ui, snap); free(snap); }
+        SBuf b;
+        sb_init(&b);
+        int tool_id = 0;
+        samples_begin(&s);
+        while (samples_more(&s)) {
+            b.n = 0;
+            gen_record(&b, &tool_id);
+            FILE *f = fopen(live, "a");
+            if (!f) break;
+            fwrite(b.d, 1, (size_t)b.n, f);
+            fclose(f);
+            long long t0 = now_us();
+            worker_pass(&w);
+            snap = worker_take(&w);
+            if (snap) { snapshot_apply(&ui, snap); free(snap); }
+            samples_add(&s, t0);
+        }
+        sb_free(&b);
+        if (s.n > 0) print_stage("append", &s);
+        /* Resident set once the session settles, and what a
+         * CLAUDE_PAGER_MAX_RSS_MB budget took back to stay under it. */
+        worker_budget(&w);
+        printf(",\"rss_kb\":%ld,\"budget_passes\":%d,\"budget_blocks\":%d,\"budget_released_kb\":%zu",
+               w.rss_max ? w.rss_kb : rss_now_kb(), w.budget_passes, w.budget_blocks, w.budget_released >> 10);
+        L_free(&ui);
+        worker_stop(&w);
+    }
+    if (fd >= 0) unlink(live);
+    printf(",\"peak_rss_kb\":%ld}\n", peak_rss_kb());
+    fflush(stdout);
+}
+
+static int run_main(int argc, char **argv) {
+    /* Headless: nothing is read from or written to the real home. */
+    setenv("CLAUDE_PAGER_RENDER_CACHE", "0", 1);
+    g_cols = BENCH_COLS;
+    g_rows = BENCH_ROWS;
+    g_fd = -1;
+    geo_update();
+    int max_render_lines = parse_env_int_range("CLAUDE_PAGER_MAX_RENDER_LINES", 0, 2000000, 20000);
+    for (int i = 0; i < argc; i++) bench_file(argv[i], max_render_lines);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "gen") == 0) return gen_main(argv[2], argv[3]);
+    if (argc >= 3 && strcmp(argv[1], "run") == 0) return run_main(argc - 2, argv + 2);
+    fprintf(stderr, "usage: pager_bench gen <size> <out.jsonl>\n"
+                    "       pager_bench run <transcript.jsonl>...\n");
+    return 2;
+}
@@ -1,6 +1,8 @@
 /*
  * pager_cli.c — Standalone CLI for the C pager.
  * Usage: claude-pager-c <transcript.jsonl> [editor_pid] [--ctx-limit N]
+ *        claude-pager-c --daemon <transcript.jsonl> <session_pid> [--ctx-limit N]
+ *        claude-pager-c queue-pop < stop-hook.json
  *
  * Drop-in replacement for the Python claude-pager CLI.
  */
@@ -16,10 +18,15 @@ int main(int argc, char *argv[]) {
     const char *transcript = "";
     int editor_pid = 0;
     int ctx_limit = 200000;
+    int daemon_mode = 0;
+
+    if (argc == 2 && strcmp(argv[1], "queue-pop") == 0) return run_queue_pop(STDIN_FILENO, STDOUT_FILENO);
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--ctx-limit") == 0 && i + 1 < argc) {
             ctx_limit = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            daemon_mode = 1;
         } else if (!transcript[0]) {
             transcript = argv[i];
         } else if (editor_pid == 0) {
@@ -27,6 +34,14 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (daemon_mode) {
+        if (!transcript[0] || editor_pid <= 0) {
+            fprintf(stderr, "usage: claude-pager-c --daemon <transcript.jsonl> <session_pid>\n");
+            return 2;
+        }
+        return run_pager_daemon(transcript, editor_pid, ctx_limit);
+    }
+
     int tty_fd = open("/dev/tty", O_RDWR);
     if (tty_fd < 0) { perror("open /dev/tty"); return 1; }
 
@@ -21,6 +21,16 @@ static void assert_int_eq(int got, int want, const char *msg) {
     }
 }
 
+/* Scan-per-frame path that drawing used before rows cached their spans. */
+static void link_map_run(void *ctx, int dy, int x0, int x1, const char *uri) {
+    link_map_add(*(int *)ctx + dy, x0, x1, uri_intern(uri));
+}
+
+static int link_map_track_line(const char *s, int start_row) {
+    if (!s || start_row <= 0) return 0;
+    return link_scan_line(s, g_cols, link_map_run, &start_row);
+}
+
 static void reset_render_state(int cols) {
     g_cols = cols;
     g_rows = 24;
@@ -36,54 +46,61 @@ static void reset_render_state(int cols) {
     link_map_clear();
 }
 
-static int current_rows_consumed(const Lines *l) {
+static int current_rows_consumed(Lines *l) {
     int row = 2;
     link_map_clear();
     for (int i = 0; i < l->n; i++) {
-        if (line_is_wrap_placeholder(l->d[i])) {
-            row++;
-            continue;
-        }
-        (void)link_map_track_line(l->d[i], row);
-        row++;
+        (void)link_map_track_line(L_get(l, i), row);
+        row += L_line_rows(l, i);
     }
     return row - 2;
 }
 
-static int legacy_rows_consumed(const Lines *l) {
+static int scanned_rows_consumed(const Lines *l) {
     int row = 2;
     link_map_clear();
     for (int i = 0; i < l->n; i++) {
-        int used_rows = link_map_track_line(l->d[i], row);
+        int used_rows = link_map_track_line(L_get(l, i), row);
         row += (used_rows > 0 ? used_rows : 1);
     }
     return row - 2;
 }
 
-static void test_wrap_slots_mark_placeholders(void) {
+static void test_wrapped_line_stays_one_logical_line(void) {
     reset_render_state(10);
     Lines l;
     L_init(&l);
     L_pushw(&l, "1234567890123456789012345");
 
-    assert_int_eq(l.n, 3, "wrapped line should reserve three visual slots");
-    assert_true(strcmp(l.d[0], "1234567890123456789012345") == 0, "first slot should be original line");
-    assert_true(line_is_wrap_placeholder(l.d[1]), "second slot should be wrap placeholder");
-    assert_true(line_is_wrap_placeholder(l.d[2]), "third slot should be wrap placeholder");
+    assert_int_eq(l.n, 1, "wrapped line should be stored once");
+    assert_true(strcmp(L_get(&l, 0), "1234567890123456789012345") == 0, "line text should be kept whole");
+    assert_int_eq(L_line_rows(&l, 0), 3, "wrapped line should take three screen rows");
+    assert_int_eq(L_vrow(&l, 1), 3, "wrap index should count the wrapped rows");
+
+    g_cols = 5;
+    assert_int_eq(L_vrow(&l, 1), 5, "width change should rebuild the wrap index");
+    g_cols = 40;
+    assert_int_eq(L_vrow(&l, 1), 1, "wider terminal should unwrap the line");
 
     L_free(&l);
 }
 
-static void test_normalize_offset_skips_placeholders(void) {
+static void test_vrow_lookup_lands_on_line_heads(void) {
     reset_render_state(10);
     Lines l;
     L_init(&l);
     L_pushw(&l, "1234567890123456789012345");
     L_pushw(&l, "tail");
 
-    assert_int_eq(normalize_off_visual(&l, 1, -1), 0, "backward normalize should land on wrapped line head");
-    assert_int_eq(normalize_off_visual(&l, 1, +1), 3, "forward normalize should skip to next real line");
-    assert_int_eq(normalize_off_visual(&l, 2, +1), 3, "forward normalize should skip all wrap placeholders");
+    assert_int_eq(L_line_at_vrow(&l, 1, -1), 0, "backward lookup should land on wrapped line head");
+    assert_int_eq(L_line_at_vrow(&l, 1, +1), 1, "forward lookup should skip to next line");
+    assert_int_eq(L_line_at_vrow(&l, 2, +1), 1, "forward lookup should skip every wrapped row");
+    assert_int_eq(L_scroll(&l, 0, 1), 1, "scrolling down one row should pass the wrapped line");
+    assert_int_eq(L_scroll(&l, 1, -1), 0, "scrolling up one row should land on its head");
+    assert_int_eq(L_bottom_off(&l, 1), 1, "bottom offset should show the last line");
+    assert_int_eq(L_line_at_row(&l, 0, 2, 4), 0, "last wrapped row should map to its line");
+    assert_int_eq(L_line_at_row(&l, 0, 2, 5), 1, "row after the wrap should map to the next line");
+    assert_int_eq(L_line_at_row(&l, 0, 2, 6), -1, "rows past the end should map to no line");
 
     L_free(&l);
 }
@@ -94,19 +111,19 @@ static void test_current_row_accounting_matches_slots(void) {
     L_init(&l);
     L_pushw(&l, "1234567890123456789012345");
 
-    assert_int_eq(current_rows_consumed(&l), l.n, "current draw accounting should match reserved visual slots");
+    assert_int_eq(current_rows_consumed(&l), L_vrow(&l, l.n), "draw accounting should match the wrap index");
 
     L_free(&l);
 }
 
-static void test_legacy_row_accounting_overcounts_wrapped_lines(void) {
+static void test_scanned_rows_match_wrap_index(void) {
     reset_render_state(10);
     Lines l;
     L_init(&l);
     L_pushw(&l, "1234567890123456789012345");
 
-    assert_int_eq(legacy_rows_consumed(&l), 5, "legacy row accounting should overcount wrapped lines");
-    assert_true(legacy_rows_consumed(&l) > l.n, "legacy row accounting should exceed reserved slots");
+    assert_int_eq(scanned_rows_consumed(&l), 3, "scanning a wrapped line should count its rows");
+    assert_int_eq(scanned_rows_consumed(&l), L_vrow(&l, l.n), "scan and wrap index should agree");
 
     L_free(&l);
 }
@@ -119,17 +136,1070 @@ static void test_unwrapped_line_is_stable(void) {
 
     assert_int_eq(l.n, 1, "short line should reserve one slot");
     assert_int_eq(current_rows_consumed(&l), 1, "current row accounting should be one row for short lines");
-    assert_int_eq(legacy_rows_consumed(&l), 1, "legacy row accounting should also be one row for short lines");
+    assert_int_eq(scanned_rows_consumed(&l), 1, "scanned row accounting should also be one row for short lines");
+
+    L_free(&l);
+}
+
+static void test_ring_drop_keeps_row_order(void) {
+    reset_render_state(80);
+    Lines l;
+    L_init(&l);
+    L_set_limit(&l, 100);
+    char b[64];
+    for (int i = 0; i < 5000; i++) {
+        snprintf(b, sizeof(b), "row %d with some padding to fill the arena", i);
+        L_push(&l, b);
+    }
+    assert_true(l.n <= 100 + l.drop_chunk, "ring should stay near the render cap");
+    assert_int_eq(l.dropped_total + l.n, 5000, "dropped plus kept rows should cover every push");
+    for (int i = 0; i < l.n; i++) {
+        snprintf(b, sizeof(b), "row %d with some padding to fill the arena", l.dropped_total + i);
+        assert_true(strcmp(L_get(&l, i), b) == 0, "kept rows should stay in push order");
+    }
+    assert_true(l.arena_len - l.arena_live < (256u << 10) + l.arena_live, "dead arena bytes should be compacted");
+
+    L_prepend(&l, "banner");
+    assert_true(strcmp(L_get(&l, 0), "banner") == 0, "prepend should become the first row");
+    L_pop_head(&l);
+    snprintf(b, sizeof(b), "row %d with some padding to fill the arena", l.dropped_total);
+    assert_true(strcmp(L_get(&l, 0), b) == 0, "pop head should restore the first row");
+
+    L_free(&l);
+}
+
+/* Replay the cached spans of row 0 and check them against a fresh scan. */
+static int assert_spans_match_scan(const Lines *l, LinkSpan *out, int max) {
+    link_map_clear();
+    L_track_links(l, 0, 2);
+    int n = g_link_map.n;
+    assert_true(n > 1 && n <= max, "wrapped link should split per screen row");
+    memcpy(out, g_link_map.d, sizeof(LinkSpan) * (size_t)n);
+    link_map_clear();
+    (void)link_map_track_line(L_get(l, 0), 2);
+    assert_int_eq(g_link_map.n, n, "cached spans should match a fresh scan");
+    for (int i = 0; i < n; i++) {
+        assert_int_eq(out[i].row, g_link_map.d[i].row, "cached span row");
+        assert_int_eq(out[i].x0, g_link_map.d[i].x0, "cached span start");
+        assert_int_eq(out[i].x1, g_link_map.d[i].x1, "cached span end");
+        assert_true(out[i].uri == g_link_map.d[i].uri, "interned uris should be shared");
+    }
+    return n;
+}
+
+static void test_cached_link_spans_match_scan(void) {
+    reset_render_state(20);
+    Lines l;
+    L_init(&l);
+    L_pushw_link(&l, "see https://example.com/some/long/path and more text");
+    assert_true(L_row(&l, 0)->nlink > 0, "linkified row should cache its spans");
+
+    LinkSpan cached[16];
+    (void)assert_spans_match_scan(&l, cached, 16);
+    assert_true(link_map_hit(3, 1) == cached[1].uri, "per-row lookup should find the wrapped part");
+    assert_true(link_map_hit(2, 1) == NULL, "cells before the link should miss");
+
+    g_cols = 13;
+    int n = assert_spans_match_scan(&l, cached, 16);
+    assert_int_eq(cached[n - 1].row, 4, "spans should follow the new width");
+
+    L_free(&l);
+    link_map_clear();
+}
+
+static void write_file(const char *path, const char *mode, const char *data) {
+    FILE *f = fopen(path, mode);
+    if (!f) failf("could not open temp transcript");
+    fputs(data, f);
+    fclose(f);
+}
+
+#define T_USER(text) "{\"type\":\"user\",\"message\":{\"content\":\"" text "\"}}\n"
+#define T_ASST(text) "{\"type\":\"assistant\",\"message\":{\"content\":[{\"type\":\"text\",\"text\":\"" text "\"}],\"usage\":{\"input_tokens\":10}}}\n"
+
+static void test_ingest_follows_appends(void) {
+    char path[] = "/tmp/pager-ingest-XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0, "mkstemp should succeed");
+    close(fd);
+    write_file(path, "w", T_USER("hello"));
+
+    Items items; memset(&items, 0, sizeof(items));
+    IngestCursor cur; memset(&cur, 0, sizeof(cur));
+    assert_int_eq(ingest_transcript(path, &items, &cur), INGEST_REBUILD, "first ingest is a full load");
+    assert_int_eq(items.n, 1, "first ingest should parse one item");
+    assert_int_eq(ingest_transcript(path, &items, &cur), INGEST_NONE, "unchanged file has nothing new");
+
+    write_file(path, "a", T_ASST("world") "{\"type\":\"user\",\"message\":{\"content\":\"par");
+    assert_int_eq(ingest_transcript(path, &items, &cur), INGEST_APPEND, "appended record should be ingested");
+    assert_int_eq(items.n, 2, "partial trailing record should be held back");
+    assert_int_eq(cur.li, 10, "usage should come from the appended record");
+
+    write_file(path, "a", "tial\"}}\n");
+    assert_int_eq(ingest_transcript(path, &items, &cur), INGEST_APPEND, "completed record should be ingested");
+    assert_int_eq(items.n, 3, "completed record should become an item");
+    assert_true(strcmp(item_text(&items.d[2]), "partial") == 0, "completed record should parse from its start");
+
+    write_file(path, "w", T_USER("fresh"));
+    assert_int_eq(ingest_transcript(path, &items, &cur), INGEST_REBUILD, "truncated file should rebuild");
+    assert_int_eq(items.n, 1, "rebuild should drop stale items");
+    assert_true(strcmp(item_text(&items.d[0]), "fresh") == 0, "rebuild should parse the new content");
+
+    I_free(&items);
+    ingest_close(&cur);
+    unlink(path);
+}
+
+static void test_ingest_views_decode_on_demand(void) {
+    char path[] = "/tmp/pager-views-XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0, "mkstemp should succeed");
+    close(fd);
+    write_file(path, "w",
+               T_USER("<system-reminder>skip</system-reminder>")
+               T_USER(" \\n ")
+               "{\"type\":\"user\",\"message\":{\"content\":[{\"type\":\"tool_result\",\"content\":"
+               "[{\"type\":\"text\",\"text\":\"one\"},{\"type\":\"text\",\"text\":\"two\\n\"}]}]}}\n");
+    /* Pad the last record so the file ends exactly on a page boundary. */
+    long pg = sysconf(_SC_PAGESIZE);
+    struct stat sb;
+    assert_true(stat(path, &sb) == 0, "stat should succeed");
+    char *pad = malloc((size_t)pg);
+    assert_true(pad != NULL, "pad alloc");
+    int n = (int)(pg - sb.st_size) - (int)strlen(T_USER("")) ;
+    memset(pad, 'x', (size_t)n);
+    pad[n] = '\0';
+    FILE *f = fopen(path, "a");
+    fprintf(f, "{\"type\":\"user\",\"message\":{\"content\":\"%s\"}}\n", pad);
+    fclose(f);
+    free(pad);
+    assert_true(stat(path, &sb) == 0 && sb.st_size == pg, "transcript should fill exactly one page");
+
+    Items items; memset(&items, 0, sizeof(items));
+    IngestCursor cur; memset(&cur, 0, sizeof(cur));
+    ingest_transcript(path, &items, &cur);
+    assert_int_eq(items.n, 2, "system tags and blank text should not become items");
+    assert_true(items.d[0].text == NULL, "view-backed text should not be decoded while parsing");
+    assert_true(strcmp(item_text(&items.d[0]), "one\ntwo") == 0, "text blocks should join and trim");
+    item_release_text(&items.d[0]);
+    assert_true(items.d[0].text == NULL, "released text should be dropped");
+    assert_int_eq((int)strlen(item_text(&items.d[1])), n, "record at the page edge should decode fully");
+
+    I_free(&items);
+    ingest_close(&cur);
+    unlink(path);
+}
+
+static void test_linkify_prefilter_skips_only_unlinkable_rows(void) {
+    static const char *rows[] = {
+        "plain text", "ratio 3/4 and a/b/c", "see https://example.com/x", "open /tmp/a/b.txt now",
+        "~/work/notes.md", "(~/x/y)", "path:/usr/lib/x", "dir/sub/file", "\033[1mbold\033[22m a/b",
+        "\033]8;;file:///tmp/a/b\a/tmp/a/b\033]8;;\a", "trailing /", NULL
+    };
+    char out[32768];
+    for (int i = 0; rows[i]; i++) {
+        linkify(out, sizeof(out), rows[i]);
+        if (!linkify_candidate(rows[i])) assert_true(strcmp(out, rows[i]) == 0, "skipped row should be one linkify leaves alone");
+        if (strcmp(out, rows[i]) != 0) assert_true(linkify_candidate(rows[i]), "linked row should be a candidate");
+    }
+    assert_true(!linkify_candidate("ratio 3/4 and a/b/c"), "mid-word slashes should not be candidates");
+
+    char a[4096], b[4096];
+    assert_true(build_file_uri_target(a, sizeof(a), "~/dir with space/f.txt", 22), "home path should expand");
+    assert_true(build_file_uri_target(b, sizeof(b), "~/dir with space/f.txt", 22), "memoized path should expand");
+    assert_true(strcmp(a, b) == 0 && strstr(a, "dir%20with%20space/f.txt") != NULL, "memoized target should match");
+    assert_true(build_file_uri_target(b, sizeof(b), "~/dir with space/g.txt", 22), "sibling path should expand");
+    assert_true(strstr(b, "g.txt") != NULL, "a different path should not reuse the memo");
+}
+
+static void test_string_scan_at_every_alignment(void) {
+    /* Runs long enough to cross vector widths, with escapes at their ends. */
+    static const char *body[] = {
+        "", "a", "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOP",
+        "tab\\there \\\"quoted\\\" end", "\\u00e9t\\u00e9 and \\\\ backslash",
+        "0123456789abcdef0123456789abcdef\\n0123456789abcdef0123456789abcde\\\"",
+    };
+    static const char *want[] = {
+        "", "a", "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOP",
+        "tab\there \"quoted\" end", "\xc3\xa9t\xc3\xa9 and \\ backslash",
+        "0123456789abcdef0123456789abcdef\n0123456789abcdef0123456789abcde\"",
+    };
+    char *buf = malloc(256);
+    char out[256];
+    assert_true(buf != NULL, "scan buffer alloc");
+    for (size_t k = 0; k < sizeof(body) / sizeof(body[0]); k++) {
+        for (int at = 0; at < 40; at++) {
+            memset(buf, 'x', 256);
+            int n = snprintf(buf + at, (size_t)(256 - at), "\"%s\",1", body[k]);
+            assert_true(jskip_s(buf + at) == buf + at + n - 2, "string skip should stop after the closing quote");
+            jstr(buf + at, out, sizeof(out));
+            assert_true(strcmp(out, want[k]) == 0, "decoded string should match");
+        }
+    }
+    assert_int_eq(jstr("\"abcdefghij\"", out, 5), 4, "decode should respect the buffer size");
+    assert_true(strcmp(out, "abcd") == 0, "truncated decode should keep the head");
+    strcpy(buf, "\"unterminated");
+    assert_true(*jskip_s(buf) == '\0', "unterminated string should stop at the NUL");
+    free(buf);
+}
+
+static void test_jobj_index_matches_jfind(void) {
+    char obj[4096];
+    int o = snprintf(obj, sizeof(obj), "{\"type\":\"user\",\"message\":{\"content\":[{\"a\":\"}\\\"\"}]}");
+    for (int i = 0; i < JOBJ_MAX + 4; i++) o += snprintf(obj + o, sizeof(obj) - (size_t)o, ",\"k%d\":%d", i, i);
+    snprintf(obj + o, sizeof(obj) - (size_t)o, ",\"type\":\"dup\"} tail");
+
+    JObj jo;
+    jobj_index(&jo, obj);
+    assert_int_eq(jo.n, JOBJ_MAX, "index should stop at its capacity");
+    assert_true(jobj_get(&jo, "message") == jfind(obj, "message"), "indexed value should match jfind");
+    assert_true(jstreq(jobj_get(&jo, "type"), "user"), "first duplicate key should win");
+    assert_true(jobj_get(&jo, "k35") == jfind(obj, "k35"), "keys past capacity should still be found");
+    assert_true(jobj_get(&jo, "missing") == NULL, "absent key should miss");
+    assert_true(jobj_skip(&jo, obj) == jskip(obj), "skip should land after the object");
+
+    jobj_index(&jo, "{\"x\":[1,{\"y\":2}]} rest");
+    assert_int_eq(jo.n, 1, "small object should be fully indexed");
+    assert_true(jo.end != NULL && strcmp(jo.end, " rest") == 0, "index should record the object end");
+}
+
+static void test_render_resume_matches_full_render(void) {
+    reset_render_state(80);
+    Items items; memset(&items, 0, sizeof(items));
+    I_push(&items, IT_HUM, xstrdup("question"), NULL, 0);
+    I_push(&items, IT_AST, xstrdup("answer **bold**"), NULL, 0);
+    I_push(&items, IT_TU, xstrdup("Bash"), xstrdup("ls"), 0);
+    I_push(&items, IT_TR, xstrdup("a\nb\nc"), NULL, 0);
+
+    Lines full; L_init(&full);
+    render_items_from(&full, &items, 0);
+
+    Lines inc; L_init(&inc);
+    items.n = 2;
+    render_items_from(&inc, &items, 0);
+    items.n = 4;
+    render_items_from(&inc, &items, 2);
+
+    assert_int_eq(inc.n, full.n, "incremental render should produce the same row count");
+    for (int i = 0; i < full.n; i++) {
+        assert_true(strcmp(L_get(&inc, i), L_get(&full, i)) == 0, "incremental render rows should match");
+    }
+
+    L_truncate(&inc, items.d[2].line0 - inc.dropped_total);
+    render_items_from(&inc, &items, 2);
+    assert_int_eq(inc.n, full.n, "re-render from an item should restore the same rows");
+
+    L_free(&full);
+    L_free(&inc);
+    I_free(&items);
+}
+
+static void test_redraw_emits_only_changed_rows(void) {
+    reset_render_state(40);
+    geo_update();
+    frame_free();
+    Lines l;
+    L_init(&l);
+    char buf[64];
+    for (int i = 0; i < 60; i++) {
+        if (i == 10) {
+            memset(buf, 'x', 50);
+            buf[50] = '\0';
+            L_pushw(&l, buf);
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "row %d", i);
+        L_pushw(&l, buf);
+    }
+
+    draw(&l, 0, 0, 0.0, 200000, 1);
+    assert_int_eq(g_frame.last_rows_emitted, g_rows - 1, "first frame should paint every row but the wrap tail");
+    draw(&l, 0, 0, 0.0, 200000, 0);
+    assert_int_eq(g_frame.last_rows_emitted, 0, "unchanged frame should emit nothing");
+
+    draw(&l, 1, 0, 0.0, 200000, 0);
+    draw(&l, 2, 0, 0.0, 200000, 0);
+    assert_int_eq(g_frame.last_shift, 1, "one-row scroll should shift the body region");
+    assert_int_eq(g_frame.last_rows_emitted, 2, "shifted frame should repaint the banner and the new bottom row");
+    draw(&l, 1, 0, 0.0, 200000, 0);
+    assert_int_eq(g_frame.last_shift, -1, "scrolling back should shift the other way");
+    assert_int_eq(g_frame.last_rows_emitted, 2, "reverse shift should repaint the banner and the new top row");
 
     L_free(&l);
+    frame_free();
+}
+
+static void test_ob_ref_leaves_room_for_flush_tail(void) {
+    reset_render_state(40);
+    FILE *sink = tmpfile();
+    assert_true(sink != NULL, "tmpfile should succeed");
+    g_fd = fileno(sink);
+    char ref[200];
+    memset(ref, 'r', sizeof(ref));
+    for (int i = 0; i < OB_IOV_MAX / 2; i++) {
+        ob_raw("x", 1);
+        ob_ref(ref, (int)sizeof(ref));
+        assert_true(g_iovn < OB_IOV_MAX, "ob_ref should keep a slot for the flush tail");
+    }
+    ob_raw("y", 1);
+    ob_flush();
+    g_fd = -1;
+
+    size_t want = (size_t)(OB_IOV_MAX / 2) * (1 + sizeof(ref)) + 1;
+    static char out[16384];
+    size_t n = (size_t)pread(fileno(sink), out, sizeof(out), 0);
+    fclose(sink);
+    assert_int_eq((int)n, (int)want, "every queued byte should be written once");
+    for (int i = 0; i < OB_IOV_MAX / 2; i++) {
+        const char *row = out + (size_t)i * (1 + sizeof(ref));
+        assert_true(row[0] == 'x' && row[1] == 'r' && row[sizeof(ref)] == 'r', "runs should keep their order");
+    }
+    assert_true(out[want - 1] == 'y', "the pending tail should be written last");
+}
+
+static void test_frame_rows_drop_redundant_sgr(void) {
+    reset_render_state(40);
+    geo_update();
+    frame_free();
+    FILE *sink = tmpfile();
+    assert_true(sink != NULL, "tmpfile should succeed");
+    g_fd = fileno(sink);
+    Lines l;
+    L_init(&l);
+    L_pushw(&l, RS RS "\033[38;2;1;2;3m\033[38;2;4;5;6mab" BO "\033[22mcd" RS);
+    L_pushw(&l, "\033[38;2;4;5;6mef\033[4:3m\033[38;2;4;5;6mgh" RS);
+    draw(&l, 0, 0, 0.0, 200000, 1);
+    g_fd = -1;
+
+    char out[16384];
+    size_t n = (size_t)pread(fileno(sink), out, sizeof(out) - 1, 0);
+    fclose(sink);
+    out[n] = '\0';
+    assert_true(strstr(out, "\033[38;2;4;5;6mabcd\033[0m\033[K") != NULL, "unused styles should be dropped");
+    assert_true(strstr(out, "\033[38;2;1;2;3m") == NULL, "a color replaced before any text should not be sent");
+    assert_true(strstr(out, "\033[0m\033[0m") == NULL, "repeated resets should collapse");
+    assert_true(strstr(out, "ef\033[4:3m\033[38;2;4;5;6mgh") != NULL, "rows with unknown sequences should pass through");
+    L_free(&l);
+    frame_free();
+}
+
+static void test_watcher_reports_transcript_appends(void) {
+    char path[] = "/tmp/pager-watch-XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0, "mkstemp should succeed");
+    close(fd);
+    int tty[2];
+    assert_true(pipe(tty) == 0, "pipe should succeed");
+
+    Watcher w;
+    watcher_open(&w, tty[0], path, NULL, 0);
+    if (w.active) {
+        assert_int_eq(watcher_wait(&w, tty[0], 0), 0, "idle watcher should report nothing");
+        write_file(path, "a", T_USER("hi"));
+        assert_true(watcher_wait(&w, tty[0], -1) & WATCH_TRANSCRIPT, "append should wake the watcher");
+        assert_true(write(tty[1], "x", 1) == 1, "tty write should succeed");
+        assert_int_eq(watcher_wait(&w, tty[0], -1), WATCH_TTY, "tty input should wake the watcher");
+    }
+    watcher_close(&w);
+    assert_true(g_wake_pipe[0] < 0, "close should release the wake pipe");
+
+    close(tty[0]);
+    close(tty[1]);
+    unlink(path);
+}
+
+static Snapshot *wait_snapshot(RenderWorker *w) {
+    for (int i = 0; i < 2000; i++) {
+        Snapshot *snap = worker_take(w);
+        if (snap) return snap;
+        usleep(1000);
+    }
+    failf("worker should publish a snapshot");
+    return NULL;
+}
+
+static void test_worker_snapshot_matches_inline_render(void) {
+    reset_render_state(80);
+    char path[] = "/tmp/pager-worker-XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0, "mkstemp should succeed");
+    close(fd);
+    write_file(path, "w", T_USER("question") T_ASST("answer with `code`"));
+
+    RenderWorker w;
+    worker_start(&w, path, 200000, 0, 0, 40);
+    worker_kick(&w);
+    Snapshot *snap = wait_snapshot(&w);
+
+    Items items; memset(&items, 0, sizeof(items));
+    IngestCursor cur; memset(&cur, 0, sizeof(cur));
+    ingest_transcript(path, &items, &cur);
+    Lines want; L_init(&want);
+    render_items_from(&want, &items, 0);
+    assert_int_eq(snap->base, 0, "first snapshot should carry every row");
+    Lines ui; L_init(&ui);
+    snapshot_apply(&ui, snap);
+    free(snap);
+    assert_true(ui.n > want.n, "snapshot should carry the trailer rows");
+    for (int i = 0; i < want.n; i++) {
+        assert_true(strcmp(L_get(&ui, i), L_get(&want, i)) == 0, "snapshot rows should match an inline render");
+    }
+    int n0 = ui.n;
+
+    write_file(path, "a", T_USER("follow-up"));
+    worker_kick(&w);
+    snap = wait_snapshot(&w);
+    assert_true(snap->base > 0, "append snapshot should reuse the rows the UI holds");
+    assert_true(snap->L.n < n0, "append snapshot should carry only the changed tail");
+    snapshot_apply(&ui, snap);
+    free(snap);
+    assert_true(ui.n > n0, "appended record should show up in the next snapshot");
+    assert_true(strcmp(L_get(&ui, ui.n - 3), C_HDM "  " EMD " end of transcript " EMD RS) == 0,
+                "trailer should follow the appended rows");
+    for (int i = 0; i < want.n; i++) {
+        assert_true(strcmp(L_get(&ui, i), L_get(&want, i)) == 0, "kept prefix should be unchanged");
+    }
+
+    worker_stop(&w);
+    L_free(&ui);
+    L_free(&want);
+    I_free(&items);
+    ingest_close(&cur);
+    unlink(path);
+}
+
+static void assert_rows_match(const Lines *got, const Lines *want, const char *msg) {
+    for (int i = 0; i < want->n; i++) {
+        const LineRow *g = L_row(got, i), *r = L_row(want, i);
+        assert_true(strcmp(L_get(got, i), L_get(want, i)) == 0, msg);
+        assert_true(g->width == r->width && g->fold == r->fold && g->nlink == r->nlink, msg);
+        for (int k = 0; k < r->nlink; k++) {
+            const LineLink *a = &got->links[g->link0 + k], *b = &want->links[r->link0 + k];
+            assert_true(a->x0 == b->x0 && a->x1 == b->x1 && a->uri == b->uri, msg);
+        }
+    }
+}
+
+static void test_render_cache_skips_parse_on_reopen(void) {
+    reset_render_state(80);
+    char path[] = "/tmp/pager-rcache-XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0, "mkstemp should succeed");
+    close(fd);
+    write_file(path, "w", T_USER("question") T_ASST("see https://example.com/a and `code`"));
+
+    RenderWorker w;
+    worker_start(&w, path, 200000, 0, 0, 40);
+    assert_true(w.cache_path[0] != '\0', "render cache should be on by default");
+    worker_kick(&w);
+    snapshot_free(wait_snapshot(&w));
+    worker_stop(&w);
+    assert_true(!w.cache_hit, "first open has nothing cached");
+
+    Items items; memset(&items, 0, sizeof(items));
+    IngestCursor cur; memset(&cur, 0, sizeof(cur));
+    ingest_transcript(path, &items, &cur);
+    Lines want; L_init(&want);
+    render_items_from(&want, &items, 0);
+
+    worker_start(&w, path, 200000, 0, 0, 40);
+    worker_kick(&w);
+    Snapshot *snap = wait_snapshot(&w);
+    assert_true(w.cache_hit, "reopen should load the cached render");
+    Lines ui; L_init(&ui);
+    snapshot_apply(&ui, snap);
+    free(snap);
+    assert_true(ui.n > want.n, "cached snapshot should carry the trailer rows");
+    assert_rows_match(&ui, &want, "cached rows should match an inline render");
+    int n0 = ui.n;
+
+    write_file(path, "a", T_USER("follow-up"));
+    worker_kick(&w);
+    snap = wait_snapshot(&w);
+    assert_true(snap->base > 0, "append after a cache hit should only render the tail");
+    snapshot_apply(&ui, snap);
+    free(snap);
+    assert_true(ui.n > n0, "appended record should show up after a cache hit");
+    worker_stop(&w);
+
+    /* A rewritten prefix must not reuse the cache. */
+    write_file(path, "w", T_USER("different") T_ASST("history"));
+    worker_start(&w, path, 200000, 0, 0, 40);
+    worker_kick(&w);
+    snapshot_free(wait_snapshot(&w));
+    assert_true(!w.cache_hit, "rewritten transcript should miss the cache");
+    char cache_path[PATH_MAX];
+    snprintf(cache_path, sizeof(cache_path), "%s", w.cache_path);
+    worker_stop(&w);
+
+    unlink(cache_path);
+    L_free(&ui);
+    L_free(&want);
+    I_free(&items);
+    ingest_close(&cur);
+    unlink(path);
+}
+
+static void test_daemon_sync_renders_at_client_width(void) {
+    reset_render_state(80);
+    char path[] = "/tmp/pager-daemon-XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0, "mkstemp should succeed");
+    close(fd);
+    write_file(path, "w", T_USER("question") T_ASST("answer"));
+
+    RenderWorker d;
+    worker_init(&d, path, 200000, 0, 0, 0);
+    d.daemon = 1;
+    worker_pass(&d);
+
+    /* The opening pager is narrower than what the daemon rendered at. */
+    int sv[2];
+    assert_true(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair should succeed");
+    assert_true(write(sv[1], "sync 64\n", 8) == 8, "request should be written");
+    daemon_serve(&d, sv[0]);
+    char rep[8] = "";
+    assert_true(read(sv[1], rep, sizeof(rep) - 1) == 3 && strcmp(rep, "ok\n") == 0, "daemon should answer ok");
+    close(sv[0]);
+    close(sv[1]);
+    assert_int_eq(g_cols, 64, "daemon should take the client's width");
+
+    RenderWorker w;
+    worker_init(&w, path, 200000, 0, 0, 0);
+    assert_true(render_cache_load(&w), "client should load the cache the daemon saved at its width");
+    assert_true(w.L.n == d.L.n, "loaded rows should be the daemon's");
+    assert_rows_match(&w.L, &d.L, "loaded rows should match the daemon's render");
+
+    char cache_path[PATH_MAX];
+    snprintf(cache_path, sizeof(cache_path), "%s", w.cache_path);
+    worker_stop(&w);
+    worker_stop(&d);
+    unlink(cache_path);
+    unlink(path);
+}
+
+static void test_viewport_window_matches_full_render(void) {
+    reset_render_state(80);
+    char path[] = "/tmp/pager-view-XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0, "mkstemp should succeed");
+    close(fd);
+    write_file(path, "w", "");
+    for (int i = 0; i < 300; i++) write_file(path, "a", T_USER("question") T_ASST("answer line one\\nline two\\nline three"));
+    setenv("CLAUDE_PAGER_VIEW_ROWS", "200", 1);
+    setenv("CLAUDE_PAGER_RENDER_CACHE", "0", 1);
+
+    Items items; memset(&items, 0, sizeof(items));
+    IngestCursor cur; memset(&cur, 0, sizeof(cur));
+    ingest_transcript(path, &items, &cur);
+    Lines want; L_init(&want);
+    render_items_from(&want, &items, 0);
+
+    RenderWorker w;
+    worker_init(&w, path, 200000, 0, 0, 0);
+    worker_pass(&w);
+    assert_true(w.win_lo > 0 && w.win_hi == w.items.n, "first window should hold only the tail items");
+    assert_true(w.L.n < want.n, "window should hold fewer rows than a full render");
+    assert_int_eq(w.L.dropped_total, w.items.d[w.win_lo].line0, "rows above should be the window's first row");
+    for (int i = 0; i < w.L.n - 3; i++) {
+        assert_true(strcmp(L_get(&w.L, i), L_get(&want, w.L.dropped_total + i)) == 0, "tail window should match a full render");
+    }
+
+    snapshot_free(worker_take(&w));
+    int seq = worker_view(&w, 0);
+    worker_pass(&w);
+    Snapshot *snap = worker_take(&w);
+    assert_true(snap != NULL, "request should publish a snapshot");
+    assert_int_eq(snap->view_seq, seq, "snapshot should answer the request");
+    assert_int_eq(snap->view_row, 0, "top row should stay the top row");
+    snapshot_free(snap);
+    assert_int_eq(w.win_lo, 0, "window should move to the top");
+    assert_true(w.L.rows_below > 0, "rows below the window should be counted");
+    for (int i = 0; i < w.L.n; i++) {
+        assert_true(strcmp(L_get(&w.L, i), L_get(&want, i)) == 0, "top window should match a full render");
+    }
+
+    worker_stop(&w);
+    unsetenv("CLAUDE_PAGER_VIEW_ROWS");
+    unsetenv("CLAUDE_PAGER_RENDER_CACHE");
+    L_free(&want);
+    I_free(&items);
+    ingest_close(&cur);
+    unlink(path);
+}
+
+#define T_ASST_AT(ts, text) "{\"type\":\"assistant\",\"timestamp\":\"" ts "\",\"message\":{\"content\":[{\"type\":\"text\",\"text\":\"" text "\"}]}}\n"
+
+static void test_subagents_merge_by_timestamp(void) {
+    reset_render_state(80);
+    char dir[] = "/tmp/pager-agents-XXXXXX";
+    assert_true(mkdtemp(dir) != NULL, "mkdtemp should succeed");
+    char main_path[PATH_MAX], sess[128], sub[192], agent[PATH_MAX];
+    snprintf(main_path, sizeof(main_path), "%s/s.jsonl", dir);
+    snprintf(sess, sizeof(sess), "%s/s", dir);
+    snprintf(sub, sizeof(sub), "%s/subagents", sess);
+    snprintf(agent, sizeof(agent), "%s/agent-a1.jsonl", sub);
+    write_file(main_path, "w", T_ASST_AT("2026-01-01T10:00:00.000Z", "main one")
+                               T_ASST_AT("2026-01-01T10:00:02.000Z", "main three"));
+    assert_true(mkdir(sess, 0700) == 0 && mkdir(sub, 0700) == 0, "mkdir should succeed");
+    write_file(agent, "w", T_ASST_AT("2026-01-01T10:00:01.500Z", "agent two"));
+    setenv("CLAUDE_PAGER_RENDER_CACHE", "0", 1);
+
+    RenderWorker w;
+    worker_init(&w, main_path, 200000, 0, 0, 0);
+    worker_pass(&w);
+    const char *want[] = { "main one", "agent-a1", "agent two", "main session", "main three" };
+    assert_int_eq(w.items.n, 5, "subagent records should merge between the session's");
+    for (int i = 0; i < 5; i++) {
+        assert_true(strcmp(item_text(&w.items.d[i]), want[i]) == 0, "items should follow their timestamps");
+        item_release_text(&w.items.d[i]);
+    }
+    assert_true(w.items.d[1].type == IT_AGENT && w.items.d[3].type == IT_AGENT, "a change of transcript should get a divider");
+
+    snapshot_free(worker_take(&w));
+    write_file(agent, "a", T_ASST_AT("2026-01-01T10:00:03.000Z", "agent four"));
+    worker_pass(&w);
+    assert_int_eq(w.items.n, 7, "an append to the subagent should be picked up");
+    assert_true(strcmp(item_text(&w.items.d[6]), "agent four") == 0, "appended record should come last");
+    item_release_text(&w.items.d[6]);
+    int divider = 0;
+    for (int i = 0; i < w.L.n; i++) divider += strstr(L_get(&w.L, i), "agent-a1") != NULL;
+    assert_int_eq(divider, 2, "each run of subagent items should be headed by its name");
+
+    worker_stop(&w);
+    unsetenv("CLAUDE_PAGER_RENDER_CACHE");
+    unlink(agent);
+    rmdir(sub);
+    rmdir(sess);
+    unlink(main_path);
+    rmdir(dir);
+}
+
+static int search_answer(RenderWorker *w, const char *q, int from, int dir, int *hits) {
+    int seq = worker_search(w, q, from, dir);
+    worker_pass(w);
+    Snapshot *snap = worker_take(w);
+    assert_true(snap != NULL, "search should publish a snapshot");
+    assert_int_eq(snap->search_seq, seq, "snapshot should answer the search");
+    int row = snap->search_row;
+    *hits = snap->search_hits;
+    snapshot_free(snap);
+    return row;
+}
+
+static void test_search_finds_items_outside_window(void) {
+    reset_render_state(80);
+    char path[] = "/tmp/pager-search-XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0, "mkstemp should succeed");
+    close(fd);
+    write_file(path, "w", "");
+    for (int i = 0; i < 300; i++) {
+        if (i == 10) write_file(path, "a", T_ASST("an early Needle here"));
+        else if (i == 290) write_file(path, "a", T_USER("say \\\"needle\\\" twice"));
+        else write_file(path, "a", T_USER("question") T_ASST("answer line one\\nline two"));
+    }
+    setenv("CLAUDE_PAGER_VIEW_ROWS", "200", 1);
+    setenv("CLAUDE_PAGER_RENDER_CACHE", "0", 1);
+
+    Items items; memset(&items, 0, sizeof(items));
+    IngestCursor cur; memset(&cur, 0, sizeof(cur));
+    ingest_transcript(path, &items, &cur);
+    Lines want; L_init(&want);
+    render_items_from(&want, &items, 0);
+
+    RenderWorker w;
+    worker_init(&w, path, 200000, 0, 0, 0);
+    worker_pass(&w);
+    snapshot_free(worker_take(&w));
+    assert_true(w.win_lo > 10, "the early item should be outside the first window");
+
+    int hits;
+    int row = search_answer(&w, "need", 0, 0, &hits);
+    assert_int_eq(hits, 2, "lowercase query should ignore case");
+    assert_true(row >= 0 && strstr(L_get(&want, row), "Needle") != NULL, "first match should land on the early item's row");
+    int row2 = search_answer(&w, "needle", row, 1, &hits);
+    assert_int_eq(hits, 2, "refined query should keep both items");
+    assert_true(row2 > row && strstr(L_get(&want, row2), "\"needle\"") != NULL, "next match should be the later item");
+    assert_int_eq(search_answer(&w, "needle", row2, 1, &hits), row, "next after the last match should wrap");
+    assert_int_eq(search_answer(&w, "nee", row2, -1, &hits), row, "previous match should step back");
+    assert_int_eq(hits, 2, "shortened query should keep both items");
+    (void)search_answer(&w, "Needle", 0, 0, &hits);
+    assert_int_eq(hits, 1, "uppercase query should match case");
+    (void)search_answer(&w, "\"needle\"", 0, 0, &hits);
+    assert_int_eq(hits, 1, "quotes should match their JSON escapes");
+    (void)search_answer(&w, "nline", 0, 0, &hits);
+    assert_int_eq(hits, 0, "escape letters should not match as text");
+
+    worker_stop(&w);
+    unsetenv("CLAUDE_PAGER_VIEW_ROWS");
+    unsetenv("CLAUDE_PAGER_RENDER_CACHE");
+    L_free(&want);
+    I_free(&items);
+    ingest_close(&cur);
+    unlink(path);
+}
+
+#define T_PATCH(path, line) \
+    "{\"type\":\"user\",\"message\":{\"content\":[{\"type\":\"tool_result\",\"content\":\"ok\"}]}," \
+    "\"toolUseResult\":{\"filePath\":\"" path "\",\"structuredPatch\":[{\"oldStart\":1,\"oldLines\":1," \
+    "\"newStart\":1,\"newLines\":1,\"lines\":[\"-old\",\"+" line "\"]}]}}\n"
+
+/* Rows above a tail window are estimates, so it is lined up by its end. */
+static void assert_window_matches(const RenderWorker *w, const Lines *want, const char *msg) {
+    int tail = w->win_hi == w->items.n;
+    int n = tail ? w->L.n - 3 : w->L.n;
+    int at = tail ? want->n - n : w->L.dropped_total;
+    for (int i = 0; i < n; i++) assert_true(strcmp(L_get(&w->L, i), L_get(want, at + i)) == 0, msg);
+}
+
+static void test_memory_budget_rebuilds_evicted_items(void) {
+    reset_render_state(80);
+    char path[] = "/tmp/pager-budget-XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0, "mkstemp should succeed");
+    close(fd);
+    write_file(path, "w", "");
+    for (int i = 0; i < 300; i++) {
+        if (i == 5) write_file(path, "a", T_PATCH("/tmp/a.c", "renamed_fn();"));
+        else write_file(path, "a", T_USER("question") T_ASST("answer line one\\nline two\\nline three"));
+    }
+    setenv("CLAUDE_PAGER_VIEW_ROWS", "200", 1);
+    setenv("CLAUDE_PAGER_RENDER_CACHE", "0", 1);
+
+    Items items; memset(&items, 0, sizeof(items));
+    IngestCursor cur; memset(&cur, 0, sizeof(cur));
+    ingest_transcript(path, &items, &cur);
+    Item *patch = NULL;
+    for (int i = 0; i < items.n && !patch; i++) {
+        if (items.d[i].src == SRC_PATCH) patch = &items.d[i];
+    }
+    assert_true(patch && !patch->text, "diff payload should stay in the transcript");
+    const char *payload = item_text(patch);
+    assert_true(payload && strstr(payload, "L\t+renamed_fn();\n"), "diff payload should be built on demand");
+    item_release_text(patch);
+    Lines want; L_init(&want);
+    render_items_from(&want, &items, 0);
+
+    /* Any process is over a one-megabyte budget, so every pass trims. */
+    setenv("CLAUDE_PAGER_MAX_RSS_MB", "1", 1);
+    RenderWorker w;
+    worker_init(&w, path, 200000, 0, 0, 0);
+    worker_pass(&w);
+    assert_true(w.budget_passes == 1 && w.rss_kb > 0, "over budget pass should be counted");
+    assert_window_matches(&w, &want, "tail window should match a full render");
+
+    snapshot_free(worker_take(&w));
+    worker_view(&w, 0);
+    worker_pass(&w);
+    snapshot_free(worker_take(&w));
+    assert_int_eq(w.win_lo, 0, "window should move to the top");
+    assert_true(w.budget_blocks > 0, "tail blocks should be evicted once outside the window");
+    for (int i = w.win_hi; i < w.items.n; i++) assert_true(!w.blk[i].rows, "no block outside the window should stay cached");
+    assert_window_matches(&w, &want, "top window rebuilt after eviction should match a full render");
+    int hits = 0;
+    int row = search_answer(&w, "renamed_fn", 0, 1, &hits);
+    assert_true(row >= 0 && strstr(L_get(&want, row), "renamed_fn"), "search should find the diff line");
+
+    worker_stop(&w);
+    unsetenv("CLAUDE_PAGER_MAX_RSS_MB");
+    unsetenv("CLAUDE_PAGER_VIEW_ROWS");
+    unsetenv("CLAUDE_PAGER_RENDER_CACHE");
+    L_free(&want);
+    I_free(&items);
+    ingest_close(&cur);
+    unlink(path);
+}
+
+static void queue_pop_reply(const char *hook, char *out, size_t outlen) {
+    int in[2], res[2];
+    assert_true(pipe(in) == 0 && pipe(res) == 0, "pipe should succeed");
+    assert_true(write(in[1], hook, strlen(hook)) == (ssize_t)strlen(hook), "hook input should be written");
+    close(in[1]);
+    assert_int_eq(run_queue_pop(in[0], res[1]), 0, "queue-pop should succeed");
+    close(in[0]);
+    close(res[1]);
+    ssize_t n = read(res[0], out, outlen - 1);
+    close(res[0]);
+    out[n > 0 ? n : 0] = '\0';
+}
+
+static void test_queue_pop_answers_stop_hook(void) {
+    const char *hook = "{\"session_id\":\"pop/test\",\"stop_hook_active\":false}";
+    setenv("CLAUDE_SESSION_ID", "pop/test", 1);
+    char path[PATH_MAX], key[160];
+    assert_int_eq(pager_queue_attachment_for_transcript(NULL, path, sizeof(path), key, sizeof(key)), 0, "queue path should resolve");
+    assert_true(strcmp(key, "pop_test") == 0, "session id should be compacted like the shell hook did");
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/.claude", getenv("HOME"));
+    mkdir(dir, 0700);
+    snprintf(dir, sizeof(dir), "%s/.claude/queues", getenv("HOME"));
+    mkdir(dir, 0700);
+    write_file(path, "w", "{\"id\":\"1\",\"prompt\":\"say \\\"hi\\\"\\nthen stop\",\"added_us\":5}\n\nplain line\nbell\001\177\b\n");
+
+    char out[512];
+    queue_pop_reply(hook, out, sizeof(out));
+    assert_true(strcmp(out, "{\"decision\":\"block\",\"reason\":\"say \\\"hi\\\"\\nthen stop\"}\n") == 0, "JSON item should block with its prompt");
+    queue_pop_reply(hook, out, sizeof(out));
+    assert_true(strcmp(out, "{\"decision\":\"block\",\"reason\":\"plain line\"}\n") == 0, "plain item should be the prompt itself");
+    queue_pop_reply(hook, out, sizeof(out));
+    assert_true(strcmp(out, "{\"decision\":\"block\",\"reason\":\"bell\\u0001\\u007f\\b\"}\n") == 0, "control characters should be escaped as jq did");
+    struct stat st;
+    assert_true(stat(path, &st) != 0, "popping the last item should remove the queue file");
+    queue_pop_reply(hook, out, sizeof(out));
+    assert_true(strcmp(out, "{\"ok\":true}\n") == 0, "empty queue should let Claude stop");
+    queue_pop_reply("{}", out, sizeof(out));
+    assert_true(strcmp(out, "{\"ok\":true}\n") == 0, "hook input without a session should let Claude stop");
+
+    char lock[PATH_MAX];
+    assert_true(queue_lock_path_for(path, lock, sizeof(lock)), "lock path should resolve");
+    unlink(lock);
+    rmdir(dir);
+    unsetenv("CLAUDE_SESSION_ID");
+}
+
+static int queue_file_has(const char *path, const char *needle) {
+    char buf[8192];
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    return strstr(buf, needle) != NULL;
+}
+
+static void test_queue_log_applies_appended_ops(void) {
+    char path[] = "/tmp/pager-queue-XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0, "mkstemp should succeed");
+    close(fd);
+    write_file(path, "w", "{\"id\":\"a\",\"prompt\":\"first\"}\nsecond\n");
+    snprintf(g_queue_path, sizeof(g_queue_path), "%s", path);
+    g_queue_enabled = 1;
+
+    assert_true(queue_load_from_disk(), "initial load should read the log");
+    assert_int_eq(g_queue.n, 2, "both adds should load");
+    assert_int_eq(queue_append_prompt("third"), 0, "append should succeed");
+    assert_int_eq(g_queue.n, 3, "own append should be applied in memory");
+    assert_true(!queue_load_from_disk(), "own append should not be read back");
+
+    off_t before = g_queue_log.off;
+    write_file(path, "a", "{\"op\":\"update\",\"id\":\"a\",\"prompt\":\"FIRST\"}\n{\"op\":\"delete\",\"id\":\"a\"");
+    assert_true(queue_load_from_disk(), "external update should load");
+    assert_true(strcmp(g_queue.d[0].prompt, "FIRST") == 0, "update should replace the prompt");
+    assert_int_eq(g_queue.n, 3, "a torn line should wait for its newline");
+    assert_true(g_queue_log.off > before, "only the appended bytes should advance the log");
+    write_file(path, "a", "}\n");
+    assert_true(queue_load_from_disk(), "completed delete should load");
+    assert_int_eq(g_queue.n, 2, "delete should remove the item");
+    assert_true(strcmp(g_queue.d[0].prompt, "second") == 0, "remaining items should keep order");
+
+    assert_int_eq(queue_update_item(1, "THIRD"), 0, "update by id should succeed");
+    assert_true(queue_file_has(path, "{\"op\":\"update\""), "update should be appended as an op");
+    assert_int_eq(queue_update_item(0, "SECOND"), 0, "id-less item should fall back to a rewrite");
+    assert_true(!queue_file_has(path, "\"op\""), "rewrite should leave only adds");
+
+    for (int i = 0; i < QUEUE_LOG_COMPACT_OPS - 1; i++) (void)queue_update_item(1, "again");
+    assert_int_eq(g_queue_log.ops, QUEUE_LOG_COMPACT_OPS - 1, "ops should accumulate before compaction");
+    assert_int_eq(queue_delete_item(0), 0, "delete by rewrite should succeed");
+    for (int i = 0; i < QUEUE_LOG_COMPACT_OPS; i++) (void)queue_update_item(0, "last");
+    assert_int_eq(g_queue_log.ops, 0, "compaction should reset the op count");
+    assert_true(!queue_file_has(path, "\"op\""), "compaction should rewrite as adds");
+
+    queue_log_reload();
+    assert_int_eq(g_queue.n, 1, "the compacted log should reload to the same queue");
+    assert_true(strcmp(g_queue.d[0].prompt, "last") == 0, "the compacted prompt should survive");
+    assert_int_eq(queue_delete_item(0), 0, "deleting the last item should succeed");
+    struct stat st;
+    assert_true(stat(path, &st) != 0, "an empty queue should remove the file");
+
+    char lock[PATH_MAX];
+    if (queue_lock_path_for(path, lock, sizeof(lock))) unlink(lock);
+    queue_clear_items();
+    g_queue_enabled = 0;
+    g_queue_path[0] = '\0';
+}
+
+static void test_diff_token_ranges_handle_long_lines(void) {
+    int ors[DIFF_RNG_MAX], ore[DIFF_RNG_MAX], orc = 0;
+    int nrs[DIFF_RNG_MAX], nre[DIFF_RNG_MAX], nrc = 0;
+    const char *o = "int foo = bar(1, two);";
+    const char *n = "int foo = baz(1, three);";
+    int used = diff_token_ranges(o, (int)strlen(o), n, (int)strlen(n), ors, ore, &orc, nrs, nre, &nrc);
+    assert_true(used, "short edit should use token ranges");
+    assert_int_eq(orc, 2, "old line should have two changed tokens");
+    assert_int_eq(nrc, 2, "new line should have two changed tokens");
+    assert_true(strncmp(o + ors[0], "bar", (size_t)(ore[0] - ors[0])) == 0 && ore[0] - ors[0] == 3, "first old range should be bar");
+    assert_true(strncmp(n + nrs[1], "three", (size_t)(nre[1] - nrs[1])) == 0 && nre[1] - nrs[1] == 5, "second new range should be three");
+
+    /* Far more tokens than one diff pass holds, with edits at both ends. */
+    char lo[8192], ln[8192];
+    int ol = 0, nl = 0;
+    ol += snprintf(lo + ol, sizeof(lo) - (size_t)ol, "alpha ");
+    nl += snprintf(ln + nl, sizeof(ln) - (size_t)nl, "omega ");
+    for (int i = 0; i < 1000; i++) {
+        ol += snprintf(lo + ol, sizeof(lo) - (size_t)ol, "x%d ", i % 7);
+        nl += snprintf(ln + nl, sizeof(ln) - (size_t)nl, "x%d ", i % 7);
+    }
+    ol += snprintf(lo + ol, sizeof(lo) - (size_t)ol, "old");
+    nl += snprintf(ln + nl, sizeof(ln) - (size_t)nl, "new");
+    used = diff_token_ranges(lo, ol, ln, nl, ors, ore, &orc, nrs, nre, &nrc);
+    assert_true(used, "long line should still use token ranges");
+    assert_int_eq(orc, 2, "long old line should have two changed tokens");
+    assert_int_eq(ors[0], 0, "first change should be the leading token");
+    assert_int_eq(ore[0], 5, "first change should end after alpha");
+    assert_int_eq(ors[1], ol - 3, "last change should be the trailing token");
+    used = diff_token_ranges(lo, ol, ln, nl, ors, ore, &orc, nrs, nre, &nrc);
+    assert_int_eq(orc, 2, "memoised ranges should match");
+    diff_memo_free();
+}
+
+static void test_sync_probe_answer_is_cached(void) {
+    setenv("TERM_PROGRAM", "ghostty", 1);
+    setenv("TERM_PROGRAM_VERSION", "1.0", 1);
+    char key[320], path[PATH_MAX];
+    sync_cache_key(key, sizeof(key));
+    assert_true(sync_cache_path(path, sizeof(path)), "cache path should resolve under HOME");
+    unlink(path);
+    assert_int_eq(sync_cache_lookup(key), -1, "unprobed terminal should be unknown");
+    sync_cache_record(key, 0);
+    sync_cache_record(key, 1);
+    assert_int_eq(sync_cache_lookup(key), 1, "latest answer should win");
+    setenv("TERM_PROGRAM_VERSION", "1.1", 1);
+    char key2[320];
+    sync_cache_key(key2, sizeof(key2));
+    assert_int_eq(sync_cache_lookup(key2), -1, "another terminal version should probe again");
+    write_file(path, "a", "");
+    char stale[400];
+    snprintf(stale, sizeof(stale), "%s\toff\t%lld\n", key2, (long long)time(NULL) - SYNC_CACHE_TTL_S - 1);
+    write_file(path, "a", stale);
+    assert_int_eq(sync_cache_lookup(key2), -1, "a stale answer should probe again");
+    unlink(path);
+    unsetenv("TERM_PROGRAM");
+    unsetenv("TERM_PROGRAM_VERSION");
+}
+
+static void test_perf_quantile_bounds_by_bucket(void) {
+    memset(g_perf, 0, sizeof(g_perf));
+    for (int i = 1; i <= 100; i++) perf_add(PERF_DRAW_US, i);
+    const PerfStat *st = &g_perf[PERF_DRAW_US];
+    assert_int_eq((int)st->n, 100, "every sample should be counted");
+    assert_int_eq((int)st->min, 1, "min should be the smallest sample");
+    assert_int_eq((int)st->max, 100, "max should be the largest sample");
+    assert_int_eq((int)perf_quantile(st, 0.50), 63, "p50 should be the upper bound of its bucket");
+    assert_int_eq((int)perf_quantile(st, 0.99), 100, "p99 should be capped at the max");
+    memset(g_perf, 0, sizeof(g_perf));
+}
+
+static void test_syntax_tables_and_block_cache(void) {
+    for (int c = 0; c < 256; c++) {
+        int word = isalnum(c) || c == '_' || c >= 0x80;
+        assert_int_eq(!!(g_syn_class[c] & SYN_WORD), word, "word class should match the old predicate");
+        assert_int_eq(!!(g_syn_class[c] & SYN_LEAD), word && !isdigit(c) && c < 0x80, "lead class should be letters and _");
+    }
+    for (int l = 0; l < SYN_NLANG; l++) {
+        const SynLang *lg = &g_syn_langs[l];
+        for (int k = 0; k <= lg->mask; k++) {
+            const char *kw = lg->kw[k];
+            if (!kw) continue;
+            int n = (int)strlen(kw);
+            assert_int_eq(syn_kw_slot(lg, (const unsigned char *)kw, n), k, "keyword should sit in its hash slot");
+            assert_true(syn_is_keyword(lg, kw, n), "keyword should be found");
+            assert_true(!syn_is_keyword(lg, kw, n - 1), "keyword prefix should not match");
+        }
+    }
+    assert_true(!syn_is_keyword(&g_syn_langs[SYN_C], "main", 4), "identifier should not be a keyword");
+    assert_true(syn_lang_for_path("src/lib.rs", 10) == &g_syn_langs[SYN_RUST], "extension should pick the language");
+    assert_true(syn_lang_for_path("v1.2/Makefile", 13) == &g_syn_langs[SYN_GENERIC], "no extension should stay generic");
+    assert_true(syn_lang_for_tag("Python title=x") == &g_syn_langs[SYN_PY], "fence tag should pick the language");
+    assert_true(syn_lang_for_tag("text") == NULL, "unknown tag should not be styled");
+
+    reset_render_state(80);
+    syn_cache_free();
+    g_syn_cache_hits = g_syn_cache_misses = 0;
+    const char *md = "intro\n```c\nint x = 0; // note\n```\nafter\n```text\nint y\n```\n";
+    Lines a; L_init(&a);
+    render_md(&a, md, 0);
+    assert_true(strstr(L_get(&a, 1), C_SYN_KW "int") != NULL, "c block should style keywords");
+    assert_true(strstr(L_get(&a, 1), C_HDM "// note") != NULL, "c block should style line comments");
+    assert_true(strstr(L_get(&a, 3), C_SYN_KW) == NULL, "unknown tag should keep plain rows");
+    assert_int_eq(g_syn_cache_hits, 0, "first render should miss");
+    Lines b; L_init(&b);
+    render_md(&b, md, 0);
+    assert_int_eq(g_syn_cache_hits, 2, "second render should replay both code blocks");
+    assert_int_eq(b.n, a.n, "replayed render should keep the row count");
+    for (int i = 0; i < a.n; i++) {
+        assert_true(strcmp(L_get(&b, i), L_get(&a, i)) == 0, "replayed rows should match");
+        assert_int_eq(L_row(&b, i)->fold, L_row(&a, i)->fold, "replayed rows should keep their fold");
+    }
+
+    const char *diff = "--- a/x.py\n+++ b/x.py\n@@ -1 +1 @@\n-def f(): pass\n+def g(): pass\n";
+    Lines d1; L_init(&d1);
+    render_diff_block(&d1, diff, "  ", 10, 0);
+    int styled = 0;
+    for (int i = 0; i < d1.n; i++) styled |= strstr(L_get(&d1, i), C_SYN_KW "def") != NULL;
+    assert_true(styled, "python diff should style its keywords");
+    Lines d2; L_init(&d2);
+    render_diff_block(&d2, diff, "  ", 10, 0);
+    assert_int_eq(g_syn_cache_hits, 3, "same diff should replay");
+    assert_int_eq(d2.n, d1.n, "replayed diff should keep the row count");
+    g_cols = 100;
+    Lines d3; L_init(&d3);
+    render_diff_block(&d3, diff, "  ", 10, 0);
+    assert_int_eq(g_syn_cache_hits, 3, "another width should render again");
+
+    L_free(&a);
+    L_free(&b);
+    L_free(&d1);
+    L_free(&d2);
+    L_free(&d3);
+    syn_cache_free();
 }
 
 int main(void) {
-    test_wrap_slots_mark_placeholders();
-    test_normalize_offset_skips_placeholders();
+    /* Keep the render cache out of the real home directory. */
+    char home[] = "/tmp/pager-home-XXXXXX";
+    assert_true(mkdtemp(home) != NULL, "mkdtemp should succeed");
+    setenv("HOME", home, 1);
+    test_wrapped_line_stays_one_logical_line();
+    test_vrow_lookup_lands_on_line_heads();
     test_current_row_accounting_matches_slots();
-    test_legacy_row_accounting_overcounts_wrapped_lines();
+    test_scanned_rows_match_wrap_index();
     test_unwrapped_line_is_stable();
+    test_ring_drop_keeps_row_order();
+    test_cached_link_spans_match_scan();
+    test_linkify_prefilter_skips_only_unlinkable_rows();
+    test_ingest_follows_appends();
+    test_ingest_views_decode_on_demand();
+    test_jobj_index_matches_jfind();
+    test_string_scan_at_every_alignment();
+    test_render_resume_matches_full_render();
+    test_redraw_emits_only_changed_rows();
+    test_frame_rows_drop_redundant_sgr();
+    test_ob_ref_leaves_room_for_flush_tail();
+    test_watcher_reports_transcript_appends();
+    test_worker_snapshot_matches_inline_render();
+    test_render_cache_skips_parse_on_reopen();
+    test_daemon_sync_renders_at_client_width();
+    test_viewport_window_matches_full_render();
+    test_search_finds_items_outside_window();
+    test_memory_budget_rebuilds_evicted_items();
+    test_subagents_merge_by_timestamp();
+    test_perf_quantile_bounds_by_bucket();
+    test_sync_probe_answer_is_cached();
+    test_queue_pop_answers_stop_hook();
+    test_queue_log_applies_appended_ops();
+    test_diff_token_ranges_handle_long_lines();
+    test_syntax_tables_and_block_cache();
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/.claude/pager-cache", home);
+    DIR *d = opendir(dir);
+    for (struct dirent *de; d && (de = readdir(d)) != NULL;) unlinkat(dirfd(d), de->d_name, 0);
+    if (d) closedir(d);
+    rmdir(dir);
+    snprintf(dir, sizeof(dir), "%s/.claude", home);
+    rmdir(dir);
+    rmdir(home);
     printf("ok\n");
     return 0;
 }
@@ -5,6 +5,13 @@
 # Claude to continue with it.
 set -euo pipefail
 
+# The pager binary does the same pop natively under the pager's own queue
+# lock; the jq version below is kept for installs that have not rebuilt. It
+# only pops plain adds: once the queue holds update/delete ops (format 2) it
+# lets Claude stop and leaves the queue for the pager to drain.
+pager="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/bin/claude-pager-c"
+[[ -x "$pager" ]] && exec "$pager" queue-pop
+
 input=$(cat)
 session_id=$(printf '%s' "$input" | jq -r '.session_id // empty' 2>/dev/null || true)
 [[ -z "$session_id" ]] && { printf '{"ok":true}\n'; exit 0; }
@@ -30,6 +37,12 @@ while ! mkdir "$lock_dir" 2>/dev/null; do
   sleep 0.05
 done
 
+if jq -Rne '[inputs | try fromjson catch null | objects | select(has("op"))] | length > 0' \
+    < "$queue_file" >/dev/null 2>&1; then
+  printf '{"ok":true}\n'
+  exit 0
+fi
+
 head -n 1 "$queue_file" > "$pop_file" 2>/dev/null || true
 tail -n +2 "$queue_file" > "$tmp_file" 2>/dev/null || true
 if [[ -s "$tmp_file" ]]; then
@@ -10,6 +10,35 @@ input=$(cat)
 transcript=$(printf '%s' "$input" | jq -r '.transcript_path // empty' 2>/dev/null || true)
 [[ -z "$transcript" ]] && exit 0
 
+# Transcript index read by claude-pager-open when the tty file below is
+# missing: "kind<TAB>key<TAB>mtime<TAB>path" lines, the last one for a
+# kind/key winning. Entries for this session replace older ones. tty
+# entries carry the time they were recorded, which the reader checks
+# against the terminal session's start; project and last entries carry the
+# transcript's own mtime (the time, before it exists), so the reader trusts
+# them after stat()ing that one file.
+index="${HOME}/.claude/pager-transcripts.index"
+index_set() {
+    local stamp=$1 tmp="${index}.$$"
+    shift
+    mkdir -p "${index%/*}"
+    {
+        if [[ -f "$index" ]]; then
+            awk -F '\t' -v sets="$(IFS=$'\034'; printf '%s' "$*")" 'BEGIN { n = split(sets, s, "\034") }
+                { for (i = 1; i < n; i += 2) if ($1 == s[i] && $2 == s[i + 1]) next; print }' "$index" | tail -n 2000
+        fi
+        while (( $# >= 2 )); do
+            printf '%s\t%s\t%s\t%s\n' "$1" "$2" "$stamp" "$transcript"
+            shift 2
+        done
+    } > "$tmp" && mv "$tmp" "$index"
+}
+now=$(date +%s)
+mtime=$(date -r "$transcript" +%s 2>/dev/null || printf '%s' "$now")
+cwd=$(printf '%s' "$input" | jq -r '.cwd // empty' 2>/dev/null || true)
+[[ -z "$cwd" ]] && cwd="$PWD"
+index_set "$mtime" project "${cwd//\//-}" last - || true
+
 # Walk up the process tree to find the Claude process and get its tty
 pid=$PPID
 tty_key=""
@@ -24,6 +53,21 @@ for _ in 1 2 3 4 5 6; do
     pid=$ppid
 done
 
-[[ -z "$tty_key" || "$tty_key" == "??" ]] && exit 0
+[[ -z "$tty_key" || "$tty_key" == "??" || "$tty_key" == "?" ]] && exit 0
 
 printf '%s\n' "$transcript" > "/tmp/claude-transcript-${tty_key}"
+index_set "$now" tty "$tty_key" || true
+
+# Optional resident pager (CLAUDE_PAGER_DAEMON=1 in the env or in the env
+# section of settings.json): it follows this session's transcript and keeps
+# its render cache warm, so Ctrl-G opens skip parsing. It exits with Claude.
+daemon="${CLAUDE_PAGER_DAEMON:-}"
+if [[ -z "$daemon" && -f "${HOME}/.claude/settings.json" ]]; then
+    daemon=$(jq -r '.env.CLAUDE_PAGER_DAEMON // empty' "${HOME}/.claude/settings.json" 2>/dev/null || true)
+fi
+if [[ "$daemon" == "1" ]]; then
+    pager="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/bin/claude-pager-c"
+    if [[ -x "$pager" ]]; then
+        "$pager" --daemon "$transcript" "$pid" </dev/null >/dev/null 2>&1 || true
+    fi
+fi